@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Bench.hpp"
+#include "LoopIR.hpp"
+
+#include "Knife/Aot.hpp"
+#include "Knife/IR.hpp"
+#include "Knife/Jit.hpp"
+#include "Knife/ModuleCache.hpp"
+
+using namespace Semantic;
+
+extern char** environ;
+
+namespace
+{
+
+typedef double (*LoopFn)(double);
+
+// A file next to the benchmark's own executable, unless the variable names one.
+std::string sibling_file(char const* name, char const* variable)
+{
+    if (char const* path = std::getenv(variable))
+        return path;
+
+    char self[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", self, sizeof self - 1);
+    if (n <= 0)
+        return "";
+    std::string path(self, n);
+    path = path.substr(0, path.rfind('/') + 1) + name;
+    return access(path.c_str(), R_OK) == 0 ? path : "";
+}
+
+bool run_quietly(std::vector<std::string> const& args)
+{
+    std::vector<char*> argv;
+    for (auto const& arg : args)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+
+    pid_t pid;
+    int status;
+    bool ok = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ) == 0
+        && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    posix_spawn_file_actions_destroy(&actions);
+    return ok;
+}
+
+double ms_per_run(int n, std::vector<std::string> const& args)
+{
+    Bench::Stopwatch time;
+    for (int i = 0; i < n; ++i)
+        if (!run_quietly(args))
+            return -1;
+    return time.elapsed_ms() / n;
+}
+
+double best_ns_per_iteration(LoopFn fn, double n)
+{
+    double best = 1e300;
+    for (int run = 0; run < 3; ++run)
+    {
+        Bench::Stopwatch time;
+        double s = fn(n);
+        double ms = time.elapsed_ms();
+        Bench::keep(s);
+        best = std::min(best, ms * 1e6 / n);
+    }
+    return best;
+}
+
+}
+
+// Startup: a linked program from an object compiled ahead of time, against
+// the Compiler running the same def through the JIT, both as new processes.
+// Steady state: the same loop compiled both ways, the object loaded as a
+// shared library, called in this process.
+KNIFE_BENCHMARK(aot_vs_jit)
+{
+    std::string dir = "/tmp/knife-aot-bench-" + std::to_string(getpid());
+    if (system(("mkdir -p " + dir).c_str()) != 0)
+        return;
+
+    Aot::Options options;
+    options.opt_level = 2;
+    options.native = true;
+    options.debug_info = false;
+
+    std::string runtime = sibling_file("libknife-runtime.a", "KNIFE_RUNTIME");
+    std::string compiler = sibling_file("Compiler", "KNIFE_COMPILER");
+    if (runtime.empty() || compiler.empty())
+        ctx.out << "startup skipped: needs libknife-runtime.a and Compiler next to this executable, "
+                << "or KNIFE_RUNTIME and KNIFE_COMPILER naming them" << std::endl;
+    else
+    {
+        std::string source = dir + "/small.kn";
+        std::ofstream(source) << "def pick(c, a, b) {\n    if(c) { return(a) } else { b }\n}\n\n"
+                                 "def twice(x) {\n    y := pick(x, x, 7)\n    return(pick(0, 1, y))\n}\n";
+
+        Aot::Options entry = options;
+        entry.entry = "twice";
+        auto module = compile_module(source);
+        std::string program = dir + "/small";
+        if (!module || !Aot::emit_object(module->spec.get_ir(), module->spec.item_nodes(), source, program + ".o", entry)
+            || system(("cc " + program + ".o " + runtime + " -o " + program).c_str()) != 0)
+        {
+            ctx.out << "could not build the program" << std::endl;
+            return;
+        }
+
+        int n = std::max(1, int(100 * ctx.scale));
+        double aot = ms_per_run(n, { program, "3" });
+        double jit = ms_per_run(n, { compiler, "--run", source, "twice", "3" });
+        ctx.out << "startup to result      " << aot << " ms linked program, " << jit << " ms through the JIT ("
+                << jit / aot << "x)" << std::endl;
+    }
+
+    IR ir;
+    std::vector<NodeId> items = build_loop_module(ir, true);
+    double n = double(long(200000000 * ctx.scale) + 1);
+
+    std::string library = dir + "/loop.so";
+    Bench::Stopwatch compile_time;
+    if (!Aot::emit_object(ir, items, "loop.kn", dir + "/loop.o", options)
+        || system(("cc -shared " + dir + "/loop.o -o " + library).c_str()) != 0)
+    {
+        ctx.out << "could not build the loop library" << std::endl;
+        return;
+    }
+    double aot_compile_ms = compile_time.elapsed_ms();
+
+    void* handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    LoopFn aot_loop = handle ? reinterpret_cast<LoopFn>(dlsym(handle, "loop")) : nullptr;
+
+    Bench::Stopwatch jit_time;
+    Jit jit;
+    CodegenOptions jit_options;
+    jit_options.probes = false;
+    jit_options.debug_info = false;
+    LoopFn jit_loop = jit.load(ir, items, "loop.kn", jit_options) == 2 ? reinterpret_cast<LoopFn>(jit.lookup("loop")) : nullptr;
+    double jit_compile_ms = jit_time.elapsed_ms();
+
+    if (!aot_loop || !jit_loop)
+    {
+        ctx.out << "could not load the loop" << std::endl;
+        return;
+    }
+
+    double aot_ns = best_ns_per_iteration(aot_loop, n);
+    double jit_ns = best_ns_per_iteration(jit_loop, n);
+    ctx.out << "steady state           " << aot_ns << " ns per iteration ahead of time, " << jit_ns
+            << " ns JIT (" << jit_ns / aot_ns << "x)" << std::endl;
+    ctx.out << "compile time           " << aot_compile_ms << " ms object and link, " << jit_compile_ms
+            << " ms JIT" << std::endl;
+
+    dlclose(handle);
+    if (system(("rm -rf " + dir).c_str()) != 0)
+        ctx.out << "could not remove " << dir << std::endl;
+}
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Bench.hpp"
+#include "LoopIR.hpp"
+
+#include "Knife/Codegen.hpp"
+#include "Knife/IR.hpp"
+#include "Knife/Jit.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+typedef double (*DotFn)(double const*, std::int64_t, double const*, std::int64_t);
+typedef double (*SaxpyFn)(double, double const*, std::int64_t, double*, std::int64_t);
+
+// The loops as scalar C++ compiled with the benchmark, for reference.
+__attribute__((noinline)) double reference_dot(double const* a, std::int64_t n, double const* b, std::int64_t)
+{
+    double s = 0;
+    for (std::int64_t i = 0; i < n; ++i)
+        s += a[i] * b[i];
+    return s;
+}
+
+__attribute__((noinline)) double reference_saxpy(double alpha, double const* x, std::int64_t n, double* __restrict y, std::int64_t)
+{
+    for (std::int64_t i = 0; i < n; ++i)
+        y[i] = alpha * x[i] + y[i];
+    return 0;
+}
+
+double* aligned_array(std::size_t n, double value)
+{
+    void* memory = nullptr;
+    if (posix_memalign(&memory, array_alignment, n * sizeof(double)) != 0)
+        std::abort();
+    double* p = static_cast<double*>(memory);
+    std::fill(p, p + n, value);
+    return p;
+}
+
+// Best of three, in elements per nanosecond.
+template <typename Kernel>
+double elements_per_ns(long reps, std::int64_t n, Kernel kernel)
+{
+    double best = 1e300;
+    for (int run = 0; run < 3; ++run)
+    {
+        Bench::Stopwatch time;
+        for (long r = 0; r < reps; ++r)
+            Bench::keep(kernel());
+        best = std::min(best, time.elapsed_ms());
+    }
+    return double(reps) * n / (best * 1e6);
+}
+
+}
+
+// Dot product and saxpy over arrays that fit in cache, written with the
+// array loop templates and (dot only) as a while loop over at, against
+// scalar C++ loops.  The templates' loops vectorize; the while loop and
+// the strict-order C++ dot cannot.  The templates again with probe sites,
+// as Compiler --run generates them, must vectorize as well.
+KNIFE_BENCHMARK(array_kernels)
+{
+    std::int64_t const n = 4096;
+    long reps = std::max(1L, long(50000 * ctx.scale));
+
+    IR ir;
+    std::vector<NodeId> items = build_array_module(ir);
+    CodegenOptions options;
+    options.probes = false;
+    options.debug_info = false;
+    Jit jit;
+    if (jit.load(ir, items, "arrays.kn", options) != items.size())
+    {
+        ctx.out << "could not load the kernels" << std::endl;
+        return;
+    }
+    DotFn dot = reinterpret_cast<DotFn>(jit.lookup("dot"));
+    DotFn dot_while = reinterpret_cast<DotFn>(jit.lookup("dot_while"));
+    SaxpyFn saxpy = reinterpret_cast<SaxpyFn>(jit.lookup("saxpy"));
+
+    options.probes = true;
+    Jit probed_jit;
+    if (probed_jit.load(ir, items, "arrays.kn", options) != items.size())
+    {
+        ctx.out << "could not load the kernels with probe sites" << std::endl;
+        return;
+    }
+    DotFn probed_dot = reinterpret_cast<DotFn>(probed_jit.lookup("dot"));
+    SaxpyFn probed_saxpy = reinterpret_cast<SaxpyFn>(probed_jit.lookup("saxpy"));
+
+    double* a = aligned_array(n, 0.5);
+    double* b = aligned_array(n, 2.0);
+    double* y = aligned_array(n, 0.0);
+    if (dot(a, n, b, n) != double(n) || dot_while(a, n, b, n) != double(n))
+        ctx.out << "dot gave a wrong result" << std::endl;
+
+    double knife_dot = elements_per_ns(reps, n, [&] { return dot(a, n, b, n); });
+    double while_dot = elements_per_ns(reps, n, [&] { return dot_while(a, n, b, n); });
+    double cxx_dot = elements_per_ns(reps, n, [&] { return reference_dot(a, n, b, n); });
+    double knife_saxpy = elements_per_ns(reps, n, [&] { return saxpy(1e-9, a, n, y, n); });
+    double cxx_saxpy = elements_per_ns(reps, n, [&] { return reference_saxpy(1e-9, a, n, y, n); });
+    double probed_knife_dot = elements_per_ns(reps, n, [&] { return probed_dot(a, n, b, n); });
+    double probed_knife_saxpy = elements_per_ns(reps, n, [&] { return probed_saxpy(1e-9, a, n, y, n); });
+
+    ctx.out << "dot, sum template      " << knife_dot << " elements per ns (" << 2 * knife_dot << " GFLOP/s)" << std::endl;
+    ctx.out << "dot, while and at      " << while_dot << " elements per ns (the template is " << knife_dot / while_dot << "x faster)" << std::endl;
+    ctx.out << "dot, scalar C++        " << cxx_dot << " elements per ns (the template is " << knife_dot / cxx_dot << "x faster)" << std::endl;
+    ctx.out << "saxpy, map template    " << knife_saxpy << " elements per ns (" << 2 * knife_saxpy << " GFLOP/s)" << std::endl;
+    ctx.out << "saxpy, C++             " << cxx_saxpy << " elements per ns (the template is " << knife_saxpy / cxx_saxpy << "x faster)" << std::endl;
+    ctx.out << "with probe sites       dot " << probed_knife_dot << ", saxpy " << probed_knife_saxpy
+            << " elements per ns (" << probed_knife_dot / knife_dot << "x and " << probed_knife_saxpy / knife_saxpy
+            << "x of without)" << std::endl;
+
+    std::free(a);
+    std::free(b);
+    std::free(y);
+}
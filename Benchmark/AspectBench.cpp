@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include "Bench.hpp"
+#include "LoopIR.hpp"
+
+#include "Knife/Codegen.hpp"
+#include "Knife/IR.hpp"
+#include "Knife/Jit.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+typedef double (*SampleFn)(double, double);
+
+CodegenOptions options_with(unsigned max_specializations)
+{
+    CodegenOptions options;
+    options.probes = false;
+    options.debug_info = false;
+    options.max_specializations = max_specializations;
+    return options;
+}
+
+// ns per call of moments made by sample<length>, best of three.
+double ns_per_call(SampleFn sample, double length, long calls)
+{
+    double best = 1e300;
+    for (int run = 0; run < 3; ++run)
+    {
+        Bench::Stopwatch time;
+        Bench::keep(sample(double(calls), length));
+        best = std::min(best, time.elapsed_ms());
+    }
+    return best * 1e6 / calls;
+}
+
+}
+
+// Calls of a def over two arrays of known length, instantiated for them
+// (short arrays by value, longer ones with the length as a constant),
+// against the def's own symbol, which takes a pointer and a length; then
+// what the cap on instantiations does to code size when one def is called
+// with 16 different lengths.
+KNIFE_BENCHMARK(type_aspects)
+{
+    long const calls = std::max(1L, long(2000000 * ctx.scale));
+    std::vector<int> const lengths = { 0, 3, 64 };
+
+    SampleFn generic[3], special[3];
+    IR generic_ir, special_ir;
+    Jit generic_jit, special_jit;
+    std::vector<NodeId> generic_items = build_moments_module(generic_ir, lengths);
+    std::vector<NodeId> special_items = build_moments_module(special_ir, lengths);
+    if (generic_jit.load(generic_ir, generic_items, "moments.kn", options_with(0)) != generic_items.size()
+        || special_jit.load(special_ir, special_items, "moments.kn", options_with(8)) != special_items.size())
+    {
+        ctx.out << "could not load the samples" << std::endl;
+        return;
+    }
+    for (std::size_t k = 0; k < lengths.size(); ++k)
+    {
+        std::string name = "sample" + std::to_string(lengths[k]);
+        generic[k] = reinterpret_cast<SampleFn>(generic_jit.lookup(name));
+        special[k] = reinterpret_cast<SampleFn>(special_jit.lookup(name));
+    }
+
+    for (std::size_t k = 0; k < lengths.size(); ++k)
+    {
+        int length = lengths[k] ? lengths[k] : 3;
+        if (generic[k](10, length) != special[k](10, length))
+            ctx.out << "sample" << lengths[k] << " gave different results" << std::endl;
+        double generic_ns = ns_per_call(generic[k], length, calls / length + 1);
+        double special_ns = ns_per_call(special[k], length, calls / length + 1);
+        std::string what = lengths[k] == 0 ? "length 3, unknown" : lengths[k] <= max_value_elements
+            ? "length " + std::to_string(length) + ", by value" : "length " + std::to_string(length) + ", fixed";
+        ctx.out << what << std::string(what.size() < 23 ? 23 - what.size() : 1, ' ') << special_ns
+                << " ns per call, " << generic_ns << " ns unspecialized (" << generic_ns / special_ns << "x)" << std::endl;
+    }
+
+    std::vector<int> many;
+    for (int length = 1; length <= 16; ++length)
+        many.push_back(length);
+    unsigned const caps[] = { 0, 2, 4, 8, 16 };
+    for (unsigned cap : caps)
+    {
+        IR ir;
+        std::vector<NodeId> items = build_moments_module(ir, many);
+        llvm::LLVMContext context;
+        Codegen codegen(ir, context, "moments", "moments.kn", options_with(cap));
+        codegen.emit(items);
+        SpecializationStats stats = codegen.specialization_stats();
+        std::unique_ptr<llvm::Module> module = codegen.take_module();
+        optimize(*module, 2);
+
+        std::size_t functions = 0;
+        for (auto const& f : *module)
+            if (!f.isDeclaration())
+                ++functions;
+        ctx.out << "cap " << cap << std::string(cap < 10 ? 19 : 18, ' ') << stats.instances << " instances, "
+                << stats.call_sites << " call sites specialized, " << stats.capped << " over the cap; "
+                << functions << " functions, " << module->getInstructionCount() << " instructions optimized" << std::endl;
+    }
+}
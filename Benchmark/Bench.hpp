@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace Bench
+{
+
+struct Context
+{
+    std::ostream& out;
+    double scale;   // multiplies problem sizes; set with --scale
+};
+
+struct Case
+{
+    char const* name;
+    void (*run)(Context&);
+};
+
+std::vector<Case>& registry();
+
+struct Register
+{
+    Register(char const* name, void (*run)(Context&))
+    {
+        registry().push_back(Case{name, run});
+    }
+};
+
+class Stopwatch
+{
+private:
+    std::chrono::steady_clock::time_point start;
+
+public:
+    Stopwatch()
+        : start(std::chrono::steady_clock::now())
+    {
+    }
+
+    double elapsed_ms() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+// Keeps the optimizer from discarding a computed value.
+template <typename T>
+inline void keep(T const& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+}
+
+#define KNIFE_BENCHMARK(name) \
+    static void name(Bench::Context&); \
+    static Bench::Register name##_registration(#name, &name); \
+    static void name(Bench::Context& ctx)
@@ -0,0 +1,157 @@
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <sstream>
+#include <unordered_map>
+using namespace std;
+
+#include "Bench.hpp"
+
+#include "Knife/Parse.hpp"
+#include "Knife/Semantic.hpp"
+#include "Knife/Resolve.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+// def outer(p0:Int) { v0 := 0; { v1 := 1; { ... { use(v0, ..., p0) } } } }
+std::string nested_closures(int depth)
+{
+    std::stringstream src;
+    src << "def outer(p0:Int) {\n";
+    for (int i = 0; i < depth; ++i)
+        src << "v" << i << " := " << i << "\n{\n";
+    src << "use(";
+    for (int i = 0; i < depth; ++i)
+        src << "v" << i << ", ";
+    src << "p0)\n";
+    for (int i = 0; i < depth; ++i)
+        src << "}\n";
+    src << "}\n";
+    return src.str();
+}
+
+// The frame-keyed-by-name environment that tutorial3's NamedValues implies,
+// chained through enclosing scopes.
+template <typename Map>
+struct NamedFrame
+{
+    NamedFrame* parent;
+    Map values;
+
+    double lookup(std::string const& name) const
+    {
+        for (NamedFrame const* f = this; f; f = f->parent)
+        {
+            auto pos = f->values.find(name);
+            if (pos != f->values.end())
+                return pos->second;
+        }
+        return 0;
+    }
+};
+
+template <typename Map>
+double time_named(IR const& ir, std::vector<ScopeId> const& path, std::vector<NodeId> const& uses, int iterations)
+{
+    std::vector<NamedFrame<Map>> frames(path.size());
+    for (std::size_t i = 0; i < path.size(); ++i)
+        frames[i].parent = i == 0 ? nullptr : &frames[i - 1];
+    for (LabelId id = 0; id < ir.label_count(); ++id)
+        for (std::size_t i = 0; i < path.size(); ++i)
+            if (ir.label(id).scope == path[i])
+                frames[i].values[ir.symbols.name(ir.label(id).name)] = id;
+
+    std::vector<std::string> names;
+    for (NodeId use : uses)
+        names.push_back(ir.symbols.name(ir.node(use).symbol));
+
+    NamedFrame<Map> const& innermost = frames.back();
+    double sum = 0;
+    Bench::Stopwatch time;
+    for (int n = 0; n < iterations; ++n)
+        for (auto const& name : names)
+            sum += innermost.lookup(name);
+    double ms = time.elapsed_ms();
+    Bench::keep(sum);
+    return ms;
+}
+
+double time_slots(IR const& ir, std::vector<ScopeId> const& path, std::vector<NodeId> const& uses, int iterations)
+{
+    std::vector<std::unique_ptr<Frame<double>>> frames;
+    for (ScopeId sc : path)
+    {
+        Frame<double>* parent = frames.empty() ? nullptr : frames.back().get();
+        frames.emplace_back(new Frame<double>(parent, ir.scope(sc).label_count));
+    }
+    for (LabelId id = 0; id < ir.label_count(); ++id)
+        for (std::size_t i = 0; i < path.size(); ++i)
+            if (ir.label(id).scope == path[i])
+                frames[i]->slots[ir.label(id).index_in_scope] = id;
+
+    std::vector<std::pair<std::uint16_t, std::uint32_t>> coords;
+    for (NodeId use : uses)
+        coords.emplace_back(ir.node(use).depth, ir.node(use).slot);
+
+    Frame<double>& innermost = *frames.back();
+    double sum = 0;
+    Bench::Stopwatch time;
+    for (int n = 0; n < iterations; ++n)
+        for (auto const& c : coords)
+            sum += innermost.at(c.first, c.second);
+    double ms = time.elapsed_ms();
+    Bench::keep(sum);
+    return ms;
+}
+
+}
+
+// Reading every enclosing label from the innermost of N nested closures:
+// name lookup through chained maps versus resolved (depth, slot) access.
+KNIFE_BENCHMARK(deep_closure_access)
+{
+    for (int depth : {1, 4, 16, 64})
+    {
+        Syntax::Module module = ParseModule(nested_closures(depth), "closures.kn");
+        ModuleSpec spec(module);
+        IR const& ir = spec.get_ir();
+
+        Symbol use = ir.symbols.find("use");
+        NodeId call = none;
+        for (NodeId id = 0; id < ir.node_count(); ++id)
+            if (ir.node(id).kind == NodeKind::Call && ir.node(id).symbol == use)
+                call = id;
+
+        // The scope of the call is the innermost block; its frame-bearing
+        // ancestors are the frames a run-time access walks through.
+        ScopeId innermost = none;
+        for (NodeId id = 0; id < ir.node_count(); ++id)
+            if (ir.node(id).kind == NodeKind::Block)
+                for (NodeId child : ir.children_of(id))
+                    if (child == call)
+                        innermost = ir.node(id).value;
+
+        std::vector<ScopeId> path;
+        for (ScopeId sc = innermost; sc != none; sc = ir.scope(sc).parent)
+            if (ir.scope(sc).label_count != 0)
+                path.insert(path.begin(), sc);
+
+        std::vector<NodeId> uses(ir.children_of(call).begin(), ir.children_of(call).end());
+
+        int iterations = int(200000 * ctx.scale / uses.size()) + 1;
+        double accesses = double(iterations) * uses.size();
+
+        double map_ms = time_named<std::map<std::string, double>>(ir, path, uses, iterations);
+        double hash_ms = time_named<std::unordered_map<std::string, double>>(ir, path, uses, iterations);
+        double slot_ms = time_slots(ir, path, uses, iterations);
+
+        ctx.out << "depth " << depth << ": "
+                << "std::map " << map_ms * 1e6 / accesses << " ns, "
+                << "unordered_map " << hash_ms * 1e6 / accesses << " ns, "
+                << "slots " << slot_ms * 1e6 / accesses << " ns per access" << std::endl;
+    }
+}
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Bench.hpp"
+#include "SourceGen.hpp"
+
+#include "Knife/Daemon.hpp"
+
+extern char** environ;
+
+namespace
+{
+
+// A program next to the benchmark's own executable (the Code::Blocks
+// targets all write to bin/Release), unless the variable names one.
+std::string sibling_program(char const* name, char const* variable)
+{
+    if (char const* path = std::getenv(variable))
+        return path;
+
+    char self[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", self, sizeof self - 1);
+    if (n <= 0)
+        return "";
+    std::string path(self, n);
+    path = path.substr(0, path.rfind('/') + 1) + name;
+    return access(path.c_str(), X_OK) == 0 ? path : "";
+}
+
+// Starts the program with its output discarded.  Returns the pid or -1.
+pid_t spawn(std::vector<std::string> const& args)
+{
+    std::vector<char*> argv;
+    for (auto const& arg : args)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+
+    pid_t pid;
+    int error = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    return error ? -1 : pid;
+}
+
+bool run(std::vector<std::string> const& args)
+{
+    pid_t pid = spawn(args);
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Ms per command over n sequential runs, or a negative number if a run failed.
+template <typename Run>
+double ms_per_run(int n, Run run_one)
+{
+    Bench::Stopwatch time;
+    for (int i = 0; i < n; ++i)
+        if (!run_one())
+            return -1;
+    return time.elapsed_ms() / n;
+}
+
+}
+
+// N sequential compiles the way a build issues them: a fresh compiler
+// process each time, the thin client talking to a warm daemon, and (the
+// floor) the same requests sent from inside this process.  One command
+// runs the front end on a generated module, the other also generates,
+// optimizes and runs machine code for a small one.
+KNIFE_BENCHMARK(daemon_compiles)
+{
+    std::string compiler = sibling_program("Compiler", "KNIFE_COMPILER");
+    std::string client = sibling_program("knifec", "KNIFE_CLIENT");
+    if (compiler.empty() || client.empty())
+    {
+        ctx.out << "needs the Compiler and knifec executables next to this one, "
+                << "or KNIFE_COMPILER and KNIFE_CLIENT naming them" << std::endl;
+        return;
+    }
+
+    std::string dir = "/tmp/knife-daemon-bench-" + std::to_string(getpid());
+    std::string socket_path = dir + "/daemon.sock";
+    std::string large = dir + "/large.kn";
+    std::string small = dir + "/small.kn";
+    if (system(("mkdir -p " + dir).c_str()) != 0)
+        return;
+
+    std::ofstream(large) << generate_module(300);
+    std::ofstream(small) << "def pick(c, a, b) {\n    if(c) { return(a) } else { b }\n}\n\n"
+                            "def twice(x) {\n    y := pick(x, x, 7)\n    return(pick(0, 1, y))\n}\n";
+
+    struct Command
+    {
+        char const* label;
+        std::vector<std::string> args;
+    };
+    Command const commands[] = {
+        { "front end, 300 lines  ", { large } },
+        { "run a def, 8 lines    ", { "--run", small, "twice", "3" } }
+    };
+
+    pid_t daemon = spawn({ compiler, "--daemon", socket_path });
+    for (int wait = 0; wait < 500 && access(socket_path.c_str(), F_OK) != 0; ++wait)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    int n = std::max(1, int(100 * ctx.scale));
+    for (auto const& command : commands)
+    {
+        std::vector<std::string> direct(1, compiler);
+        direct.insert(direct.end(), command.args.begin(), command.args.end());
+        std::vector<std::string> through_client = { client, "--socket", socket_path };
+        through_client.insert(through_client.end(), command.args.begin(), command.args.end());
+
+        std::vector<char const*> forwarded;
+        for (auto const& arg : command.args)
+            forwarded.push_back(arg.c_str());
+
+        // Warm the daemon's cache the way the build's first compile would.
+        run(through_client);
+
+        double cold = ms_per_run(n, [&] { return run(direct); });
+        double warm = ms_per_run(n, [&] { return run(through_client); });
+        double floor = ms_per_run(n, [&] {
+            int saved = dup(1);
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, 1);
+            int status = Daemon::forward(socket_path, int(forwarded.size()), forwarded.data());
+            dup2(saved, 1);
+            close(null);
+            close(saved);
+            return status == 0;
+        });
+
+        if (cold < 0 || warm < 0 || floor < 0)
+        {
+            ctx.out << command.label << "a compile failed" << std::endl;
+            continue;
+        }
+        ctx.out << command.label << cold << " ms per compile in a new process, "
+                << warm << " ms through knifec (" << cold / warm << "x), "
+                << floor << " ms without the client process" << std::endl;
+    }
+
+    if (daemon > 0)
+    {
+        char const* stop[] = { Daemon::stop_argument };
+        if (Daemon::forward(socket_path, 1, stop) != 0)
+            kill(daemon, SIGTERM);
+        waitpid(daemon, nullptr, 0);
+    }
+    if (system(("rm -rf " + dir).c_str()) != 0)
+        ctx.out << "could not remove " << dir << std::endl;
+}
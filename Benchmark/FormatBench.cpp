@@ -0,0 +1,59 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+using namespace std;
+
+#include "Bench.hpp"
+#include "SourceGen.hpp"
+
+#include "Knife/Parse.hpp"
+#include "Knife/Format.hpp"
+
+namespace
+{
+
+// "def d { def d { ... } }" nested the given number of levels.
+std::string nested_defs(int depth)
+{
+    std::stringstream src;
+    for (int i = 0; i < depth; ++i)
+        src << "def d" << i << " {\nsay(" << i << ")\n";
+    for (int i = 0; i < depth; ++i)
+        src << "}\n";
+    return src.str();
+}
+
+void time_print(Bench::Context& ctx, std::string const& what, std::string const& source)
+{
+    Syntax::Module module = ParseModule(source, "generated.kn");
+    std::string out;
+    int const rounds = 5;
+
+    Bench::Stopwatch time;
+    for (int r = 0; r < rounds; ++r)
+    {
+        out.clear();
+        SyntaxPrinter(out).print(module);
+    }
+    double ms = time.elapsed_ms() / rounds;
+
+    ctx.out << what << ": " << ms << " ms for " << out.size() << " bytes, "
+            << ms * 1e6 / out.size() << " ns per output byte" << std::endl;
+}
+
+}
+
+// Printing cost per output byte should stay flat, both for long modules and
+// for deeply nested ones (whose output grows with the square of the depth
+// because of indentation alone).
+KNIFE_BENCHMARK(format_linear_time)
+{
+    for (int lines : {10000, 50000, 200000})
+    {
+        lines = int(lines * ctx.scale);
+        time_print(ctx, std::to_string(lines) + " lines", generate_module(lines));
+    }
+
+    for (int depth : {100, 400, 1600})
+        time_print(ctx, "nesting depth " + std::to_string(depth), nested_defs(depth));
+}
@@ -0,0 +1,38 @@
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "Bench.hpp"
+#include "SourceGen.hpp"
+
+#include "Knife/Parse.hpp"
+#include "Knife/Semantic.hpp"
+
+// Construction time and memory of the semantic IR per 1k lines of source.
+KNIFE_BENCHMARK(ir_construction)
+{
+    for (int lines : {1000, 10000, 50000})
+    {
+        lines = int(lines * ctx.scale);
+        std::string source = generate_module(lines);
+        double klines = lines / 1000.0;
+
+        Bench::Stopwatch parse_time;
+        Syntax::Module module = ParseModule(source, "generated.kn");
+        double parse_ms = parse_time.elapsed_ms();
+
+        Bench::Stopwatch lower_time;
+        Semantic::ModuleSpec spec(module);
+        double lower_ms = lower_time.elapsed_ms();
+
+        Semantic::IR const& ir = spec.get_ir();
+
+        ctx.out << lines << " lines: "
+                << "parse " << parse_ms / klines << " ms/kline, "
+                << "lower " << lower_ms / klines << " ms/kline, "
+                << "IR " << ir.bytes_used() / klines / 1024 << " KiB/kline, "
+                << ir.node_count() / klines << " nodes/kline, "
+                << ir.label_count() / klines << " labels/kline"
+                << std::endl;
+    }
+}
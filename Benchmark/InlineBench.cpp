@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Bench.hpp"
+#include "LoopIR.hpp"
+
+#include "Knife/IR.hpp"
+#include "Knife/Jit.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+typedef double (*LoopFn)(double);
+
+struct Result
+{
+    double ns_per_iteration;
+    InlineStats stats;
+};
+
+// Loads square as one module and loop, calling it, as the next.
+bool run(bool cross_module_inlining, double n, Result& result)
+{
+    IR ir;
+    std::vector<NodeId> square = build_square_module(ir);
+    std::vector<NodeId> loop = build_loop_calling_other_module(ir);
+
+    CodegenOptions options;
+    options.probes = false;
+    options.debug_info = false;
+
+    Jit jit(2, cross_module_inlining);
+    if (jit.load(ir, square, "square.kn", options) != 1 || jit.load(ir, loop, "loop.kn", options) != 1)
+        return false;
+    LoopFn fn = reinterpret_cast<LoopFn>(jit.lookup("loop"));
+    if (!fn)
+        return false;
+
+    result.ns_per_iteration = 1e300;
+    for (int run = 0; run < 3; ++run)
+    {
+        Bench::Stopwatch time;
+        double s = fn(n);
+        double ms = time.elapsed_ms();
+        Bench::keep(s);
+        result.ns_per_iteration = std::min(result.ns_per_iteration, ms * 1e6 / n);
+    }
+    result.stats = jit.inline_stats();
+    return true;
+}
+
+}
+
+// A loop calling a one-line def of another module, loaded into the JIT
+// after it: with the def's body imported from the first module's summary,
+// and with a plain call across the modules.
+KNIFE_BENCHMARK(cross_module_inlining)
+{
+    double n = double(long(100000000 * ctx.scale) + 1);
+
+    Result inlined, called;
+    if (!run(true, n, inlined) || !run(false, n, called))
+    {
+        ctx.out << "could not load the modules" << std::endl;
+        return;
+    }
+
+    ctx.out << "inlined across modules " << inlined.ns_per_iteration << " ns per iteration ("
+            << inlined.stats.call_sites_inlined << " of " << inlined.stats.call_sites << " call sites inlined, "
+            << inlined.stats.bodies_imported << " bodies imported)" << std::endl;
+    ctx.out << "called across modules  " << called.ns_per_iteration << " ns per iteration ("
+            << called.ns_per_iteration / inlined.ns_per_iteration << "x)" << std::endl;
+}
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <unistd.h>
+
+#include "Bench.hpp"
+#include "SourceGen.hpp"
+
+#include "Knife/Interface.hpp"
+#include "Knife/Parse.hpp"
+#include "Knife/Semantic.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+// Besides the generated defs, what importers use: templates, types and
+// defs codegen compiles.
+char const* const library_tail =
+    "def Vec(T: type) { x: T; y: T; z: T }\n"
+    "def Particle(T: type) { id: Int; pos: Vec(T); vel: Vec(T); mass: Float }\n"
+    "def square(x) { x * x }\n"
+    "def norm2(x, y, z := 0) { square(x) + square(y) + square(z) }\n"
+    "Scale := 3\n";
+
+char const* const client_source =
+    "P := Particle(Double)\n"
+    "def start(a) {\n"
+    "    b := norm2(a, Scale)\n"
+    "    if (b > 10) { square(b) } else { b }\n"
+    "}\n";
+
+// The value of the client's first label, as text (symbols differ between
+// the two ways), to check they agree.
+std::string first_label_value(ModuleSpec const& spec)
+{
+    IR const& ir = spec.get_ir();
+    for (NodeId item : spec.item_nodes())
+        if (ir.node(item).kind == NodeKind::Label && (ir.node(item).flags & HasInit))
+        {
+            IR::Range kids = ir.children_of(item);
+            if (Constant const* value = spec.constant_value(kids[kids.size() - 1]))
+            {
+                std::stringstream text;
+                value->dump(text, ir.symbols);
+                return text.str();
+            }
+        }
+    return "";
+}
+
+template <typename Run>
+double best_ms(Run run)
+{
+    double best = 1e300;
+    for (int r = 0; r < 3; ++r)
+    {
+        Bench::Stopwatch time;
+        run();
+        best = std::min(best, time.elapsed_ms());
+    }
+    return best;
+}
+
+}
+
+// A client of a large library: compiling it with the library's source
+// included (parsed, lowered and folded every time) against importing the
+// library's interface file, written once.  The front end's results must
+// be the same either way.
+KNIFE_BENCHMARK(library_import)
+{
+    int lines = std::max(100, int(50000 * ctx.scale));
+    std::string library = generate_module(lines) + library_tail;
+    std::string path = "/tmp/knife-interface-bench-" + std::to_string(getpid()) + ".kni";
+
+    double ms = best_ms([&] {
+        Syntax::Module module = ParseModule(library, "library.kn");
+        ModuleSpec spec(module);
+        spec.fold_constants();
+        Interface(spec, library).save(path);
+    });
+    std::ifstream written(path, std::ios::binary | std::ios::ate);
+    ctx.out << "writing the interface of " << lines << " lines: " << ms << " ms, " << library.size() / 1024
+            << " KB of source, " << written.tellg() / 1024 << " KB of interface" << std::endl;
+
+    std::string included, imported;
+    double include_ms = best_ms([&] {
+        Syntax::Module module = ParseModule(library + client_source, "client.kn");
+        ModuleSpec spec(module);
+        spec.fold_constants();
+        included = first_label_value(spec);
+    });
+
+    double load_ms = best_ms([&] { Bench::keep(load_interface(path)); });
+    double import_ms = best_ms([&] {
+        std::vector<std::shared_ptr<Interface const>> imports(1, load_interface(path));
+        Syntax::Module module = ParseModule(client_source, "client.kn");
+        ModuleSpec spec(module, imports);
+        spec.fold_constants();
+        imported = first_label_value(spec);
+    });
+    std::remove(path.c_str());
+
+    ctx.out << "source included          " << include_ms << " ms" << std::endl;
+    ctx.out << "interface imported       " << import_ms << " ms (" << load_ms << " ms reading it), "
+            << include_ms / import_ms << "x faster" << std::endl;
+    if (included.empty() || included != imported)
+        ctx.out << "the client's type differs between including and importing the library" << std::endl;
+}
@@ -0,0 +1,387 @@
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "LoopIR.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+class LoopBuilder
+{
+private:
+    IR& ir;
+    ScopeId module;
+
+    NodeId number(double value)
+    {
+        return ir.add_node(NodeKind::Number, 0, none, ir.add_number(value));
+    }
+
+    NodeId ref(LabelId label)
+    {
+        return ir.add_node(NodeKind::Ref, 0, ir.label(label).name, label);
+    }
+
+    NodeId call(char const* name, NodeId a, NodeId b)
+    {
+        NodeId args[] = { a, b };
+        return ir.add_node(NodeKind::Call, HasArgs, ir.symbols.intern(name), none, args, 2);
+    }
+
+    NodeId call(char const* name, std::vector<NodeId> const& args)
+    {
+        return ir.add_node(NodeKind::Call, HasArgs, ir.symbols.intern(name), none, args.data(), args.size());
+    }
+
+    // name(index:, arrays...) { value }
+    NodeId array_loop(char const* name, LabelId index, std::vector<LabelId> const& arrays, ScopeId scope, NodeId value,
+        std::uint32_t line)
+    {
+        std::vector<NodeId> args(1, ir.label(index).decl);
+        for (LabelId a : arrays)
+            args.push_back(ref(a));
+        args.push_back(block(scope, { value }, line));
+        return ir.add_node(NodeKind::Call, HasArgs | HasBlock, ir.symbols.intern(name), none, args.data(), args.size());
+    }
+
+    NodeId call_def(LabelId def, NodeId arg)
+    {
+        return ir.add_node(NodeKind::Call, HasArgs, ir.label(def).name, def, &arg, 1);
+    }
+
+    NodeId call_def(LabelId def, NodeId a, NodeId b)
+    {
+        NodeId args[] = { a, b };
+        return ir.add_node(NodeKind::Call, HasArgs, ir.label(def).name, def, args, 2);
+    }
+
+    NodeId call(char const* name, NodeId arg)
+    {
+        return ir.add_node(NodeKind::Call, HasArgs, ir.symbols.intern(name), none, &arg, 1);
+    }
+
+    // if(cond) { stmt }, on one line
+    NodeId if_then(NodeId cond, ScopeId scope, NodeId stmt, std::uint32_t line)
+    {
+        NodeId args[] = { cond, block(scope, { stmt }, line) };
+        NodeId node = ir.add_node(NodeKind::Call, HasArgs | HasBlock, ir.symbols.intern("if"), none, args, 2);
+        ir.set_line(node, line);
+        return node;
+    }
+
+    // A def this module does not define, left for code generation to find.
+    NodeId call_free(char const* name, NodeId arg)
+    {
+        return ir.add_node(NodeKind::Call, HasArgs, ir.symbols.intern(name), none, &arg, 1);
+    }
+
+    NodeId ret(NodeId value)
+    {
+        return ir.add_node(NodeKind::Call, HasArgs, ir.symbols.intern("return"), none, &value, 1);
+    }
+
+    LabelId index_label(char const* name, ScopeId scope)
+    {
+        LabelId label = ir.add_label(ir.symbols.intern(name), scope, LabelKind::Local, none);
+        ir.label(label).decl = ir.add_node(NodeKind::Label, 0, ir.label(label).name, label);
+        return label;
+    }
+
+    NodeId local(char const* name, ScopeId scope, NodeId init)
+    {
+        LabelId label = ir.add_label(ir.symbols.intern(name), scope, LabelKind::Local, none);
+        NodeId node = ir.add_node(NodeKind::Label, HasInit, ir.label(label).name, label, &init, 1);
+        ir.label(label).decl = node;
+        return node;
+    }
+
+    NodeId assign(LabelId label, NodeId value)
+    {
+        return ir.add_node(NodeKind::Assign, 0, ir.label(label).name, label, &value, 1);
+    }
+
+    NodeId block(ScopeId scope, std::vector<NodeId> const& stmts, std::uint32_t first_line)
+    {
+        for (std::size_t k = 0; k < stmts.size(); ++k)
+            if (ir.line_of(stmts[k]) == 0)
+                ir.set_line(stmts[k], first_line + k);
+        return ir.add_node(NodeKind::Block, 0, none, scope, stmts.data(), stmts.size());
+    }
+
+    // Opens a def; returns the parameters' labels.  Parameters named with
+    // a leading '@' are arrays.
+    std::vector<LabelId> open_def(char const* name, std::vector<char const*> const& names, DefId& def, ScopeId& scope,
+        LabelId& label)
+    {
+        Symbol sym = ir.symbols.intern(name);
+        def = ir.add_def(sym, true);
+        scope = ir.add_scope(module, def);
+        ir.def(def).scope = scope;
+        label = ir.add_label(sym, module, LabelKind::Def, none);
+
+        std::vector<Param> params;
+        std::vector<LabelId> labels;
+        for (char const* param : names)
+        {
+            bool array = param[0] == '@';
+            Param p;
+            p.name = ir.symbols.intern(array ? param + 1 : param);
+            p.label = ir.add_label(p.name, scope, LabelKind::Param, none);
+            p.type = array ? ir.add_node(NodeKind::Ref, 0, ir.symbols.intern("Array"), none) : none;
+            p.default_value = none;
+            params.push_back(p);
+            labels.push_back(p.label);
+        }
+        ir.set_params(def, params);
+        return labels;
+    }
+
+    LabelId open_def(char const* name, char const* param, DefId& def, ScopeId& scope, LabelId& label)
+    {
+        return open_def(name, std::vector<char const*>(1, param), def, scope, label)[0];
+    }
+
+    NodeId close_def(DefId def, LabelId label, NodeId body, std::uint32_t line)
+    {
+        ir.def(def).body = body;
+        NodeId node = ir.add_node(NodeKind::Def, 0, ir.def(def).name, def, &body, 1);
+        ir.label(label).decl = node;
+        ir.set_line(node, line);
+        return node;
+    }
+
+public:
+    LoopBuilder(IR& ir)
+        : ir(ir), module(ir.add_scope(none, none))
+    {
+    }
+
+    // Returns square's label.
+    LabelId build_square()
+    {
+        DefId def;
+        ScopeId scope;
+        LabelId square;
+        LabelId x = open_def("square", "x", def, scope, square);
+        NodeId body = block(scope, { ret(call("*", ref(x), ref(x))) }, 12);
+        close_def(def, square, body, 11);
+        return square;
+    }
+
+    // Squares inline without call_square; with it, calls the square def
+    // when there is one and the free name otherwise.
+    std::vector<NodeId> build(bool call_square, LabelId square = none)
+    {
+        DefId loop_def;
+        ScopeId loop_scope;
+        LabelId loop;
+        LabelId n = open_def("loop", "n", loop_def, loop_scope, loop);
+
+        NodeId decl_i = local("i", loop_scope, number(0));
+        NodeId decl_s = local("s", loop_scope, number(0));
+        LabelId i = ir.node(decl_i).value;
+        LabelId s = ir.node(decl_s).value;
+
+        NodeId term = !call_square ? call("*", ref(i), ref(i))
+            : square != none ? call_def(square, ref(i))
+            : call_free("square", ref(i));
+        NodeId body = block(ir.add_scope(loop_scope, none), {
+            assign(s, call("+", ref(s), term)),
+            assign(i, call("+", ref(i), number(1)))
+        }, 5);
+
+        NodeId loop_args[] = { call("<", ref(i), ref(n)), body };
+        NodeId while_call = ir.add_node(NodeKind::Call, HasArgs | HasBlock, ir.symbols.intern("while"), none, loop_args, 2);
+        ir.set_line(while_call, 4);
+
+        NodeId result = ret(ref(s));
+        ir.set_line(result, 8);
+
+        std::vector<NodeId> items;
+        items.push_back(close_def(loop_def, loop, block(loop_scope, { decl_i, decl_s, while_call, result }, 2), 1));
+        if (square != none)
+            items.push_back(ir.label(square).decl);
+        return items;
+    }
+
+    std::vector<NodeId> build_arrays()
+    {
+        std::vector<NodeId> items;
+        DefId def;
+        ScopeId scope;
+        LabelId label;
+
+        std::vector<LabelId> p = open_def("dot", { "@a", "@b" }, def, scope, label);
+        LabelId i = index_label("i", scope);
+        NodeId product = call("*", call("at", ref(p[0]), ref(i)), call("at", ref(p[1]), ref(i)));
+        NodeId sum = array_loop("sum", i, { p[0], p[1] }, ir.add_scope(scope, none), product, 2);
+        items.push_back(close_def(def, label, block(scope, { ret(sum) }, 2), 1));
+
+        p = open_def("saxpy", { "alpha", "@x", "@y" }, def, scope, label);
+        i = index_label("i", scope);
+        NodeId scaled = call("+", call("*", ref(p[0]), call("at", ref(p[1]), ref(i))), call("at", ref(p[2]), ref(i)));
+        NodeId map = array_loop("map", i, { p[2], p[1] }, ir.add_scope(scope, none), scaled, 6);
+        items.push_back(close_def(def, label, block(scope, { map }, 6), 5));
+
+        p = open_def("dot_while", { "@a", "@b" }, def, scope, label);
+        NodeId decl_i = local("i", scope, number(0));
+        NodeId decl_s = local("s", scope, number(0));
+        LabelId j = ir.node(decl_i).value;
+        LabelId s = ir.node(decl_s).value;
+        product = call("*", call("at", ref(p[0]), ref(j)), call("at", ref(p[1]), ref(j)));
+        NodeId body = block(ir.add_scope(scope, none), {
+            assign(s, call("+", ref(s), product)),
+            assign(j, call("+", ref(j), number(1)))
+        }, 13);
+        NodeId loop_args[] = { call("<", ref(j), call("length", std::vector<NodeId>(1, ref(p[0])))), body };
+        NodeId while_call = ir.add_node(NodeKind::Call, HasArgs | HasBlock, ir.symbols.intern("while"), none, loop_args, 2);
+        ir.set_line(while_call, 12);
+        NodeId result = ret(ref(s));
+        ir.set_line(result, 16);
+        items.push_back(close_def(def, label, block(scope, { decl_i, decl_s, while_call, result }, 10), 9));
+        return items;
+    }
+
+    std::vector<NodeId> build_tasks()
+    {
+        std::vector<NodeId> items;
+        DefId def;
+        ScopeId scope;
+        LabelId fib;
+        LabelId n = open_def("fib", "n", def, scope, fib);
+        NodeId small = if_then(call("<", ref(n), number(2)), ir.add_scope(scope, none), ret(ref(n)), 2);
+        NodeId sum = call("+", call_def(fib, call("-", ref(n), number(1))), call_def(fib, call("-", ref(n), number(2))));
+        items.push_back(close_def(def, fib, block(scope, { small, ret(sum) }, 2), 1));
+
+        LabelId pfib;
+        std::vector<LabelId> p = open_def("pfib", { "n", "cutoff" }, def, scope, pfib);
+        small = if_then(call("<", ref(p[0]), ref(p[1])), ir.add_scope(scope, none), ret(call_def(fib, ref(p[0]))), 7);
+        NodeId decl_a = local("a", scope,
+            call("spawn", call_def(pfib, call("-", ref(p[0]), number(1)), ref(p[1]))));
+        NodeId decl_b = local("b", scope, call_def(pfib, call("-", ref(p[0]), number(2)), ref(p[1])));
+        sum = call("+", call("await", ref(ir.node(decl_a).value)), ref(ir.node(decl_b).value));
+        items.push_back(close_def(def, pfib, block(scope, { small, decl_a, decl_b, ret(sum) }, 7), 6));
+
+        LabelId noop;
+        LabelId x = open_def("noop", "x", def, scope, noop);
+        items.push_back(close_def(def, noop, block(scope, { ret(ref(x)) }, 14), 13));
+
+        LabelId spawn_loop;
+        n = open_def("spawn_loop", "n", def, scope, spawn_loop);
+        NodeId decl_i = local("i", scope, number(0));
+        NodeId decl_s = local("s", scope, number(0));
+        LabelId i = ir.node(decl_i).value;
+        LabelId s = ir.node(decl_s).value;
+        ScopeId body_scope = ir.add_scope(scope, none);
+        NodeId decl_t = local("t", body_scope, call("spawn", call_def(noop, ref(i))));
+        NodeId body = block(body_scope, {
+            decl_t,
+            assign(s, call("+", ref(s), call("await", ref(ir.node(decl_t).value)))),
+            assign(i, call("+", ref(i), number(1)))
+        }, 21);
+        NodeId loop_args[] = { call("<", ref(i), ref(n)), body };
+        NodeId while_call = ir.add_node(NodeKind::Call, HasArgs | HasBlock, ir.symbols.intern("while"), none, loop_args, 2);
+        ir.set_line(while_call, 20);
+        NodeId result = ret(ref(s));
+        ir.set_line(result, 25);
+        items.push_back(close_def(def, spawn_loop, block(scope, { decl_i, decl_s, while_call, result }, 18), 17));
+        return items;
+    }
+
+    std::vector<NodeId> build_moments(std::vector<int> const& lengths)
+    {
+        std::vector<NodeId> items;
+        DefId def;
+        ScopeId scope;
+        LabelId moments;
+        std::vector<LabelId> p = open_def("moments", { "@x", "@w" }, def, scope, moments);
+        LabelId x = p[0], w = p[1];
+        std::vector<NodeId> stmts;
+        for (int power = 0; power < 6; ++power)
+        {
+            LabelId i = index_label("i", scope);
+            NodeId term = call("at", ref(w), ref(i));
+            for (int k = 0; k < power; ++k)
+                term = call("*", term, call("at", ref(x), ref(i)));
+            std::string name = "m" + std::to_string(power);
+            stmts.push_back(local(name.c_str(), scope,
+                array_loop("sum", i, { x, w }, ir.add_scope(scope, none), term, 2 + power)));
+        }
+        NodeId total = ref(ir.node(stmts.back()).value);
+        for (std::size_t k = stmts.size() - 1; k-- > 0;)
+            total = call("+", ref(ir.node(stmts[k]).value), total);
+        stmts.push_back(ret(total));
+        items.push_back(close_def(def, moments, block(scope, stmts, 2), 1));
+
+        for (int length : lengths)
+        {
+            std::string name = "sample" + std::to_string(length);
+            LabelId sample;
+            p = open_def(name.c_str(), { "n", "m" }, def, scope, sample);
+            NodeId size = length ? number(length) : ref(p[1]);
+            NodeId decl_x = local("x", scope, call("array", size));
+            NodeId decl_w = local("w", scope, call("array", length ? number(length) : ref(p[1])));
+            LabelId sx = ir.node(decl_x).value;
+            LabelId sw = ir.node(decl_w).value;
+            NodeId weights = array_loop("map", index_label("k", scope), { sw }, ir.add_scope(scope, none), number(1), 14);
+            ir.set_line(weights, 14);
+            NodeId decl_s = local("s", scope, number(0));
+            NodeId decl_i = local("i", scope, number(0));
+            LabelId s = ir.node(decl_s).value;
+            LabelId i = ir.node(decl_i).value;
+
+            LabelId j = index_label("j", scope);
+            NodeId values = array_loop("map", j, { sx }, ir.add_scope(scope, none), call("+", ref(i), ref(j)), 18);
+            NodeId moment_args[] = { ref(sx), ref(sw) };
+            NodeId moment = ir.add_node(NodeKind::Call, HasArgs, ir.label(moments).name, moments, moment_args, 2);
+            NodeId body = block(ir.add_scope(scope, none), {
+                values,
+                assign(s, call("+", ref(s), moment)),
+                assign(i, call("+", ref(i), number(1)))
+            }, 18);
+            NodeId loop_args[] = { call("<", ref(i), ref(p[0])), body };
+            NodeId while_call = ir.add_node(NodeKind::Call, HasArgs | HasBlock, ir.symbols.intern("while"), none, loop_args, 2);
+            ir.set_line(while_call, 17);
+            NodeId result = ret(ref(s));
+            ir.set_line(result, 22);
+            items.push_back(close_def(def, sample, block(scope, { decl_x, decl_w, weights, decl_s, decl_i, while_call, result }, 12), 11));
+        }
+        return items;
+    }
+};
+
+}
+
+std::vector<NodeId> build_loop_module(IR& ir, bool call_square)
+{
+    LoopBuilder builder(ir);
+    return call_square ? builder.build(true, builder.build_square()) : builder.build(false);
+}
+
+std::vector<NodeId> build_square_module(IR& ir)
+{
+    return std::vector<NodeId>(1, ir.label(LoopBuilder(ir).build_square()).decl);
+}
+
+std::vector<NodeId> build_loop_calling_other_module(IR& ir)
+{
+    return LoopBuilder(ir).build(true);
+}
+
+std::vector<NodeId> build_array_module(IR& ir)
+{
+    return LoopBuilder(ir).build_arrays();
+}
+
+std::vector<NodeId> build_task_module(IR& ir)
+{
+    return LoopBuilder(ir).build_tasks();
+}
+
+std::vector<NodeId> build_moments_module(IR& ir, std::vector<int> const& lengths)
+{
+    return LoopBuilder(ir).build_moments(lengths);
+}
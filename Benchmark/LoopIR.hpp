@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vector>
+
+#include "Knife/IR.hpp"
+
+// Builds the module below straight into an IR, with its source lines,
+// since the grammar has no infix operators yet; the builtin operators are
+// calls named "+", "<" and so on.  Returns the module's items.
+//
+//     1  def loop(n) {
+//     2      i := 0
+//     3      s := 0
+//     4      while(<(i, n)) {
+//     5          s = +(s, *(i, i))           or  s = +(s, square(i))
+//     6          i = +(i, 1)
+//     7      }
+//     8      return(s)
+//     9  }
+//    10
+//    11  def square(x) {                     with call_square only
+//    12      return(*(x, x))
+//    13  }
+std::vector<Semantic::NodeId> build_loop_module(Semantic::IR& ir, bool call_square);
+
+// The same split in two modules: square alone, and loop calling square by
+// name as a def of some other module.
+std::vector<Semantic::NodeId> build_square_module(Semantic::IR& ir);
+std::vector<Semantic::NodeId> build_loop_calling_other_module(Semantic::IR& ir);
+
+// Array kernels, the first two over the loop templates and the last the
+// way it would be written without them:
+//
+//     def dot(a: Array, b: Array) {
+//         return(sum(i:, a, b) { *(at(a, i), at(b, i)) })
+//     }
+//
+//     def saxpy(alpha, x: Array, y: Array) {
+//         map(i:, y, x) { +(*(alpha, at(x, i)), at(y, i)) }
+//     }
+//
+//     def dot_while(a: Array, b: Array) {
+//         i := 0
+//         s := 0
+//         while(<(i, length(a))) {
+//             s = +(s, *(at(a, i), at(b, i)))
+//             i = +(i, 1)
+//         }
+//         return(s)
+//     }
+std::vector<Semantic::NodeId> build_array_module(Semantic::IR& ir);
+
+// Fibonacci, sequentially and with tasks (see Knife/Scheduler.hpp), and a
+// def that spawns and awaits one trivial task at a time:
+//
+//     1  def fib(n) {
+//     2      if(<(n, 2)) { return(n) }
+//     3      return(+(fib(-(n, 1)), fib(-(n, 2))))
+//     4  }
+//     5
+//     6  def pfib(n, cutoff) {
+//     7      if(<(n, cutoff)) { return(fib(n)) }
+//     8      a := spawn(pfib(-(n, 1), cutoff))
+//     9      b := pfib(-(n, 2), cutoff)
+//    10      return(+(await(a), b))
+//    11  }
+//    12
+//    13  def noop(x) {
+//    14      return(x)
+//    15  }
+//    16
+//    17  def spawn_loop(n) {
+//    18      i := 0
+//    19      s := 0
+//    20      while(<(i, n)) {
+//    21          t := spawn(noop(i))
+//    22          s = +(s, await(t))
+//    23          i = +(i, 1)
+//    24      }
+//    25      return(s)
+//    26  }
+std::vector<Semantic::NodeId> build_task_module(Semantic::IR& ir);
+
+// A def over two arrays, and for each length a def sample<length> that
+// calls it with arrays of that length; sample0 makes them m long, which is
+// only known when it runs:
+//
+//     1  def moments(x: Array, w: Array) {
+//     2      m0 := sum(i:, x, w) { at(w, i) }
+//     3      m1 := sum(i:, x, w) { *(at(w, i), at(x, i)) }
+//     4      m2 := sum(i:, x, w) { *(*(at(w, i), at(x, i)), at(x, i)) }
+//            ... and so on to m5
+//     8      return(+(m0, +(m1, +(m2, +(m3, +(m4, m5))))))
+//     9  }
+//    10
+//    11  def sample3(n, m) {
+//    12      x := array(3)
+//    13      w := array(3)
+//    14      map(k:, w) { 1 }
+//    15      s := 0
+//    16      i := 0
+//    17      while(<(i, n)) {
+//    18          map(j:, x) { +(i, j) }
+//    19          s = +(s, moments(x, w))
+//    20          i = +(i, 1)
+//    21      }
+//    22      return(s)
+//    23  }
+std::vector<Semantic::NodeId> build_moments_module(Semantic::IR& ir, std::vector<int> const& lengths);
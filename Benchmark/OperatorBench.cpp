@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Bench.hpp"
+
+#include "Knife/Format.hpp"
+#include "Knife/Parse.hpp"
+
+namespace
+{
+
+// A def whose body is one expression of the given number of operators,
+// cycling through the given ones: "def f(a, b) { a + b * 3 - a ... }".
+std::string long_expression(int operators, std::vector<char const*> const& ops)
+{
+    std::stringstream src;
+    src << "def f(a, b) { a";
+    for (int i = 0; i < operators; ++i)
+        src << ' ' << ops[i % ops.size()] << ' ' << (i % 3 == 0 ? "b" : i % 3 == 1 ? "3" : "a");
+    src << " }\n";
+    return src.str();
+}
+
+// The same operands as the arguments of one call: "g(a, b, 3, a ...)".
+std::string long_call(int operators)
+{
+    std::stringstream src;
+    src << "def f(a, b) { g(a";
+    for (int i = 0; i < operators; ++i)
+        src << ", " << (i % 3 == 0 ? "b" : i % 3 == 1 ? "3" : "a");
+    src << ") }\n";
+    return src.str();
+}
+
+void time_parse(Bench::Context& ctx, std::string const& what, std::string const& source, int operators)
+{
+    int const rounds = 3;
+    double best = 1e300;
+    for (int r = 0; r < rounds; ++r)
+    {
+        Bench::Stopwatch time;
+        Syntax::Module module = ParseModule(source, "expression.kn");
+        best = std::min(best, time.elapsed_ms());
+        Bench::keep(module.items.size());
+    }
+
+    ctx.out << what << std::string(what.size() < 30 ? 30 - what.size() : 1, ' ') << best << " ms, "
+            << best * 1e6 / operators << " ns per operator" << std::endl;
+}
+
+}
+
+// Parsing one long expression: the time per operator should stay flat as
+// it grows, whether every operator has the same precedence (everything
+// nests to the left) or they alternate (operands wait on the stack), and
+// should stay close to the cost of as many operands passed to one call.
+// Also checks that the printer's output reprints the same.
+KNIFE_BENCHMARK(operator_expressions)
+{
+    std::vector<char const*> const same = { "+", "-" };
+    std::vector<char const*> const mixed = { "+", "*", "-", "/", "<", "==", "&&", "<+>" };
+
+    for (int operators : {1000, 5000, 20000})
+    {
+        operators = std::max(10, int(operators * ctx.scale));
+        std::string n = std::to_string(operators);
+        time_parse(ctx, n + " of + and -", long_expression(operators, same), operators);
+        time_parse(ctx, n + " of mixed precedence", long_expression(operators, mixed), operators);
+        time_parse(ctx, n + " as call arguments", long_call(operators), operators);
+    }
+
+    std::string source = long_expression(1000, mixed);
+    std::string printed, reprinted;
+    SyntaxPrinter(printed).print(ParseModule(source, "expression.kn"));
+    SyntaxPrinter(reprinted).print(ParseModule(printed, "expression.kn"));
+    if (reprinted != printed)
+        ctx.out << "the printer did not round-trip the expression" << std::endl;
+}
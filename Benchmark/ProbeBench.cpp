@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Bench.hpp"
+#include "LoopIR.hpp"
+
+#include "Knife/IR.hpp"
+#include "Knife/Jit.hpp"
+#include "Knife/Debugger.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+typedef double (*LoopFn)(double);
+
+double best_ns_per_iteration(LoopFn fn, double n)
+{
+    double best = 1e300;
+    for (int run = 0; run < 3; ++run)
+    {
+        Bench::Stopwatch time;
+        double s = fn(n);
+        double ms = time.elapsed_ms();
+        Bench::keep(s);
+        best = std::min(best, ms * 1e6 / n);
+    }
+    return best;
+}
+
+}
+
+// A tight Knife loop compiled without probe sites, with probe sites that
+// are not armed, with a breakpoint armed on a line outside the loop, and
+// with one armed on a line inside it (every iteration calls the hook).
+KNIFE_BENCHMARK(probe_overhead)
+{
+    IR ir;
+    std::vector<NodeId> items = build_loop_module(ir, false);
+    double n = double(long(20000000 * ctx.scale) + 1);
+
+    struct Variant
+    {
+        char const* label;
+        bool probes;
+        int armed_line;
+        double iterations;
+    };
+
+    Variant const variants[] = {
+        { "no probe sites           ", false, 0, n },
+        { "probe sites, none armed  ", true, 0, n },
+        { "armed outside the loop   ", true, 8, n },
+        { "armed inside the loop    ", true, 5, std::max(1.0, double(long(n / 20))) }
+    };
+
+    // One file, loaded again by each variant's Jit; the one before has
+    // unregistered its module by the time a breakpoint is set.
+    std::string const file_name = "probe_bench.kn";
+    double baseline = 0;
+    for (auto const& v : variants)
+    {
+        Jit jit;
+        CodegenOptions options;
+        options.probes = v.probes;
+        options.debug_info = false;
+
+        if (jit.load(ir, items, file_name, options) != 1)
+        {
+            ctx.out << "could not compile the loop" << std::endl;
+            return;
+        }
+
+        LoopFn fn = reinterpret_cast<LoopFn>(jit.lookup("loop"));
+        int breakpoint = v.armed_line ? Debugger::set_breakpoint(file_name, v.armed_line) : 0;
+        std::size_t hits_before = Debugger::hit_count();
+
+        double ns = best_ns_per_iteration(fn, v.iterations);
+        if (!v.probes)
+            baseline = ns;
+
+        std::size_t hits = Debugger::hit_count() - hits_before;
+        if (breakpoint)
+            Debugger::clear_breakpoint(breakpoint);
+
+        ctx.out << v.label << ns << " ns per iteration (" << ns / baseline << "x), "
+                << hits << " hits" << std::endl;
+    }
+}
@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Bench.hpp"
+#include "LoopIR.hpp"
+
+#include "Knife/IR.hpp"
+#include "Knife/Jit.hpp"
+#include "Knife/Profiler.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+typedef double (*LoopFn)(double);
+
+double time_ms(LoopFn fn, double n)
+{
+    Bench::Stopwatch time;
+    double s = fn(n);
+    double ms = time.elapsed_ms();
+    Bench::keep(s);
+    return ms;
+}
+
+}
+
+// A loop that calls a small def every iteration, compiled without debug
+// info, with it (frame pointers kept) but not sampling, and sampled at the
+// default rate.  The flat profile shows where the samples landed.
+KNIFE_BENCHMARK(profiler_overhead)
+{
+    IR ir;
+    std::vector<NodeId> items = build_loop_module(ir, true);
+    double n = double(long(200000000 * ctx.scale) + 1);
+
+    double baseline = 0;
+    for (int variant = 0; variant < 3; ++variant)
+    {
+        Jit jit;
+        CodegenOptions options;
+        options.probes = false;
+        options.debug_info = variant != 0;
+
+        if (jit.load(ir, items, "profile_bench.kn", options) != 2)
+        {
+            ctx.out << "could not compile the loop" << std::endl;
+            return;
+        }
+
+        LoopFn fn = reinterpret_cast<LoopFn>(jit.lookup("loop"));
+        time_ms(fn, n / 10);
+
+        if (variant == 2)
+            Profiler::start();
+
+        double best = 1e300;
+        for (int run = 0; run < 3; ++run)
+            best = std::min(best, time_ms(fn, n));
+
+        // Write the profile while the code is still loaded to resolve it.
+        std::stringstream flat;
+        if (variant == 2)
+        {
+            Profiler::stop();
+            Profiler::write_flat(flat);
+        }
+
+        if (variant == 0)
+            baseline = best;
+
+        char const* labels[] = { "no debug info       ", "debug info, idle    ", "sampling at default " };
+        ctx.out << labels[variant] << best * 1e6 / n << " ns per iteration ("
+                << best / baseline << "x)" << std::endl;
+        if (variant == 2)
+            ctx.out << std::endl << flat.str();
+    }
+}
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Bench.hpp"
+
+#include "Knife/IR.hpp"
+#include "Knife/Jit.hpp"
+#include "Knife/ModuleCache.hpp"
+#include "Knife/Parse.hpp"
+#include "Knife/Region.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+// The sizes of small tuples and closure frames, cycled through.
+std::size_t const object_sizes[] = { 16, 24, 32, 48, 64, 24, 16, 40 };
+
+struct Pauses
+{
+    std::vector<double> ns;
+
+    void add(Clock::time_point start)
+    {
+        ns.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+    }
+
+    double percentile(double p)
+    {
+        std::sort(ns.begin(), ns.end());
+        return ns.empty() ? 0 : ns[std::min(ns.size() - 1, std::size_t(p * ns.size()))];
+    }
+};
+
+void touch(void* p, std::size_t bytes, int value)
+{
+    std::memset(p, value, bytes);
+    Bench::keep(p);
+}
+
+}
+
+// Calls that each make many small short-lived objects and drop them all
+// on return: bump allocated from a region and released to a mark, against
+// malloc and free of each object.  The pause is the time to free one
+// call's objects.
+KNIFE_BENCHMARK(region_allocation)
+{
+    int const calls = std::max(1, int(2000 * ctx.scale));
+    int const per_call = 5000;
+    std::size_t const sizes = sizeof object_sizes / sizeof object_sizes[0];
+
+    Region region;
+    Pauses region_pauses;
+    Bench::Stopwatch region_time;
+    for (int c = 0; c < calls; ++c)
+    {
+        Region::Mark mark = region.mark();
+        for (int k = 0; k < per_call; ++k)
+        {
+            std::size_t bytes = object_sizes[k % sizes];
+            touch(region.allocate(bytes, 8), bytes, k);
+        }
+        Clock::time_point start = Clock::now();
+        region.release(mark);
+        region_pauses.add(start);
+    }
+    double region_ms = region_time.elapsed_ms();
+
+    std::vector<void*> objects(per_call);
+    Pauses malloc_pauses;
+    Bench::Stopwatch malloc_time;
+    for (int c = 0; c < calls; ++c)
+    {
+        for (int k = 0; k < per_call; ++k)
+        {
+            std::size_t bytes = object_sizes[k % sizes];
+            objects[k] = std::malloc(bytes);
+            touch(objects[k], bytes, k);
+        }
+        Clock::time_point start = Clock::now();
+        for (void* p : objects)
+            std::free(p);
+        malloc_pauses.add(start);
+    }
+    double malloc_ms = malloc_time.elapsed_ms();
+
+    double allocations = double(calls) * per_call;
+    ctx.out << "region                 " << allocations / (region_ms * 1e3) << " allocations per us, release "
+            << region_pauses.percentile(0.5) << " ns median, " << region_pauses.percentile(0.99) << " ns p99, "
+            << region_pauses.percentile(1) << " ns max" << std::endl;
+    ctx.out << "malloc and free        " << allocations / (malloc_ms * 1e3) << " allocations per us ("
+            << malloc_ms / region_ms << "x slower), free " << malloc_pauses.percentile(0.5) << " ns median, "
+            << malloc_pauses.percentile(0.99) << " ns p99, " << malloc_pauses.percentile(1) << " ns max" << std::endl;
+}
+
+// A generated def that makes a scratch array on each call, against the
+// same in C++ with a std::vector.
+KNIFE_BENCHMARK(region_arrays)
+{
+    CompiledModule module(ParseModule(
+        "def scratch(n) {\n"
+        "    t := array(n)\n"
+        "    map(i:, t) { i }\n"
+        "    return(sum(j:, t) { at(t, j) })\n"
+        "}\n", "scratch.kn"));
+
+    CodegenOptions options;
+    options.probes = false;
+    options.debug_info = false;
+    Jit jit;
+    typedef double (*ScratchFn)(double);
+    ScratchFn scratch = jit.load(module.spec.get_ir(), module.spec.item_nodes(), "scratch.kn", options) == 1
+        ? reinterpret_cast<ScratchFn>(jit.lookup("scratch")) : nullptr;
+    if (!scratch)
+    {
+        ctx.out << "could not load scratch" << std::endl;
+        return;
+    }
+
+    long const calls = std::max(1L, long(1000000 * ctx.scale));
+    double const lengths[] = { 8, 64, 512 };
+    for (double n : lengths)
+    {
+        Bench::Stopwatch knife_time;
+        for (long c = 0; c < calls; ++c)
+            Bench::keep(scratch(n));
+        double knife_ns = knife_time.elapsed_ms() * 1e6 / calls;
+
+        Bench::Stopwatch vector_time;
+        for (long c = 0; c < calls; ++c)
+        {
+            std::vector<double> t(std::size_t(n), 0.0);
+            Bench::keep(t.data());
+            for (std::size_t i = 0; i < t.size(); ++i)
+                t[i] = double(i);
+            Bench::keep(t.data());
+            double s = 0;
+            for (double x : t)
+                s += x;
+            Bench::keep(s);
+        }
+        double vector_ns = vector_time.elapsed_ms() * 1e6 / calls;
+
+        ctx.out << "array(" << n << ")" << std::string(n < 10 ? 14 : n < 100 ? 13 : 12, ' ') << knife_ns
+                << " ns per call from the region, " << vector_ns << " ns with std::vector ("
+                << vector_ns / knife_ns << "x)" << std::endl;
+    }
+    ctx.out << "region in use after    " << Region::current().bytes_reserved() << " bytes" << std::endl;
+}
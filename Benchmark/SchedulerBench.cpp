@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "Bench.hpp"
+#include "LoopIR.hpp"
+
+#include "Knife/Codegen.hpp"
+#include "Knife/IR.hpp"
+#include "Knife/Jit.hpp"
+#include "Knife/Scheduler.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+typedef double (*UnaryFn)(double);
+typedef double (*BinaryFn)(double, double);
+
+// The task entries below call these; a benchmark sets them before it
+// spawns.
+UnaryFn unary;
+BinaryFn binary;
+std::vector<Scheduler::TaskSlot> chain;
+
+double run_unary(double const* args)
+{
+    return unary(args[0]);
+}
+
+double run_binary(double const* args)
+{
+    return binary(args[0], args[1]);
+}
+
+// Task k waits for task k + 1, so every task of the chain but the last is
+// suspended at once.
+double run_chain_link(double const* args)
+{
+    std::size_t k = std::size_t(args[0]);
+    return k + 1 < chain.size() ? 1 + knife_task_await(&chain[k + 1]) : 1;
+}
+
+// Spawns a task from this thread, which is not in the pool, and waits.
+double run_as_task(double (*run)(double const*), std::vector<double> const& args)
+{
+    Scheduler::TaskSlot slot = { nullptr, 0 };
+    knife_task_spawn(&slot, run, args.data(), args.size());
+    return knife_task_await(&slot);
+}
+
+bool load_tasks(Bench::Context& ctx, Jit& jit, IR& ir)
+{
+    std::vector<NodeId> items = build_task_module(ir);
+    CodegenOptions options;
+    options.probes = false;
+    options.debug_info = false;
+    if (jit.load(ir, items, "tasks.kn", options) != items.size())
+    {
+        ctx.out << "could not load the task module" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void print_stats(Bench::Context& ctx)
+{
+    Scheduler::Stats s = Scheduler::stats();
+    ctx.out << s.tasks << " tasks, " << s.steals << " steals, " << s.suspensions << " suspensions";
+}
+
+}
+
+// What a task costs: spawning a def that returns its argument and
+// awaiting it, one at a time from inside a task, against calling it; and
+// a chain of tasks that are all suspended at once.
+KNIFE_BENCHMARK(task_spawn)
+{
+    IR ir;
+    Jit jit;
+    if (!load_tasks(ctx, jit, ir))
+        return;
+    UnaryFn noop = reinterpret_cast<UnaryFn>(jit.lookup("noop"));
+
+    long const n = std::max(1L, long(200000 * ctx.scale));
+    Scheduler::stop();
+    Scheduler::start(1);
+
+    unary = reinterpret_cast<UnaryFn>(jit.lookup("spawn_loop"));
+    Bench::Stopwatch task_time;
+    double s = run_as_task(run_unary, std::vector<double>(1, double(n)));
+    double task_ns = task_time.elapsed_ms() * 1e6 / n;
+    if (s != double(n) * (n - 1) / 2)
+        ctx.out << "spawn_loop gave a wrong result" << std::endl;
+
+    Bench::Stopwatch call_time;
+    for (long i = 0; i < n; ++i)
+        Bench::keep(noop(double(i)));
+    double call_ns = call_time.elapsed_ms() * 1e6 / n;
+
+    ctx.out << "spawn and await        " << task_ns << " ns per task (a call is " << call_ns << " ns); ";
+    print_stats(ctx);
+    ctx.out << std::endl;
+
+    std::size_t const links = std::max<std::size_t>(2, std::size_t(10000 * ctx.scale));
+    Scheduler::stop();
+    Scheduler::start(1);
+    chain.assign(links, Scheduler::TaskSlot{ nullptr, 0 });
+    Bench::Stopwatch chain_time;
+    // The newest task runs first, so spawning the last link first has each
+    // link suspend on one that has not run yet.
+    for (std::size_t k = links; k-- > 0;)
+    {
+        double arg = double(k);
+        knife_task_spawn(&chain[k], run_chain_link, &arg, 1);
+    }
+    double length = knife_task_await(&chain[0]);
+    double chain_ms = chain_time.elapsed_ms();
+    if (length != double(links))
+        ctx.out << "the chain gave a wrong result" << std::endl;
+
+    ctx.out << "chain of " << links << " tasks    " << chain_ms << " ms, " << chain_ms * 1e6 / links << " ns per task; ";
+    print_stats(ctx);
+    ctx.out << std::endl;
+    Scheduler::stop();
+}
+
+// Fibonacci with a task for each call above the cutoff, on 1 to 16
+// threads, against the sequential def.
+KNIFE_BENCHMARK(parallel_fib)
+{
+    IR ir;
+    Jit jit;
+    if (!load_tasks(ctx, jit, ir))
+        return;
+    UnaryFn fib = reinterpret_cast<UnaryFn>(jit.lookup("fib"));
+    binary = reinterpret_cast<BinaryFn>(jit.lookup("pfib"));
+
+    double const n = ctx.scale >= 1 ? 32 : 24;
+    double const cutoff = n - 12;
+    std::vector<double> args = { n, cutoff };
+
+    Bench::Stopwatch sequential_time;
+    double expected = fib(n);
+    double sequential_ms = sequential_time.elapsed_ms();
+    ctx.out << "fib(" << n << ") sequential     " << sequential_ms << " ms" << std::endl;
+
+    double one_thread_ms = 0;
+    unsigned const threads[] = { 1, 2, 4, 8, 16 };
+    for (unsigned t : threads)
+    {
+        Scheduler::stop();
+        Scheduler::start(t);
+        Bench::Stopwatch time;
+        double result = run_as_task(run_binary, args);
+        double ms = time.elapsed_ms();
+        if (result != expected)
+            ctx.out << "pfib gave a wrong result" << std::endl;
+        if (t == 1)
+            one_thread_ms = ms;
+
+        ctx.out << "pfib on " << t << " thread" << (t == 1 ? " " : "s") << std::string(t < 10 ? 6 : 5, ' ') << ms
+                << " ms, " << one_thread_ms / ms << "x one thread; ";
+        print_stats(ctx);
+        ctx.out << std::endl;
+    }
+    Scheduler::stop();
+    ctx.out << "hardware threads       " << std::thread::hardware_concurrency() << std::endl;
+}
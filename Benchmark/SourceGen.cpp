@@ -0,0 +1,97 @@
+#include <string>
+#include <sstream>
+using namespace std;
+
+#include "SourceGen.hpp"
+
+namespace
+{
+
+struct Generator
+{
+    std::stringstream out;
+    unsigned state;
+    int lines;
+    int defs;
+
+    Generator(unsigned seed)
+        : state(seed), lines(0), defs(0)
+    {
+    }
+
+    unsigned next(unsigned n)
+    {
+        state = state * 1103515245u + 12345u;
+        return (state >> 16) % n;
+    }
+
+    void line(int depth, std::string const& text)
+    {
+        for (int i = 0; i < depth; ++i)
+            out << "    ";
+        out << text << '\n';
+        ++lines;
+    }
+
+    std::string local(int i)
+    {
+        return "v" + std::to_string(i);
+    }
+
+    void body(int depth, int locals, int budget)
+    {
+        for (int i = 0; i < budget; ++i)
+        {
+            switch (next(6))
+            {
+            case 0:
+                line(depth, local(locals) + " := " + std::to_string(next(1000)));
+                ++locals;
+                break;
+            case 1:
+                line(depth, local(locals) + ": Int");
+                ++locals;
+                break;
+            case 2:
+                if (locals > 0)
+                    line(depth, local(next(locals)) + " = " + local(next(locals)));
+                else
+                    line(depth, "say(\"nothing\")");
+                break;
+            case 3:
+                line(depth, "say(" + (locals > 0 ? local(next(locals)) : std::string("1")) + ", \"text\")");
+                break;
+            case 4:
+                line(depth, "if (" + (locals > 0 ? local(next(locals)) : std::string("happy")) + ") {");
+                body(depth + 1, locals, 2);
+                line(depth, "} else {");
+                body(depth + 1, locals, 1);
+                line(depth, "}");
+                i += 3;
+                break;
+            case 5:
+                line(depth, "obj crack hatch(" + std::to_string(next(9)) + ")");
+                break;
+            }
+        }
+    }
+
+    void def()
+    {
+        int n = defs++;
+        line(0, "def f" + std::to_string(n) + "(a:Int, b:Int = 0, c) {");
+        body(1, 0, 4 + next(8));
+        line(0, "}");
+        line(0, "");
+    }
+};
+
+}
+
+std::string generate_module(int lines, unsigned seed)
+{
+    Generator gen(seed);
+    while (gen.lines < lines)
+        gen.def();
+    return gen.out.str();
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+// Generates a syntactically valid Knife module of roughly the given number
+// of lines: a mix of typed defs, labels, closures, postfix blocks and
+// message chains, in the proportions seen in LanguageDoc.txt.
+std::string generate_module(int lines, unsigned seed = 1);
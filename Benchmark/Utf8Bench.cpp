@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string>
+using namespace std;
+
+#include "Bench.hpp"
+#include "SourceGen.hpp"
+
+#include "Knife/Parse.hpp"
+#include "Knife/Utf8.hpp"
+
+namespace
+{
+
+// The generated module with its locals named λ0, λ1... and its strings in
+// French and Russian: the same structure, a few percent of it outside ASCII.
+std::string translate(std::string const& ascii)
+{
+    std::string out;
+    out.reserve(ascii.size() * 5 / 4);
+    for (std::size_t i = 0; i < ascii.size(); ++i)
+    {
+        char c = ascii[i];
+        bool starts_name = i == 0 || !(std::isalnum(std::uint8_t(ascii[i - 1])) || ascii[i - 1] == '_');
+        if (c == 'v' && starts_name && i + 1 < ascii.size() && std::isdigit(std::uint8_t(ascii[i + 1])))
+            out += "\xCE\xBB";
+        else if (ascii.compare(i, 6, "\"text\"") == 0)
+        {
+            out += "\"texte \xC3\xA9quilibr\xC3\xA9 \xE2\x9C\x93\"";
+            i += 5;
+        }
+        else if (ascii.compare(i, 9, "\"nothing\"") == 0)
+        {
+            out += "\"\xD0\xBD\xD0\xB8\xD1\x87\xD0\xB5\xD0\xB3\xD0\xBE\"";
+            i += 8;
+        }
+        else
+            out += c;
+    }
+    return out;
+}
+
+// What a lexer decoding a code point per character would do: the length
+// from the lead byte, then each continuation byte and the range checked.
+std::size_t decode_each(std::string const& text)
+{
+    std::uint8_t const* p = reinterpret_cast<std::uint8_t const*>(text.data());
+    std::size_t size = text.size();
+    std::size_t i = 0;
+    while (i < size)
+    {
+        std::uint32_t lead = p[i];
+        std::size_t length = lead < 0x80 ? 1 : lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 0;
+        if (length == 0 || i + length > size)
+            return i;
+        std::uint32_t point = length == 1 ? lead : lead & (0x7F >> length);
+        for (std::size_t k = 1; k < length; ++k)
+        {
+            if ((p[i + k] & 0xC0) != 0x80)
+                return i;
+            point = point << 6 | (p[i + k] & 0x3F);
+        }
+        static std::uint32_t const least[] = { 0, 0, 0x80, 0x800, 0x10000 };
+        if (point < least[length] || point > 0x10FFFF || (point >= 0xD800 && point < 0xE000))
+            return i;
+        i += length;
+    }
+    return size;
+}
+
+template <typename Check>
+double best_gbps(std::string const& text, Check check)
+{
+    int const rounds = 20;
+    double best = 1e300;
+    for (int r = 0; r < 3; ++r)
+    {
+        Bench::Stopwatch time;
+        for (int i = 0; i < rounds; ++i)
+            Bench::keep(check(text));
+        best = std::min(best, time.elapsed_ms() / rounds);
+    }
+    return text.size() / best / 1e6;
+}
+
+double parse_ms(std::string const& source)
+{
+    double best = 1e300;
+    for (int r = 0; r < 3; ++r)
+    {
+        Bench::Stopwatch time;
+        Bench::keep(ParseModule(source, "generated.kn"));
+        best = std::min(best, time.elapsed_ms());
+    }
+    return best;
+}
+
+}
+
+// Checking source text is UTF-8 in bulk before parsing, on an ASCII module
+// and on the same module with names and strings outside ASCII, against
+// decoding every character; and what the check adds to parsing.
+KNIFE_BENCHMARK(utf8_sources)
+{
+    int lines = std::max(100, int(50000 * ctx.scale));
+    std::string ascii = generate_module(lines);
+    std::string unicode = translate(ascii);
+    auto bulk = [](std::string const& text) { return Syntax::find_invalid_utf8(text.data(), text.size()); };
+
+    std::size_t outside = unicode.size() - std::count_if(unicode.begin(), unicode.end(), [](char c) { return std::uint8_t(c) < 0x80; });
+    ctx.out << lines << " lines, " << ascii.size() / 1024 << " KB in ASCII, " << unicode.size() / 1024 << " KB with "
+            << outside * 100 / unicode.size() << "% of bytes outside ASCII" << std::endl;
+    if (bulk(ascii) != ascii.size() || bulk(unicode) != unicode.size() || decode_each(unicode) != unicode.size())
+        ctx.out << "a generated module was taken for invalid UTF-8" << std::endl;
+
+    ctx.out << "ASCII      in bulk " << best_gbps(ascii, bulk) << " GB/s, decoding each character "
+            << best_gbps(ascii, decode_each) << " GB/s" << std::endl;
+    ctx.out << "non-ASCII  in bulk " << best_gbps(unicode, bulk) << " GB/s, decoding each character "
+            << best_gbps(unicode, decode_each) << " GB/s" << std::endl;
+
+    double check_ms = ascii.size() / best_gbps(ascii, bulk) / 1e6;
+    double ascii_ms = parse_ms(ascii);
+    double unicode_ms = parse_ms(unicode);
+    ctx.out << "parse      ASCII " << ascii_ms << " ms (checking it " << check_ms * 100 / ascii_ms << "%), non-ASCII "
+            << unicode_ms << " ms" << std::endl;
+    if (ParseModule(ascii, "generated.kn").items.size() != ParseModule(unicode, "generated.kn").items.size())
+        ctx.out << "the two modules parse to different numbers of items" << std::endl;
+}
@@ -0,0 +1,207 @@
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "Bench.hpp"
+#include "SourceGen.hpp"
+
+#include "Knife/Parse.hpp"
+#include "Knife/Walk.hpp"
+
+using namespace Syntax;
+
+namespace
+{
+
+// Recursive boost::static_visitor walk, children taken by reference.
+struct CountingVisitor : boost::static_visitor<std::size_t>
+{
+    std::size_t operator()(Stmt const& t) const { return boost::apply_visitor(*this, t); }
+    std::size_t operator()(Expr const& t) const { return boost::apply_visitor(*this, t); }
+
+    std::size_t operator()(TupleExpr const& t) const
+    {
+        std::size_t n = 1;
+        for (auto const& e : t.elements)
+            n += (*this)(e);
+        return n;
+    }
+
+    std::size_t operator()(LabelExpr const& t) const
+    {
+        std::size_t n = 1;
+        if (t.type)
+            n += (*this)(*t.type);
+        if (t.term)
+            n += (*this)(t.term->value);
+        return n;
+    }
+
+    std::size_t operator()(BracesBlock const& t) const
+    {
+        std::size_t n = 1;
+        for (auto const& s : t.stmts)
+            n += (*this)(s);
+        return n;
+    }
+
+    std::size_t operator()(DefExpr const& t) const
+    {
+        std::size_t n = 1;
+        if (t.args)
+            for (auto const& e : t.args->elements)
+                n += (*this)(e);
+        return n + (*this)(t.code);
+    }
+
+    std::size_t operator()(Invocation const& t) const
+    {
+        std::size_t n = 1;
+        if (t.args)
+            for (auto const& e : t.args->elements)
+                n += (*this)(e);
+        if (t.postfix_lambda)
+            n += (*this)(*t.postfix_lambda);
+        if (t.next_call)
+            n += (*this)(t.next_call->get());
+        return n;
+    }
+
+    std::size_t operator()(Reassignment const& t) const { return 1 + (*this)(t.value); }
+    std::size_t operator()(Number const&) const { return 1; }
+    std::size_t operator()(QuotedString const&) const { return 1; }
+};
+
+// The same walk written the way the old SyntaxPrinter was: children copied
+// out of their containers by value.
+struct CopyingVisitor : boost::static_visitor<std::size_t>
+{
+    std::size_t operator()(Stmt const& t) const { return boost::apply_visitor(*this, t); }
+    std::size_t operator()(Expr const& t) const { return boost::apply_visitor(*this, t); }
+
+    std::size_t operator()(TupleExpr const& t) const
+    {
+        auto self = *this;
+        std::size_t n = 1;
+        for (auto e : t.elements)
+            n += self(e);
+        return n;
+    }
+
+    std::size_t operator()(LabelExpr const& t) const
+    {
+        auto self = *this;
+        std::size_t n = 1;
+        if (t.type)
+            n += self(Expr(*t.type));
+        if (t.term)
+            n += self(Expr(t.term->value));
+        return n;
+    }
+
+    std::size_t operator()(BracesBlock const& t) const
+    {
+        auto self = *this;
+        std::size_t n = 1;
+        for (auto s : t.stmts)
+            n += self(s);
+        return n;
+    }
+
+    std::size_t operator()(DefExpr const& t) const
+    {
+        auto self = *this;
+        std::size_t n = 1;
+        if (t.args)
+            for (auto e : t.args->elements)
+                n += self(e);
+        return n + self(BracesBlock(t.code));
+    }
+
+    std::size_t operator()(Invocation const& t) const
+    {
+        auto self = *this;
+        std::size_t n = 1;
+        if (t.args)
+            for (auto e : t.args->elements)
+                n += self(e);
+        if (t.postfix_lambda)
+            n += self(BracesBlock(*t.postfix_lambda));
+        if (t.next_call)
+            n += self(Invocation(t.next_call->get()));
+        return n;
+    }
+
+    std::size_t operator()(Reassignment const& t) const { return 1 + (*this)(Expr(t.value)); }
+    std::size_t operator()(Number const&) const { return 1; }
+    std::size_t operator()(QuotedString const&) const { return 1; }
+};
+
+struct CountingWalk
+{
+    std::size_t count = 0;
+
+    Visit enter(NodeRef) { ++count; return Visit::Continue; }
+    Visit leave(NodeRef) { return Visit::Continue; }
+};
+
+struct FindNumber
+{
+    std::string const& raw;
+    std::size_t seen;
+
+    Visit enter(NodeRef n)
+    {
+        ++seen;
+        if (n.tag == NodeTag::Number && n.as<Number>().raw == raw)
+            return Visit::Stop;
+        return Visit::Continue;
+    }
+
+    Visit leave(NodeRef) { return Visit::Continue; }
+};
+
+}
+
+// A full walk of a large module: recursive apply_visitor by reference, the
+// same with by-value copies (the old SyntaxPrinter idiom), and Syntax::walk.
+KNIFE_BENCHMARK(syntax_tree_walk)
+{
+    int lines = int(50000 * ctx.scale);
+    Module module = ParseModule(generate_module(lines), "generated.kn");
+    int const rounds = 5;
+
+    std::size_t visited = 0;
+    Bench::Stopwatch by_ref;
+    for (int r = 0; r < rounds; ++r)
+        for (auto const& item : module.items)
+            visited += CountingVisitor()(item.stmt);
+    double by_ref_ms = by_ref.elapsed_ms() / rounds;
+    std::size_t nodes = visited / rounds;
+
+    visited = 0;
+    Bench::Stopwatch by_value;
+    for (int r = 0; r < rounds; ++r)
+        for (auto const& item : module.items)
+            visited += CopyingVisitor()(item.stmt);
+    double by_value_ms = by_value.elapsed_ms() / rounds;
+    Bench::keep(visited);
+
+    CountingWalk counter;
+    Bench::Stopwatch tagged;
+    for (int r = 0; r < rounds; ++r)
+        walk(module, counter);
+    double tagged_ms = tagged.elapsed_ms() / rounds;
+
+    std::string target = "999";
+    FindNumber finder{target, 0};
+    Bench::Stopwatch early;
+    walk(module, finder);
+    double early_ms = early.elapsed_ms();
+
+    ctx.out << lines << " lines, " << nodes << " nodes (walker saw " << counter.count / rounds << ")" << std::endl
+            << "apply_visitor by reference: " << by_ref_ms << " ms" << std::endl
+            << "apply_visitor copying:      " << by_value_ms << " ms" << std::endl
+            << "Syntax::walk:               " << tagged_ms << " ms" << std::endl
+            << "Syntax::walk early exit:    " << early_ms << " ms after " << finder.seen << " nodes" << std::endl;
+}
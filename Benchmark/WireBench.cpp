@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <unistd.h>
+
+#include "Bench.hpp"
+
+#include "Knife/Parse.hpp"
+#include "Knife/Semantic.hpp"
+#include "Knife/Wire.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+char const* const particle_source =
+    "def Vec(T: type) { x: T; y: T; z: T }\n"
+    "def Particle(T: type) {\n"
+    "    id: Int\n"
+    "    pos: Vec(T)\n"
+    "    vel: Vec(T)\n"
+    "    mass: Float\n"
+    "    alive: Bool\n"
+    "    name: String\n"
+    "}\n"
+    "P := Particle(Double)\n";
+
+// The layout of P, as "knife --schema" derives it.
+bool particle_schema(Wire::Schema& schema)
+{
+    Syntax::Module module = ParseModule(particle_source, "particle.kn");
+    ModuleSpec spec(module);
+    spec.fold_constants();
+    IR const& ir = spec.get_ir();
+    for (NodeId item : spec.item_nodes())
+    {
+        Node const& label = ir.node(item);
+        if (label.kind != NodeKind::Label || !(label.flags & HasInit))
+            continue;
+        IR::Range kids = ir.children_of(item);
+        if (Constant const* type = spec.constant_value(kids[kids.size() - 1]))
+            return schema.derive(*type, ir.symbols);
+    }
+    return false;
+}
+
+struct Particle
+{
+    std::int64_t id;
+    double pos[3], vel[3];
+    float mass;
+    bool alive;
+    std::string name;
+};
+
+std::vector<Particle> make_particles(std::size_t n)
+{
+    std::vector<Particle> ps(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        Particle& p = ps[i];
+        p.id = std::int64_t(i) * 7919;
+        for (int k = 0; k < 3; ++k)
+        {
+            p.pos[k] = double(i) / (k + 3) - 1000.125;
+            p.vel[k] = 1.0 / (double(i % 97) + k + 1);
+        }
+        p.mass = float(i % 1000) * 0.25f;
+        p.alive = i % 3 != 0;
+        p.name = "p" + std::to_string(i);
+    }
+    return ps;
+}
+
+// What every decoder adds up, so they can be checked against each other.
+double checksum(std::int64_t id, double const* pos, double const* vel, float mass, bool alive, std::size_t name_size)
+{
+    return double(id % 1000) + pos[0] + pos[1] + pos[2] + vel[0] + vel[1] + vel[2] + mass + alive + name_size;
+}
+
+struct Indices
+{
+    std::size_t id, pos[3], vel[3], mass, alive, name;
+};
+
+Indices field_indices(Wire::Schema const& schema)
+{
+    Indices f;
+    f.id = schema.find("id");
+    f.mass = schema.find("mass");
+    f.alive = schema.find("alive");
+    f.name = schema.find("name");
+    for (int k = 0; k < 3; ++k)
+    {
+        std::string axis(1, "xyz"[k]);
+        f.pos[k] = schema.find("pos." + axis);
+        f.vel[k] = schema.find("vel." + axis);
+    }
+    return f;
+}
+
+void encode_binary(Wire::Schema const& schema, Indices const& f, std::vector<Particle> const& ps, std::string& out)
+{
+    out.clear();
+    Wire::Writer w(schema, out);
+    for (auto const& p : ps)
+    {
+        w.begin();
+        w.set_int(f.id, p.id);
+        for (int k = 0; k < 3; ++k)
+        {
+            w.set_double(f.pos[k], p.pos[k]);
+            w.set_double(f.vel[k], p.vel[k]);
+        }
+        w.set_float(f.mass, p.mass);
+        w.set_bool(f.alive, p.alive);
+        w.set_string(f.name, p.name);
+        w.end();
+    }
+}
+
+double decode_binary(Wire::Schema const& schema, char const* data, std::size_t size)
+{
+    std::vector<Wire::Field> const& fields = schema.field_list();
+    Indices f = field_indices(schema);
+    Wire::Reader reader(schema, data, size);
+    Wire::Record r;
+    double sum = 0;
+    while (reader.next(r))
+    {
+        double pos[3], vel[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            pos[k] = r.get_double(fields[f.pos[k]]);
+            vel[k] = r.get_double(fields[f.vel[k]]);
+        }
+        sum += checksum(r.get_int(fields[f.id]), pos, vel, r.get_float(fields[f.mass]), r.get_bool(fields[f.alive]),
+                        r.get_string(fields[f.name]).size());
+    }
+    return reader.valid() ? sum : -1;
+}
+
+// The same records as text, one per line, the way they would be printed
+// as Knife tuples: id:17, pos:(x:..., y:..., z:...), ..., name:"p17".
+void encode_text(std::vector<Particle> const& ps, std::string& out)
+{
+    out.clear();
+    char line[512];
+    for (auto const& p : ps)
+    {
+        int n = std::snprintf(line, sizeof line,
+            "id:%lld, pos:(x:%.17g, y:%.17g, z:%.17g), vel:(x:%.17g, y:%.17g, z:%.17g), mass:%.9g, alive:%d, name:\"%s\"\n",
+            (long long)p.id, p.pos[0], p.pos[1], p.pos[2], p.vel[0], p.vel[1], p.vel[2], p.mass, int(p.alive),
+            p.name.c_str());
+        out.append(line, n);
+    }
+}
+
+// Just past the next colon.
+char const* after_colon(char const* at)
+{
+    while (*at != ':')
+        ++at;
+    return at + 1;
+}
+
+double decode_text(std::string const& text)
+{
+    double sum = 0;
+    char const* at = text.c_str();
+    char const* end = at + text.size();
+    while (at < end)
+    {
+        char* next;
+        std::int64_t id = std::strtoll(after_colon(at), &next, 10);
+        at = next;
+        double pos[3], vel[3];
+        for (double* v : { pos, vel })
+        {
+            at = after_colon(at);       // the tuple's label
+            for (int k = 0; k < 3; ++k)
+            {
+                v[k] = std::strtod(after_colon(at), &next);
+                at = next;
+            }
+        }
+        float mass = std::strtof(after_colon(at), &next);
+        bool alive = std::strtol(after_colon(next), &next, 10) != 0;
+        char const* name = after_colon(next) + 1;
+        at = name;
+        while (*at != '"')
+            ++at;
+        sum += checksum(id, pos, vel, mass, alive, at - name);
+        at += 2;
+    }
+    return sum;
+}
+
+template <typename Run>
+double best_ms(Run run)
+{
+    double best = 1e300;
+    for (int r = 0; r < 3; ++r)
+    {
+        Bench::Stopwatch time;
+        run();
+        best = std::min(best, time.elapsed_ms());
+    }
+    return best;
+}
+
+void report(Bench::Context& ctx, std::string const& what, double ms, std::size_t records, std::size_t bytes)
+{
+    ctx.out << what << std::string(what.size() < 28 ? 28 - what.size() : 1, ' ') << ms * 1e6 / records
+            << " ns per record, " << bytes / (ms * 1e3) << " MB/s" << std::endl;
+}
+
+}
+
+// Particles with an id, position and velocity vectors, mass, a flag and a
+// name, laid out by a schema folded from Knife source: encoding and
+// decoding them in the wire format (in memory and from a mapped file)
+// against printing them as text and parsing it back, and the generic path
+// through constants.  The decoders' checksums must agree.
+KNIFE_BENCHMARK(wire_format)
+{
+    Wire::Schema schema;
+    if (!particle_schema(schema))
+    {
+        ctx.out << "could not derive the particle schema" << std::endl;
+        return;
+    }
+    Indices f = field_indices(schema);
+
+    std::size_t const n = std::max(std::size_t(1000), std::size_t(200000 * ctx.scale));
+    std::vector<Particle> ps = make_particles(n);
+
+    std::string binary, text;
+    double ms = best_ms([&] { encode_binary(schema, f, ps, binary); });
+    report(ctx, "binary encode", ms, n, binary.size());
+    ms = best_ms([&] { encode_text(ps, text); });
+    report(ctx, "text encode", ms, n, text.size());
+    ctx.out << binary.size() / n << " bytes per record in binary, " << text.size() / n << " in text" << std::endl;
+
+    double binary_sum = 0, text_sum = 0, mapped_sum = 0;
+    ms = best_ms([&] { binary_sum = decode_binary(schema, binary.data(), binary.size()); });
+    report(ctx, "binary decode in place", ms, n, binary.size());
+    ms = best_ms([&] { text_sum = decode_text(text); });
+    report(ctx, "text decode", ms, n, text.size());
+
+    std::string path = "/tmp/knife-wire-bench-" + std::to_string(getpid()) + ".bin";
+    std::ofstream(path, std::ios::binary) << binary;
+    {
+        Wire::MappedFile file(path);
+        ms = best_ms([&] { mapped_sum = decode_binary(schema, file.data(), file.size()); });
+        report(ctx, "binary decode, mapped file", ms, n, file.size());
+    }
+    std::remove(path.c_str());
+
+    if (binary_sum != text_sum || binary_sum != mapped_sum)
+        ctx.out << "the decoders disagree: " << binary_sum << ", " << text_sum << ", " << mapped_sum << std::endl;
+
+    // The generic path: whole records as constant tuples.
+    std::size_t const generic = std::min(n, std::size_t(20000));
+    std::vector<Constant> tuples;
+    Wire::Reader reader(schema, binary.data(), binary.size());
+    Wire::Record r;
+    while (tuples.size() < generic && reader.next(r))
+        tuples.push_back(r.to_constant(schema));
+    ms = best_ms([&] {
+        Wire::Reader again(schema, binary.data(), binary.size());
+        std::size_t count = 0;
+        while (count < generic && again.next(r))
+        {
+            Bench::keep(r.to_constant(schema));
+            ++count;
+        }
+    });
+    report(ctx, "to_constant", ms, generic, binary.size() / n * generic);
+
+    std::string rewritten;
+    ms = best_ms([&] {
+        rewritten.clear();
+        Wire::Writer w(schema, rewritten);
+        for (auto const& tuple : tuples)
+            if (!w.write(tuple))
+                return;
+    });
+    report(ctx, "write from constants", ms, generic, rewritten.size());
+    if (rewritten.compare(0, rewritten.size(), binary, 0, rewritten.size()) != 0)
+        ctx.out << "records written from constants differ from the originals" << std::endl;
+}
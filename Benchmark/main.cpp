@@ -0,0 +1,51 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+using namespace std;
+
+#include "Bench.hpp"
+
+std::vector<Bench::Case>& Bench::registry()
+{
+    static std::vector<Bench::Case> cases;
+    return cases;
+}
+
+// Usage: Benchmark [--scale factor] [name-substring...]
+int main(int argc, char* argv[])
+{
+    Bench::Context ctx{std::cout, 1.0};
+    std::vector<std::string> filters;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+            ctx.scale = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--list") == 0)
+        {
+            for (auto const& c : Bench::registry())
+                std::cout << c.name << std::endl;
+            return 0;
+        }
+        else
+            filters.push_back(argv[i]);
+    }
+
+    for (auto const& c : Bench::registry())
+    {
+        bool selected = filters.empty();
+        for (auto const& f : filters)
+            if (std::string(c.name).find(f) != std::string::npos)
+                selected = true;
+
+        if (!selected)
+            continue;
+
+        std::cout << "== " << c.name << std::endl;
+        c.run(ctx);
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "Knife/Daemon.hpp"
+
+// A thin client for a compiler started with "Compiler --daemon": it links
+// none of the compiler, so starting it costs little more than a process.
+//
+// Usage:
+//   knifec [--socket path] compiler arguments...
+//   knifec [--socket path] --daemon-stop
+int main(int argc, char* argv[])
+{
+    std::string socket_path = Daemon::default_socket_path();
+    int first = 1;
+    if (argc > 2 && std::strcmp(argv[1], "--socket") == 0)
+    {
+        socket_path = argv[2];
+        first = 3;
+    }
+
+    int status = Daemon::forward(socket_path, argc - first, argv + first);
+    if (status < 0)
+    {
+        std::cerr << "knifec: no compiler daemon on " << socket_path
+                  << " (start one with: Compiler --daemon " << socket_path << ")" << std::endl;
+        return 2;
+    }
+    return status;
+}
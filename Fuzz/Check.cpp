@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Check.hpp"
+
+#include "Knife/Codegen.hpp"
+#include "Knife/Format.hpp"
+#include "Knife/Interface.hpp"
+#include "Knife/Parse.hpp"
+#include "Knife/Semantic.hpp"
+#include "Knife/Walk.hpp"
+
+using namespace Syntax;
+
+namespace
+{
+
+// The parser and codegen report every error on cout or cerr, and a fuzzer
+// makes millions of them.
+class Quiet
+{
+private:
+    struct Discard : std::streambuf
+    {
+        int overflow(int c) override
+        {
+            return traits_type::not_eof(c);
+        }
+    };
+
+    Discard discard;
+    std::streambuf* out;
+    std::streambuf* err;
+
+public:
+    Quiet()
+        : out(std::cout.rdbuf(&discard)), err(std::cerr.rdbuf(&discard))
+    {
+    }
+
+    ~Quiet()
+    {
+        std::cout.rdbuf(out);
+        std::cerr.rdbuf(err);
+    }
+};
+
+// The diff functions return true if the trees differ, having added where
+// to the trail, innermost first.
+typedef std::vector<std::string> Trail;
+
+bool differ(Trail& trail, std::string const& where)
+{
+    trail.push_back(where);
+    return true;
+}
+
+bool diff_expr(Expr const& a, Expr const& b, Trail& trail);
+bool diff_stmt(Stmt const& a, Stmt const& b, Trail& trail);
+
+bool diff_text(std::string const& a, std::string const& b, char const* what, Trail& trail)
+{
+    return a != b && differ(trail, std::string(what) + " \"" + a + "\" vs \"" + b + '"');
+}
+
+bool diff_name(boost::optional<Ident> const& a, boost::optional<Ident> const& b, Trail& trail)
+{
+    return diff_text(a ? a->value : "", b ? b->value : "", "name", trail);
+}
+
+bool diff_exprs(std::vector<Expr> const& a, std::vector<Expr> const& b, char const* what, Trail& trail)
+{
+    if (a.size() != b.size())
+        return differ(trail, std::to_string(a.size()) + " vs " + std::to_string(b.size()) + ' ' + what + 's');
+    for (std::size_t i = 0; i < a.size(); ++i)
+        if (diff_expr(a[i], b[i], trail))
+            return differ(trail, std::string(what) + ' ' + std::to_string(i));
+    return false;
+}
+
+bool diff_tuple(boost::optional<TupleExpr> const& a, boost::optional<TupleExpr> const& b, char const* what, Trail& trail)
+{
+    if (bool(a) != bool(b))
+        return differ(trail, std::string(a ? "no " : "extra ") + what + " list");
+    return a && diff_exprs(a->elements, b->elements, what, trail);
+}
+
+bool diff_block(BracesBlock const& a, BracesBlock const& b, Trail& trail)
+{
+    if (a.stmts.size() != b.stmts.size())
+        return differ(trail, std::to_string(a.stmts.size()) + " vs " + std::to_string(b.stmts.size()) + " stmts");
+    for (std::size_t i = 0; i < a.stmts.size(); ++i)
+        if (diff_stmt(a.stmts[i], b.stmts[i], trail))
+            return differ(trail, "stmt " + std::to_string(i));
+    return false;
+}
+
+bool diff_optional_expr(boost::optional<Expr> const& a, boost::optional<Expr> const& b, char const* what, Trail& trail)
+{
+    if (bool(a) != bool(b))
+        return differ(trail, std::string(a ? "no " : "extra ") + what);
+    return a && diff_expr(*a, *b, trail) && differ(trail, what);
+}
+
+bool diff_invocation(Invocation const& a, Invocation const& b, Trail& trail)
+{
+    if (diff_text(a.name.value, b.name.value, "call", trail))
+        return true;
+    if (diff_tuple(a.args, b.args, "arg", trail)
+        || (bool(a.postfix_lambda) != bool(b.postfix_lambda) && differ(trail, "block after the call"))
+        || (a.postfix_lambda && diff_block(*a.postfix_lambda, *b.postfix_lambda, trail) && differ(trail, "block"))
+        || (bool(a.next_call) != bool(b.next_call) && differ(trail, "next call")))
+        return differ(trail, "call " + a.name.value);
+    return a.next_call && diff_invocation(a.next_call->get(), b.next_call->get(), trail);
+}
+
+bool diff_expr(Expr const& a, Expr const& b, Trail& trail)
+{
+    NodeRef x = node_ref(a);
+    NodeRef y = node_ref(b);
+    if (x.tag != y.tag)
+        return differ(trail, "node kind " + std::to_string(int(x.tag)) + " vs " + std::to_string(int(y.tag)));
+
+    switch (x.tag)
+    {
+    case NodeTag::Tuple:
+        return diff_exprs(x.as<TupleExpr>().elements, y.as<TupleExpr>().elements, "element", trail);
+
+    case NodeTag::Label:
+    {
+        LabelExpr const& p = x.as<LabelExpr>();
+        LabelExpr const& q = y.as<LabelExpr>();
+        if (diff_name(p.name, q.name, trail)
+            || diff_optional_expr(p.type, q.type, "type", trail)
+            || (bool(p.term) != bool(q.term) && differ(trail, p.term ? "no value" : "extra value"))
+            || (p.term && diff_expr(p.term->value, q.term->value, trail) && differ(trail, "value")))
+            return differ(trail, "label " + (p.name ? p.name->value : std::string()));
+        return false;
+    }
+
+    case NodeTag::Block:
+        return diff_block(x.as<BracesBlock>(), y.as<BracesBlock>(), trail);
+
+    case NodeTag::Def:
+    {
+        DefExpr const& p = x.as<DefExpr>();
+        DefExpr const& q = y.as<DefExpr>();
+        if (diff_name(p.name, q.name, trail)
+            || diff_tuple(p.args, q.args, "param", trail)
+            || diff_block(p.code, q.code, trail))
+            return differ(trail, "def " + (p.name ? p.name->value : std::string()));
+        return false;
+    }
+
+    case NodeTag::Invocation:
+        return diff_invocation(x.as<Invocation>(), y.as<Invocation>(), trail);
+
+    case NodeTag::Number:
+        return diff_text(x.as<Number>().raw, y.as<Number>().raw, "number", trail);
+
+    case NodeTag::String:
+        return diff_text(x.as<QuotedString>().raw, y.as<QuotedString>().raw, "string", trail);
+
+    case NodeTag::Reassignment:
+        break;
+    }
+    return false;
+}
+
+bool diff_stmt(Stmt const& a, Stmt const& b, Trail& trail)
+{
+    Reassignment const* p = boost::get<Reassignment>(&a);
+    Reassignment const* q = boost::get<Reassignment>(&b);
+    if (bool(p) != bool(q))
+        return differ(trail, p ? "reassignment vs expression" : "expression vs reassignment");
+    if (!p)
+        return diff_expr(boost::get<Expr>(a), boost::get<Expr>(b), trail);
+    if (diff_text(p->name.value, q->name.value, "reassigned", trail))
+        return true;
+    return diff_expr(p->value, q->value, trail) && differ(trail, "reassignment of " + p->name.value);
+}
+
+std::string describe(Trail const& trail)
+{
+    std::string where;
+    for (std::size_t i = trail.size(); i-- > 0;)
+    {
+        where += trail[i];
+        if (i != 0)
+            where += " / ";
+    }
+    return where;
+}
+
+}
+
+std::string Fuzz::first_difference(Module const& expected, Module const& actual)
+{
+    if (expected.items.size() != actual.items.size())
+        return std::to_string(expected.items.size()) + " vs " + std::to_string(actual.items.size()) + " items";
+
+    Trail trail;
+    for (std::size_t i = 0; i < expected.items.size(); ++i)
+        if (diff_stmt(expected.items[i].stmt, actual.items[i].stmt, trail))
+        {
+            trail.push_back("item " + std::to_string(i));
+            return describe(trail);
+        }
+    return "";
+}
+
+Fuzz::ParseCheck Fuzz::check_parse(std::string const& source, ModuleParser const& alternative)
+{
+    ParseCheck result;
+    result.accepted = false;
+    result.complete = false;
+    Quiet quiet;
+
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        result.module = ParseModule(source, "fuzz.kn");
+        result.accepted = true;
+    }
+    catch (std::exception const&)
+    {
+    }
+    result.parse_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    if (!result.accepted)
+        return result;
+    if (!(result.complete = parsed_completely(result.module)))
+    {
+        // The formatter must leave such a file alone rather than reprint
+        // only the parts ParseModule kept.
+        std::string formatted;
+        if (format_source(source, "fuzz.kn", formatted))
+            result.problem = "format_source rewrote a file ParseModule did not parse completely";
+        return result;
+    }
+    Module const& module = result.module;
+
+    for (std::size_t i = 0; i < module.items.size(); ++i)
+    {
+        Trail trail;
+        try
+        {
+            Stmt again = ParseItem(module.source, module.items[i].span);
+            if (diff_stmt(module.items[i].stmt, again, trail))
+            {
+                result.problem = "ParseItem: item " + std::to_string(i) + " / " + describe(trail);
+                return result;
+            }
+        }
+        catch (std::exception const&)
+        {
+            result.problem = "ParseItem: item " + std::to_string(i) + " does not parse again from its span";
+            return result;
+        }
+    }
+
+    std::string printed, reprinted;
+    SyntaxPrinter(printed).print(module);
+    try
+    {
+        Module reparsed = ParseModule(printed, "printed.kn");
+        std::string difference = first_difference(module, reparsed);
+        if (!parsed_completely(reparsed))
+            result.problem = "printer: its output does not parse completely";
+        else if (!difference.empty())
+            result.problem = "printer: " + difference;
+        else
+        {
+            SyntaxPrinter(reprinted).print(reparsed);
+            if (reprinted != printed)
+                result.problem = "printer: printing the reprinted module changes it";
+        }
+    }
+    catch (std::exception const&)
+    {
+        result.problem = "printer: its output does not parse";
+    }
+    if (!result.problem.empty() || !alternative)
+        return result;
+
+    try
+    {
+        std::string difference = first_difference(module, alternative(source));
+        if (!difference.empty())
+            result.problem = "alternative parser: " + difference;
+    }
+    catch (std::exception const&)
+    {
+        result.problem = "alternative parser: rejects what ParseModule accepts";
+    }
+    return result;
+}
+
+namespace
+{
+
+std::string compile_and_verify(Semantic::IR const& ir, std::vector<Semantic::NodeId> const& items,
+    std::string const& file_name)
+{
+    llvm::LLVMContext context;
+    Semantic::CodegenOptions options;
+    options.probes = false;
+    options.debug_info = false;
+    Semantic::Codegen codegen(ir, context, "fuzz", file_name, options);
+    codegen.emit(items);
+    if (codegen.invalid_functions() != 0)
+        return "codegen: " + std::to_string(codegen.invalid_functions()) + " functions did not verify";
+
+    std::unique_ptr<llvm::Module> compiled = codegen.take_module();
+    if (llvm::verifyModule(*compiled, &llvm::errs()))
+        return "codegen: the module does not verify";
+    Semantic::optimize(*compiled, 2);
+    if (llvm::verifyModule(*compiled, &llvm::errs()))
+        return "codegen: the module does not verify after optimizing";
+    return "";
+}
+
+}
+
+std::string Fuzz::check_codegen(Module const& module)
+{
+    Quiet quiet;
+    Semantic::ModuleSpec spec(module);
+    spec.fold_constants();
+    return compile_and_verify(spec.get_ir(), spec.item_nodes(), module.file_name);
+}
+
+std::string Fuzz::check_interface(std::string const& bytes)
+{
+    Quiet quiet;
+    auto loaded = std::make_shared<Semantic::Interface>();
+    if (!loaded->read(bytes.data(), bytes.size()))
+        return "";
+
+    Semantic::ModuleSpec spec(Module(), std::vector<std::shared_ptr<Semantic::Interface const>>(1, loaded));
+    spec.fold_constants();
+    return compile_and_verify(loaded->get_ir(), loaded->item_nodes(), loaded->file_name());
+}
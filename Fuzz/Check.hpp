@@ -0,0 +1,49 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "Knife/Module.hpp"
+
+// The checks the fuzz targets run on each input.  ParseModule is the
+// reference parser; everything else that produces syntax trees (reparsing
+// one item from its span, the printer's output parsed back, and any
+// faster parser meant to replace the grammar) must give identical trees
+// wherever the reference accepts the input.
+namespace Fuzz
+{
+
+// A parser to hold to the reference: it may throw to reject an input.
+typedef std::function<Syntax::Module (std::string const& source)> ModuleParser;
+
+struct ParseCheck
+{
+    bool accepted;          // ParseModule did not throw
+    bool complete;          // and every byte outside its items is a separator
+    double parse_ns;        // how long ParseModule took
+    std::string problem;    // empty unless a check failed
+    Syntax::Module module;
+};
+
+// Parses the source and, if it is accepted completely, compares every
+// other parse of it with the reference and checks that printing it twice
+// gives the same text; if it is accepted only in part, checks that the
+// formatter refuses it.
+ParseCheck check_parse(std::string const& source, ModuleParser const& alternative = ModuleParser());
+
+// Lowers, folds constants in, compiles and optimizes the module.  Defs
+// codegen rejects are fine; code LLVM's verifier rejects is not.  Returns
+// the problem, or an empty string.
+std::string check_codegen(Syntax::Module const& module);
+
+// Reads the bytes as an interface file, which must either be rejected or
+// import, fold and compile as check_codegen's modules do: interfaces come
+// from disk, so the IR in them is no more trusted than source text.
+// Returns the problem, or an empty string.
+std::string check_interface(std::string const& bytes);
+
+// Empty if the trees are identical (statement offsets aside); otherwise
+// where they first differ, as in "item 2 / def f / stmt 3 / args 1".
+std::string first_difference(Syntax::Module const& expected, Syntax::Module const& actual);
+
+}
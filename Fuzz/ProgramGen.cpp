@@ -0,0 +1,334 @@
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ProgramGen.hpp"
+
+namespace
+{
+
+char const* const operators[] = { "+", "-", "*", "/", "<", ">", "<=", ">=", "==", "!=" };
+
+int const max_depth = 4;
+
+struct Def
+{
+    std::string name;
+    unsigned arity;
+};
+
+// What a statement can refer to: labels holding numbers (and parameters),
+// arrays, and labels holding tasks.
+struct Scope
+{
+    std::vector<std::string> numbers;
+    std::vector<std::string> arrays;
+    std::vector<std::string> tasks;
+};
+
+struct Writer
+{
+    Choices& c;
+    std::string out;
+    std::vector<Def> defs;
+    unsigned names;
+
+    explicit Writer(Choices& c)
+        : c(c), names(0)
+    {
+    }
+
+    // Some names take a letter from outside ASCII, in two, three and four
+    // bytes of UTF-8.
+    std::string fresh(char const* prefix)
+    {
+        static char const* const letters[] = { "", "\xCE\xBB", "\xE5\x90\x8D", "\xF0\x9D\x91\xA5" };
+        unsigned n = names++;
+        return prefix + std::string(letters[n % 4]) + std::to_string(n);
+    }
+
+    std::string const& pick(std::vector<std::string> const& from)
+    {
+        return from[c.next(from.size())];
+    }
+
+    void newline(int depth)
+    {
+        out += '\n';
+        out.append(depth * 4, ' ');
+    }
+
+    void call(Scope const& scope, int depth)
+    {
+        Def const& d = defs[c.next(defs.size())];
+        out += d.name;
+        out += '(';
+        for (unsigned i = 0; i < d.arity; ++i)
+        {
+            if (i != 0)
+                out += ", ";
+            expr(scope, depth + 1);
+        }
+        out += ')';
+    }
+
+    void expr(Scope const& scope, int depth)
+    {
+        switch (c.next(depth < max_depth ? 7 : 2))
+        {
+        case 0:
+            out += std::to_string(c.next(100));
+            break;
+        case 1:
+            out += scope.numbers.empty() ? std::string("1") : pick(scope.numbers);
+            break;
+        case 2:
+        case 3:
+            expr(scope, depth + 1);
+            out += ' ';
+            out += operators[c.next(10)];
+            out += c.next(8) == 0 ? "\n" : " ";
+            expr(scope, depth + 1);
+            break;
+        case 4:
+            out += '(';
+            expr(scope, depth + 1);
+            out += ')';
+            break;
+        case 5:
+            if (defs.empty())
+                out += '0';
+            else
+                call(scope, depth);
+            break;
+        case 6:
+            if (scope.arrays.empty())
+                out += '2';
+            else if (c.next(2) == 0)
+                out += "length(" + pick(scope.arrays) + ")";
+            else
+            {
+                out += "at(" + pick(scope.arrays) + ", ";
+                expr(scope, depth + 1);
+                out += ')';
+            }
+            break;
+        }
+    }
+
+    // "{ ... }" with the given number of statements, or "{ expr }".
+    void block(Scope scope, int depth, unsigned stmts)
+    {
+        if (stmts == 1 && c.next(3) == 0)
+        {
+            out += "{ ";
+            expr(scope, depth + 1);
+            out += " }";
+            return;
+        }
+
+        out += '{';
+        for (unsigned i = 0; i < stmts; ++i)
+        {
+            if (i != 0 && c.next(6) == 0)
+                out += "; ";
+            else
+                newline(depth + 1);
+            stmt(scope, depth + 1);
+        }
+        newline(depth);
+        out += '}';
+    }
+
+    void stmt(Scope& scope, int depth)
+    {
+        bool nested = depth < max_depth;
+        switch (c.next(10))
+        {
+        case 0:
+        {
+            std::string name = fresh("v");
+            out += name + " := ";
+            expr(scope, depth);
+            scope.numbers.push_back(name);
+            break;
+        }
+        case 1:
+            if (scope.numbers.empty())
+                out += "return(0)";
+            else
+            {
+                out += pick(scope.numbers) + " = ";
+                expr(scope, depth);
+            }
+            break;
+        case 2:
+            if (defs.empty())
+                out += "0";
+            else
+                call(scope, depth);
+            break;
+        case 3:
+            if (!nested)
+            {
+                out += '1';
+                break;
+            }
+            out += "if(";
+            expr(scope, depth);
+            out += ") ";
+            block(scope, depth, 1 + c.next(3));
+            if (c.next(2) == 0)
+            {
+                out += " else ";
+                block(scope, depth, 1 + c.next(3));
+            }
+            break;
+        case 4:
+        {
+            if (!nested)
+            {
+                out += '2';
+                break;
+            }
+            std::string counter = fresh("n");
+            out += counter + " := 0";
+            newline(depth);
+            out += "while(" + counter + " < " + std::to_string(c.next(10)) + ") {";
+            Scope inner = scope;
+            inner.numbers.push_back(counter);
+            for (unsigned i = c.next(3); i > 0; --i)
+            {
+                newline(depth + 1);
+                stmt(inner, depth + 1);
+            }
+            newline(depth + 1);
+            out += counter + " = " + counter + " + 1";
+            newline(depth);
+            out += '}';
+            scope.numbers.push_back(counter);
+            break;
+        }
+        case 5:
+        {
+            std::string array = fresh("a");
+            out += array + " := array(" + std::to_string(1 + c.next(70)) + ")";
+            scope.arrays.push_back(array);
+            Scope inner = scope;
+            inner.numbers.push_back("i");
+            switch (c.next(3))
+            {
+            case 0:
+                newline(depth);
+                out += "map(i:, " + array + ") ";
+                block(inner, depth, 1);
+                break;
+            case 1:
+            {
+                std::string total = fresh("s");
+                newline(depth);
+                out += total + " := sum(i:, " + pick(scope.arrays) + ", " + array + ") { at(" + array + ", i) }";
+                scope.numbers.push_back(total);
+                break;
+            }
+            case 2:
+                newline(depth);
+                out += "each(i:, " + array + ") { put(" + array + ", i, ";
+                expr(inner, depth + 1);
+                out += ") }";
+                break;
+            }
+            break;
+        }
+        case 6:
+        {
+            if (defs.empty())
+            {
+                out += '3';
+                break;
+            }
+            std::string task = fresh("t");
+            out += task + " := spawn(";
+            call(scope, depth);
+            out += ')';
+            scope.tasks.push_back(task);
+            break;
+        }
+        case 7:
+        {
+            if (scope.tasks.empty())
+            {
+                out += '4';
+                break;
+            }
+            std::string result = fresh("v");
+            out += result + " := await(" + pick(scope.tasks) + ")";
+            scope.numbers.push_back(result);
+            break;
+        }
+        case 8:
+        {
+            if (!nested)
+            {
+                out += '5';
+                break;
+            }
+            std::string name = fresh("g");
+            out += "def " + name + "(x) ";
+            Scope inner = scope;
+            inner.numbers.push_back("x");
+            block(inner, depth, 1 + c.next(2));
+            newline(depth);
+            std::string result = fresh("v");
+            out += result + " := " + name + "(";
+            expr(scope, depth);
+            out += ')';
+            scope.numbers.push_back(result);
+            break;
+        }
+        case 9:
+            out += "return(";
+            expr(scope, depth);
+            out += ')';
+            break;
+        }
+    }
+
+    void def()
+    {
+        Def d;
+        d.name = "f" + std::to_string(defs.size());
+        d.arity = c.next(4);
+
+        Scope scope;
+        out += "def " + d.name + "(";
+        for (unsigned i = 0; i < d.arity; ++i)
+        {
+            std::string param = "p" + std::to_string(i);
+            if (i != 0)
+                out += ", ";
+            out += param;
+            scope.numbers.push_back(param);
+        }
+        out += ") ";
+        block(scope, 0, 1 + c.next(6));
+        out += '\n';
+
+        // Calls in the body went to earlier defs only.
+        defs.push_back(d);
+    }
+};
+
+}
+
+std::string generate_program(Choices& choices)
+{
+    Writer w(choices);
+    for (unsigned n = 1 + choices.next(8); n > 0; --n)
+    {
+        w.def();
+        if (choices.next(2) == 0)
+            w.out += '\n';
+    }
+    return w.out;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Where the program generator's decisions come from: the fuzzer's input
+// bytes, so that mutating an input mutates the structure of the program
+// it stands for.  Once they run out every choice is 0, which the
+// generator takes as "the smallest option", so every input gives a
+// finite program.
+class Choices
+{
+private:
+    std::uint8_t const* data;
+    std::size_t size;
+    std::size_t used;
+
+public:
+    Choices(std::uint8_t const* data, std::size_t size)
+        : data(data), size(size), used(0)
+    {
+    }
+
+    // In [0, n).
+    unsigned next(unsigned n)
+    {
+        if (n <= 1 || used == size)
+            return 0;
+        return data[used++] % n;
+    }
+};
+
+// A module that parses completely: defs that call earlier ones with the
+// right number of arguments, labels, reassignments, operator expressions
+// (with parentheses, and broken across lines after an operator), if and
+// else, while, arrays walked by each, map and sum, spawn and await, and
+// nested defs, laid out with newlines or semicolons.  Names refer to
+// something in scope, so most defs also lower and compile.
+std::string generate_program(Choices& choices);
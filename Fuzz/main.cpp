@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Check.hpp"
+#include "ProgramGen.hpp"
+
+// Each input is checked twice: as source text, which the parser must
+// survive whatever it is, and as the choices for a generated program,
+// which must parse completely, match every other parse of it and compile
+// to code LLVM accepts.  Parse time per byte is tracked to catch inputs
+// that hit a slow path in the grammar.
+//
+// Built with clang's -fsanitize=fuzzer and -DKNIFE_LIBFUZZER, libFuzzer
+// drives LLVMFuzzerTestOneInput and keeps any input that fails (the check
+// aborts).  KNIFE_FUZZ_CLIFF=ns makes a parse slower than that many ns per
+// byte a failure too.  Otherwise main below drives it from a seed.
+namespace
+{
+
+// Inputs shorter than this are dominated by fixed costs.
+std::size_t const min_timed_bytes = 256;
+
+struct Session
+{
+    std::size_t inputs, accepted, complete, generated, compiled;
+    double worst_ns_per_byte;
+    std::string slowest;
+    double cliff;                   // ns per byte; 0 for none
+    std::vector<std::string> failures;
+    bool abort_on_failure;
+
+    Session()
+        : inputs(0), accepted(0), complete(0), generated(0), compiled(0), worst_ns_per_byte(0),
+          cliff(0), abort_on_failure(false)
+    {
+        if (char const* env = std::getenv("KNIFE_FUZZ_CLIFF"))
+            cliff = std::atof(env);
+    }
+};
+
+Session& session()
+{
+    static Session s;
+    return s;
+}
+
+void fail(Session& s, std::string const& problem, std::string const& source)
+{
+    std::cerr << "fuzz: " << problem << std::endl;
+    if (s.abort_on_failure)
+    {
+        std::cerr << source << std::endl;
+        std::abort();
+    }
+
+    std::string path = "fuzz-failure-" + std::to_string(s.failures.size()) + ".kn";
+    std::ofstream(path) << source;
+    std::cerr << "fuzz: input written to " << path << std::endl;
+    s.failures.push_back(problem);
+}
+
+void check(Session& s, std::string const& source, bool generated)
+{
+    ++s.inputs;
+    Fuzz::ParseCheck result = Fuzz::check_parse(source);
+    s.accepted += result.accepted;
+    s.complete += result.complete;
+    s.generated += generated;
+
+    if (!result.problem.empty())
+        return fail(s, result.problem, source);
+    if (generated && !result.complete)
+        return fail(s, result.accepted ? "a generated program did not parse completely"
+            : "a generated program was rejected", source);
+
+    if (source.size() >= min_timed_bytes)
+    {
+        // A slow parse is timed again before it counts, in case the
+        // thread was only preempted.
+        double ns_per_byte = result.parse_ns / source.size();
+        for (int again = 0; again < 2 && (ns_per_byte > s.worst_ns_per_byte || (s.cliff > 0 && ns_per_byte > s.cliff)); ++again)
+            ns_per_byte = std::min(ns_per_byte, Fuzz::check_parse(source).parse_ns / source.size());
+        if (ns_per_byte > s.worst_ns_per_byte)
+        {
+            s.worst_ns_per_byte = ns_per_byte;
+            s.slowest = source;
+            if (s.abort_on_failure)
+                std::cerr << "fuzz: slowest parse so far, " << ns_per_byte << " ns per byte over "
+                          << source.size() << " bytes" << std::endl;
+        }
+        if (s.cliff > 0 && ns_per_byte > s.cliff)
+            return fail(s, "parsing took " + std::to_string(ns_per_byte) + " ns per byte", source);
+    }
+
+    if (!result.complete)
+        return;
+    std::string problem = Fuzz::check_codegen(result.module);
+    if (!problem.empty())
+        return fail(s, problem, source);
+    ++s.compiled;
+}
+
+void check_input(Session& s, std::uint8_t const* data, std::size_t size)
+{
+    check(s, std::string(reinterpret_cast<char const*>(data), size), false);
+    Choices choices(data, size);
+    check(s, generate_program(choices), true);
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(std::uint8_t const* data, std::size_t size)
+{
+    Session& s = session();
+    s.abort_on_failure = true;
+    check_input(s, data, size);
+    return 0;
+}
+
+#ifndef KNIFE_LIBFUZZER
+
+namespace
+{
+
+// Turns a generated program into near misses: a few bytes replaced,
+// inserted or deleted, from the characters Knife's syntax is made of.
+std::string mutate(std::string source, unsigned& state)
+{
+    static char const alphabet[] = "(){},:;=+-*/<>!&|\"\n\t 0123456789abcdefxyz_";
+    auto next = [&state](unsigned n) {
+        state = state * 1103515245u + 12345u;
+        return (state >> 16) % n;
+    };
+
+    for (unsigned edits = 1 + next(4); edits > 0 && !source.empty(); --edits)
+    {
+        std::size_t at = next(source.size());
+        char c = alphabet[next(sizeof alphabet - 1)];
+        switch (next(3))
+        {
+        case 0: source[at] = c; break;
+        case 1: source.insert(source.begin() + at, c); break;
+        case 2: source.erase(source.begin() + at); break;
+        }
+    }
+    return source;
+}
+
+}
+
+// Usage: KnifeFuzz [--runs n] [--seed s] [--max-bytes n] [--cliff ns] [file...]
+// With files, checks each one as source text, or as an interface file if
+// its name ends in .kni.  Otherwise generates --runs
+// inputs of up to --max-bytes random bytes, each also checked after a few
+// random edits to its generated program.
+int main(int argc, char* argv[])
+{
+    Session& s = session();
+    long runs = 10000;
+    unsigned seed = 1;
+    std::size_t max_bytes = 512;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = std::atol(argv[++i]);
+        else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--max-bytes") == 0 && i + 1 < argc)
+            max_bytes = std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--cliff") == 0 && i + 1 < argc)
+            s.cliff = std::atof(argv[++i]);
+        else
+            files.push_back(argv[i]);
+    }
+
+    for (auto const& file : files)
+    {
+        std::ifstream in(file, std::ios::binary);
+        std::stringstream text;
+        text << in.rdbuf();
+        if (file.size() > 4 && file.compare(file.size() - 4, 4, ".kni") == 0)
+        {
+            ++s.inputs;
+            std::string problem = Fuzz::check_interface(text.str());
+            if (!problem.empty())
+                fail(s, problem, text.str());
+        }
+        else
+            check(s, text.str(), false);
+    }
+
+    unsigned state = seed;
+    std::vector<std::uint8_t> bytes;
+    for (long run = 0; files.empty() && run < runs; ++run)
+    {
+        state = state * 1103515245u + 12345u;
+        bytes.resize((state >> 16) % (max_bytes + 1));
+        for (auto& b : bytes)
+        {
+            state = state * 1103515245u + 12345u;
+            b = std::uint8_t(state >> 16);
+        }
+        check_input(s, bytes.data(), bytes.size());
+
+        Choices choices(bytes.data(), bytes.size());
+        check(s, mutate(generate_program(choices), state), false);
+    }
+
+    std::cout << s.inputs << " inputs, " << s.accepted << " accepted, " << s.complete << " parsed completely ("
+              << s.generated << " generated), " << s.compiled << " compiled" << std::endl;
+    if (!s.slowest.empty())
+    {
+        std::ofstream("fuzz-slowest.kn") << s.slowest;
+        std::cout << "slowest parse " << s.worst_ns_per_byte << " ns per byte over " << s.slowest.size()
+                  << " bytes, written to fuzz-slowest.kn" << std::endl;
+    }
+    std::cout << s.failures.size() << " failures" << std::endl;
+    return s.failures.empty() ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Knife/IR.hpp"
+
+// Ahead-of-time compilation of a module's defs to a native object file,
+// for linking into programs that carry no compiler.  Each emitted def is
+// an external function of its own name taking and returning doubles.
+//
+// With an entry def the object also defines what Runtime/Runtime.cpp's
+// main calls:
+//
+//     double knife_main(double const* args);     calls the entry def
+//     int knife_entry_arity;                     its number of parameters
+//
+// so that
+//
+//     Compiler --emit-obj prog.kn -o prog.o --entry start
+//     c++ prog.o libknife-runtime.a -o prog
+//
+// gives a program that calls start with its numeric arguments and prints
+// the result.
+//
+// Every object also carries its module summary (see Knife/Inline.hpp).  An
+// object compiled with others among its imports may call their defs by
+// name, and has the small ones inlined:
+//
+//     Compiler --emit-obj lib.kn -o lib.o
+//     Compiler --emit-obj prog.kn -o prog.o --import lib.o --entry start
+//     c++ prog.o lib.o libknife-runtime.a -o prog
+namespace Aot
+{
+
+struct Options
+{
+    int opt_level;
+    std::string entry;      // empty for a plain object
+    bool native;            // tune for this machine's CPU rather than the generic one for its triple
+    bool debug_info;
+    std::vector<std::string> imports;   // objects written by emit_object
+};
+
+// Returns false (reported on cerr) if the object could not be written or
+// the entry def was not emitted.
+bool emit_object(Semantic::IR const& ir, std::vector<Semantic::NodeId> const& items,
+    std::string const& file_name, std::string const& object_path, Options const& options);
+
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "Knife/IR.hpp"
+
+namespace llvm
+{
+class LLVMContext;
+class Module;
+class Function;
+class GlobalVariable;
+class TargetMachine;
+class DIBuilder;
+class DICompileUnit;
+class DIFile;
+}
+
+namespace Semantic
+{
+
+// A per-line probe site compiled into generated code.  Probe k of a module
+// tests byte k of the module's probe flag array before running the first
+// statement that starts on its line, and calls knife_probe_hit when the
+// byte is nonzero.
+struct ProbeSite
+{
+    DefId def;
+    std::uint32_t line;
+};
+
+struct CodegenOptions
+{
+    bool probes;
+    bool debug_info;    // DWARF line tables and frame pointers, for the profiler and native debuggers
+    unsigned max_specializations = 8;   // instantiations of a def besides its own (see ArrayStorage); 0 for none
+};
+
+// Parameters declared "a: Array" are arrays of numbers.  An array is passed
+// as two machine parameters, a pointer to its first element (aligned to
+// array_alignment) and its length as a 64-bit integer, so a def
+//
+//     def saxpy(alpha, x: Array, y: Array) { ... }
+//
+// is the C function double saxpy(double, double const*, int64_t, double*,
+// int64_t).  The pointers are declared noalias: arrays passed to one call
+// must not overlap unless the def only reads them.
+std::size_t const array_alignment = 32;
+
+// How an instantiation of a def takes an array argument.  Storage class is
+// a hidden aspect of a type argument (see "Type Aspects" in LanguageDoc.txt):
+// a def reads and writes an array the same way however it was passed, so
+// where a call passes arrays of known length, the def is instantiated
+// again for the cheapest way to pass them.
+enum class ArrayStorage : std::uint8_t
+{
+    Reference,      // a pointer and a length, as the def's own symbol takes it
+    Fixed,          // a pointer; the length is a constant of the instantiation
+    Value,          // the elements, as numbers in registers, of an array the def does not write
+};
+
+struct ArrayAspect
+{
+    ArrayStorage storage;
+    std::int64_t length;    // for Fixed and Value
+};
+
+inline bool operator==(ArrayAspect const& a, ArrayAspect const& b)
+{
+    return a.storage == b.storage && a.length == b.length;
+}
+
+// The longest array passed by value.
+std::int64_t const max_value_elements = 4;
+
+struct SpecializationStats
+{
+    std::size_t instances;      // instantiations made
+    std::size_t call_sites;     // calls that use one
+    std::size_t capped;         // calls left on the def's own symbol by the cap
+};
+
+// Generates LLVM IR for the top-level defs of a module.  Every value is a
+// double for now; the supported subset is numbers, labels, reassignment,
+// the builtin operators, calls between top-level defs, to the defs of
+// imported interfaces and to declared external defs, and the if/else,
+// while and return templates with literal blocks.  A def that uses
+// anything else is reported and left out of the module.
+//
+// Arrays are array parameters and labels made with
+//
+//     a := array(n)               n zeros, freed when the def returns
+//                                 (see Knife/Region.hpp)
+//
+// and are read and written with
+//
+//     length(a)
+//     at(a, i)                    element i; a bad index traps
+//     put(a, i, v)                stores v as element i; returns v
+//
+// and walked with loop templates over one or more arrays, which run their
+// block for each i below the shortest length:
+//
+//     each(i:, a, b) { ... }
+//     map(i:, y, x) { ... }       stores the block's value as y's element i
+//     sum(i:, a, b) { ... }       adds up the block's values, in any order
+//
+// These give the loop vectorizer what it needs: the trip count is known
+// before the loop, at and put of an array the loop walks at its own index
+// need no bounds check, and sum's additions may be reassociated.
+//
+// A call of a top-level def that takes only numbers can run as a task
+// (see Knife/Scheduler.hpp):
+//
+//     t := spawn(f(x, y))         starts f(x, y)
+//     await(t)                    waits for it and gives its result
+class Codegen
+{
+private:
+    friend class FunctionGen;
+
+    IR const& ir;
+    llvm::LLVMContext& context;
+    std::unique_ptr<llvm::Module> module;
+    CodegenOptions options;
+    std::string flags_name;
+
+    std::unique_ptr<llvm::DIBuilder> di;
+    llvm::DIFile* di_file;
+    llvm::DICompileUnit* di_unit;
+
+    std::unordered_map<DefId, llvm::Function*> functions;
+    std::unordered_map<DefId, llvm::Function*> imports;    // declarations of imported interfaces' defs
+    std::unordered_map<std::string, unsigned> externals;    // defs of other modules, by name, with their arity
+    std::unordered_map<llvm::Function*, llvm::Function*> task_entries;
+
+    struct Specialization
+    {
+        DefId def;
+        std::vector<ArrayAspect> aspects;   // one for each array parameter
+        llvm::Function* function;
+        std::uint32_t line;
+    };
+
+    std::vector<Specialization> specializations;    // emitted after the defs, in the order asked for
+    std::unordered_map<DefId, std::vector<bool>> written_arrays;
+    SpecializationStats spec_stats;
+    std::size_t invalid;    // functions LLVM's verifier rejected
+
+    // Aspects are for the array parameters; none for the def's own symbol.
+    llvm::Function* declare(DefId def, std::string const& name, std::vector<ArrayAspect> const* aspects);
+
+    // The declaration of a top-level def of an imported interface.
+    llvm::Function* declare_import(DefId def);
+
+    // The instantiation of the def declared by the node for the aspects,
+    // made if need be; null once the def has max_specializations.
+    llvm::Function* specialize(NodeId decl, std::vector<ArrayAspect> const& aspects);
+
+    // Whether the def may write the array it takes as the parameter:
+    // with put, as map's destination, or by passing it on to a def.
+    bool may_write(DefId def, std::uint32_t param);
+    std::vector<ProbeSite> probes;
+    llvm::GlobalVariable* pending_flags;    // stands in for the flag array until its size is known
+
+    void finish_probes();
+
+    // double f.task(double const* args), which calls f with the args, for
+    // the scheduler to run.
+    llvm::Function* task_entry(llvm::Function* f);
+
+public:
+    // The module name must be unique among loaded modules; the file name
+    // is the source the IR was lowered from, for debug info.
+    Codegen(IR const& ir, llvm::LLVMContext& context, std::string const& module_name,
+        std::string const& file_name, CodegenOptions options);
+    ~Codegen();
+
+    // Lets the module's defs call a def of another module by its name.
+    // Calls must pass every argument; defaults are not known here.
+    void declare_external(std::string const& name, unsigned arity);
+
+    // Emits every named def among the items.  Returns how many were emitted.
+    std::size_t emit(std::vector<NodeId> const& items);
+
+    // Null if the def was not emitted.
+    llvm::Function* function_of(DefId def) const;
+
+    std::vector<ProbeSite> const& probe_sites() const { return probes; }
+
+    SpecializationStats const& specialization_stats() const { return spec_stats; }
+
+    // Defs (and instantiations) whose generated code did not verify, and
+    // were dropped for it; always a bug in codegen.
+    std::size_t invalid_functions() const { return invalid; }
+
+    // The symbol of the module's probe flag array (one byte per probe site).
+    std::string const& probe_flags_name() const { return flags_name; }
+
+    std::unique_ptr<llvm::Module> take_module();
+};
+
+// Runs the standard optimization pipeline at level 0-3.  With a target
+// machine the passes can use its cost model (e.g. for vectorization).
+void optimize(llvm::Module& module, int level, llvm::TargetMachine* target = nullptr);
+
+}
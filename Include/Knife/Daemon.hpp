@@ -0,0 +1,35 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+// A long-running compiler behind a Unix socket.  A client sends its
+// working directory, its arguments and its stdin, stdout and stderr; the
+// server runs the command in that directory with those streams and
+// replies with the exit status.  Commands run one at a time in the server
+// process, so whatever it keeps between them (parsed modules, the grammar,
+// LLVM's target setup) stays warm.  Each end checks through SO_PEERCRED
+// that the other runs as the same user.
+namespace Daemon
+{
+
+typedef std::function<int(int argc, char* argv[])> Command;
+
+// The socket named by $KNIFE_DAEMON_SOCKET, else knife.sock in
+// $XDG_RUNTIME_DIR, else one in a directory only the user can enter,
+// /tmp/knife-<uid>, which is created if need be.  Empty if that directory
+// is not private to the user.
+std::string default_socket_path();
+
+// Serves until a client sends stop_argument or the process is signalled
+// to terminate.  argv[0] passed to the command is "Compiler".  Returns
+// false if the socket could not be set up.
+bool serve(std::string const& socket_path, Command const& command);
+
+// Runs the arguments on the server and returns their exit status, or -1
+// if no server is listening.
+int forward(std::string const& socket_path, int argc, char const* const argv[]);
+
+char const* const stop_argument = "--daemon-stop";
+
+}
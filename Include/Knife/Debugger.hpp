@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Knife/Codegen.hpp"
+
+extern "C"
+{
+
+// Called by generated code when the flag of a probe site is set.
+void knife_probe_hit(std::uint8_t* flag);
+
+// Every breakpoint hit ends up here.  A native debugger that stops on this
+// function can read the Knife location from its arguments.
+void knife_debugger_break_here(int breakpoint_number, char const* file_name, int line_number);
+
+}
+
+// Breakpoints by file and line, carried out by the probe sites of loaded
+// modules.  Setting a breakpoint arms the probes on its line; a module that
+// is loaded later is armed for the breakpoints already set.
+namespace Debugger
+{
+
+// The flags stay registered until the module is unregistered, which must
+// happen before they are freed.  Any number of loaded modules may come
+// from the same file, e.g. one per Jit that loaded it.
+void register_module(std::string const& file_name, std::uint8_t* flags, std::vector<Semantic::ProbeSite> const& sites);
+void unregister_module(std::uint8_t* flags);
+
+// Returns the breakpoint's number.
+int set_breakpoint(std::string const& file_name, int line_number);
+
+// Returns false if no breakpoint has that number.
+bool clear_breakpoint(int breakpoint_number);
+
+// Number of breakpoint hits since the program started.
+std::size_t hit_count();
+
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "Knife/IR.hpp"
+#include "Knife/Resolve.hpp"
+
+namespace Semantic
+{
+
+// A value known at compile time.
+struct Constant
+{
+    enum class Kind : std::uint8_t
+    {
+        Unknown,    // depends on run-time state or has side effects
+        Number,
+        String,
+        Type,       // a builtin type such as Int (name), or a tuple type (elements)
+        Tuple
+    };
+
+    Kind kind;
+    Symbol name;        // Type: the builtin type's name, or none for a tuple type
+    Symbol label;       // the label of a named tuple element or field, or none
+    double number;
+    std::string text;
+    std::vector<Constant> elements;
+
+    Constant()
+        : kind(Kind::Unknown), name(none), label(none), number(0)
+    {
+    }
+
+    static Constant of_number(double value);
+    static Constant of_string(std::string const& value);
+    static Constant of_type(Symbol name);
+
+    bool known() const { return kind != Kind::Unknown; }
+
+    bool operator==(Constant const& that) const;
+    bool operator!=(Constant const& that) const { return !(*this == that); }
+    std::size_t hash() const;
+
+    void dump(std::ostream& s, SymbolTable const& symbols) const;
+};
+
+struct FoldStats
+{
+    std::size_t nodes_folded;
+    std::size_t calls_evaluated;
+    std::size_t memo_hits;
+};
+
+// Evaluates IR at compile time: numeric and string literals, the builtin
+// arithmetic and comparison operators, immutable labels, and calls to defs
+// whose bodies are pure when every argument is constant.  A template that
+// returns a type, such as
+//
+//     def PairOf(T:type) { first:T; second:T }
+//
+// evaluates to a tuple type: a block whose statements are all typed labels
+// without initial values evaluates to the tuple of those fields.
+//
+// Results of def calls are memoized on (def, arguments), so a template used
+// with the same constant arguments throughout a module is evaluated once.
+class ConstEval
+{
+private:
+    struct CallKey
+    {
+        DefId def;
+        std::vector<Constant> args;
+
+        bool operator==(CallKey const& that) const { return def == that.def && args == that.args; }
+    };
+
+    struct CallKeyHash
+    {
+        std::size_t operator()(CallKey const& key) const;
+    };
+
+    enum class LabelState : std::uint8_t { Unvisited, InProgress, Done };
+
+    IR& ir;
+    std::vector<bool> reassigned;
+    std::vector<LabelState> label_state;
+    std::vector<Constant> label_value;
+    std::unordered_map<CallKey, Constant, CallKeyHash> memo;
+    std::unordered_map<NodeId, Constant> folded;
+    std::unordered_map<Symbol, int> builtin_ops;
+    std::vector<Symbol> builtin_types;
+    Symbol return_symbol;
+
+    // Frames of the def calls being evaluated, innermost last.
+    Frame<Constant>* frame;
+    std::size_t frame_count;
+    int call_depth;
+    FoldStats stats;
+
+    Constant eval_ref(Node const& n);
+    Constant eval_label(LabelId id);
+    Constant eval_op(int op, IR::Range args);
+    Constant eval_body(NodeId block, bool& returned);
+    void fold_walk(NodeId id, std::vector<NodeId>& order);
+
+public:
+    ConstEval(IR& ir);
+
+    // Evaluates an expression outside of any call: parameters are unknown.
+    Constant evaluate(NodeId id);
+
+    // Evaluates a call to a def with constant arguments.
+    Constant call(DefId def, std::vector<Constant> const& args);
+
+    // Replaces every foldable number or string expression under the roots
+    // with a literal node, and remembers type and tuple results so later
+    // passes can ask for them with folded_value.
+    FoldStats fold(std::vector<NodeId> const& roots);
+
+    Constant const* folded_value(NodeId id) const;
+};
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Knife/Syntax.hpp"
+#include "Knife/Module.hpp"
+
+// Writes syntax trees back out as Knife source, appending to one output
+// buffer in a single pass.  Blocks with more than one statement (or one
+// statement that is not a simple value) go on their own lines, indented
+// four spaces per level; everything else stays on one line.  The output
+// parses back to the same tree.
+class SyntaxPrinter
+{
+private:
+    std::string& out;
+
+    void newline(int depth);
+    void print_args(std::vector<Syntax::Expr> const& args, int depth);
+    void print_block(Syntax::BracesBlock const& block, int depth);
+    void print_operand(Syntax::Expr const& operand, int precedence, bool right, int depth);
+    void print_invocation(Syntax::Invocation const& call, int depth);
+    void print_expr(Syntax::Expr const& expr, int depth);
+
+public:
+    SyntaxPrinter(std::string& out)
+        : out(out)
+    {
+    }
+
+    void print(Syntax::Stmt const& stmt, int depth = 0);
+    void print(Syntax::Module const& module);
+};
+
+// Parses and reprints one file's source.  Returns false if it does not parse.
+bool format_source(std::string const& source, std::string const& file_name, std::string& formatted);
+
+struct FormatOptions
+{
+    bool check_only;    // report files that are not formatted instead of rewriting them
+    unsigned threads;   // 0 picks one per hardware thread
+};
+
+struct FormatReport
+{
+    std::size_t files;
+    std::size_t changed;
+    std::vector<std::string> failed;
+};
+
+// Formats every .kn file under the given files and directories, spreading
+// the files over a pool of threads.
+FormatReport format_paths(std::vector<std::string> const& paths, FormatOptions const& options);
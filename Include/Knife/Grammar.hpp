@@ -0,0 +1,143 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "Knife/Syntax.hpp"
+#include "Knife/Operators.hpp"
+
+#include "boost/spirit/include/qi.hpp"
+#include "boost/fusion/include/io.hpp"
+#include "boost/spirit/include/karma.hpp"
+
+#include "boost/spirit/include/phoenix_core.hpp"
+#include "boost/spirit/include/phoenix_operator.hpp"
+#include "boost/spirit/include/phoenix_object.hpp"
+#include "boost/spirit/include/phoenix_bind.hpp"
+
+namespace qi = boost::spirit::qi;
+namespace ascii = boost::spirit::ascii;
+
+struct printer
+{
+    typedef boost::spirit::utf8_string string;
+
+    void element(string const& tag, string const& value, int depth) const
+    {
+        for (int i = 0; i < (depth*4); ++i) // indent to depth
+            std::cout << ' ';
+
+        std::cout << "tag: " << tag;
+        if (value != "")
+            std::cout << ", value: " << value;
+        std::cout << std::endl;
+    }
+};
+
+inline void print_info(boost::spirit::info const& what)
+{
+    using boost::spirit::basic_info_walker;
+
+    printer pr;
+    basic_info_walker<printer> walker(pr, what.tag, 0);
+    boost::apply_visitor(walker, what.value);
+}
+
+template <typename Iterator>
+struct Skipper : qi::grammar<Iterator>
+{
+    Skipper() : Skipper::base_type(start)
+    {
+        start = +qi::char_(" \t");
+    }
+
+    qi::rule<Iterator> start;
+};
+
+// The start rule parses one top-level item of a module (a def, a label,
+// a reassignment or any other statement).  ParseModule drives it in a loop
+// so that it can record where each item begins and ends in the source.
+template <typename Iterator>
+struct LangParseGrammar : qi::grammar<Iterator, Syntax::Stmt(), Skipper<Iterator>>
+{
+    // Statement offsets in parsed blocks are measured from here.
+    Iterator source_begin;
+
+    void append_stmt(Syntax::BracesBlock& block, boost::iterator_range<Iterator> const& at, Syntax::Stmt& stmt) const
+    {
+        block.stmts.push_back(std::move(stmt));
+        block.offsets.push_back(std::uint32_t(at.begin() - source_begin));
+    }
+
+    LangParseGrammar() : LangParseGrammar::base_type(top_level_item)
+    {
+        // Character sets rather than qi::alpha and qi::alnum, which assert
+        // on bytes outside ASCII.  Any such byte is part of a name: the
+        // source has been checked to be UTF-8 (see Utf8.hpp), so they come
+        // as whole code points.
+        ident = qi::lexeme[qi::char_("a-zA-Z\x80-\xff") >> *qi::char_("a-zA-Z0-9_\x80-\xff")];
+        label = -ident >> qi::lit(":");
+        op_char = qi::char_("+*/%<>=!&|^~?@$") | qi::char_('-');
+        assign = qi::lexeme[qi::lit('=') >> !op_char];
+        operator_token = qi::lexeme[!(qi::lit('=') >> !op_char) >> +op_char];
+        def_name = ident | operator_token;
+        label_assignment = assign > expr;
+        label_expr = label >> -expr >> -label_assignment;
+        line_break = *(qi::lit('\n') | qi::lit('\r'));
+        expr_list = expr % (line_break >> qi::lit(",") >> line_break);
+        tuple_expr = expr_list;
+        paren_arg_list = qi::lit("(") > line_break > -expr_list > line_break > qi::lit(")");
+        braces_block = qi::lit("{") > stmt_list > qi::lit("}");
+        def_expr = qi::lit("def") > -def_name > -paren_arg_list > braces_block;
+        invocation = ident >> -paren_arg_list >> -braces_block >> -invocation;
+        number_str %= qi::lexeme[+qi::char_("0-9")];
+        number = number_str;
+        quoted_string = qi::lexeme[qi::lit('"') > *(qi::char_-'"') > '"'];
+        paren_expr %= qi::lit('(') > expr > ')';
+        reassignment = ident >> assign > expr;
+        stmt = reassignment | expr;
+        operand = paren_expr | braces_block | invocation | number | quoted_string;
+        operation = operator_token >> line_break >> operand;
+        operator_chain = operand >> *operation;
+        binary_expr = operator_chain[boost::phoenix::bind(&Syntax::fold_operators, qi::_1, qi::_val)];
+        expr = def_expr | label_expr | binary_expr;
+        separator = qi::lit('\n') | qi::lit('\r') | qi::lit(';');
+        stmt_position = qi::raw[qi::eps];
+        stmt_list = *separator
+            >> -((stmt_position >> stmt)[boost::phoenix::bind(&LangParseGrammar::append_stmt, this, qi::_val, qi::_1, qi::_2)] % +separator)
+            >> *separator;
+        top_level_item = stmt;
+    }
+
+    qi::rule<Iterator, std::string(), Skipper<Iterator>> dummy_str;
+    qi::rule<Iterator, std::string(), Skipper<Iterator>> ident;
+    qi::rule<Iterator, std::string(), Skipper<Iterator>> number_str;
+    qi::rule<Iterator, char()> op_char;
+    qi::rule<Iterator, Skipper<Iterator>> assign;
+    qi::rule<Iterator, std::string(), Skipper<Iterator>> operator_token;
+    qi::rule<Iterator, std::string(), Skipper<Iterator>> def_name;
+    qi::rule<Iterator, Syntax::Ident(), Skipper<Iterator>> label;
+    qi::rule<Iterator, Syntax::LabelAssignment(), Skipper<Iterator>> label_assignment;
+    qi::rule<Iterator, Syntax::LabelExpr(), Skipper<Iterator>> label_expr;
+    qi::rule<Iterator, Syntax::Expr(), Skipper<Iterator>> expr;
+    qi::rule<Iterator, Syntax::TupleExpr(), Skipper<Iterator>> tuple_expr;
+    qi::rule<Iterator, Syntax::DefExpr(), Skipper<Iterator>> def_expr;
+    qi::rule<Iterator, Syntax::TupleExpr(), Skipper<Iterator>> paren_arg_list;
+    qi::rule<Iterator, Syntax::BracesBlock(), Skipper<Iterator>> braces_block;
+    qi::rule<Iterator, Syntax::Number(), Skipper<Iterator>> number;
+    qi::rule<Iterator, Syntax::QuotedString(), Skipper<Iterator>> quoted_string;
+    qi::rule<Iterator, Syntax::Reassignment(), Skipper<Iterator>> reassignment;
+    qi::rule<Iterator, Syntax::Stmt(), Skipper<Iterator>> stmt;
+    qi::rule<Iterator, Skipper<Iterator>> separator;
+    qi::rule<Iterator, Skipper<Iterator>> line_break;
+    qi::rule<Iterator, boost::iterator_range<Iterator>(), Skipper<Iterator>> stmt_position;
+    qi::rule<Iterator, Syntax::BracesBlock(), Skipper<Iterator>> stmt_list;
+    qi::rule<Iterator, Syntax::Stmt(), Skipper<Iterator>> top_level_item;
+    qi::rule<Iterator, Syntax::Invocation(), Skipper<Iterator>> invocation;
+    qi::rule<Iterator, Syntax::Expr(), Skipper<Iterator>> paren_expr;
+    qi::rule<Iterator, Syntax::Expr(), Skipper<Iterator>> operand;
+    qi::rule<Iterator, Syntax::Operation(), Skipper<Iterator>> operation;
+    qi::rule<Iterator, Syntax::OperatorChain(), Skipper<Iterator>> operator_chain;
+    qi::rule<Iterator, Syntax::Expr(), Skipper<Iterator>> binary_expr;
+    qi::rule<Iterator, std::vector<Syntax::Expr>(), Skipper<Iterator>> expr_list;
+};
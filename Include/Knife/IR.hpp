@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace Semantic
+{
+
+typedef std::uint32_t Symbol;
+typedef std::uint32_t NodeId;
+typedef std::uint32_t LabelId;
+typedef std::uint32_t ScopeId;
+typedef std::uint32_t DefId;
+
+// Marks an absent symbol, node, label, scope or def.
+static const std::uint32_t none = ~std::uint32_t(0);
+
+// Interns identifier text so the IR compares and stores names as integers.
+class SymbolTable
+{
+private:
+    std::vector<std::string> names;
+    std::unordered_map<std::string, Symbol> ids;
+
+public:
+    Symbol intern(std::string const& name);
+    Symbol find(std::string const& name) const;    // none if never interned
+    std::string const& name(Symbol sym) const;
+    std::size_t size() const { return names.size(); }
+    std::size_t bytes_used() const;
+};
+
+enum class NodeKind : std::uint8_t
+{
+    Number,     // value: index into numbers
+    String,     // value: index into strings
+    Ref,        // use of a name; symbol: name, value: LabelId or none if free
+    Label,      // declaration; symbol: name (or none), value: LabelId, children: [type] [init]
+    Assign,     // reassignment; symbol: name, value: LabelId or none, children: [value]
+    Call,       // symbol: callee name, value: LabelId or none, children: args... [block]
+    Send,       // message to the result of the previous call; children: receiver, args... [block]
+    Tuple,      // children: elements
+    Block,      // closure; value: ScopeId, children: stmts
+    Def         // symbol: name (or none), value: DefId, children: [body block]
+};
+
+enum NodeFlags : std::uint8_t
+{
+    HasType = 1,    // Label: first child is the type
+    HasInit = 2,    // Label: last child is the initial value
+    HasArgs = 4,    // Call/Send: written with a parenthesized argument list
+    HasBlock = 8    // Call/Send: last child is a postfix block
+};
+
+// Depth of a use that does not refer to a label (a free name).
+static const std::uint16_t no_depth = 0xFFFF;
+
+// All nodes of a module live in one array and refer to their children
+// through a range of the shared children array, so walking a block is a
+// linear scan rather than a chase through individually allocated objects.
+//
+// Nodes that use or declare a label (Ref, Assign, Call, Label) also carry
+// the label's frame coordinate once resolve_slots has run: walk "depth"
+// frame links out from the innermost frame, then index "slot".
+struct Node
+{
+    NodeKind kind;
+    std::uint8_t flags;
+    std::uint16_t depth;
+    Symbol symbol;
+    std::uint32_t value;
+    std::uint32_t first_child;
+    std::uint32_t child_count;
+    std::uint32_t slot;
+};
+
+enum class LabelKind : std::uint8_t
+{
+    Local,
+    Param,
+    Def
+};
+
+struct Label
+{
+    Symbol name;
+    ScopeId scope;
+    std::uint32_t index_in_scope;
+    LabelKind kind;
+    NodeId decl;
+};
+
+// Every def and every braces block opens a scope.  Labels declared in a
+// scope are visible to nested scopes (closures) but not to the parent.
+//
+// Only scopes that declare labels get a run-time frame.  frame_depth is the
+// number of frames on the path from the module scope to this scope,
+// inclusive, and is filled in by resolve_slots.
+struct Scope
+{
+    ScopeId parent;
+    DefId owner;            // the def whose parameters live here, or none
+    std::uint32_t depth;    // 0 for the module scope
+    std::uint32_t label_count;
+    std::uint32_t frame_depth;
+};
+
+struct Param
+{
+    Symbol name;        // none for a positional pattern such as def f(5)
+    LabelId label;
+    NodeId type;        // none if untyped
+    NodeId default_value;
+};
+
+struct Def
+{
+    Symbol name;
+    ScopeId scope;
+    std::uint32_t first_param;
+    std::uint32_t param_count;
+    bool has_args;      // false for "def Egg { ... }", true for "def Egg() { ... }"
+    NodeId body;
+};
+
+class IR
+{
+private:
+    std::vector<Node> nodes;
+    std::vector<NodeId> children;
+    std::vector<double> numbers;
+    std::vector<std::string> strings;
+    std::vector<Label> labels;
+    std::vector<Scope> scopes;
+    std::vector<Param> params;
+    std::vector<Def> defs;
+
+    // Source line of each statement lowered from parsed text.
+    std::unordered_map<NodeId, std::uint32_t> lines;
+
+    void dump_node(std::ostream& s, NodeId id, int depth) const;
+
+public:
+    SymbolTable symbols;
+
+    struct Range
+    {
+        NodeId const* first;
+        NodeId const* last;
+        NodeId const* begin() const { return first; }
+        NodeId const* end() const { return last; }
+        std::size_t size() const { return last - first; }
+        NodeId operator[](std::size_t i) const { return first[i]; }
+    };
+
+    NodeId add_node(NodeKind kind, std::uint8_t flags, Symbol symbol, std::uint32_t value,
+        NodeId const* first_child = nullptr, std::size_t child_count = 0);
+    std::uint32_t add_number(double value);
+    std::uint32_t add_string(std::string const& value);
+    ScopeId add_scope(ScopeId parent, DefId owner);
+    LabelId add_label(Symbol name, ScopeId scope, LabelKind kind, NodeId decl);
+    DefId add_def(Symbol name, bool has_args);
+    void set_params(DefId def, std::vector<Param> const& list);
+    void set_line(NodeId id, std::uint32_t line) { lines[id] = line; }
+
+    Node const& node(NodeId id) const { return nodes[id]; }
+    Node& node(NodeId id) { return nodes[id]; }
+    Range children_of(NodeId id) const;
+    double number(std::uint32_t index) const { return numbers[index]; }
+    std::string const& string(std::uint32_t index) const { return strings[index]; }
+    Label const& label(LabelId id) const { return labels[id]; }
+    Label& label(LabelId id) { return labels[id]; }
+    Scope const& scope(ScopeId id) const { return scopes[id]; }
+    Scope& scope(ScopeId id) { return scopes[id]; }
+    Def const& def(DefId id) const { return defs[id]; }
+    Def& def(DefId id) { return defs[id]; }
+    Param const& param(DefId def, std::uint32_t index) const { return params[defs[def].first_param + index]; }
+    std::uint32_t line_of(NodeId id) const;     // 0 if the node is not a statement with a known line
+
+    std::size_t node_count() const { return nodes.size(); }
+    std::size_t label_count() const { return labels.size(); }
+    std::size_t scope_count() const { return scopes.size(); }
+    std::size_t def_count() const { return defs.size(); }
+
+    // Heap bytes held by the IR, including the symbol table.
+    std::size_t bytes_used() const;
+
+    void dump(std::ostream& s, NodeId id) const;
+
+    // Where the parts of an appended IR start in this one.
+    struct Offsets
+    {
+        NodeId nodes;
+        LabelId labels;
+        ScopeId scopes;
+        DefId defs;
+        std::vector<Symbol> symbols;    // this IR's symbol for each of the other's
+    };
+
+    // Copies another IR after this one's nodes, labels, scopes and defs,
+    // renumbering its references.  Its root scopes stay roots, and its
+    // resolved coordinates stay valid.
+    Offsets append(IR const& other);
+
+    // The IR as bytes (in the machine's byte order), for interface files,
+    // and back.  read fills an empty IR; it returns false, leaving at
+    // where it stopped, if the bytes run out or refer outside the IR.
+    void write(std::string& out) const;
+    bool read(char const*& at, char const* end);
+};
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace llvm
+{
+class Module;
+class TargetMachine;
+}
+
+namespace Semantic
+{
+
+// Defs up to this many LLVM instructions after optimization have their
+// bodies recorded for other modules to inline.
+std::size_t const max_inline_instructions = 32;
+
+// What other modules need to call a module's defs: a bitcode module that
+// declares each def, with the bodies of the small ones.  Bodies that use
+// the module's private globals are left out; external ones, such as its
+// probe flags, are declared.
+struct ModuleSummary
+{
+    std::string bitcode;
+};
+
+struct ExportedDef
+{
+    std::string name;
+    unsigned arity;
+    bool inlinable;
+};
+
+// From an optimized module; defs are the names of its Knife defs.
+ModuleSummary summarize(llvm::Module const& module, std::vector<std::string> const& defs);
+
+// The defs other modules can call: for now, those taking only numbers.
+std::vector<ExportedDef> exports_of(ModuleSummary const& summary);
+
+struct InlineStats
+{
+    std::size_t bodies_imported;
+    std::size_t call_sites;             // calls to other modules' defs before optimization
+    std::size_t call_sites_inlined;     // of those, the ones optimization removed
+};
+
+// Copies the bodies the module's external calls need out of the summaries,
+// as available_externally definitions: the optimizer may inline them, and
+// code generation drops them.  Then runs optimize at the level and fills
+// in the statistics.
+InlineStats optimize_with_imports(llvm::Module& module, std::vector<ModuleSummary> const& summaries,
+    int level, llvm::TargetMachine* target = nullptr);
+
+// Objects compiled ahead of time carry their summary in this section.
+char const* const summary_section = ".knife.summary";
+
+void embed_summary(llvm::Module& module, ModuleSummary const& summary);
+
+// False if the object cannot be read or has no summary.
+bool read_summary(std::string const& object_path, ModuleSummary& summary);
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Knife/Semantic.hpp"
+
+// A library's interface file: everything an importer needs from it,
+// produced once from its source so that importers neither reparse nor
+// reanalyse it.
+//
+//     Compiler --emit-interface lib.kn -o lib.kni
+//     Compiler --run --interface lib.kni prog.kn start
+//
+// The file holds the library's IR as lowered, resolved and constant
+// folded, its top-level items, and its exports: the top-level defs and
+// labels, by name.  Importing appends the IR to the importer's (see
+// ModuleSpec) and makes the exports visible in its module scope, under
+// any names of its own.  So a call of an imported template or type def
+// is evaluated from the body in the interface, as if the library had been
+// written above the importer; a call of an imported def that codegen can
+// compile is a call of the def's symbol, which the library's own JIT
+// module or object file defines (Compiler --emit-obj lib.kn -o lib.o).
+// Arrays are passed to imported defs as to local ones, and a def called
+// with arrays of known length is instantiated for them from its body.
+namespace Semantic
+{
+
+enum class ExportKind : std::uint8_t
+{
+    Def,        // compiled by the library; called by its symbol
+    Template,   // takes a type, or has no argument list: evaluated where it is used
+    Value       // a label, with its value if folding found one
+};
+
+struct Export
+{
+    std::string name;
+    ExportKind kind;
+    LabelId label;      // in the interface's IR
+    unsigned arity;     // Def and Template
+    Constant value;     // Value; symbols are the interface IR's
+};
+
+class Interface
+{
+private:
+    std::shared_ptr<IR const> ir;
+    std::string file;           // the library's source
+    std::uint64_t hash;         // of its text
+    std::vector<NodeId> items;
+    std::vector<Export> exported;
+
+public:
+    Interface();
+
+    // From a library module after fold_constants, and its source text.
+    Interface(ModuleSpec const& spec, std::string const& source);
+
+    IR const& get_ir() const { return *ir; }
+    std::string const& file_name() const { return file; }
+    std::uint64_t source_hash() const { return hash; }
+    std::vector<NodeId> const& item_nodes() const { return items; }
+    std::vector<Export> const& exports() const { return exported; }
+
+    void write(std::string& out) const;
+
+    // Fills an empty interface.  False if the bytes are not an interface
+    // file of this compiler's format or fail its checksum.
+    bool read(char const* data, std::size_t size);
+
+    // False, reported on cerr, if the file cannot be written.
+    bool save(std::string const& path) const;
+
+    void dump(std::ostream& s) const;
+};
+
+// FNV-1a, as interfaces record their source's.
+std::uint64_t hash_source(std::string const& text);
+
+// Null, reported on cerr, if the file cannot be read or is not an interface.
+std::shared_ptr<Interface const> load_interface(std::string const& path);
+
+}
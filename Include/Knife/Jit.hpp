@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Knife/IR.hpp"
+#include "Knife/Codegen.hpp"
+#include "Knife/Inline.hpp"
+
+namespace llvm
+{
+class JITEventListener;
+namespace orc
+{
+class LLJIT;
+}
+}
+
+// Compiles generated code in process with ORC.  The runtime hooks called by
+// generated code are bound explicitly, so the host executable does not have
+// to export its symbols.  Modules loaded later may call the defs of modules
+// loaded earlier by name, and with cross-module inlining the small ones are
+// inlined into them.
+class Jit
+{
+private:
+    std::unique_ptr<llvm::JITEventListener> listener;   // outlives the jit, which notifies it when freeing code
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+    std::unique_ptr<llvm::TargetMachine> target;
+    int opt_level;
+    int modules_loaded;
+    bool cross_module_inlining;
+    std::vector<Semantic::ModuleSummary> summaries;
+    std::unordered_map<std::string, unsigned> exported;     // def name to arity
+    std::vector<std::uint8_t*> probe_flags;                 // registered with the debugger
+    Semantic::InlineStats stats;
+
+public:
+    Jit(int opt_level = 2, bool cross_module_inlining = true);
+    ~Jit();
+
+    // Generates, optimizes and loads the named defs among the items, and
+    // registers their probe sites with the debugger (until the Jit is
+    // destroyed) and, with debug_info, their line tables with the profiler.
+    // Returns the number of defs loaded.
+    std::size_t load(Semantic::IR const& ir, std::vector<Semantic::NodeId> const& items,
+        std::string const& file_name, Semantic::CodegenOptions options);
+
+    // The address of a loaded def or global, or null.
+    void* lookup(std::string const& name);
+
+    // Totals over the modules loaded so far.
+    Semantic::InlineStats const& inline_stats() const { return stats; }
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "Knife/Syntax.hpp"
+
+namespace Syntax {
+
+// Where a top-level item lives in its module's source text.
+// Offsets are byte offsets into Module::source, [begin, end).
+// Lines are 1-based.
+struct SourceSpan
+{
+    std::size_t begin;
+    std::size_t end;
+    int first_line;
+    int last_line;
+};
+
+struct TopLevelItem
+{
+    std::string name;   // empty for anonymous items such as bare invocations
+    SourceSpan span;
+    Stmt stmt;
+};
+
+struct Module
+{
+    std::string file_name;
+    std::string source;
+    std::vector<TopLevelItem> items;
+};
+
+// Maps byte offsets in a source text to 1-based line numbers.
+class LineMap
+{
+private:
+    std::vector<std::size_t> starts;    // offset of the first byte of each line
+
+public:
+    LineMap(std::string const& source);
+
+    int line_of(std::size_t offset) const;
+};
+
+// Whether the items account for the whole of the module's source, with
+// only blanks and separators between them.  ParseModule keeps what it
+// could parse of an item and skips the rest of that line, and stops at an
+// item it cannot start, so tools that rewrite the source check this first.
+bool parsed_completely(Module const& module);
+
+// Returns the name a top-level statement binds, if any: the name of a def,
+// of a label, or of the label being reassigned.  Returns "" otherwise.
+std::string top_level_name(Stmt const& stmt);
+
+}
+
+// Name -> span -> tree lookup over a parsed module.  Lets tools find one
+// definition (and its source text) without walking every item's tree.
+// Only defs and labels bind names; a top-level reassignment is recorded
+// against the binding it reassigns.
+// The index refers into the module; keep the module alive while using it.
+class ModuleIndex
+{
+private:
+    Syntax::Module const& module;
+    std::unordered_map<std::string, std::size_t> by_name;
+    std::unordered_map<std::size_t, std::vector<std::size_t>> reassigned;   // binding -> reassignments
+
+public:
+    ModuleIndex(Syntax::Module const& module);
+
+    // Returns null if no def or label at the top level has this name.  If
+    // the name is bound more than once the last binding wins, as it would
+    // at run time.
+    Syntax::TopLevelItem const* find(std::string const& name) const;
+
+    // The top-level reassignments of a binding, in source order: those
+    // after it and before the name's next binding.  A reassignment of a
+    // name not yet bound belongs to no binding.
+    std::vector<Syntax::TopLevelItem const*> reassignments_of(Syntax::TopLevelItem const& binding) const;
+
+    // The source text of an item, e.g. to hash it for per-definition caching.
+    std::string text_of(Syntax::TopLevelItem const& item) const;
+
+    // All defs and labels with names, in source order.
+    std::vector<Syntax::TopLevelItem const*> named_items() const;
+
+    void dump(std::ostream& s) const;
+};
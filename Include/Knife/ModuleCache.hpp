@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Knife/Module.hpp"
+#include "Knife/Semantic.hpp"
+
+// A source file parsed, lowered and constant folded.
+struct CompiledModule
+{
+    Syntax::Module syntax;
+    Semantic::ModuleSpec spec;
+    Semantic::FoldStats folded;
+
+    explicit CompiledModule(Syntax::Module module);
+    CompiledModule(Syntax::Module module, std::vector<std::shared_ptr<Semantic::Interface const>> const& imports);
+};
+
+// Keeps compiled modules by path so a long-running compiler only redoes
+// the front end for files whose text changed.  Each load still reads the
+// file; the text is compared rather than the modification time, which is
+// too coarse for a build that rewrites a file within the same second.
+// Files that do not parse completely are not kept, so each load reports
+// their errors again, and past the capacity the least recently loaded
+// module is dropped.
+class ModuleCache
+{
+private:
+    struct Entry
+    {
+        std::shared_ptr<CompiledModule const> module;
+        std::list<std::string>::iterator recent;
+    };
+
+    std::mutex lock;
+    std::unordered_map<std::string, Entry> modules;
+    std::list<std::string> recent;      // keys, the most recently loaded first
+    std::size_t capacity;
+    std::size_t hit_count;
+    std::size_t miss_count;
+
+public:
+    explicit ModuleCache(std::size_t capacity = 256);
+
+    // Null if the file cannot be read.  Throws what the parser throws.
+    std::shared_ptr<CompiledModule const> load(std::string const& path);
+
+    std::size_t size() const { return modules.size(); }
+    std::size_t hits() const { return hit_count; }
+    std::size_t misses() const { return miss_count; }
+};
+
+// Compiles the file without caching it.  Null if it cannot be read.
+std::shared_ptr<CompiledModule const> compile_module(std::string const& path);
+
+// The same, importing the interfaces.  Modules with imports are not
+// cached, since their IR depends on the interfaces as well.
+std::shared_ptr<CompiledModule const> compile_module(std::string const& path,
+    std::vector<std::shared_ptr<Semantic::Interface const>> const& imports);
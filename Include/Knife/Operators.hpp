@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+
+#include "Knife/Syntax.hpp"
+
+// Binary operators.  The grammar reads "a op b op c ..." as a flat chain
+// and fold_operators nests it into calls by precedence, so
+//
+//     a + b * c == d
+//
+// is the call ==(+(a, *(b, c)), d), and lowers like any other call.  An
+// operator is a run of the characters + - * / % < > = ! & | ^ ~ ? @ $
+// other than a lone "=", which assigns; ":=" stays the label operator.
+//
+// A def named by an operator defines it:
+//
+//     def <+>(a, b) { ... }
+//     x <+> y
+//
+// Precedence comes from the operator's spelling, as in Scala, so a new
+// operator needs no declaration: || && | ^ & then = and ! (== !=), < and >
+// (< <= > >=), << >>, + -, and * / % bind tighter in that order, and any
+// other operator tightest.  Every operator is left-associative.
+namespace Syntax
+{
+
+int const tightest_precedence = 11;
+
+// 1 (loosest) to tightest_precedence; 0 if op is not an operator.
+int operator_precedence(std::string const& op);
+
+bool is_operator_name(std::string const& name);
+
+// True for a call the grammar folded from "a op b".
+bool is_binary_operation(Invocation const& t);
+
+// Nests the chain by precedence into result, in time linear in the
+// chain's length, moving its operands out.
+void fold_operators(OperatorChain& chain, Expr& result);
+
+}
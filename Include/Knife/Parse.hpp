@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+#include "Knife/Syntax.hpp"
+#include "Knife/Module.hpp"
+
+// Parses a single def expression.
+Syntax::DefExpr Parse(std::string str);
+
+// Parses a whole source file into its sequence of top-level items.
+// Items are separated by newlines or semicolons.  Source is UTF-8, with
+// or without a byte order mark; text that is not is reported on cerr and
+// gives a module with no items.
+Syntax::Module ParseModule(std::string source, std::string file_name = "");
+
+// Re-parses a single top-level item from its span, e.g. to load one def
+// out of a file whose index was cached from an earlier compile.
+Syntax::Stmt ParseItem(std::string const& source, Syntax::SourceSpan const& span);
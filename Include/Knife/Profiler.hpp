@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// A sampling profiler for generated code.  A SIGPROF timer records the
+// interrupted program counter and walks the frame-pointer chain while it
+// stays in generated code; the samples go to a buffer allocated up front.
+// Reports resolve addresses to defs and lines through the line tables of
+// the loaded code, so code must be generated with debug_info.  Inlined
+// defs show up as frames of their own.
+namespace Profiler
+{
+
+int const default_hz = 997;     // not a round number, to avoid sampling in lockstep with periodic work
+
+struct CodeLocation
+{
+    std::string def;
+    std::string file;
+    int line;
+    int def_line;
+};
+
+// Code from address up to the next row's address runs these defs,
+// innermost (possibly inlined) first.
+struct LineRow
+{
+    std::uintptr_t address;
+    std::vector<CodeLocation> frames;
+};
+
+// Called by the JIT for each block of loaded code, with its rows sorted
+// by address.
+void register_code(std::uintptr_t begin, std::uintptr_t end, std::vector<LineRow> rows);
+
+// Called before the block starting at begin is freed.
+void unregister_code(std::uintptr_t begin);
+
+// Discards earlier samples and starts the timer.  Returns false if a
+// profile is already running or the timer could not be set.
+bool start(int hz = default_hz);
+void stop();
+
+std::size_t sample_count();
+std::size_t dropped_count();    // samples lost to a full buffer
+
+// Self and total samples per def, then self samples per line.
+void write_flat(std::ostream& s);
+
+// For each def: its callers and callees with the samples spent through them.
+void write_call_graph(std::ostream& s);
+
+// One line per distinct stack, outermost first ("loop:5;square:12 37"),
+// the input format of flamegraph.pl and similar tools.
+void write_folded(std::ostream& s);
+
+}
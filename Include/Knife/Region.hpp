@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Memory for values that cannot outlive the call that made them.  Values
+// are bump allocated out of chunks, and releasing to a mark frees all that
+// was allocated since in one step, however many values that was.
+//
+// Generated code allocates the arrays of array(n) here: a def that
+// allocates takes a mark of its thread's region on entry and releases it
+// when it returns.  A def returns a number, so nothing it allocates can be
+// reached after that.  Allocating in a loop keeps the memory until the def
+// returns.
+//
+// Uses only the C library, so the runtime of programs compiled ahead of
+// time can include it.
+class Region
+{
+private:
+    struct Chunk
+    {
+        Chunk* previous;
+        char* end;
+    };
+
+    Chunk* chunk;       // the newest, allocated from
+    char* top;
+    Chunk* spare;       // the last chunk released, reused by the next growth
+    std::size_t next_chunk_bytes;
+    std::size_t reserved;
+
+    void* grow(std::size_t bytes, std::size_t alignment);
+
+    Region(Region const&);
+    Region& operator=(Region const&);
+
+public:
+    struct Mark
+    {
+        void* chunk;
+        char* top;
+    };
+
+    Region();
+    ~Region();
+
+    // Aborts when out of memory.  The alignment must be a power of two.
+    void* allocate(std::size_t bytes, std::size_t alignment)
+    {
+        char* p = reinterpret_cast<char*>((reinterpret_cast<std::uintptr_t>(top) + alignment - 1) & ~(alignment - 1));
+        if (chunk && p + bytes <= chunk->end && p >= top)
+        {
+            top = p + bytes;
+            return p;
+        }
+        return grow(bytes, alignment);
+    }
+
+    Mark mark() const { return Mark{ chunk, top }; }
+
+    // Frees everything allocated since the mark was taken.
+    void release(Mark const& mark);
+
+    // Bytes in the chunks still allocated from, not counting the one
+    // kept for reuse.
+    std::size_t bytes_reserved() const { return reserved; }
+
+    // The calling thread's region, freed when the thread exits, unless the
+    // thread is running a task (see Knife/Scheduler.hpp).  Tasks take turns
+    // on a thread and move between threads, so each has its own region,
+    // which the scheduler passes to use while the task runs and takes back
+    // with null.
+    static Region& current();
+    static void use(Region* region);
+};
+
+// The calls generated code makes.
+extern "C"
+{
+
+void knife_region_mark(Region::Mark* mark);
+void knife_region_release(Region::Mark const* mark);
+
+// Aligned for arrays (Semantic::array_alignment).
+void* knife_region_alloc(std::int64_t bytes);
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include "Knife/IR.hpp"
+
+namespace Semantic
+{
+
+// Assigns every label a (depth, slot) frame coordinate and writes it into
+// each node that declares or uses the label, so generated code and the
+// evaluator reach a local by index instead of looking its name up.
+//
+// Each scope that declares labels gets a frame whose slots are its labels
+// in declaration order; scopes without labels get no frame and do not
+// count toward depth.  The roots are walked starting in the given scope.
+void resolve_slots(IR& ir, std::vector<NodeId> const& roots, ScopeId scope);
+
+// An activation of a scope with labels: its slots plus the link to the
+// frame of the nearest enclosing scope that has one.
+template <typename Value>
+struct Frame
+{
+    Frame* parent;
+    std::vector<Value> slots;
+
+    Frame(Frame* parent, std::size_t size)
+        : parent(parent), slots(size)
+    {
+    }
+
+    Value& at(std::uint16_t depth, std::uint32_t slot)
+    {
+        Frame* f = this;
+        while (depth-- != 0)
+            f = f->parent;
+        return f->slots[slot];
+    }
+};
+
+}
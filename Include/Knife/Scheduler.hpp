@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Runs tasks spawned by generated code on a pool of threads.  Each task is
+// a stackful coroutine: a task that awaits one still running is suspended
+// and its thread goes on with other tasks, so thousands of tasks can wait
+// at once on a few threads.  Each thread keeps its own deque of ready
+// tasks, running the newest first, and an idle thread steals the oldest
+// task of another.
+//
+// In Knife code
+//
+//     t := spawn(f(x, y))
+//     ...
+//     await(t)
+//
+// starts f(x, y) as a task and later waits for its result.  Awaiting again
+// gives the same result, spawning into t again awaits the task t had, and
+// a def does not return before the tasks it spawned have finished.
+namespace Scheduler
+{
+
+// The most parameters a spawned def can take.
+std::size_t const max_task_args = 8;
+
+// Starts the threads; 0 for one per hardware thread.  The first spawn
+// starts the pool with 0 if it is not running.  Returns false if it
+// already is.
+bool start(unsigned threads = 0);
+
+// Stops the threads.  Every task must have been awaited.
+void stop();
+
+unsigned thread_count();
+
+struct Stats
+{
+    std::uint64_t tasks;
+    std::uint64_t steals;
+    std::uint64_t suspensions;     // awaits that had to wait
+};
+
+// Since the pool started.
+Stats stats();
+
+// Where generated code keeps a label's task: the task until it is
+// awaited, then its result.
+struct TaskSlot
+{
+    void* task;
+    double result;
+};
+
+}
+
+// The calls generated code makes.
+extern "C"
+{
+
+// Starts run(args) as a task; args are copied.
+void knife_task_spawn(Scheduler::TaskSlot* slot, double (*run)(double const* args), double const* args, std::int64_t count);
+
+double knife_task_await(Scheduler::TaskSlot* slot);
+
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "boost/optional.hpp"
+
+#include "Knife/Syntax.hpp"
+#include "Knife/Module.hpp"
+#include "Knife/IR.hpp"
+#include "Knife/Eval.hpp"
+
+namespace Semantic
+{
+
+class Ident
+{
+private:
+    std::string value;
+
+public:
+    Ident(Syntax::Ident const& name)
+        : value(name.value)
+    {
+    }
+
+    Ident(std::string const& name)
+        : value(name)
+    {
+    }
+
+    std::string const& str() const { return value; }
+
+    void dump(std::ostream& s) const;
+};
+
+// The parameters of a def, read out of the LabelExprs of its argument tuple.
+class Signature
+{
+private:
+    IR const* ir;
+    DefId def;
+
+public:
+    Signature(IR const& ir, DefId def);
+
+    std::size_t size() const;
+    Param const& operator[](std::size_t index) const;
+
+    void dump(std::ostream& s) const;
+};
+
+// A view of the statements of a block.  The statements themselves are
+// nodes in the IR the block was lowered into.
+class CodeBlock
+{
+private:
+    IR const* ir;
+    NodeId block;
+
+public:
+    CodeBlock(IR const& ir, NodeId block);
+
+    IR::Range stmts() const;
+    ScopeId scope() const;
+
+    void dump(std::ostream& s) const;
+};
+
+class DefSpec
+{
+private:
+    std::shared_ptr<IR const> ir;
+    DefId id;
+    boost::optional<Ident> name;
+    boost::optional<Signature> signature;
+    CodeBlock code;
+
+public:
+    // Lowers a single def into an IR of its own.
+    DefSpec(Syntax::DefExpr const& syntax);
+
+    // A def that was lowered as part of a module.
+    DefSpec(std::shared_ptr<IR const> ir, DefId id);
+
+    DefId def_id() const { return id; }
+    IR const& get_ir() const { return *ir; }
+
+    void dump(std::ostream& s) const;
+};
+
+class Interface;
+
+// All top-level items of a module lowered into one IR.  Top-level defs are
+// visible to every item in the module regardless of their order.
+class ModuleSpec
+{
+private:
+    std::shared_ptr<IR> ir;
+    std::string file;
+    ScopeId scope;
+    std::vector<NodeId> items;
+    std::unique_ptr<ConstEval> constants;
+
+public:
+    ModuleSpec(Syntax::Module const& module);
+
+    // A module importing library interfaces (see Knife/Interface.hpp):
+    // their IR is appended first, and their exports are visible at the top
+    // level unless the module declares the same names.
+    ModuleSpec(Syntax::Module const& module, std::vector<std::shared_ptr<Interface const>> const& imports);
+
+    IR const& get_ir() const { return *ir; }
+    std::shared_ptr<IR const> share_ir() const { return ir; }
+    std::string const& file_name() const { return file; }
+    ScopeId module_scope() const { return scope; }
+    std::vector<NodeId> const& item_nodes() const { return items; }
+
+    std::vector<DefSpec> defs() const;
+
+    // Folds constant expressions and constant calls of pure templates in
+    // place.  Afterwards constant_value answers for type-valued results.
+    FoldStats fold_constants();
+    Constant const* constant_value(NodeId id) const;
+
+    void dump(std::ostream& s) const;
+};
+
+}
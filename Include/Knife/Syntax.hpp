@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <typeinfo>
+
+#include "boost/variant.hpp"
+#include "boost/optional.hpp"
+#include "boost/fusion/include/adapt_struct.hpp"
+
+namespace Syntax {
+
+struct TupleExpr;
+struct Invocation;
+struct LabelExpr;
+struct DefExpr;
+struct BracesBlock;
+struct Number;
+struct QuotedString;
+struct Reassignment;
+
+typedef  boost::variant
+<
+    boost::recursive_wrapper<TupleExpr>,
+    boost::recursive_wrapper<LabelExpr>,
+    boost::recursive_wrapper<BracesBlock>,
+    boost::recursive_wrapper<DefExpr>,
+    boost::recursive_wrapper<Invocation>,
+    boost::recursive_wrapper<Number>,
+    boost::recursive_wrapper<QuotedString>
+> Expr;
+
+// Expr is already a complete type here, so it is held directly rather than
+// through a recursive_wrapper (which would make every Expr -> Stmt
+// conversion ambiguous to boost::variant).
+typedef  boost::variant
+<
+    Expr,
+    boost::recursive_wrapper<Reassignment>
+> Stmt;
+
+template <typename T>
+struct DebugTrack
+{
+    char const* type;
+
+    DebugTrack()
+        : type(typeid(T).name())
+    {
+        //cout << type << " " << this << " constructed" << endl;
+    }
+
+    ~DebugTrack()
+    {
+        //cout << type << " " << this << " destructed" << endl;
+    }
+};
+
+struct Ident : private DebugTrack<Ident>
+{
+    std::string value;
+};
+
+struct BracesBlock : private DebugTrack<BracesBlock>
+{
+    std::vector<Syntax::Stmt> stmts;
+
+    // Byte offset of each statement in the parsed text, for line tables.
+    // Empty for blocks that were built rather than parsed.
+    std::vector<std::uint32_t> offsets;
+};
+
+struct TupleExpr : private DebugTrack<TupleExpr>
+{
+    std::vector<Expr> elements;
+};
+
+struct LabelAssignment : private DebugTrack<LabelAssignment>
+{
+    Expr value;
+};
+
+struct LabelExpr : private DebugTrack<LabelExpr>
+{
+    boost::optional<Ident> name;
+    boost::optional<Expr> type;
+    boost::optional<LabelAssignment> term;
+};
+
+struct DefExpr : private DebugTrack<DefExpr>
+{
+    boost::optional<Ident> name;
+    boost::optional<TupleExpr> args;
+    BracesBlock code;
+};
+
+struct Invocation : private DebugTrack<Invocation>
+{
+    Ident name;
+    boost::optional<TupleExpr> args;
+    boost::optional<BracesBlock> postfix_lambda;
+    boost::optional<
+        boost::recursive_wrapper<
+            Invocation
+        >
+    > next_call;
+};
+
+struct Number : private DebugTrack<Number>
+{
+    std::string raw;
+};
+
+struct QuotedString : private DebugTrack<QuotedString>
+{
+    std::string raw;
+};
+
+struct Reassignment : private DebugTrack<QuotedString>
+{
+    Ident name;
+    Expr value;
+};
+
+// "a op b op c ..." as the grammar reads it, before fold_operators (in
+// Knife/Operators.hpp) nests it into calls by precedence.
+struct Operation : private DebugTrack<Operation>
+{
+    std::string op;
+    Expr operand;
+};
+
+struct OperatorChain : private DebugTrack<OperatorChain>
+{
+    Expr first;
+    std::vector<Operation> rest;
+};
+
+}
+
+BOOST_FUSION_ADAPT_STRUCT(
+    Syntax::Ident,
+    (std::string, value)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    Syntax::TupleExpr,
+    (std::vector<Syntax::Expr>, elements)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    Syntax::LabelAssignment,
+    (Syntax::Expr, value)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    Syntax::LabelExpr,
+    (boost::optional<Syntax::Ident>, name)
+    (boost::optional<Syntax::Expr>, type)
+    (boost::optional<Syntax::LabelAssignment>, term)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    Syntax::DefExpr,
+    (boost::optional<Syntax::Ident>, name)
+    (boost::optional<Syntax::TupleExpr>, args)
+    (Syntax::BracesBlock, code)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    Syntax::Invocation,
+    (Syntax::Ident, name)
+    (boost::optional<Syntax::TupleExpr>, args)
+    (boost::optional<Syntax::BracesBlock>, postfix_lambda)
+    (boost::optional<
+        boost::recursive_wrapper<
+            Syntax::Invocation
+        >
+    >, next_call)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    Syntax::Number,
+    (std::string, raw)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    Syntax::QuotedString,
+    (std::string, raw)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    Syntax::Reassignment,
+    (Syntax::Ident, name)
+    (Syntax::Expr, value)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    Syntax::Operation,
+    (std::string, op)
+    (Syntax::Expr, operand)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    Syntax::OperatorChain,
+    (Syntax::Expr, first)
+    (std::vector<Syntax::Operation>, rest)
+)
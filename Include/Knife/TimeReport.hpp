@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Time per compiler phase and named counters, reported at the end of a
+// compile in the manner of -ftime-report.  Phases and counts go to the
+// report collecting on the calling thread; when there is none they cost a
+// thread-local load.
+namespace TimeReport
+{
+
+class Report
+{
+private:
+    friend class Phase;
+    friend void count(char const* name, std::uint64_t n);
+
+    struct PhaseTotal
+    {
+        std::string name;
+        int depth;              // nesting of the first run
+        std::size_t runs;
+        double ms;
+        long long heap_growth;  // net, in bytes; only measured for outermost phases
+    };
+
+    struct Counter
+    {
+        std::string name;
+        std::uint64_t value;
+    };
+
+    std::vector<PhaseTotal> phases;     // in order of first run
+    std::vector<Counter> counters;      // in order of first count
+    int depth;
+
+public:
+    Report();
+
+    // Sum over the outermost phases.
+    double total_ms() const;
+
+    void write_table(std::ostream& s) const;
+    void write_json(std::ostream& s) const;
+};
+
+// While it exists, the calling thread's phases and counts go to the report.
+class Collect
+{
+private:
+    Report* saved;
+
+public:
+    explicit Collect(Report& report);
+    ~Collect();
+
+    Collect(Collect const&) = delete;
+    Collect& operator=(Collect const&) = delete;
+};
+
+// Times the enclosing scope as a phase.  Runs of a phase with the same name
+// add up; phases opened inside another nest under it in the table.
+class Phase
+{
+private:
+    Report* report;
+    std::size_t index;
+    std::chrono::steady_clock::time_point start;
+    long long heap_start;
+
+public:
+    explicit Phase(char const* name);
+    ~Phase();
+
+    Phase(Phase const&) = delete;
+    Phase& operator=(Phase const&) = delete;
+};
+
+void count(char const* name, std::uint64_t n = 1);
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+// Source text is UTF-8.  ParseModule checks a whole buffer before parsing
+// it, so the grammar can take any byte outside ASCII as part of an
+// identifier or a string without decoding it: in valid UTF-8 such bytes
+// only ever come as whole sequences.  Every code point outside ASCII is an
+// identifier character.
+namespace Syntax
+{
+
+// The offset of the first byte that does not belong to a valid UTF-8
+// sequence (overlong forms, surrogates and code points past U+10FFFF are
+// invalid), or size if every byte does.  ASCII is skipped 32 bytes at a
+// time with SSE2 (8 at a time without), and only sequences outside ASCII
+// are decoded, so checking ASCII text costs a small fraction of parsing it.
+std::size_t find_invalid_utf8(char const* data, std::size_t size);
+
+// The length of a byte order mark at the start of the text, or 0.
+std::size_t byte_order_mark(char const* data, std::size_t size);
+
+}
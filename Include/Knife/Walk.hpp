@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Knife/Syntax.hpp"
+#include "Knife/Module.hpp"
+
+namespace Syntax {
+
+// One tag per node type.
+enum class NodeTag : std::uint8_t
+{
+    Tuple,
+    Label,
+    Block,
+    Def,
+    Invocation,
+    Number,
+    String,
+    Reassignment
+};
+
+// A non-owning, untyped reference to a node of the syntax tree.
+struct NodeRef
+{
+    NodeTag tag;
+    void const* node;
+
+    template <typename T>
+    T const& as() const
+    {
+        return *static_cast<T const*>(node);
+    }
+};
+
+namespace Detail {
+
+// The reference to whichever node a variant holds, in one dispatch.
+struct RefOf : boost::static_visitor<NodeRef>
+{
+    NodeRef operator()(TupleExpr const& t) const { return NodeRef{NodeTag::Tuple, &t}; }
+    NodeRef operator()(LabelExpr const& t) const { return NodeRef{NodeTag::Label, &t}; }
+    NodeRef operator()(BracesBlock const& t) const { return NodeRef{NodeTag::Block, &t}; }
+    NodeRef operator()(DefExpr const& t) const { return NodeRef{NodeTag::Def, &t}; }
+    NodeRef operator()(Invocation const& t) const { return NodeRef{NodeTag::Invocation, &t}; }
+    NodeRef operator()(Number const& t) const { return NodeRef{NodeTag::Number, &t}; }
+    NodeRef operator()(QuotedString const& t) const { return NodeRef{NodeTag::String, &t}; }
+    NodeRef operator()(Reassignment const& t) const { return NodeRef{NodeTag::Reassignment, &t}; }
+    NodeRef operator()(Expr const& e) const { return boost::apply_visitor(*this, e); }
+};
+
+}
+
+inline NodeRef node_ref(Expr const& expr)
+{
+    return boost::apply_visitor(Detail::RefOf(), expr);
+}
+
+inline NodeRef node_ref(Stmt const& stmt)
+{
+    return boost::apply_visitor(Detail::RefOf(), stmt);
+}
+
+inline NodeRef node_ref(BracesBlock const& block)
+{
+    return NodeRef{NodeTag::Block, &block};
+}
+
+inline NodeRef node_ref(Invocation const& call)
+{
+    return NodeRef{NodeTag::Invocation, &call};
+}
+
+// Calls f(NodeRef) for each child of a node, in source order, until f
+// returns false.  Returns false if f did.
+template <typename F>
+bool for_each_child(NodeRef ref, F&& f)
+{
+    switch (ref.tag)
+    {
+    case NodeTag::Tuple:
+        for (auto const& e : ref.as<TupleExpr>().elements)
+            if (!f(node_ref(e)))
+                return false;
+        return true;
+
+    case NodeTag::Label:
+    {
+        LabelExpr const& t = ref.as<LabelExpr>();
+        return (!t.type || f(node_ref(*t.type)))
+            && (!t.term || f(node_ref(t.term->value)));
+    }
+
+    case NodeTag::Block:
+        for (auto const& s : ref.as<BracesBlock>().stmts)
+            if (!f(node_ref(s)))
+                return false;
+        return true;
+
+    case NodeTag::Def:
+    {
+        DefExpr const& t = ref.as<DefExpr>();
+        if (t.args)
+            for (auto const& e : t.args->elements)
+                if (!f(node_ref(e)))
+                    return false;
+        return f(node_ref(t.code));
+    }
+
+    case NodeTag::Invocation:
+    {
+        Invocation const& t = ref.as<Invocation>();
+        if (t.args)
+            for (auto const& e : t.args->elements)
+                if (!f(node_ref(e)))
+                    return false;
+        return (!t.postfix_lambda || f(node_ref(*t.postfix_lambda)))
+            && (!t.next_call || f(node_ref(t.next_call->get())));
+    }
+
+    case NodeTag::Reassignment:
+        return f(node_ref(ref.as<Reassignment>().value));
+
+    case NodeTag::Number:
+    case NodeTag::String:
+        return true;
+    }
+
+    return true;
+}
+
+enum class Visit : std::uint8_t
+{
+    Continue,   // descend into the node's children
+    Skip,       // do not descend (only meaningful from enter)
+    Stop        // abandon the walk
+};
+
+// Pre/post-order traversal of a syntax tree that never copies a node.
+// The visitor provides
+//
+//     Visit enter(NodeRef n);    // before the children of n
+//     Visit leave(NodeRef n);    // after them (not called if enter skipped)
+//
+// Children are visited in source order.  Returns false if the visitor
+// stopped the walk.
+template <typename Visitor>
+bool walk(NodeRef ref, Visitor& visitor)
+{
+    Visit v = visitor.enter(ref);
+    if (v == Visit::Stop)
+        return false;
+    if (v == Visit::Skip)
+        return true;
+
+    if (!for_each_child(ref, [&visitor](NodeRef child) { return walk(child, visitor); }))
+        return false;
+
+    return visitor.leave(ref) != Visit::Stop;
+}
+
+template <typename Visitor>
+bool walk(Module const& module, Visitor& visitor)
+{
+    for (auto const& item : module.items)
+        if (!walk(node_ref(item.stmt), visitor))
+            return false;
+    return true;
+}
+
+}
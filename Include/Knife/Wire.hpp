@@ -0,0 +1,210 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "boost/utility/string_ref.hpp"
+
+#include "Knife/Eval.hpp"
+
+// A binary format for tuples, laid out by a schema derived at compile
+// time from the tuple's type.  Given
+//
+//     def Vec(T: type) { x: T; y: T; z: T }
+//     def Particle { id: Int; pos: Vec(Double); name: String; alive: Bool }
+//     P := Particle()
+//
+// the compiler folds P to a tuple type, and Schema::derive lays it out:
+// nested tuples are flattened (pos.x, pos.y, pos.z), and the fields are
+// placed largest first so each is aligned with no padding between them.
+// "knife --schema file.kn" prints the layout of every such label.
+//
+// A buffer is a 16-byte header (magic, then the schema's fingerprint)
+// followed by records.  A record is an 8-byte header (its size in bytes)
+// and the fixed part, in which a string is a 32-bit offset from the
+// record's start and a 32-bit length, then the strings' bytes; its size is
+// a multiple of 8, so every record and every field stays aligned.  A
+// Reader walks a buffer (or a MappedFile) in place: fields are read
+// straight out of it and strings are views into it.  Numbers are stored
+// in the machine's byte order.
+namespace Wire
+{
+
+enum class FieldKind : std::uint8_t
+{
+    Int,        // 64-bit
+    Float,      // 32-bit
+    Double,
+    Bool,       // one byte
+    String
+};
+
+struct Field
+{
+    std::string name;       // a dotted path for fields of nested tuples; #i for unnamed elements
+    FieldKind kind;
+    std::uint32_t offset;   // from the start of the record
+};
+
+std::size_t const buffer_header_bytes = 16;
+std::size_t const record_header_bytes = 8;
+
+class Schema
+{
+private:
+    Semantic::Constant type;
+    std::vector<Field> fields;              // in the order the type declares them
+    std::vector<std::uint32_t> strings;     // offsets of the string fields
+    std::uint32_t fixed_bytes;              // record header and fixed part
+    std::uint64_t print;
+
+    bool add(Semantic::Constant const& element, std::string const& name, Semantic::SymbolTable const& symbols);
+
+public:
+    Schema();
+
+    // Lays out a tuple type, as ConstEval folds a def that returns one.
+    // Every element must be Int, Float, Double, Bool, String or a tuple
+    // type; otherwise reports why to cerr and returns false.
+    bool derive(Semantic::Constant const& tuple_type, Semantic::SymbolTable const& symbols);
+
+    std::vector<Field> const& field_list() const { return fields; }
+    std::vector<std::uint32_t> const& string_offsets() const { return strings; }
+    std::uint32_t fixed_size() const { return fixed_bytes; }
+
+    // Changes with any field's name, kind or position, so a reader can
+    // tell a buffer written with another layout.
+    std::uint64_t fingerprint() const { return print; }
+
+    Semantic::Constant const& tuple_type() const { return type; }
+
+    // The index of the field with the given (dotted) name, or -1.
+    int find(std::string const& name) const;
+
+    void dump(std::ostream& s) const;
+};
+
+// Appends records to a buffer, writing the buffer header first if the
+// buffer is empty:
+//
+//     Writer w(schema, buffer);
+//     w.begin();
+//     w.set_int(0, 17);
+//     w.set_string(4, "p17");
+//     w.end();
+//
+// Fields that are not set are zero (strings empty).
+class Writer
+{
+private:
+    Schema const& schema;
+    std::string& out;
+    std::size_t record;     // where the record being written starts
+
+    template <typename T>
+    void store(std::size_t field, T value)
+    {
+        std::memcpy(&out[record + schema.field_list()[field].offset], &value, sizeof value);
+    }
+
+public:
+    Writer(Schema const& schema, std::string& out);
+
+    void begin();
+    void set_int(std::size_t field, std::int64_t value) { store(field, value); }
+    void set_float(std::size_t field, float value) { store(field, value); }
+    void set_double(std::size_t field, double value) { store(field, value); }
+    void set_bool(std::size_t field, bool value) { out[record + schema.field_list()[field].offset] = value; }
+    void set_string(std::size_t field, boost::string_ref value);
+    void end();
+
+    // A whole record from a constant tuple of the schema's type, whose
+    // elements are matched up with the type's by position.  Returns false
+    // (writing nothing) if it does not fit the type.
+    bool write(Semantic::Constant const& tuple);
+};
+
+// A record in place in its buffer.
+class Record
+{
+private:
+    char const* data;
+
+    template <typename T>
+    T load(std::uint32_t offset) const
+    {
+        T value;
+        std::memcpy(&value, data + offset, sizeof value);
+        return value;
+    }
+
+public:
+    Record()
+        : data(nullptr)
+    {
+    }
+
+    explicit Record(char const* data)
+        : data(data)
+    {
+    }
+
+    std::int64_t get_int(Field const& field) const { return load<std::int64_t>(field.offset); }
+    float get_float(Field const& field) const { return load<float>(field.offset); }
+    double get_double(Field const& field) const { return load<double>(field.offset); }
+    bool get_bool(Field const& field) const { return data[field.offset] != 0; }
+
+    boost::string_ref get_string(Field const& field) const
+    {
+        return boost::string_ref(data + load<std::uint32_t>(field.offset), load<std::uint32_t>(field.offset + 4));
+    }
+
+    // The record as a constant tuple of the schema's type, with its labels.
+    Semantic::Constant to_constant(Schema const& schema) const;
+};
+
+// Walks the records of a buffer without copying them.  Every record is
+// checked against the buffer's bounds before it is handed out, so a
+// truncated or corrupt buffer ends the walk rather than being read past.
+class Reader
+{
+private:
+    Schema const& schema;
+    char const* at;
+    char const* end;
+    bool usable;
+
+public:
+    // Checks the header: the magic and the schema's fingerprint.
+    Reader(Schema const& schema, char const* data, std::size_t size);
+
+    bool valid() const { return usable; }
+
+    // False at the end of the buffer or at a malformed record, after which
+    // valid() tells them apart.
+    bool next(Record& record);
+};
+
+// A file mapped read-only into memory, for a Reader.
+class MappedFile
+{
+private:
+    void* base;
+    std::size_t bytes;
+
+public:
+    // Empty, having reported why to cerr, if the file cannot be mapped.
+    explicit MappedFile(std::string const& path);
+    ~MappedFile();
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    char const* data() const { return static_cast<char const*>(base); }
+    std::size_t size() const { return bytes; }
+};
+
+}
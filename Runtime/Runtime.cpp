@@ -0,0 +1,41 @@
+#include <cstdio>
+#include <cstdlib>
+
+// The runtime of programs compiled ahead of time (see Include/Knife/Aot.hpp):
+// this main and the region generated code allocates from (Source/Region.cpp).
+// It uses only the C library, so programs link with a plain cc as well.
+
+extern "C"
+{
+
+// Defined by an object emitted with an entry def.
+double knife_main(double const* args);
+extern int const knife_entry_arity;
+
+}
+
+// Usage: program [numbers...], one per parameter of the entry def.
+int main(int argc, char* argv[])
+{
+    if (argc - 1 != knife_entry_arity)
+    {
+        std::fprintf(stderr, "%s: expected %d arguments, got %d\n", argv[0], knife_entry_arity, argc - 1);
+        return 1;
+    }
+
+    double* args = static_cast<double*>(std::malloc(sizeof(double) * (argc > 1 ? argc - 1 : 1)));
+    for (int i = 1; i < argc; ++i)
+    {
+        char* end;
+        args[i - 1] = std::strtod(argv[i], &end);
+        if (end == argv[i] || *end)
+        {
+            std::fprintf(stderr, "%s: not a number: %s\n", argv[0], argv[i]);
+            return 1;
+        }
+    }
+
+    std::printf("%g\n", knife_main(args));
+    std::free(args);
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "Knife/Aot.hpp"
+#include "Knife/Codegen.hpp"
+#include "Knife/Inline.hpp"
+#include "Knife/TimeReport.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+bool report(llvm::Error error)
+{
+    if (!error)
+        return true;
+    llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "aot: ");
+    return false;
+}
+
+void initialize_native_target()
+{
+    static bool initialized = !llvm::InitializeNativeTarget() && !llvm::InitializeNativeTargetAsmPrinter();
+    if (!initialized)
+        cerr << "aot: no native target" << endl;
+}
+
+// Position independent, so the object links into the default PIE
+// executables and into shared libraries alike.
+std::unique_ptr<llvm::TargetMachine> create_target(Aot::Options const& options)
+{
+    llvm::orc::JITTargetMachineBuilder builder{llvm::Triple(llvm::sys::getProcessTriple())};
+    if (options.native)
+    {
+        auto host = llvm::orc::JITTargetMachineBuilder::detectHost();
+        if (!host)
+        {
+            report(host.takeError());
+            return nullptr;
+        }
+        builder = std::move(*host);
+    }
+
+    llvm::CodeGenOpt::Level const levels[] = {
+        llvm::CodeGenOpt::None, llvm::CodeGenOpt::Less, llvm::CodeGenOpt::Default, llvm::CodeGenOpt::Aggressive };
+    builder.setRelocationModel(llvm::Reloc::PIC_);
+    builder.setCodeGenOptLevel(levels[options.opt_level < 0 ? 0 : options.opt_level > 3 ? 3 : options.opt_level]);
+
+    auto machine = builder.createTargetMachine();
+    if (!machine)
+    {
+        report(machine.takeError());
+        return nullptr;
+    }
+    return std::move(*machine);
+}
+
+// knife_main(args) calls the entry with args[0 .. arity).
+bool add_entry(llvm::Module& module, llvm::Function* entry)
+{
+    llvm::LLVMContext& context = module.getContext();
+    llvm::Type* dbl = llvm::Type::getDoubleTy(context);
+    llvm::Type* i32 = llvm::Type::getInt32Ty(context);
+    unsigned arity = entry->arg_size();
+
+    new llvm::GlobalVariable(module, i32, true, llvm::GlobalValue::ExternalLinkage,
+        llvm::ConstantInt::get(i32, arity), "knife_entry_arity");
+
+    llvm::FunctionType* type = llvm::FunctionType::get(dbl, { llvm::PointerType::getUnqual(dbl) }, false);
+    llvm::Function* main = llvm::Function::Create(type, llvm::Function::ExternalLinkage, "knife_main", &module);
+
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(context, "entry", main));
+    std::vector<llvm::Value*> args;
+    for (unsigned i = 0; i < arity; ++i)
+        args.push_back(b.CreateLoad(dbl, b.CreateConstInBoundsGEP1_32(dbl, main->getArg(0), i)));
+    b.CreateRet(b.CreateCall(entry, args));
+
+    return !llvm::verifyFunction(*main, &llvm::errs());
+}
+
+}
+
+bool Aot::emit_object(IR const& ir, std::vector<NodeId> const& items,
+    std::string const& file_name, std::string const& object_path, Options const& options)
+{
+    initialize_native_target();
+    std::unique_ptr<llvm::TargetMachine> target = create_target(options);
+    if (!target)
+        return false;
+
+    // No debugger at run time, so no probe sites.
+    CodegenOptions codegen_options;
+    codegen_options.probes = false;
+    codegen_options.debug_info = options.debug_info;
+
+    std::vector<ModuleSummary> summaries;
+    for (auto const& path : options.imports)
+    {
+        ModuleSummary summary;
+        if (!read_summary(path, summary))
+        {
+            cerr << "aot: " << path << " has no module summary" << endl;
+            return false;
+        }
+        summaries.push_back(std::move(summary));
+    }
+
+    llvm::LLVMContext context;
+    Codegen codegen(ir, context, file_name, file_name, codegen_options);
+    for (auto const& summary : summaries)
+        for (auto const& def : exports_of(summary))
+            codegen.declare_external(def.name, def.arity);
+    codegen.emit(items);
+
+    std::vector<std::string> defs;
+    llvm::Function* entry = nullptr;
+    for (NodeId item : items)
+    {
+        Node const& n = ir.node(item);
+        llvm::Function* f = n.kind == NodeKind::Def && n.symbol != none ? codegen.function_of(n.value) : nullptr;
+        if (!f)
+            continue;
+        defs.push_back(ir.symbols.name(n.symbol));
+        if (defs.back() == options.entry)
+            entry = f;
+    }
+
+    if (!options.entry.empty() && !entry)
+    {
+        cerr << "aot: entry def " << options.entry << " was not emitted" << endl;
+        return false;
+    }
+    for (llvm::Type const* param : entry ? entry->getFunctionType()->params() : llvm::ArrayRef<llvm::Type*>())
+        if (!param->isDoubleTy())
+        {
+            cerr << "aot: entry def " << options.entry << " takes an array; knife_main passes numbers only" << endl;
+            return false;
+        }
+
+    std::unique_ptr<llvm::Module> module = codegen.take_module();
+
+    // The scheduler needs threads and a C++ runtime, which the runtime
+    // library does without.
+    if (module->getFunction("knife_task_spawn"))
+    {
+        cerr << "aot: spawn is only supported in the JIT for now" << endl;
+        return false;
+    }
+
+    module->setDataLayout(target->createDataLayout());
+    module->setTargetTriple(target->getTargetTriple().str());
+    if (entry && !add_entry(*module, entry))
+        return false;
+    optimize_with_imports(*module, summaries, options.opt_level, target.get());
+    embed_summary(*module, summarize(*module, defs));
+
+    std::error_code error;
+    llvm::raw_fd_ostream out(object_path, error, llvm::sys::fs::OF_None);
+    if (error)
+    {
+        cerr << "aot: cannot write " << object_path << ": " << error.message() << endl;
+        return false;
+    }
+
+    TimeReport::Phase phase("machine code");
+    llvm::legacy::PassManager passes;
+    if (target->addPassesToEmitFile(passes, out, nullptr, llvm::CGFT_ObjectFile))
+    {
+        cerr << "aot: the target cannot emit object files" << endl;
+        return false;
+    }
+    passes.run(*module);
+    out.close();
+    if (out.has_error())
+    {
+        cerr << "aot: cannot write " << object_path << ": " << out.error().message() << endl;
+        out.clear_error();
+        return false;
+    }
+    return true;
+}
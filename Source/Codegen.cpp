@@ -0,0 +1,1421 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+using namespace std;
+
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Knife/Codegen.hpp"
+#include "Knife/Region.hpp"
+#include "Knife/Scheduler.hpp"
+#include "Knife/TimeReport.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+enum Op { Add, Sub, Mul, Div, Less, Greater, LessEqual, GreaterEqual, Equal, NotEqual, NotAnOp };
+
+char const* const op_names[] = { "+", "-", "*", "/", "<", ">", "<=", ">=", "==", "!=" };
+
+enum ArrayLoop { Each, Map, Sum };
+
+bool is_array_param(IR const& ir, Param const& p)
+{
+    if (p.type == none)
+        return false;
+    Node const& type = ir.node(p.type);
+    return type.kind == NodeKind::Ref && type.value == none && ir.symbols.name(type.symbol) == "Array";
+}
+
+bool writes_array(IR const& ir, NodeId id, LabelId array, Symbol put, Symbol map)
+{
+    Node const& n = ir.node(id);
+    IR::Range kids = ir.children_of(id);
+    auto names_array = [&](std::size_t k) {
+        return k < kids.size() && ir.node(kids[k]).kind == NodeKind::Ref && ir.node(kids[k]).value == array;
+    };
+
+    if (n.kind == NodeKind::Call && n.value == none && ((n.symbol == put && names_array(0)) || (n.symbol == map && names_array(1))))
+        return true;
+    if (n.kind == NodeKind::Call && n.value != none)
+        for (std::size_t k = 0; k < kids.size(); ++k)
+            if (names_array(k))
+                return true;
+
+    for (NodeId kid : kids)
+        if (writes_array(ir, kid, array, put, map))
+            return true;
+    return false;
+}
+
+}
+
+namespace Semantic
+{
+
+// Emits the body of one def.  Every label of the def, including those of
+// the blocks passed to if and while, gets a stack slot in the entry block;
+// mem2reg turns them into registers.
+class FunctionGen
+{
+private:
+    Codegen& cg;
+    IR const& ir;
+    llvm::IRBuilder<> b;
+    llvm::Function* function;
+    DefId def;
+    std::unordered_map<LabelId, llvm::AllocaInst*> slots;
+    bool failed;
+    llvm::DISubprogram* subprogram;
+    std::vector<ArrayAspect> const* aspects;
+
+    struct Array
+    {
+        llvm::Value* data;
+        llvm::Value* length;    // i64
+    };
+
+    // The index label of an array loop, while its block is generated:
+    // the 64-bit induction variable and the arrays it is known to be in
+    // range of.
+    struct Index
+    {
+        llvm::Value* value;
+        std::vector<LabelId> arrays;
+    };
+
+    // An array argument of a call, at args[position] and the next.
+    struct PassedArray
+    {
+        std::size_t position;
+        std::uint32_t param;
+        Array array;
+    };
+
+    std::unordered_map<LabelId, Array> arrays;
+    std::unordered_map<LabelId, Index> indexes;
+    int array_loops;                // blocks of array loops being generated, which get no probes
+    llvm::Value* region_mark;       // set once the def allocates
+
+    // The task slots of labels made with spawn (Scheduler::TaskSlot), and
+    // where their arguments are put while spawning.
+    std::unordered_map<LabelId, llvm::Value*> tasks;
+    llvm::Value* task_args;
+
+    Symbol sym_if, sym_else, sym_while, sym_return;
+    Symbol sym_length, sym_at, sym_put, sym_each, sym_map, sym_sum, sym_array;
+    Symbol sym_spawn, sym_await;
+    Symbol ops[NotAnOp];
+
+    llvm::Value* error(std::string const& message)
+    {
+        if (!failed)
+            cerr << "codegen: " << ir.symbols.name(ir.def(def).name) << ": " << message << endl;
+        failed = true;
+        return nullptr;
+    }
+
+    llvm::Value* zero()
+    {
+        return llvm::ConstantFP::get(b.getDoubleTy(), 0.0);
+    }
+
+    llvm::AllocaInst* slot_for(LabelId label)
+    {
+        auto pos = slots.find(label);
+        if (pos != slots.end())
+            return pos->second;
+
+        llvm::BasicBlock& entry = function->getEntryBlock();
+        llvm::IRBuilder<> at_entry(&entry, entry.begin());
+        llvm::AllocaInst* slot = at_entry.CreateAlloca(at_entry.getDoubleTy(), nullptr, ir.symbols.name(ir.label(label).name));
+        slots[label] = slot;
+        return slot;
+    }
+
+    // Labels of this def live in scopes whose nearest enclosing owner is it.
+    bool is_local(LabelId label) const
+    {
+        for (ScopeId sc = ir.label(label).scope; sc != none; sc = ir.scope(sc).parent)
+            if (ir.scope(sc).owner != none)
+                return ir.scope(sc).owner == def;
+        return false;
+    }
+
+    Op op_of(Symbol name) const
+    {
+        for (int op = 0; op < NotAnOp; ++op)
+            if (ops[op] == name)
+                return Op(op);
+        return NotAnOp;
+    }
+
+    // A call of a free template with a literal block, e.g. while(c) { ... }
+    bool is_literal_call(NodeId id, Symbol name, std::size_t args) const
+    {
+        Node const& n = ir.node(id);
+        return n.kind == NodeKind::Call && n.symbol == name && n.value == none
+            && n.flags == (HasArgs | HasBlock) && n.child_count == args + 1
+            && ir.node(ir.children_of(id)[args]).kind == NodeKind::Block;
+    }
+
+    llvm::Value* truth(llvm::Value* v)
+    {
+        return b.CreateFCmpONE(v, zero(), "cond");
+    }
+
+    void emit_probe(std::uint32_t line)
+    {
+        if (!cg.pending_flags)
+            cg.pending_flags = new llvm::GlobalVariable(*cg.module, b.getInt8Ty(), false,
+                llvm::GlobalValue::ExternalLinkage, nullptr, cg.flags_name + ".pending");
+
+        std::uint32_t index = cg.probes.size();
+        cg.probes.push_back(ProbeSite{def, line});
+
+        // A relaxed atomic load is a plain byte load on common targets, but
+        // keeps the optimizer from hoisting the flag out of loops: the
+        // debugger sets it from another thread.
+        llvm::Value* flag = b.CreateConstInBoundsGEP1_64(b.getInt8Ty(), cg.pending_flags, index);
+        llvm::LoadInst* armed = b.CreateLoad(b.getInt8Ty(), flag, "probe");
+        armed->setAtomic(llvm::AtomicOrdering::Monotonic);
+        armed->setAlignment(llvm::Align(1));
+
+        llvm::BasicBlock* hit = llvm::BasicBlock::Create(cg.context, "probe.hit", function);
+        llvm::BasicBlock* cont = llvm::BasicBlock::Create(cg.context, "probe.cont", function);
+        llvm::MDNode* unlikely = llvm::MDBuilder(cg.context).createBranchWeights(1, 1 << 20);
+        b.CreateCondBr(b.CreateICmpNE(armed, b.getInt8(0)), hit, cont, unlikely);
+
+        b.SetInsertPoint(hit);
+        llvm::FunctionCallee hook = cg.module->getOrInsertFunction("knife_probe_hit",
+            llvm::FunctionType::get(b.getVoidTy(), { b.getInt8PtrTy() }, false));
+        llvm::cast<llvm::Function>(hook.getCallee())->addFnAttr(llvm::Attribute::Cold);
+        b.CreateCall(hook, { flag });
+        b.CreateBr(cont);
+
+        b.SetInsertPoint(cont);
+    }
+
+    // The lines of the statements in a block and the blocks within it.
+    void statement_lines(NodeId id, std::vector<std::uint32_t>& lines) const
+    {
+        bool block = ir.node(id).kind == NodeKind::Block;
+        for (NodeId kid : ir.children_of(id))
+        {
+            std::uint32_t line = block ? ir.line_of(kid) : 0;
+            if (line != 0 && std::find(lines.begin(), lines.end(), line) == lines.end())
+                lines.push_back(line);
+            statement_lines(kid, lines);
+        }
+    }
+
+    // The statements of a block, in line.  The value is the last statement's.
+    llvm::Value* gen_stmts(NodeId block)
+    {
+        llvm::Value* last = zero();
+        std::uint32_t probed_line = 0;
+
+        for (NodeId stmt : ir.children_of(block))
+        {
+            // Code after a return is unreachable but must still be well formed.
+            if (b.GetInsertBlock()->getTerminator())
+                b.SetInsertPoint(llvm::BasicBlock::Create(cg.context, "dead", function));
+
+            std::uint32_t line = ir.line_of(stmt);
+            if (line != 0 && line != probed_line)
+            {
+                if (subprogram)
+                    b.SetCurrentDebugLocation(llvm::DILocation::get(cg.context, line, 0, subprogram));
+                if (cg.options.probes && array_loops == 0)
+                    emit_probe(line);
+                probed_line = line;
+            }
+
+            last = gen(stmt);
+            if (!last)
+                return nullptr;
+        }
+
+        return last;
+    }
+
+    llvm::Value* gen_if(llvm::Value* cond_value, NodeId then_block, NodeId else_block)
+    {
+        llvm::Value* cond = truth(cond_value);
+        llvm::BasicBlock* then_bb = llvm::BasicBlock::Create(cg.context, "then", function);
+        llvm::BasicBlock* else_bb = llvm::BasicBlock::Create(cg.context, "else", function);
+        llvm::BasicBlock* merge_bb = llvm::BasicBlock::Create(cg.context, "endif", function);
+        b.CreateCondBr(cond, then_bb, else_bb);
+
+        b.SetInsertPoint(then_bb);
+        llvm::Value* then_value = gen_stmts(then_block);
+        if (!then_value)
+            return nullptr;
+        llvm::BasicBlock* then_end = b.GetInsertBlock();
+        bool then_falls = !then_end->getTerminator();
+        if (then_falls)
+            b.CreateBr(merge_bb);
+
+        b.SetInsertPoint(else_bb);
+        llvm::Value* else_value = else_block != none ? gen_stmts(else_block) : zero();
+        if (!else_value)
+            return nullptr;
+        llvm::BasicBlock* else_end = b.GetInsertBlock();
+        bool else_falls = !else_end->getTerminator();
+        if (else_falls)
+            b.CreateBr(merge_bb);
+
+        b.SetInsertPoint(merge_bb);
+        llvm::PHINode* phi = b.CreatePHI(b.getDoubleTy(), 2, "if");
+        if (then_falls)
+            phi->addIncoming(then_value, then_end);
+        if (else_falls)
+            phi->addIncoming(else_value, else_end);
+        if (phi->getNumIncomingValues() == 0)
+        {
+            phi->eraseFromParent();
+            b.CreateUnreachable();
+            return zero();
+        }
+        return phi;
+    }
+
+    llvm::Value* gen_while(NodeId cond_node, NodeId body)
+    {
+        llvm::BasicBlock* cond_bb = llvm::BasicBlock::Create(cg.context, "while", function);
+        llvm::BasicBlock* body_bb = llvm::BasicBlock::Create(cg.context, "do", function);
+        llvm::BasicBlock* done_bb = llvm::BasicBlock::Create(cg.context, "endwhile", function);
+        b.CreateBr(cond_bb);
+
+        b.SetInsertPoint(cond_bb);
+        llvm::Value* cond = gen(cond_node);
+        if (!cond)
+            return nullptr;
+        b.CreateCondBr(truth(cond), body_bb, done_bb);
+
+        b.SetInsertPoint(body_bb);
+        if (!gen_stmts(body))
+            return nullptr;
+        if (!b.GetInsertBlock()->getTerminator())
+            b.CreateBr(cond_bb);
+
+        b.SetInsertPoint(done_bb);
+        return zero();
+    }
+
+    llvm::Value* gen_op(Op op, IR::Range args)
+    {
+        if (args.size() != 2)
+            return error(std::string("operator ") + op_names[op] + " takes two arguments");
+
+        llvm::Value* l = gen(args[0]);
+        llvm::Value* r = l ? gen(args[1]) : nullptr;
+        if (!r)
+            return nullptr;
+
+        llvm::Value* cmp;
+        switch (op)
+        {
+        case Add: return b.CreateFAdd(l, r, "add");
+        case Sub: return b.CreateFSub(l, r, "sub");
+        case Mul: return b.CreateFMul(l, r, "mul");
+        case Div: return b.CreateFDiv(l, r, "div");
+        case Less: cmp = b.CreateFCmpOLT(l, r); break;
+        case Greater: cmp = b.CreateFCmpOGT(l, r); break;
+        case LessEqual: cmp = b.CreateFCmpOLE(l, r); break;
+        case GreaterEqual: cmp = b.CreateFCmpOGE(l, r); break;
+        case Equal: cmp = b.CreateFCmpOEQ(l, r); break;
+        default: cmp = b.CreateFCmpUNE(l, r); break;
+        }
+        return b.CreateUIToFP(cmp, b.getDoubleTy(), "bool");
+    }
+
+    llvm::Value* gen_external_call(std::string const& name, unsigned arity, IR::Range kids)
+    {
+        if (kids.size() != arity)
+            return error(name + " takes " + std::to_string(arity) + " arguments");
+
+        std::vector<llvm::Value*> args;
+        for (NodeId kid : kids)
+        {
+            llvm::Value* v = gen(kid);
+            if (!v)
+                return nullptr;
+            args.push_back(v);
+        }
+
+        std::vector<llvm::Type*> params(arity, b.getDoubleTy());
+        llvm::FunctionCallee f = cg.module->getOrInsertFunction(name, llvm::FunctionType::get(b.getDoubleTy(), params, false));
+        return b.CreateCall(f, args, "call");
+    }
+
+    // The array parameter an argument names, or null (reported).
+    Array const* array_arg(NodeId id, LabelId& label)
+    {
+        Node const& n = ir.node(id);
+        auto pos = n.kind == NodeKind::Ref && n.value != none ? arrays.find(n.value) : arrays.end();
+        if (pos == arrays.end())
+        {
+            error("expected an array parameter");
+            return nullptr;
+        }
+        label = n.value;
+        return &pos->second;
+    }
+
+    // An element index into the array as an i64.  The index of a loop over
+    // the array is in range already; anything else is checked, and traps
+    // when out of range.
+    llvm::Value* element_index(NodeId id, LabelId array_label, Array const& array)
+    {
+        Node const& n = ir.node(id);
+        if (n.kind == NodeKind::Ref && n.value != none)
+        {
+            auto index = indexes.find(n.value);
+            if (index != indexes.end())
+                for (LabelId in_range : index->second.arrays)
+                    if (in_range == array_label)
+                        return index->second.value;
+        }
+
+        llvm::Value* v = gen(id);
+        if (!v)
+            return nullptr;
+        llvm::Value* i = to_int(v, "index");
+        trap_unless(b.CreateICmpULT(i, array.length), "index");
+        return i;
+    }
+
+    // Saturating, so NaN and out of range numbers have a defined result.
+    llvm::Value* to_int(llvm::Value* v, char const* name)
+    {
+        // Folded here so lengths given as numbers are known, e.g. to
+        // specialize calls that pass the array.
+        if (auto constant = llvm::dyn_cast<llvm::ConstantFP>(v))
+        {
+            double d = constant->getValueAPF().convertToDouble();
+            std::int64_t i = d != d ? 0 : d <= -9.2233720368547758e18 ? INT64_MIN
+                : d >= 9.2233720368547758e18 ? INT64_MAX : std::int64_t(d);
+            return b.getInt64(i);
+        }
+        return b.CreateIntrinsic(llvm::Intrinsic::fptosi_sat, { b.getInt64Ty(), b.getDoubleTy() }, { v }, nullptr, name);
+    }
+
+    void trap_unless(llvm::Value* ok_cond, char const* what)
+    {
+        if (auto constant = llvm::dyn_cast<llvm::ConstantInt>(ok_cond))
+            if (constant->isOne())
+                return;
+        llvm::BasicBlock* bad = llvm::BasicBlock::Create(cg.context, std::string(what) + ".bad", function);
+        llvm::BasicBlock* ok = llvm::BasicBlock::Create(cg.context, std::string(what) + ".ok", function);
+        llvm::MDNode* unlikely = llvm::MDBuilder(cg.context).createBranchWeights(1 << 20, 1);
+        b.CreateCondBr(ok_cond, ok, bad, unlikely);
+        b.SetInsertPoint(bad);
+        b.CreateIntrinsic(llvm::Intrinsic::trap, {}, {});
+        b.CreateUnreachable();
+        b.SetInsertPoint(ok);
+    }
+
+    bool is_array_alloc(NodeId id) const
+    {
+        Node const& n = ir.node(id);
+        return n.kind == NodeKind::Call && n.symbol == sym_array && n.value == none && n.flags == HasArgs;
+    }
+
+    // a := array(n) makes a an array of n zeros in the thread's region
+    // (see Knife/Region.hpp), which the def releases when it returns.
+    llvm::Value* gen_array_alloc(Node const& label, NodeId call)
+    {
+        IR::Range kids = ir.children_of(call);
+        if (kids.size() != 1)
+            return error("array takes a length");
+        llvm::Value* count = gen(kids[0]);
+        if (!count)
+            return nullptr;
+
+        llvm::Value* length = to_int(count, "length");
+        length = b.CreateSelect(b.CreateICmpSLT(length, b.getInt64(0)), b.getInt64(0), length);
+        trap_unless(b.CreateICmpULE(length, b.getInt64(std::int64_t(1) << 56)), "length");
+
+        llvm::Type* mark_type = llvm::ArrayType::get(b.getInt8PtrTy(), 2);
+        static_assert(sizeof(Region::Mark) == 2 * sizeof(void*), "the region mark is two pointers");
+        if (!region_mark)
+        {
+            llvm::BasicBlock& entry = function->getEntryBlock();
+            llvm::IRBuilder<> at_entry(&entry, entry.begin());
+            at_entry.SetCurrentDebugLocation(b.getCurrentDebugLocation());
+            region_mark = at_entry.CreateBitCast(at_entry.CreateAlloca(mark_type, nullptr, "region"), b.getInt8PtrTy());
+            at_entry.CreateCall(cg.module->getOrInsertFunction("knife_region_mark",
+                llvm::FunctionType::get(b.getVoidTy(), { b.getInt8PtrTy() }, false)), { region_mark });
+        }
+
+        llvm::FunctionCallee alloc = cg.module->getOrInsertFunction("knife_region_alloc",
+            llvm::FunctionType::get(b.getInt8PtrTy(), { b.getInt64Ty() }, false));
+        llvm::Function* alloc_function = llvm::cast<llvm::Function>(alloc.getCallee());
+        alloc_function->addRetAttr(llvm::Attribute::NoAlias);
+        alloc_function->addRetAttr(llvm::Attribute::getWithAlignment(cg.context, llvm::Align(array_alignment)));
+
+        llvm::Value* bytes = b.CreateMul(length, b.getInt64(sizeof(double)), "bytes", true, true);
+        llvm::Value* memory = b.CreateCall(alloc, { bytes }, "memory");
+        b.CreateMemSet(memory, b.getInt8(0), bytes, llvm::MaybeAlign(array_alignment));
+
+        Array& array = arrays[label.value];
+        array.data = b.CreateBitCast(memory, llvm::Type::getDoublePtrTy(cg.context), ir.symbols.name(label.symbol));
+        array.length = length;
+        return zero();
+    }
+
+    bool is_def_call(NodeId id) const
+    {
+        Node const& n = ir.node(id);
+        return (n.kind == NodeKind::Call || n.kind == NodeKind::Ref) && n.value != none
+            && ir.label(n.value).kind == LabelKind::Def;
+    }
+
+    bool is_spawn(NodeId id) const
+    {
+        Node const& n = ir.node(id);
+        return n.kind == NodeKind::Call && n.symbol == sym_spawn && n.value == none && n.flags == HasArgs;
+    }
+
+    llvm::FunctionCallee await_function()
+    {
+        return cg.module->getOrInsertFunction("knife_task_await",
+            llvm::FunctionType::get(b.getDoubleTy(), { b.getInt8PtrTy() }, false));
+    }
+
+    // The slot of a task label, zeroed on entry.
+    llvm::Value* task_slot(Node const& label)
+    {
+        llvm::Value*& slot = tasks[label.value];
+        if (!slot)
+        {
+            llvm::Type* slot_type = llvm::StructType::get(b.getInt8PtrTy(), b.getDoubleTy());
+            static_assert(sizeof(Scheduler::TaskSlot) == sizeof(void*) + sizeof(double), "a task slot is a pointer and a number");
+            llvm::BasicBlock& entry = function->getEntryBlock();
+            llvm::IRBuilder<> at_entry(&entry, entry.begin());
+            llvm::AllocaInst* memory = at_entry.CreateAlloca(slot_type, nullptr, ir.symbols.name(label.symbol));
+            at_entry.CreateStore(llvm::ConstantAggregateZero::get(slot_type), memory);
+            slot = at_entry.CreateBitCast(memory, b.getInt8PtrTy());
+        }
+        return slot;
+    }
+
+    // t := spawn(f(args)) starts f(args) as a task and keeps it in t's
+    // slot.  The args are copied, so one buffer serves every spawn.
+    llvm::Value* gen_spawn(Node const& label, NodeId call)
+    {
+        IR::Range kids = ir.children_of(call);
+        if (kids.size() != 1)
+            return error("spawn takes a call of a top-level def");
+
+        // The call may have been folded to its value at compile time; then
+        // the slot holds the value, as if the task had been awaited.
+        if (!is_def_call(kids[0]))
+        {
+            llvm::Value* v = gen(kids[0]);
+            if (!v)
+                return nullptr;
+            llvm::Value* slot = task_slot(label);
+            b.CreateCall(await_function(), { slot });
+            llvm::Type* slot_type = llvm::StructType::get(b.getInt8PtrTy(), b.getDoubleTy());
+            b.CreateStore(v, b.CreateStructGEP(slot_type, b.CreateBitCast(slot, slot_type->getPointerTo()), 1));
+            return zero();
+        }
+        Node const& target = ir.node(kids[0]);
+
+        llvm::Function* f = callee_of(target);
+        if (!f)
+            return nullptr;
+        for (llvm::Type* param : f->getFunctionType()->params())
+            if (!param->isDoubleTy())
+                return error("spawning " + ir.symbols.name(target.symbol) + ", which takes arrays");
+        if (f->arg_size() > Scheduler::max_task_args)
+            return error("spawning " + ir.symbols.name(target.symbol) + ", which takes more than "
+                + std::to_string(Scheduler::max_task_args) + " arguments");
+
+        std::vector<llvm::Value*> args;
+        if (!gen_args(target, kids[0], args))
+            return nullptr;
+
+        llvm::Value* slot = task_slot(label);
+        llvm::Type* args_type = llvm::ArrayType::get(b.getDoubleTy(), Scheduler::max_task_args);
+        if (!task_args)
+        {
+            llvm::BasicBlock& entry = function->getEntryBlock();
+            llvm::IRBuilder<> at_entry(&entry, entry.begin());
+            task_args = at_entry.CreateAlloca(args_type, nullptr, "task.args");
+        }
+        for (std::size_t i = 0; i < args.size(); ++i)
+            b.CreateStore(args[i], b.CreateConstInBoundsGEP2_64(args_type, task_args, 0, i));
+
+        llvm::Function* entry = cg.task_entry(f);
+        llvm::FunctionCallee spawn = cg.module->getOrInsertFunction("knife_task_spawn",
+            llvm::FunctionType::get(b.getVoidTy(),
+                { b.getInt8PtrTy(), entry->getType(), llvm::Type::getDoublePtrTy(cg.context), b.getInt64Ty() }, false));
+        b.CreateCall(spawn, { slot, entry, b.CreateConstInBoundsGEP2_64(args_type, task_args, 0, 0),
+            b.getInt64(args.size()) });
+        return zero();
+    }
+
+    llvm::Value* gen_await(IR::Range kids)
+    {
+        auto task = tasks.end();
+        if (kids.size() == 1 && ir.node(kids[0]).kind == NodeKind::Ref && ir.node(kids[0]).value != none)
+            task = tasks.find(ir.node(kids[0]).value);
+        if (task == tasks.end())
+            return error("await takes a label made with spawn");
+        return b.CreateCall(await_function(), { task->second }, "await");
+    }
+
+    // Before each return, waits for the tasks the def spawned and frees
+    // what it allocated.
+    void finish_returns()
+    {
+        llvm::FunctionCallee release = cg.module->getOrInsertFunction("knife_region_release",
+            llvm::FunctionType::get(b.getVoidTy(), { b.getInt8PtrTy() }, false));
+        for (auto& block : *function)
+            if (auto ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator()))
+            {
+                llvm::IRBuilder<> before(ret);
+                for (auto const& task : tasks)
+                    before.CreateCall(await_function(), { task.second });
+                if (region_mark)
+                    before.CreateCall(release, { region_mark });
+            }
+    }
+
+    llvm::Value* element_address(Array const& array, llvm::Value* index)
+    {
+        return b.CreateInBoundsGEP(b.getDoubleTy(), array.data, index, "element");
+    }
+
+    llvm::Value* gen_length(IR::Range kids)
+    {
+        LabelId label;
+        Array const* array = kids.size() == 1 ? array_arg(kids[0], label) : nullptr;
+        if (!array)
+            return error("length takes one array");
+        return b.CreateSIToFP(array->length, b.getDoubleTy(), "length");
+    }
+
+    llvm::Value* gen_at(IR::Range kids)
+    {
+        LabelId label;
+        Array const* array = kids.size() == 2 ? array_arg(kids[0], label) : nullptr;
+        if (!array)
+            return error("at takes an array and an index");
+        llvm::Value* i = element_index(kids[1], label, *array);
+        return i ? b.CreateLoad(b.getDoubleTy(), element_address(*array, i), "at") : nullptr;
+    }
+
+    llvm::Value* gen_put(IR::Range kids)
+    {
+        LabelId label;
+        Array const* array = kids.size() == 3 ? array_arg(kids[0], label) : nullptr;
+        if (!array)
+            return error("put takes an array, an index and a value");
+        llvm::Value* i = element_index(kids[1], label, *array);
+        llvm::Value* v = i ? gen(kids[2]) : nullptr;
+        if (!v)
+            return nullptr;
+        b.CreateStore(v, element_address(*array, i));
+        return v;
+    }
+
+    // each, map or sum(i:, arrays...) { block }: a counted loop whose
+    // induction variable is an i64 from 0 to the shortest length, so the
+    // vectorizer sees the trip count before the loop starts.  The lines of
+    // the block are probed once, before the loop: a flag load in the body
+    // would keep it from being vectorized, armed or not.
+    llvm::Value* gen_array_loop(ArrayLoop kind, Node const& n, IR::Range kids)
+    {
+        char const* const names[] = { "each", "map", "sum" };
+        Node const& index = ir.node(kids[0]);
+        if (n.flags != (HasArgs | HasBlock) || kids.size() < 3 || index.kind != NodeKind::Label
+            || index.flags != 0 || index.symbol == none || ir.node(kids[kids.size() - 1]).kind != NodeKind::Block)
+            return error(std::string(names[kind]) + " takes an index label, "
+                + (kind == Map ? "the array to store to, any arrays to read" : "the arrays to walk") + " and a block");
+
+        Index walk;
+        llvm::Value* count = nullptr;
+        for (std::size_t k = 1; k + 1 < kids.size(); ++k)
+        {
+            LabelId label;
+            Array const* array = array_arg(kids[k], label);
+            if (!array)
+                return nullptr;
+            walk.arrays.push_back(label);
+            count = count ? b.CreateSelect(b.CreateICmpULT(array->length, count), array->length, count, "count")
+                : array->length;
+        }
+
+        if (cg.options.probes && array_loops == 0)
+        {
+            std::vector<std::uint32_t> lines;
+            statement_lines(kids[kids.size() - 1], lines);
+            for (std::uint32_t line : lines)
+                emit_probe(line);
+        }
+
+        llvm::BasicBlock* entry_bb = b.GetInsertBlock();
+        llvm::BasicBlock* cond_bb = llvm::BasicBlock::Create(cg.context, names[kind], function);
+        llvm::BasicBlock* body_bb = llvm::BasicBlock::Create(cg.context, std::string(names[kind]) + ".body", function);
+        llvm::BasicBlock* done_bb = llvm::BasicBlock::Create(cg.context, std::string("end") + names[kind], function);
+        b.CreateBr(cond_bb);
+
+        b.SetInsertPoint(cond_bb);
+        llvm::PHINode* i = b.CreatePHI(b.getInt64Ty(), 2, ir.symbols.name(index.symbol));
+        i->addIncoming(b.getInt64(0), entry_bb);
+        llvm::PHINode* total = kind == Sum ? b.CreatePHI(b.getDoubleTy(), 2, "sum") : nullptr;
+        if (total)
+            total->addIncoming(zero(), entry_bb);
+        b.CreateCondBr(b.CreateICmpULT(i, count), body_bb, done_bb);
+
+        b.SetInsertPoint(body_bb);
+        walk.value = i;
+        indexes[index.value] = walk;
+        ++array_loops;
+        llvm::Value* v = gen_stmts(kids[kids.size() - 1]);
+        --array_loops;
+        indexes.erase(index.value);
+        if (!v)
+            return nullptr;
+
+        if (!b.GetInsertBlock()->getTerminator())
+        {
+            if (kind == Map)
+                b.CreateStore(v, element_address(arrays[walk.arrays[0]], i));
+            if (total)
+            {
+                llvm::Instruction* add = llvm::cast<llvm::Instruction>(b.CreateFAdd(total, v, "sum.next"));
+                add->setHasAllowReassoc(true);
+                total->addIncoming(add, b.GetInsertBlock());
+            }
+            i->addIncoming(b.CreateAdd(i, b.getInt64(1), "", true, true), b.GetInsertBlock());
+            b.CreateBr(cond_bb);
+        }
+
+        // Afterwards the label holds how many elements were walked.
+        b.SetInsertPoint(done_bb);
+        b.CreateStore(b.CreateSIToFP(i, b.getDoubleTy()), slot_for(index.value));
+        return total ? total : zero();
+    }
+
+    llvm::Value* gen_call(Node const& n, NodeId id)
+    {
+        IR::Range kids = ir.children_of(id);
+
+        if (n.value == none)
+        {
+            if (is_literal_call(id, sym_if, 1))
+            {
+                llvm::Value* cond = gen(kids[0]);
+                return cond ? gen_if(cond, kids[1], none) : nullptr;
+            }
+
+            if (is_literal_call(id, sym_while, 1))
+                return gen_while(kids[0], kids[1]);
+
+            if (n.symbol == sym_return && n.flags == HasArgs && kids.size() <= 1)
+            {
+                llvm::Value* v = kids.size() ? gen(kids[0]) : zero();
+                if (!v)
+                    return nullptr;
+                b.CreateRet(v);
+                return v;
+            }
+
+            Op op = op_of(n.symbol);
+            if (op != NotAnOp && n.flags == HasArgs)
+                return gen_op(op, kids);
+
+            if (n.flags == HasArgs)
+            {
+                if (n.symbol == sym_length)
+                    return gen_length(kids);
+                if (n.symbol == sym_at)
+                    return gen_at(kids);
+                if (n.symbol == sym_put)
+                    return gen_put(kids);
+                if (n.symbol == sym_await)
+                    return gen_await(kids);
+            }
+            if (n.symbol == sym_each)
+                return gen_array_loop(Each, n, kids);
+            if (n.symbol == sym_map)
+                return gen_array_loop(Map, n, kids);
+            if (n.symbol == sym_sum)
+                return gen_array_loop(Sum, n, kids);
+
+            auto external = cg.externals.find(ir.symbols.name(n.symbol));
+            if (external != cg.externals.end() && n.flags == HasArgs)
+                return gen_external_call(external->first, external->second, kids);
+
+            return error("unknown template " + ir.symbols.name(n.symbol));
+        }
+
+        llvm::Function* f = callee_of(n);
+        std::vector<llvm::Value*> args;
+        std::vector<PassedArray> passed;
+        if (!f || !gen_args(n, id, args, &passed))
+            return nullptr;
+        if (!passed.empty() && cg.options.max_specializations > 0)
+            f = specialize_call(ir.label(n.value).decl, f, args, passed);
+        return b.CreateCall(f, args, "call");
+    }
+
+    // Switches a call that passes arrays of known length to the callee's
+    // instantiation for them, rewriting the arguments to match.  Arrays
+    // up to max_value_elements long that the callee does not write are
+    // passed by value.
+    llvm::Function* specialize_call(NodeId decl, llvm::Function* f, std::vector<llvm::Value*>& args,
+        std::vector<PassedArray> const& passed)
+    {
+        std::vector<ArrayAspect> wanted;
+        bool special = false;
+        for (PassedArray const& p : passed)
+        {
+            auto length = llvm::dyn_cast<llvm::ConstantInt>(p.array.length);
+            ArrayAspect aspect = { ArrayStorage::Reference, 0 };
+            if (length)
+            {
+                aspect.length = length->getSExtValue();
+                aspect.storage = aspect.length <= max_value_elements && !cg.may_write(ir.node(decl).value, p.param)
+                    ? ArrayStorage::Value : ArrayStorage::Fixed;
+                special = true;
+            }
+            wanted.push_back(aspect);
+        }
+
+        llvm::Function* instance = special ? cg.specialize(decl, wanted) : nullptr;
+        if (!instance)
+            return f;
+
+        std::vector<llvm::Value*> rewritten;
+        std::size_t next = 0;
+        for (std::size_t k = 0; k < passed.size(); ++k)
+        {
+            rewritten.insert(rewritten.end(), args.begin() + next, args.begin() + passed[k].position);
+            next = passed[k].position + 2;
+            Array const& array = passed[k].array;
+            switch (wanted[k].storage)
+            {
+            case ArrayStorage::Reference:
+                rewritten.push_back(array.data);
+                rewritten.push_back(array.length);
+                break;
+            case ArrayStorage::Fixed:
+                rewritten.push_back(array.data);
+                break;
+            case ArrayStorage::Value:
+                for (std::int64_t e = 0; e < wanted[k].length; ++e)
+                    rewritten.push_back(b.CreateLoad(b.getDoubleTy(), element_address(array, b.getInt64(e)), "element"));
+                break;
+            }
+        }
+        rewritten.insert(rewritten.end(), args.begin() + next, args.end());
+        args.swap(rewritten);
+        return instance;
+    }
+
+    // The function of a call of a top-level def, or null (reported).
+    llvm::Function* callee_of(Node const& n)
+    {
+        Label const& callee = ir.label(n.value);
+        Node const& decl = ir.node(callee.decl);
+        llvm::Function* f = nullptr;
+        if (callee.kind == LabelKind::Def && decl.kind == NodeKind::Def)
+        {
+            f = cg.function_of(decl.value);
+
+            // Another module scope's def is an interface's (see
+            // Knife/Interface.hpp), which the library's module defines.
+            if (!f && ir.scope(callee.scope).parent == none)
+                f = cg.declare_import(decl.value);
+        }
+
+        if (!f)
+            error(ir.symbols.name(n.symbol) + " is not a top-level def");
+        return f;
+    }
+
+    // The machine arguments of a call of a top-level def, defaults filled
+    // in, for its own symbol.
+    bool gen_args(Node const& n, NodeId id, std::vector<llvm::Value*>& args, std::vector<PassedArray>* arrays_passed = nullptr)
+    {
+        IR::Range kids = ir.children_of(id);
+        if (n.flags & HasBlock)
+            return error("passing a block to " + ir.symbols.name(n.symbol));
+
+        NodeId decl = ir.label(n.value).decl;
+        Def const& d = ir.def(ir.node(decl).value);
+        if (kids.size() > d.param_count)
+            return error("too many arguments to " + ir.symbols.name(n.symbol));
+
+        std::vector<LabelId> passed;
+        for (std::uint32_t i = 0; i < d.param_count; ++i)
+        {
+            Param const& p = ir.param(ir.node(decl).value, i);
+            NodeId arg = i < kids.size() ? kids[i] : p.default_value;
+            if (arg == none)
+                return error("missing argument " + ir.symbols.name(p.name) + " to " + ir.symbols.name(n.symbol));
+
+            if (is_array_param(ir, p))
+            {
+                LabelId label;
+                Array const* array = array_arg(arg, label);
+                if (!array)
+                    return false;
+                if (std::find(passed.begin(), passed.end(), label) != passed.end())
+                    return error("passing array " + ir.symbols.name(ir.label(label).name) + " twice to "
+                        + ir.symbols.name(n.symbol));
+                passed.push_back(label);
+                if (arrays_passed)
+                    arrays_passed->push_back(PassedArray{ args.size(), i, *array });
+                args.push_back(array->data);
+                args.push_back(array->length);
+                continue;
+            }
+
+            llvm::Value* v = gen(arg);
+            if (!v)
+                return false;
+            args.push_back(v);
+        }
+        return true;
+    }
+
+public:
+    // With aspects, emits the instantiation of the def for them.
+    FunctionGen(Codegen& cg, llvm::Function* function, DefId def, std::vector<ArrayAspect> const* aspects)
+        : cg(cg), ir(cg.ir), b(cg.context), function(function), def(def), failed(false), subprogram(nullptr),
+          aspects(aspects), array_loops(0), region_mark(nullptr), task_args(nullptr)
+    {
+        sym_if = ir.symbols.find("if");
+        sym_else = ir.symbols.find("else");
+        sym_while = ir.symbols.find("while");
+        sym_return = ir.symbols.find("return");
+        sym_length = ir.symbols.find("length");
+        sym_at = ir.symbols.find("at");
+        sym_put = ir.symbols.find("put");
+        sym_each = ir.symbols.find("each");
+        sym_map = ir.symbols.find("map");
+        sym_sum = ir.symbols.find("sum");
+        sym_array = ir.symbols.find("array");
+        sym_spawn = ir.symbols.find("spawn");
+        sym_await = ir.symbols.find("await");
+        for (int op = 0; op < NotAnOp; ++op)
+            ops[op] = ir.symbols.find(op_names[op]);
+    }
+
+    bool run(std::uint32_t line)
+    {
+        b.SetInsertPoint(llvm::BasicBlock::Create(cg.context, "entry", function));
+
+        if (cg.di)
+        {
+            llvm::DIType* number = cg.di->createBasicType("Float", 64, llvm::dwarf::DW_ATE_float);
+            llvm::DIType* length = cg.di->createBasicType("Int", 64, llvm::dwarf::DW_ATE_signed);
+            llvm::DIType* data = cg.di->createPointerType(number, 64);
+            std::vector<llvm::Metadata*> types(1, number);
+            for (llvm::Type* param : function->getFunctionType()->params())
+                types.push_back(param->isDoubleTy() ? number : param->isPointerTy() ? data : length);
+            Def const& d = ir.def(def);
+            subprogram = cg.di->createFunction(cg.di_unit, ir.symbols.name(d.name), function->getName(),
+                cg.di_file, line, cg.di->createSubroutineType(cg.di->getOrCreateTypeArray(types)), line,
+                llvm::DINode::FlagPrototyped, llvm::DISubprogram::SPFlagDefinition);
+            function->setSubprogram(subprogram);
+            function->addFnAttr("frame-pointer", "all");
+            b.SetCurrentDebugLocation(llvm::DILocation::get(cg.context, line, 0, subprogram));
+        }
+
+        Def const& d = ir.def(def);
+        auto arg = function->arg_begin();
+        std::size_t array_params = 0;
+        for (std::uint32_t i = 0; i < d.param_count; ++i, ++arg)
+        {
+            Param const& p = ir.param(def, i);
+            std::string name = ir.symbols.name(p.name);
+            arg->setName(name);
+            if (is_array_param(ir, p))
+            {
+                ArrayAspect aspect = aspects ? (*aspects)[array_params++] : ArrayAspect{ ArrayStorage::Reference, 0 };
+                Array& array = arrays[p.label];
+                if (aspect.storage == ArrayStorage::Value)
+                {
+                    // The elements go to the stack, so at and the loops
+                    // work as usual; once the loops are unrolled, SROA
+                    // keeps them in registers.
+                    llvm::Type* type = llvm::ArrayType::get(b.getDoubleTy(), aspect.length);
+                    llvm::AllocaInst* elements = b.CreateAlloca(type, nullptr, name);
+                    elements->setAlignment(llvm::Align(array_alignment));
+                    for (std::int64_t k = 0; k < aspect.length; ++k, ++arg)
+                    {
+                        arg->setName(name + "." + std::to_string(k));
+                        b.CreateStore(&*arg, b.CreateConstInBoundsGEP2_64(type, elements, 0, k));
+                    }
+                    --arg;
+                    array.data = b.CreateBitCast(elements, llvm::Type::getDoublePtrTy(cg.context));
+                    array.length = b.getInt64(aspect.length);
+                    continue;
+                }
+
+                array.data = &*arg;
+                if (aspect.storage == ArrayStorage::Fixed)
+                {
+                    array.length = b.getInt64(aspect.length);
+                    continue;
+                }
+                ++arg;
+                array.length = &*arg;
+                arg->setName(name + ".length");
+                continue;
+            }
+            b.CreateStore(&*arg, slot_for(p.label));
+        }
+
+        llvm::Value* result = gen_stmts(d.body);
+        if (!result)
+            return false;
+
+        if (!b.GetInsertBlock()->getTerminator())
+            b.CreateRet(result);
+
+        if (region_mark || !tasks.empty())
+            finish_returns();
+        return true;
+    }
+
+    llvm::Value* gen(NodeId id)
+    {
+        Node const& n = ir.node(id);
+
+        switch (n.kind)
+        {
+        case NodeKind::Number:
+            return llvm::ConstantFP::get(b.getDoubleTy(), ir.number(n.value));
+
+        case NodeKind::Ref:
+        {
+            if (n.value == none)
+                return error("unknown name " + ir.symbols.name(n.symbol));
+
+            if (ir.label(n.value).kind == LabelKind::Def)
+                return gen_call(n, id);
+
+            if (!is_local(n.value))
+                return error(ir.symbols.name(n.symbol) + " is declared outside the def");
+
+            if (arrays.count(n.value))
+                return error("array " + ir.symbols.name(n.symbol) + " used as a number");
+            if (tasks.count(n.value))
+                return error("task " + ir.symbols.name(n.symbol) + " used as a number; await it first");
+
+            auto index = indexes.find(n.value);
+            if (index != indexes.end())
+                return b.CreateSIToFP(index->second.value, b.getDoubleTy(), ir.symbols.name(n.symbol));
+
+            return b.CreateLoad(b.getDoubleTy(), slot_for(n.value), ir.symbols.name(n.symbol));
+        }
+
+        case NodeKind::Label:
+        {
+            if ((n.flags & HasInit) && is_array_alloc(ir.children_of(id)[n.child_count - 1]))
+                return gen_array_alloc(n, ir.children_of(id)[n.child_count - 1]);
+            if ((n.flags & HasInit) && is_spawn(ir.children_of(id)[n.child_count - 1]))
+                return gen_spawn(n, ir.children_of(id)[n.child_count - 1]);
+
+            llvm::Value* v = zero();
+            if (n.flags & HasInit)
+            {
+                v = gen(ir.children_of(id)[n.child_count - 1]);
+                if (!v)
+                    return nullptr;
+            }
+            b.CreateStore(v, slot_for(n.value));
+            return v;
+        }
+
+        case NodeKind::Assign:
+        {
+            if (n.value == none || !is_local(n.value))
+                return error("reassignment of " + ir.symbols.name(n.symbol) + " outside the def");
+            if (arrays.count(n.value) || indexes.count(n.value) || tasks.count(n.value))
+                return error("reassignment of " + ir.symbols.name(n.symbol) + ", which is an array, loop index or task");
+
+            llvm::Value* v = gen(ir.children_of(id)[0]);
+            if (!v)
+                return nullptr;
+            b.CreateStore(v, slot_for(n.value));
+            return v;
+        }
+
+        case NodeKind::Call:
+            return gen_call(n, id);
+
+        case NodeKind::Send:
+        {
+            // if(c) { ... } else { ... } is an else message sent to the if call.
+            IR::Range kids = ir.children_of(id);
+            if (n.symbol == sym_else && n.flags == HasBlock && kids.size() == 2
+                && is_literal_call(kids[0], sym_if, 1)
+                && ir.node(kids[1]).kind == NodeKind::Block)
+            {
+                IR::Range if_kids = ir.children_of(kids[0]);
+                llvm::Value* cond = gen(if_kids[0]);
+                return cond ? gen_if(cond, if_kids[1], kids[1]) : nullptr;
+            }
+            return error("message " + ir.symbols.name(n.symbol) + " is not supported");
+        }
+
+        case NodeKind::String:
+            return error("strings are not supported");
+        case NodeKind::Tuple:
+            return error("tuples are not supported");
+        case NodeKind::Block:
+            return error("blocks are only supported as arguments to if and while");
+        case NodeKind::Def:
+            return error("nested defs are not supported");
+        }
+
+        return error("unexpected node");
+    }
+};
+
+}
+
+Codegen::Codegen(IR const& ir, llvm::LLVMContext& context, std::string const& module_name,
+    std::string const& file_name, CodegenOptions options)
+    : ir(ir), context(context), module(new llvm::Module(module_name, context)), options(options),
+      flags_name("knife.probes." + module_name), di_file(nullptr), di_unit(nullptr), spec_stats(), invalid(0), pending_flags(nullptr)
+{
+    if (options.debug_info)
+    {
+        module->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+        module->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+
+        std::string::size_type slash = file_name.find_last_of('/');
+        std::string directory = slash == std::string::npos ? "." : file_name.substr(0, slash);
+
+        di.reset(new llvm::DIBuilder(*module));
+        di_file = di->createFile(file_name.substr(slash == std::string::npos ? 0 : slash + 1), directory);
+        di_unit = di->createCompileUnit(llvm::dwarf::DW_LANG_C, di_file, "Knife", true, "", 0);
+    }
+}
+
+Codegen::~Codegen()
+{
+}
+
+void Codegen::declare_external(std::string const& name, unsigned arity)
+{
+    externals[name] = arity;
+}
+
+std::size_t Codegen::emit(std::vector<NodeId> const& items)
+{
+    TimeReport::Phase phase("codegen");
+
+    // Declare everything first so defs can call each other in any order.
+    std::vector<DefId> defs;
+    std::vector<std::uint32_t> lines;
+    for (NodeId item : items)
+    {
+        Node const& n = ir.node(item);
+        if (n.kind != NodeKind::Def || n.symbol == none)
+            continue;
+
+        functions[n.value] = declare(n.value, ir.symbols.name(n.symbol), nullptr);
+        defs.push_back(n.value);
+        lines.push_back(ir.line_of(item));
+    }
+
+    // A def that fails is dropped along with the functions that use it.
+    std::vector<llvm::Function*> dropped;
+    auto generate = [&](llvm::Function* f, DefId def, std::uint32_t line, std::vector<ArrayAspect> const* aspects) {
+        std::size_t first_probe = probes.size();
+        FunctionGen gen(*this, f, def, aspects);
+
+        bool ok = gen.run(line);
+        if (di && f->getSubprogram())
+            di->finalizeSubprogram(f->getSubprogram());
+        bool rejected = false;
+        if (ok)
+        {
+            TimeReport::Phase verify("verify");
+            rejected = llvm::verifyFunction(*f, &llvm::errs());
+        }
+        if (rejected)
+        {
+            cerr << "codegen: " << ir.symbols.name(ir.def(def).name) << ": generated invalid code" << endl;
+            ++invalid;
+            ok = false;
+        }
+
+        if (!ok)
+        {
+            f->deleteBody();
+            probes.resize(first_probe);
+            dropped.push_back(f);
+        }
+    };
+
+    for (std::size_t i = 0; i < defs.size(); ++i)
+        generate(functions[defs[i]], defs[i], lines[i], nullptr);
+
+    // The instantiations the calls so far asked for, which may ask for
+    // more.  Those of a def that failed fail the same way; they are
+    // dropped without generating them again.  An imported def's are
+    // generated from its body in the interface.
+    for (std::size_t i = 0; i < specializations.size(); ++i)
+    {
+        Specialization s = specializations[i];
+        auto own = functions.find(s.def);
+        if (own != functions.end() && own->second->isDeclaration())
+            dropped.push_back(s.function);
+        else
+            generate(s.function, s.def, s.line, &s.aspects);
+    }
+
+    // Functions that use a dropped one are dropped too: callers, and the
+    // entries of tasks that run it along with the defs that spawn those.
+    // They join the end of the list, so their own users follow.
+    for (std::size_t i = 0; i < dropped.size(); ++i)
+    {
+        llvm::Function* f = dropped[i];
+
+        std::vector<llvm::Function*> users;
+        for (llvm::User* user : f->users())
+            if (auto inst = llvm::dyn_cast<llvm::Instruction>(user))
+                users.push_back(inst->getFunction());
+
+        for (llvm::Function* user : users)
+        {
+            if (user->isDeclaration())
+                continue;
+
+            if (!user->hasLocalLinkage())
+            {
+                std::string use = "calls " + f->getName().str();
+                for (auto const& entry : task_entries)
+                    if (entry.second == f)
+                        use = "spawns " + entry.first->getName().str();
+                for (auto const& special : specializations)
+                    if (special.function == f)
+                        use = "calls " + ir.symbols.name(ir.def(special.def).name);
+                cerr << "codegen: " << user->getName().str() << ": " << use << ", which was not emitted" << endl;
+            }
+            user->deleteBody();
+            dropped.push_back(user);
+        }
+    }
+
+    for (llvm::Function* f : dropped)
+    {
+        for (auto& entry : functions)
+            if (entry.second == f)
+                entry.second = nullptr;
+        for (auto entry = task_entries.begin(); entry != task_entries.end();)
+            entry = entry->first == f || entry->second == f ? task_entries.erase(entry) : std::next(entry);
+        f->eraseFromParent();
+    }
+
+    std::size_t emitted = 0;
+    for (DefId def : defs)
+        if (functions[def])
+            ++emitted;
+    TimeReport::count("functions emitted", emitted);
+    TimeReport::count("functions dropped", defs.size() - emitted);
+    TimeReport::count("specialized instances", spec_stats.instances);
+    TimeReport::count("specialized call sites", spec_stats.call_sites);
+    TimeReport::count("call sites over the specialization cap", spec_stats.capped);
+    TimeReport::count("LLVM instructions generated", module->getInstructionCount());
+    return emitted;
+}
+
+llvm::Function* Codegen::declare(DefId def, std::string const& name, std::vector<ArrayAspect> const* aspects)
+{
+    Def const& d = ir.def(def);
+    std::vector<llvm::Type*> params;
+    std::vector<unsigned> array_data;
+    std::size_t array_params = 0;
+    for (std::uint32_t i = 0; i < d.param_count; ++i)
+    {
+        if (!is_array_param(ir, ir.param(def, i)))
+        {
+            params.push_back(llvm::Type::getDoubleTy(context));
+            continue;
+        }
+
+        ArrayAspect aspect = aspects ? (*aspects)[array_params++] : ArrayAspect{ ArrayStorage::Reference, 0 };
+        if (aspect.storage == ArrayStorage::Value)
+        {
+            params.insert(params.end(), aspect.length, llvm::Type::getDoubleTy(context));
+            continue;
+        }
+        array_data.push_back(params.size());
+        params.push_back(llvm::Type::getDoublePtrTy(context));
+        if (aspect.storage == ArrayStorage::Reference)
+            params.push_back(llvm::Type::getInt64Ty(context));
+    }
+
+    llvm::FunctionType* type = llvm::FunctionType::get(llvm::Type::getDoubleTy(context), params, false);
+    llvm::Function* f = llvm::Function::Create(type,
+        aspects ? llvm::Function::InternalLinkage : llvm::Function::ExternalLinkage, name, module.get());
+    for (unsigned k : array_data)
+    {
+        f->addParamAttr(k, llvm::Attribute::NoAlias);
+        f->addParamAttr(k, llvm::Attribute::NoCapture);
+        f->addParamAttr(k, llvm::Attribute::getWithAlignment(context, llvm::Align(array_alignment)));
+    }
+    return f;
+}
+
+llvm::Function* Codegen::specialize(NodeId decl, std::vector<ArrayAspect> const& aspects)
+{
+    DefId def = ir.node(decl).value;
+    std::size_t made = 0;
+    for (auto const& special : specializations)
+        if (special.def == def)
+        {
+            if (special.aspects == aspects)
+            {
+                ++spec_stats.call_sites;
+                return special.function;
+            }
+            ++made;
+        }
+
+    if (made >= options.max_specializations)
+    {
+        ++spec_stats.capped;
+        return nullptr;
+    }
+
+    // e.g. dot.v3.f100 for arrays of 3 by value and 100 by reference
+    std::string name = ir.symbols.name(ir.def(def).name);
+    for (ArrayAspect const& aspect : aspects)
+        name += aspect.storage == ArrayStorage::Reference ? std::string(".r")
+            : (aspect.storage == ArrayStorage::Value ? ".v" : ".f") + std::to_string(aspect.length);
+
+    Specialization special = { def, aspects, declare(def, name, &aspects), ir.line_of(decl) };
+    specializations.push_back(special);
+    ++spec_stats.instances;
+    ++spec_stats.call_sites;
+    return special.function;
+}
+
+bool Codegen::may_write(DefId def, std::uint32_t param)
+{
+    auto pos = written_arrays.find(def);
+    if (pos == written_arrays.end())
+    {
+        Def const& d = ir.def(def);
+        std::vector<bool> written;
+        for (std::uint32_t i = 0; i < d.param_count; ++i)
+        {
+            Param const& p = ir.param(def, i);
+            written.push_back(is_array_param(ir, p)
+                && writes_array(ir, d.body, p.label, ir.symbols.find("put"), ir.symbols.find("map")));
+        }
+        pos = written_arrays.insert(std::make_pair(def, written)).first;
+    }
+    return pos->second[param];
+}
+
+llvm::Function* Codegen::task_entry(llvm::Function* f)
+{
+    llvm::Function*& entry = task_entries[f];
+    if (entry)
+        return entry;
+
+    llvm::Type* number = llvm::Type::getDoubleTy(context);
+    llvm::FunctionType* type = llvm::FunctionType::get(number, { llvm::Type::getDoublePtrTy(context) }, false);
+    entry = llvm::Function::Create(type, llvm::Function::InternalLinkage, f->getName() + ".task", module.get());
+
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(context, "entry", entry));
+    std::vector<llvm::Value*> args;
+    for (unsigned i = 0; i < f->arg_size(); ++i)
+        args.push_back(b.CreateLoad(number, b.CreateConstInBoundsGEP1_64(number, entry->getArg(0), i)));
+    b.CreateRet(b.CreateCall(f, args));
+    return entry;
+}
+
+llvm::Function* Codegen::declare_import(DefId def)
+{
+    llvm::Function*& f = imports[def];
+    if (!f)
+        f = declare(def, ir.symbols.name(ir.def(def).name), nullptr);
+    return f;
+}
+
+llvm::Function* Codegen::function_of(DefId def) const
+{
+    auto pos = functions.find(def);
+    return pos != functions.end() ? pos->second : nullptr;
+}
+
+void Codegen::finish_probes()
+{
+    if (!pending_flags)
+        return;
+
+    // Probes of dropped defs leave their slots unused, which is harmless.
+    llvm::ArrayType* type = llvm::ArrayType::get(llvm::Type::getInt8Ty(context), std::max<std::size_t>(probes.size(), 1));
+    auto flags = new llvm::GlobalVariable(*module, type, false, llvm::GlobalValue::ExternalLinkage,
+        llvm::ConstantAggregateZero::get(type), flags_name);
+    pending_flags->replaceAllUsesWith(llvm::ConstantExpr::getBitCast(flags, pending_flags->getType()));
+    pending_flags->eraseFromParent();
+    pending_flags = nullptr;
+}
+
+std::unique_ptr<llvm::Module> Codegen::take_module()
+{
+    finish_probes();
+    if (di)
+        di->finalize();
+    return std::move(module);
+}
+
+void Semantic::optimize(llvm::Module& module, int level, llvm::TargetMachine* target)
+{
+    if (level <= 0)
+        return;
+
+    TimeReport::Phase phase("optimize");
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+
+    llvm::PassBuilder pb(target);
+    pb.registerModuleAnalyses(mam);
+    pb.registerCGSCCAnalyses(cgam);
+    pb.registerFunctionAnalyses(fam);
+    pb.registerLoopAnalyses(lam);
+    pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+    llvm::OptimizationLevel const levels[] = {
+        llvm::OptimizationLevel::O0, llvm::OptimizationLevel::O1,
+        llvm::OptimizationLevel::O2, llvm::OptimizationLevel::O3 };
+
+    llvm::ModulePassManager mpm = pb.buildPerModuleDefaultPipeline(levels[level > 3 ? 3 : level]);
+    mpm.run(module, mam);
+    TimeReport::count("LLVM instructions optimized", module.getInstructionCount());
+}
@@ -0,0 +1,380 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Knife/Daemon.hpp"
+
+// A request is a 32-bit length carrying the client's stdin, stdout and
+// stderr as SCM_RIGHTS, then that many bytes of NUL-terminated strings:
+// the working directory and the arguments.  The reply is a 32-bit exit
+// status.
+
+namespace
+{
+
+volatile sig_atomic_t stopping = 0;
+
+void on_terminate(int)
+{
+    stopping = 1;
+}
+
+bool make_address(std::string const& path, sockaddr_un& address)
+{
+    std::memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof address.sun_path)
+        return false;
+    std::memcpy(address.sun_path, path.data(), path.size());
+    return true;
+}
+
+// A socket connected to the server, or -1.
+int connect_to(std::string const& path)
+{
+    sockaddr_un address;
+    if (!make_address(path, address))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Whether the process at the other end of a connected socket runs as
+// this one's user: anyone who can reach the socket could otherwise run
+// commands as the server, or feed a client made-up output.
+bool same_user(int fd)
+{
+    ucred peer;
+    socklen_t size = sizeof peer;
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &size) == 0 && size == sizeof peer
+        && peer.uid == getuid();
+}
+
+// Creates the directory readable only by this user, or checks that an
+// existing one is: not a link, owned by the user, closed to everyone else.
+bool private_directory(std::string const& path)
+{
+    if (mkdir(path.c_str(), 0700) != 0 && errno != EEXIST)
+        return false;
+    struct stat info;
+    return lstat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode) && info.st_uid == getuid()
+        && (info.st_mode & 077) == 0;
+}
+
+bool write_all(int fd, void const* data, std::size_t size)
+{
+    char const* p = static_cast<char const*>(data);
+    while (size > 0)
+    {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool read_all(int fd, void* data, std::size_t size)
+{
+    char* p = static_cast<char*>(data);
+    while (size > 0)
+    {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool send_request(int fd, std::string const& payload, int const streams[3])
+{
+    std::uint32_t length = std::uint32_t(payload.size());
+    iovec io = { &length, sizeof length };
+
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    std::memset(control, 0, sizeof control);
+
+    msghdr message;
+    std::memset(&message, 0, sizeof message);
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof control;
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    std::memcpy(CMSG_DATA(header), streams, 3 * sizeof(int));
+
+    ssize_t sent;
+    do
+        sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+    while (sent < 0 && errno == EINTR);
+
+    return sent == ssize_t(sizeof length) && write_all(fd, payload.data(), payload.size());
+}
+
+bool receive_request(int fd, std::vector<std::string>& strings, int streams[3])
+{
+    std::uint32_t length = 0;
+    iovec io = { &length, sizeof length };
+
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    msghdr message;
+    std::memset(&message, 0, sizeof message);
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof control;
+
+    ssize_t received;
+    do
+        received = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    while (received < 0 && errno == EINTR);
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (received != ssize_t(sizeof length) || !header || header->cmsg_type != SCM_RIGHTS
+        || header->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+        return false;
+    std::memcpy(streams, CMSG_DATA(header), 3 * sizeof(int));
+
+    std::string payload(length, '\0');
+    if (length > 0 && !read_all(fd, &payload[0], length))
+    {
+        for (int i = 0; i < 3; ++i)
+            close(streams[i]);
+        return false;
+    }
+
+    std::size_t begin = 0;
+    for (std::size_t end = payload.find('\0'); end != std::string::npos; end = payload.find('\0', begin))
+    {
+        strings.push_back(payload.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return true;
+}
+
+void flush_streams()
+{
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(stdout);
+    std::fflush(stderr);
+}
+
+// Runs the command in the client's directory with the client's streams,
+// then puts the server's back.
+int run_request(Daemon::Command const& command, std::vector<std::string>& strings, int const streams[3])
+{
+    int saved_directory = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int saved[3];
+
+    flush_streams();
+    for (int i = 0; i < 3; ++i)
+    {
+        saved[i] = dup(i);
+        dup2(streams[i], i);
+    }
+
+    int status = 1;
+    if (chdir(strings[0].c_str()) != 0)
+        cerr << "daemon: cannot enter " << strings[0] << endl;
+    else
+    {
+        std::string program = "Compiler";
+        std::vector<char*> argv(1, &program[0]);
+        for (std::size_t i = 1; i < strings.size(); ++i)
+            argv.push_back(&strings[i][0]);
+        argv.push_back(nullptr);
+
+        try
+        {
+            status = command(int(argv.size() - 1), argv.data());
+        }
+        catch (std::exception const& x)
+        {
+            cerr << "daemon: " << x.what() << endl;
+        }
+    }
+
+    flush_streams();
+    std::cin.clear();
+    for (int i = 0; i < 3; ++i)
+    {
+        dup2(saved[i], i);
+        close(saved[i]);
+    }
+    if (saved_directory >= 0)
+    {
+        if (fchdir(saved_directory) != 0)
+            cerr << "daemon: cannot return to the starting directory" << endl;
+        close(saved_directory);
+    }
+    return status;
+}
+
+}
+
+std::string Daemon::default_socket_path()
+{
+    if (char const* path = std::getenv("KNIFE_DAEMON_SOCKET"))
+        return path;
+    char const* runtime = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime)
+        return std::string(runtime) + "/knife.sock";
+
+    std::string directory = "/tmp/knife-" + std::to_string(getuid());
+    if (!private_directory(directory))
+    {
+        cerr << "daemon: " << directory << " is not a directory private to this user" << endl;
+        return "";
+    }
+    return directory + "/daemon.sock";
+}
+
+bool Daemon::serve(std::string const& socket_path, Command const& command)
+{
+    sockaddr_un address;
+    if (!make_address(socket_path, address))
+    {
+        cerr << "daemon: bad socket path " << socket_path << endl;
+        return false;
+    }
+
+    // A socket file nobody listens on is left over from a server that died.
+    int existing = connect_to(socket_path);
+    if (existing >= 0)
+    {
+        close(existing);
+        cerr << "daemon: already serving on " << socket_path << endl;
+        return false;
+    }
+    unlink(socket_path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0
+        || listen(listener, 64) != 0)
+    {
+        cerr << "daemon: cannot listen on " << socket_path << ": " << std::strerror(errno) << endl;
+        if (listener >= 0)
+            close(listener);
+        return false;
+    }
+
+    // Without SA_RESTART, so a signal interrupts accept.
+    struct sigaction action;
+    std::memset(&action, 0, sizeof action);
+    action.sa_handler = &on_terminate;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    stopping = 0;
+    while (!stopping)
+    {
+        int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+            continue;
+        if (!same_user(client))
+        {
+            cerr << "daemon: refused a client run by another user" << endl;
+            close(client);
+            continue;
+        }
+
+        std::vector<std::string> strings;
+        int streams[3];
+        if (receive_request(client, strings, streams))
+        {
+            bool stop = strings.size() == 2 && strings[1] == stop_argument;
+            std::int32_t status = 0;
+            if (strings.empty())
+                status = 1;
+            else if (!stop)
+                status = run_request(command, strings, streams);
+
+            for (int i = 0; i < 3; ++i)
+                close(streams[i]);
+            write_all(client, &status, sizeof status);
+            if (stop)
+                stopping = 1;
+        }
+        close(client);
+    }
+
+    close(listener);
+    unlink(socket_path.c_str());
+    return true;
+}
+
+int Daemon::forward(std::string const& socket_path, int argc, char const* const argv[])
+{
+    int fd = connect_to(socket_path);
+    if (fd < 0)
+        return -1;
+    if (!same_user(fd))
+    {
+        close(fd);
+        cerr << "knife: the daemon on " << socket_path << " is run by another user" << endl;
+        return 1;
+    }
+
+    char directory[PATH_MAX];
+    if (!getcwd(directory, sizeof directory))
+    {
+        close(fd);
+        cerr << "knife: cannot get the working directory" << endl;
+        return 1;
+    }
+
+    std::string payload(directory);
+    payload.push_back('\0');
+    for (int i = 0; i < argc; ++i)
+    {
+        payload += argv[i];
+        payload.push_back('\0');
+    }
+
+    int const streams[3] = { 0, 1, 2 };
+    std::int32_t status = 1;
+    if (!send_request(fd, payload, streams) || !read_all(fd, &status, sizeof status))
+    {
+        cerr << "knife: the compiler daemon dropped the request" << endl;
+        status = 1;
+    }
+    close(fd);
+    return status;
+}
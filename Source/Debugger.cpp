@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#include "Knife/Debugger.hpp"
+
+namespace
+{
+
+// Files are interned, as in TestProject/BreakpointTable.hpp, so that
+// neither a probe hit nor arming a line compares file names.
+struct LoadedModule
+{
+    int file;
+    std::uint8_t* flags;
+    std::vector<Semantic::ProbeSite> sites;
+    std::unordered_map<int, std::vector<std::size_t>> flags_by_line;
+};
+
+struct State
+{
+    std::mutex lock;
+    std::unordered_map<std::string, int> file_ids;
+    std::deque<std::string> file_names;                 // by id; a deque, so their text stays put
+    std::vector<std::vector<LoadedModule*>> loaded;     // by file id
+    std::map<std::uint8_t*, LoadedModule> modules;      // by address of the flag array
+    std::map<int, std::pair<int, int>> breakpoints;     // number -> (file id, line)
+    std::unordered_map<std::uint64_t, std::vector<int>> per_line;  // numbers set on a line, in order
+    int next_number;
+    std::atomic<std::size_t> hits;
+
+    State()
+        : next_number(1), hits(0)
+    {
+    }
+
+    static std::uint64_t key(int file, int line_number)
+    {
+        return std::uint64_t(std::uint32_t(file)) << 32 | std::uint32_t(line_number);
+    }
+
+    // The methods below must be called with the lock held.
+    int intern(std::string const& file_name)
+    {
+        auto pos = file_ids.find(file_name);
+        if (pos != file_ids.end())
+            return pos->second;
+        int id = int(file_names.size());
+        file_ids[file_name] = id;
+        file_names.push_back(file_name);
+        loaded.emplace_back();
+        return id;
+    }
+
+    // The lowest numbered breakpoint on the line, or 0.
+    int breakpoint_at(int file, int line_number) const
+    {
+        auto pos = per_line.find(key(file, line_number));
+        return pos == per_line.end() ? 0 : pos->second.front();
+    }
+
+    // Generated code reads the flags with relaxed atomic loads.
+    void arm(LoadedModule const& module, int line_number, bool on)
+    {
+        auto pos = module.flags_by_line.find(line_number);
+        if (pos == module.flags_by_line.end())
+            return;
+        for (std::size_t index : pos->second)
+            reinterpret_cast<std::atomic<std::uint8_t>*>(module.flags + index)->store(on, std::memory_order_relaxed);
+    }
+
+    void arm(int file, int line_number, bool on)
+    {
+        for (LoadedModule const* module : loaded[file])
+            arm(*module, line_number, on);
+    }
+
+    void forget(std::map<std::uint8_t*, LoadedModule>::iterator pos)
+    {
+        auto& same_file = loaded[pos->second.file];
+        same_file.erase(std::find(same_file.begin(), same_file.end(), &pos->second));
+        modules.erase(pos);
+    }
+};
+
+State& state()
+{
+    static State s;
+    return s;
+}
+
+}
+
+extern "C"
+{
+
+#pragma GCC push_options
+#pragma GCC optimize ("0")
+
+void __attribute__((noinline)) knife_debugger_break_here(int breakpoint_number, char const* file_name, int line_number)
+{
+    // Prevent this function from being optimized away.
+    asm ("nop;");
+}
+
+#pragma GCC pop_options
+
+void knife_probe_hit(std::uint8_t* flag)
+{
+    State& s = state();
+    char const* file_name;
+    int line_number = 0;
+    int number = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+
+        auto pos = s.modules.upper_bound(flag);
+        if (pos == s.modules.begin())
+            return;
+        --pos;
+
+        LoadedModule const& module = pos->second;
+        std::size_t index = flag - module.flags;
+        if (index >= module.sites.size())
+            return;
+
+        file_name = s.file_names[module.file].c_str();
+        line_number = module.sites[index].line;
+        number = s.breakpoint_at(module.file, line_number);
+    }
+
+    // The breakpoint may have been cleared since the flag was read.
+    if (number == 0)
+        return;
+
+    s.hits.fetch_add(1, std::memory_order_relaxed);
+    knife_debugger_break_here(number, file_name, line_number);
+}
+
+}
+
+void Debugger::register_module(std::string const& file_name, std::uint8_t* flags, std::vector<Semantic::ProbeSite> const& sites)
+{
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    // A module whose flags overlap these was freed without being
+    // unregistered; its flags are not its own any more.
+    std::uint8_t* end = flags + std::max<std::size_t>(sites.size(), 1);
+    auto pos = s.modules.lower_bound(end);
+    while (pos != s.modules.begin())
+    {
+        --pos;
+        if (pos->first + std::max<std::size_t>(pos->second.sites.size(), 1) <= flags)
+            break;
+        s.forget(pos++);
+    }
+
+    LoadedModule& module = s.modules[flags];
+    module.file = s.intern(file_name);
+    module.flags = flags;
+    module.sites = sites;
+    for (std::size_t i = 0; i < sites.size(); ++i)
+        module.flags_by_line[int(sites[i].line)].push_back(i);
+    s.loaded[module.file].push_back(&module);
+
+    for (auto const& entry : s.breakpoints)
+        if (entry.second.first == module.file)
+            s.arm(module, entry.second.second, true);
+}
+
+void Debugger::unregister_module(std::uint8_t* flags)
+{
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    auto pos = s.modules.find(flags);
+    if (pos != s.modules.end())
+        s.forget(pos);
+}
+
+int Debugger::set_breakpoint(std::string const& file_name, int line_number)
+{
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    int file = s.intern(file_name);
+    int number = s.next_number++;
+    s.breakpoints[number] = std::make_pair(file, line_number);
+    s.per_line[State::key(file, line_number)].push_back(number);
+    s.arm(file, line_number, true);
+    return number;
+}
+
+bool Debugger::clear_breakpoint(int breakpoint_number)
+{
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    auto pos = s.breakpoints.find(breakpoint_number);
+    if (pos == s.breakpoints.end())
+        return false;
+
+    int file = pos->second.first;
+    int line_number = pos->second.second;
+    s.breakpoints.erase(pos);
+
+    // Another breakpoint may still be set on the same line.
+    auto line = s.per_line.find(State::key(file, line_number));
+    line->second.erase(std::find(line->second.begin(), line->second.end(), breakpoint_number));
+    if (line->second.empty())
+    {
+        s.per_line.erase(line);
+        s.arm(file, line_number, false);
+    }
+
+    return true;
+}
+
+std::size_t Debugger::hit_count()
+{
+    return state().hits.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,487 @@
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <functional>
+using namespace std;
+
+#include "Knife/Eval.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+enum Op { Add, Sub, Mul, Div, Less, Greater, LessEqual, GreaterEqual, Equal, NotEqual };
+
+// Calls nested deeper than this are left for run time.
+int const max_call_depth = 64;
+
+std::size_t hash_combine(std::size_t seed, std::size_t value)
+{
+    return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+}
+
+Constant Constant::of_number(double value)
+{
+    Constant c;
+    c.kind = Kind::Number;
+    c.number = value;
+    return c;
+}
+
+Constant Constant::of_string(std::string const& value)
+{
+    Constant c;
+    c.kind = Kind::String;
+    c.text = value;
+    return c;
+}
+
+Constant Constant::of_type(Symbol name)
+{
+    Constant c;
+    c.kind = Kind::Type;
+    c.name = name;
+    return c;
+}
+
+bool Constant::operator==(Constant const& that) const
+{
+    return kind == that.kind && name == that.name && label == that.label
+        && (kind != Kind::Number || number == that.number)
+        && text == that.text && elements == that.elements;
+}
+
+std::size_t Constant::hash() const
+{
+    std::size_t h = std::size_t(kind);
+    h = hash_combine(h, name);
+    h = hash_combine(h, label);
+    if (kind == Kind::Number)
+        h = hash_combine(h, std::hash<double>()(number));
+    h = hash_combine(h, std::hash<std::string>()(text));
+    for (auto const& elem : elements)
+        h = hash_combine(h, elem.hash());
+    return h;
+}
+
+void Constant::dump(std::ostream& s, SymbolTable const& symbols) const
+{
+    if (label != none)
+        s << symbols.name(label) << ":";
+
+    switch (kind)
+    {
+    case Kind::Unknown:
+        s << "<unknown>";
+        break;
+    case Kind::Number:
+        s << number;
+        break;
+    case Kind::String:
+        s << '"' << text << '"';
+        break;
+    case Kind::Type:
+        if (name != none)
+        {
+            s << symbols.name(name);
+            break;
+        }
+        // A tuple type prints like a tuple of its fields; fall through.
+    case Kind::Tuple:
+        s << "(";
+        for (std::size_t i = 0; i < elements.size(); ++i)
+        {
+            if (i != 0)
+                s << ", ";
+            elements[i].dump(s, symbols);
+        }
+        s << ")";
+        break;
+    }
+}
+
+std::size_t ConstEval::CallKeyHash::operator()(CallKey const& key) const
+{
+    std::size_t h = key.def;
+    for (auto const& arg : key.args)
+        h = hash_combine(h, arg.hash());
+    return h;
+}
+
+ConstEval::ConstEval(IR& ir)
+    : ir(ir), reassigned(ir.label_count(), false),
+      label_state(ir.label_count(), LabelState::Unvisited), label_value(ir.label_count()),
+      frame(nullptr), frame_count(0), call_depth(0), stats()
+{
+    static char const* const ops[] = { "+", "-", "*", "/", "<", ">", "<=", ">=", "==", "!=" };
+    for (int op = 0; op < int(sizeof(ops) / sizeof(ops[0])); ++op)
+        builtin_ops[ir.symbols.intern(ops[op])] = op;
+
+    for (char const* type : { "Int", "Float", "Double", "String", "Bool", "type" })
+        builtin_types.push_back(ir.symbols.intern(type));
+
+    return_symbol = ir.symbols.intern("return");
+
+    for (NodeId id = 0; id < ir.node_count(); ++id)
+        if (ir.node(id).kind == NodeKind::Assign && ir.node(id).value != none)
+            reassigned[ir.node(id).value] = true;
+}
+
+Constant ConstEval::evaluate(NodeId id)
+{
+    Node const& n = ir.node(id);
+
+    switch (n.kind)
+    {
+    case NodeKind::Number:
+        return Constant::of_number(ir.number(n.value));
+
+    case NodeKind::String:
+        return Constant::of_string(ir.string(n.value));
+
+    case NodeKind::Ref:
+        return eval_ref(n);
+
+    case NodeKind::Tuple:
+    {
+        Constant result;
+        result.kind = Constant::Kind::Tuple;
+        for (NodeId child : ir.children_of(id))
+        {
+            result.elements.push_back(evaluate(child));
+            if (!result.elements.back().known())
+                return Constant();
+        }
+        return result;
+    }
+
+    case NodeKind::Label:
+    {
+        IR::Range kids = ir.children_of(id);
+        Constant value;
+
+        if (n.flags & HasInit)
+            value = evaluate(kids[kids.size() - 1]);
+        else if (n.flags & HasType)
+            value = evaluate(kids[0]);  // a field declaration: the field's type
+
+        value.label = n.symbol;
+
+        if (frame_count > 0 && (n.flags & HasInit))
+            frame->at(0, n.slot) = value;
+
+        return value;
+    }
+
+    case NodeKind::Assign:
+    {
+        // Only the evaluated def's own locals may change.
+        if (frame_count == 0 || n.depth != 0)
+            return Constant();
+
+        Constant value = evaluate(ir.children_of(id)[0]);
+        frame->at(0, n.slot) = value;
+        return value;
+    }
+
+    case NodeKind::Call:
+    {
+        IR::Range kids = ir.children_of(id);
+
+        if (n.value == none)
+        {
+            auto op = builtin_ops.find(n.symbol);
+            if (op != builtin_ops.end() && !(n.flags & HasBlock))
+                return eval_op(op->second, kids);
+            return Constant();
+        }
+
+        Label const& callee = ir.label(n.value);
+        if (callee.kind != LabelKind::Def || callee.decl == none || (n.flags & HasBlock))
+            return Constant();
+
+        std::vector<Constant> args;
+        args.reserve(kids.size());
+        for (NodeId child : kids)
+        {
+            args.push_back(evaluate(child));
+            if (!args.back().known())
+                return Constant();
+        }
+
+        return call(ir.node(callee.decl).value, args);
+    }
+
+    default:
+        return Constant();
+    }
+}
+
+Constant ConstEval::eval_ref(Node const& n)
+{
+    if (n.value == none)
+    {
+        for (Symbol type : builtin_types)
+            if (n.symbol == type)
+                return Constant::of_type(type);
+        return Constant();
+    }
+
+    if (n.depth < frame_count)
+        return frame->at(n.depth, n.slot);
+
+    return eval_label(n.value);
+}
+
+Constant ConstEval::eval_label(LabelId id)
+{
+    Label const& lbl = ir.label(id);
+
+    if (lbl.kind != LabelKind::Local || reassigned[id] || lbl.decl == none)
+        return Constant();
+
+    Node const& decl = ir.node(lbl.decl);
+    if (!(decl.flags & HasInit))
+        return Constant();
+
+    switch (label_state[id])
+    {
+    case LabelState::Done:
+        return label_value[id];
+    case LabelState::InProgress:
+        return Constant();  // defined in terms of itself
+    case LabelState::Unvisited:
+        break;
+    }
+
+    label_state[id] = LabelState::InProgress;
+
+    // The initializer is evaluated outside of whatever call is in progress.
+    Frame<Constant>* saved_frame = frame;
+    std::size_t saved_count = frame_count;
+    frame = nullptr;
+    frame_count = 0;
+
+    IR::Range kids = ir.children_of(lbl.decl);
+    Constant value = evaluate(kids[kids.size() - 1]);
+
+    frame = saved_frame;
+    frame_count = saved_count;
+
+    label_state[id] = LabelState::Done;
+    label_value[id] = value;
+    return value;
+}
+
+Constant ConstEval::eval_op(int op, IR::Range args)
+{
+    if (args.size() != 2)
+        return Constant();
+
+    Constant lhs = evaluate(args[0]);
+    Constant rhs = evaluate(args[1]);
+
+    if (op == Add && lhs.kind == Constant::Kind::String && rhs.kind == Constant::Kind::String)
+        return Constant::of_string(lhs.text + rhs.text);
+
+    if (lhs.kind != Constant::Kind::Number || rhs.kind != Constant::Kind::Number)
+        return Constant();
+
+    double l = lhs.number;
+    double r = rhs.number;
+
+    switch (op)
+    {
+    case Add: return Constant::of_number(l + r);
+    case Sub: return Constant::of_number(l - r);
+    case Mul: return Constant::of_number(l * r);
+    case Div: return r == 0 ? Constant() : Constant::of_number(l / r);
+    case Less: return Constant::of_number(l < r);
+    case Greater: return Constant::of_number(l > r);
+    case LessEqual: return Constant::of_number(l <= r);
+    case GreaterEqual: return Constant::of_number(l >= r);
+    case Equal: return Constant::of_number(l == r);
+    case NotEqual: return Constant::of_number(l != r);
+    }
+
+    return Constant();
+}
+
+Constant ConstEval::call(DefId def, std::vector<Constant> const& args)
+{
+    CallKey key{def, args};
+
+    auto pos = memo.find(key);
+    if (pos != memo.end())
+    {
+        ++stats.memo_hits;
+        return pos->second;
+    }
+
+    Def const& d = ir.def(def);
+    if (args.size() > d.param_count || call_depth >= max_call_depth)
+        return Constant();
+
+    // The callee starts a frame chain of its own; anything outside its own
+    // frame is reached through immutable labels only.
+    Frame<Constant> callee_frame(nullptr, ir.scope(d.scope).label_count);
+    Frame<Constant>* saved_frame = frame;
+    std::size_t saved_count = frame_count;
+    frame = &callee_frame;
+    frame_count = callee_frame.slots.empty() ? 0 : 1;
+    ++call_depth;
+    ++stats.calls_evaluated;
+
+    Constant result;
+    bool bound = true;
+
+    for (std::uint32_t i = 0; i < d.param_count && bound; ++i)
+    {
+        Param const& p = ir.param(def, i);
+        Constant value;
+
+        if (i < args.size())
+            value = args[i];
+        else if (p.default_value != none)
+            value = evaluate(p.default_value);
+
+        bound = value.known();
+        value.label = none;
+        callee_frame.slots[ir.label(p.label).index_in_scope] = value;
+    }
+
+    if (bound)
+    {
+        bool returned = false;
+        result = eval_body(d.body, returned);
+    }
+
+    --call_depth;
+    frame = saved_frame;
+    frame_count = saved_count;
+
+    memo.emplace(std::move(key), result);
+    return result;
+}
+
+Constant ConstEval::eval_body(NodeId block, bool& returned)
+{
+    IR::Range stmts = ir.children_of(block);
+    Constant last;
+    Constant fields;
+    fields.kind = Constant::Kind::Type;
+    bool all_fields = stmts.size() != 0;
+
+    for (NodeId id : stmts)
+    {
+        Node const& s = ir.node(id);
+
+        if (s.kind == NodeKind::Call && s.symbol == return_symbol && s.value == none)
+        {
+            IR::Range kids = ir.children_of(id);
+            returned = true;
+
+            if (kids.size() == 1)
+                return evaluate(kids[0]);
+
+            Constant tuple;
+            tuple.kind = Constant::Kind::Tuple;
+            for (NodeId child : kids)
+            {
+                tuple.elements.push_back(evaluate(child));
+                if (!tuple.elements.back().known())
+                    return Constant();
+            }
+            return tuple;
+        }
+
+        if (s.kind == NodeKind::Def)
+        {
+            all_fields = false;
+            continue;
+        }
+
+        bool is_field = s.kind == NodeKind::Label && (s.flags & HasType) && !(s.flags & HasInit);
+        all_fields = all_fields && is_field;
+
+        last = evaluate(id);
+
+        // Anything unknown may be a side effect, so the call is left for run time.
+        if (!last.known())
+            return Constant();
+
+        if (is_field)
+            fields.elements.push_back(last);
+    }
+
+    return all_fields ? fields : last;
+}
+
+void ConstEval::fold_walk(NodeId id, std::vector<NodeId>& order)
+{
+    Node const& n = ir.node(id);
+
+    if (n.kind == NodeKind::Def)
+    {
+        Def const& d = ir.def(n.value);
+        for (std::uint32_t i = 0; i < d.param_count; ++i)
+        {
+            Param const& p = ir.param(n.value, i);
+            if (p.type != none)
+                fold_walk(p.type, order);
+            if (p.default_value != none)
+                fold_walk(p.default_value, order);
+        }
+    }
+
+    for (NodeId child : ir.children_of(id))
+        fold_walk(child, order);
+
+    if (n.kind == NodeKind::Call || n.kind == NodeKind::Ref)
+        order.push_back(id);
+}
+
+FoldStats ConstEval::fold(std::vector<NodeId> const& roots)
+{
+    // Children come before their parents, so a parent call sees folded
+    // literals as its arguments.
+    std::vector<NodeId> order;
+    for (NodeId root : roots)
+        fold_walk(root, order);
+
+    for (NodeId id : order)
+    {
+        Constant value = evaluate(id);
+
+        if (value.kind == Constant::Kind::Number || value.kind == Constant::Kind::String)
+        {
+            std::uint32_t literal = value.kind == Constant::Kind::Number
+                ? ir.add_number(value.number) : ir.add_string(value.text);
+
+            Node& n = ir.node(id);
+            n.kind = value.kind == Constant::Kind::Number ? NodeKind::Number : NodeKind::String;
+            n.flags = 0;
+            n.depth = no_depth;
+            n.symbol = none;
+            n.value = literal;
+            n.child_count = 0;
+            n.slot = none;
+            ++stats.nodes_folded;
+        }
+        else if (value.known())
+        {
+            folded[id] = value;
+        }
+    }
+
+    return stats;
+}
+
+Constant const* ConstEval::folded_value(NodeId id) const
+{
+    auto pos = folded.find(id);
+    return pos == folded.end() ? nullptr : &pos->second;
+}
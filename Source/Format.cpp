@@ -0,0 +1,375 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+using namespace std;
+
+#include "boost/filesystem.hpp"
+
+#include "Knife/Format.hpp"
+#include "Knife/Operators.hpp"
+#include "Knife/Parse.hpp"
+#include "Knife/Walk.hpp"
+
+using namespace Syntax;
+
+namespace
+{
+
+bool is_atom(NodeRef n)
+{
+    if (n.tag == NodeTag::Number || n.tag == NodeTag::String)
+        return true;
+
+    if (n.tag != NodeTag::Invocation)
+        return false;
+
+    Invocation const& t = n.as<Invocation>();
+    return !t.args && !t.postfix_lambda && !t.next_call;
+}
+
+// True for statements short enough to keep inside "{ }" on one line:
+// a literal, a name, a call with at most one such argument, or one
+// operator applied to two.
+bool is_simple(NodeRef n)
+{
+    if (is_atom(n))
+        return true;
+
+    if (n.tag != NodeTag::Invocation)
+        return false;
+
+    Invocation const& t = n.as<Invocation>();
+    if (is_binary_operation(t))
+        return is_atom(node_ref(t.args->elements[0])) && is_atom(node_ref(t.args->elements[1]));
+    return !t.postfix_lambda && !t.next_call && t.args
+        && (t.args->elements.empty()
+            || (t.args->elements.size() == 1 && is_atom(node_ref(t.args->elements[0]))));
+}
+
+// Whether an operand of an operator with the given precedence needs
+// parentheses to parse back as one.
+bool needs_parens(NodeRef n, int precedence, bool right)
+{
+    if (n.tag == NodeTag::Tuple || n.tag == NodeTag::Label || n.tag == NodeTag::Def)
+        return true;
+
+    if (n.tag != NodeTag::Invocation || !is_binary_operation(n.as<Invocation>()))
+        return false;
+
+    // Operators are left-associative, so a + (b + c) keeps its parentheses.
+    int inner = operator_precedence(n.as<Invocation>().name.value);
+    return inner < precedence || (right && inner == precedence);
+}
+
+}
+
+void SyntaxPrinter::newline(int depth)
+{
+    out += '\n';
+    out.append(depth * 4, ' ');
+}
+
+void SyntaxPrinter::print_args(std::vector<Expr> const& args, int depth)
+{
+    out += '(';
+    for (std::size_t i = 0; i < args.size(); ++i)
+    {
+        if (i != 0)
+            out += ", ";
+        print_expr(args[i], depth);
+    }
+    out += ')';
+}
+
+void SyntaxPrinter::print_block(BracesBlock const& block, int depth)
+{
+    if (block.stmts.empty())
+    {
+        out += "{}";
+        return;
+    }
+
+    if (block.stmts.size() == 1 && is_simple(node_ref(block.stmts[0])))
+    {
+        out += "{ ";
+        print(block.stmts[0], depth);
+        out += " }";
+        return;
+    }
+
+    out += '{';
+    for (auto const& stmt : block.stmts)
+    {
+        newline(depth + 1);
+        print(stmt, depth + 1);
+    }
+    newline(depth);
+    out += '}';
+}
+
+void SyntaxPrinter::print_operand(Expr const& operand, int precedence, bool right, int depth)
+{
+    if (!needs_parens(node_ref(operand), precedence, right))
+    {
+        print_expr(operand, depth);
+        return;
+    }
+
+    out += '(';
+    print_expr(operand, depth);
+    out += ')';
+}
+
+void SyntaxPrinter::print_invocation(Invocation const& call, int depth)
+{
+    if (is_binary_operation(call))
+    {
+        int precedence = operator_precedence(call.name.value);
+        print_operand(call.args->elements[0], precedence, false, depth);
+        out += ' ';
+        out += call.name.value;
+        out += ' ';
+        print_operand(call.args->elements[1], precedence, true, depth);
+        return;
+    }
+
+    Invocation const* t = &call;
+
+    while (true)
+    {
+        out += t->name.value;
+
+        if (t->args)
+            print_args(t->args->elements, depth);
+
+        if (t->postfix_lambda)
+        {
+            out += ' ';
+            print_block(*t->postfix_lambda, depth);
+        }
+
+        if (!t->next_call)
+            break;
+
+        out += ' ';
+        t = &t->next_call->get();
+    }
+}
+
+void SyntaxPrinter::print_expr(Expr const& expr, int depth)
+{
+    NodeRef n = node_ref(expr);
+
+    switch (n.tag)
+    {
+    case NodeTag::Tuple:
+    {
+        auto const& elements = n.as<TupleExpr>().elements;
+        for (std::size_t i = 0; i < elements.size(); ++i)
+        {
+            if (i != 0)
+                out += ", ";
+            print_expr(elements[i], depth);
+        }
+        break;
+    }
+
+    case NodeTag::Label:
+    {
+        LabelExpr const& t = n.as<LabelExpr>();
+        if (t.name)
+            out += t.name->value;
+        if (t.type)
+        {
+            out += ": ";
+            print_expr(*t.type, depth);
+            if (t.term)
+            {
+                out += " = ";
+                print_expr(t.term->value, depth);
+            }
+        }
+        else if (t.term)
+        {
+            out += t.name ? " := " : ":= ";
+            print_expr(t.term->value, depth);
+        }
+        else
+        {
+            out += ':';
+        }
+        break;
+    }
+
+    case NodeTag::Block:
+        print_block(n.as<BracesBlock>(), depth);
+        break;
+
+    case NodeTag::Def:
+    {
+        DefExpr const& t = n.as<DefExpr>();
+        out += "def";
+        if (t.name)
+        {
+            out += ' ';
+            out += t.name->value;
+        }
+        if (t.args)
+            print_args(t.args->elements, depth);
+        out += ' ';
+        print_block(t.code, depth);
+        break;
+    }
+
+    case NodeTag::Invocation:
+        print_invocation(n.as<Invocation>(), depth);
+        break;
+
+    case NodeTag::Number:
+        out += n.as<Number>().raw;
+        break;
+
+    case NodeTag::String:
+        out += '"';
+        out += n.as<QuotedString>().raw;
+        out += '"';
+        break;
+
+    case NodeTag::Reassignment:
+        break;
+    }
+}
+
+void SyntaxPrinter::print(Stmt const& stmt, int depth)
+{
+    if (Reassignment const* r = boost::get<Reassignment>(&stmt))
+    {
+        out += r->name.value;
+        out += " = ";
+        print_expr(r->value, depth);
+    }
+    else
+    {
+        print_expr(boost::get<Expr>(stmt), depth);
+    }
+}
+
+void SyntaxPrinter::print(Module const& module)
+{
+    for (std::size_t i = 0; i < module.items.size(); ++i)
+    {
+        // Keep one blank line wherever the source had any between items.
+        if (i != 0 && module.items[i].span.first_line > module.items[i - 1].span.last_line + 1)
+            out += '\n';
+
+        print(module.items[i].stmt);
+        out += '\n';
+    }
+}
+
+bool format_source(std::string const& source, std::string const& file_name, std::string& formatted)
+{
+    try
+    {
+        Module module = ParseModule(source, file_name);
+
+        // Reprinting a partly parsed file would silently drop what
+        // ParseModule skipped, anywhere in it.
+        if (!parsed_completely(module))
+            return false;
+
+        formatted.clear();
+        SyntaxPrinter(formatted).print(module);
+        return true;
+    }
+    catch (std::exception const&)
+    {
+        return false;
+    }
+}
+
+FormatReport format_paths(std::vector<std::string> const& paths, FormatOptions const& options)
+{
+    namespace fs = boost::filesystem;
+
+    std::vector<std::string> files;
+    for (auto const& path : paths)
+    {
+        if (fs::is_directory(path))
+        {
+            for (fs::recursive_directory_iterator it(path), end; it != end; ++it)
+                if (fs::is_regular_file(it->status()) && it->path().extension() == ".kn")
+                    files.push_back(it->path().string());
+        }
+        else
+        {
+            files.push_back(path);
+        }
+    }
+
+    FormatReport report;
+    report.files = files.size();
+    report.changed = 0;
+
+    std::atomic<std::size_t> next(0);
+    std::atomic<std::size_t> changed(0);
+    std::mutex report_lock;
+
+    auto worker = [&]()
+    {
+        // Each thread reuses one input and one output buffer for all its files.
+        std::string source;
+        std::string formatted;
+
+        for (std::size_t i = next++; i < files.size(); i = next++)
+        {
+            {
+                std::ifstream in(files[i], std::ios::binary);
+                std::stringstream ss;
+                ss << in.rdbuf();
+                source = ss.str();
+            }
+
+            if (!format_source(source, files[i], formatted))
+            {
+                std::lock_guard<std::mutex> lock(report_lock);
+                report.failed.push_back(files[i]);
+                continue;
+            }
+
+            if (formatted == source)
+                continue;
+
+            ++changed;
+
+            if (options.check_only)
+            {
+                std::lock_guard<std::mutex> lock(report_lock);
+                cout << files[i] << ": not formatted" << endl;
+            }
+            else
+            {
+                std::ofstream out(files[i], std::ios::binary | std::ios::trunc);
+                out << formatted;
+            }
+        }
+    };
+
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<std::size_t>(threads, std::max<std::size_t>(1, files.size()));
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& thread : pool)
+        thread.join();
+
+    report.changed = changed;
+    return report;
+}
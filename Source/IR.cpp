@@ -0,0 +1,531 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <type_traits>
+using namespace std;
+
+#include "Knife/IR.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+// Nodes, scopes and params have no padding, so their arrays are written
+// as they are; labels and defs are written field by field.
+static_assert(sizeof(Node) == 24 && sizeof(Scope) == 20 && sizeof(Param) == 16, "IR records have padding");
+
+template <typename T>
+void put(std::string& out, T value)
+{
+    out.append(reinterpret_cast<char const*>(&value), sizeof value);
+}
+
+template <typename T>
+void put_array(std::string& out, std::vector<T> const& values)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "written as bytes");
+    put(out, std::uint32_t(values.size()));
+    out.append(reinterpret_cast<char const*>(values.data()), values.size() * sizeof(T));
+}
+
+void put_text(std::string& out, std::string const& text)
+{
+    put(out, std::uint32_t(text.size()));
+    out.append(text);
+}
+
+template <typename T>
+bool get(char const*& at, char const* end, T& value)
+{
+    if (std::size_t(end - at) < sizeof value)
+        return false;
+    std::memcpy(&value, at, sizeof value);
+    at += sizeof value;
+    return true;
+}
+
+template <typename T>
+bool get_array(char const*& at, char const* end, std::vector<T>& values)
+{
+    std::uint32_t count;
+    if (!get(at, end, count) || std::size_t(end - at) / sizeof(T) < count)
+        return false;
+    values.resize(count);
+    std::memcpy(values.data(), at, count * sizeof(T));
+    at += count * sizeof(T);
+    return true;
+}
+
+bool get_text(char const*& at, char const* end, std::string& text)
+{
+    std::uint32_t size;
+    if (!get(at, end, size) || std::size_t(end - at) < size)
+        return false;
+    text.assign(at, size);
+    at += size;
+    return true;
+}
+
+// Whether count records of at least size bytes each can be left.
+bool fits(char const* at, char const* end, std::uint32_t count, std::size_t size)
+{
+    return std::size_t(end - at) / size >= count;
+}
+
+// An index that is either none or below the count.
+bool valid(std::uint32_t id, std::size_t count)
+{
+    return id == none || id < count;
+}
+
+std::uint32_t shift(std::uint32_t id, std::uint32_t offset)
+{
+    return id == none ? none : id + offset;
+}
+
+}
+
+Symbol SymbolTable::intern(std::string const& name)
+{
+    auto pos = ids.find(name);
+    if (pos != ids.end())
+        return pos->second;
+
+    Symbol sym = names.size();
+    names.push_back(name);
+    ids.emplace(name, sym);
+    return sym;
+}
+
+Symbol SymbolTable::find(std::string const& name) const
+{
+    auto pos = ids.find(name);
+    return pos == ids.end() ? none : pos->second;
+}
+
+std::string const& SymbolTable::name(Symbol sym) const
+{
+    static std::string const anonymous = "_";
+    return sym == none ? anonymous : names[sym];
+}
+
+std::size_t SymbolTable::bytes_used() const
+{
+    std::size_t total = names.capacity() * sizeof(std::string);
+    for (auto const& name : names)
+        total += name.capacity() + 1;
+
+    // Approximate: one node plus a copy of the key per entry, plus buckets.
+    total += ids.size() * (sizeof(std::pair<std::string const, Symbol>) + sizeof(void*));
+    total += ids.bucket_count() * sizeof(void*);
+    return total;
+}
+
+NodeId IR::add_node(NodeKind kind, std::uint8_t flags, Symbol symbol, std::uint32_t value,
+    NodeId const* first_child, std::size_t child_count)
+{
+    Node n;
+    n.kind = kind;
+    n.flags = flags;
+    n.depth = no_depth;
+    n.symbol = symbol;
+    n.value = value;
+    n.first_child = children.size();
+    n.child_count = child_count;
+    n.slot = none;
+    children.insert(children.end(), first_child, first_child + child_count);
+    nodes.push_back(n);
+    return nodes.size() - 1;
+}
+
+std::uint32_t IR::add_number(double value)
+{
+    numbers.push_back(value);
+    return numbers.size() - 1;
+}
+
+std::uint32_t IR::add_string(std::string const& value)
+{
+    strings.push_back(value);
+    return strings.size() - 1;
+}
+
+ScopeId IR::add_scope(ScopeId parent, DefId owner)
+{
+    Scope sc;
+    sc.parent = parent;
+    sc.owner = owner;
+    sc.depth = parent == none ? 0 : scopes[parent].depth + 1;
+    sc.label_count = 0;
+    sc.frame_depth = 0;
+    scopes.push_back(sc);
+    return scopes.size() - 1;
+}
+
+LabelId IR::add_label(Symbol name, ScopeId scope, LabelKind kind, NodeId decl)
+{
+    Label lbl;
+    lbl.name = name;
+    lbl.scope = scope;
+    lbl.index_in_scope = scopes[scope].label_count++;
+    lbl.kind = kind;
+    lbl.decl = decl;
+    labels.push_back(lbl);
+    return labels.size() - 1;
+}
+
+DefId IR::add_def(Symbol name, bool has_args)
+{
+    Def d;
+    d.name = name;
+    d.scope = none;
+    d.first_param = 0;
+    d.param_count = 0;
+    d.has_args = has_args;
+    d.body = none;
+    defs.push_back(d);
+    return defs.size() - 1;
+}
+
+void IR::set_params(DefId def, std::vector<Param> const& list)
+{
+    defs[def].first_param = params.size();
+    defs[def].param_count = list.size();
+    params.insert(params.end(), list.begin(), list.end());
+}
+
+IR::Range IR::children_of(NodeId id) const
+{
+    Node const& n = nodes[id];
+    NodeId const* first = children.data() + n.first_child;
+    return Range{first, first + n.child_count};
+}
+
+std::uint32_t IR::line_of(NodeId id) const
+{
+    auto pos = lines.find(id);
+    return pos != lines.end() ? pos->second : 0;
+}
+
+std::size_t IR::bytes_used() const
+{
+    std::size_t total = 0;
+    total += nodes.capacity() * sizeof(Node);
+    total += children.capacity() * sizeof(NodeId);
+    total += numbers.capacity() * sizeof(double);
+    total += strings.capacity() * sizeof(std::string);
+    for (auto const& str : strings)
+        total += str.capacity() + 1;
+    total += labels.capacity() * sizeof(Label);
+    total += scopes.capacity() * sizeof(Scope);
+    total += params.capacity() * sizeof(Param);
+    total += defs.capacity() * sizeof(Def);
+    total += lines.size() * (sizeof(std::pair<NodeId const, std::uint32_t>) + sizeof(void*));
+    total += lines.bucket_count() * sizeof(void*);
+    total += symbols.bytes_used();
+    return total;
+}
+
+void IR::dump(std::ostream& s, NodeId id) const
+{
+    dump_node(s, id, 0);
+}
+
+void IR::dump_node(std::ostream& s, NodeId id, int depth) const
+{
+    for (int i = 0; i < (depth*4); ++i) // indent to depth
+        s << ' ';
+
+    Node const& n = nodes[id];
+    std::string const& name = symbols.name(n.symbol);
+
+    switch (n.kind)
+    {
+    case NodeKind::Number:
+        s << "Number " << numbers[n.value];
+        break;
+    case NodeKind::String:
+        s << "String \"" << strings[n.value] << '"';
+        break;
+    case NodeKind::Ref:
+        s << "Ref " << name;
+        if (n.value == none)
+            s << " (free)";
+        else
+            s << " -> label " << n.value;
+        break;
+    case NodeKind::Label:
+        s << "Label " << name << " #" << n.value;
+        break;
+    case NodeKind::Assign:
+        s << "Assign " << name;
+        if (n.value == none)
+            s << " (unresolved)";
+        else
+            s << " -> label " << n.value;
+        break;
+    case NodeKind::Call:
+        s << "Call " << name;
+        if (n.value != none)
+            s << " -> label " << n.value;
+        break;
+    case NodeKind::Send:
+        s << "Send " << name;
+        break;
+    case NodeKind::Tuple:
+        s << "Tuple";
+        break;
+    case NodeKind::Block:
+        s << "Block scope " << n.value;
+        break;
+    case NodeKind::Def:
+    {
+        Def const& d = defs[n.value];
+        s << "Def " << name << " (";
+        for (std::uint32_t i = 0; i < d.param_count; ++i)
+        {
+            Param const& p = params[d.first_param + i];
+            if (i != 0)
+                s << ", ";
+            s << symbols.name(p.name);
+            if (p.type != none && nodes[p.type].kind == NodeKind::Ref)
+                s << ":" << symbols.name(nodes[p.type].symbol);
+        }
+        s << ")";
+        break;
+    }
+    }
+
+    if (n.depth != no_depth)
+        s << " @" << n.depth << ":" << n.slot;
+
+    s << std::endl;
+
+    for (NodeId child : children_of(id))
+        dump_node(s, child, depth + 1);
+}
+
+IR::Offsets IR::append(IR const& other)
+{
+    Offsets at;
+    at.nodes = nodes.size();
+    at.labels = labels.size();
+    at.scopes = scopes.size();
+    at.defs = defs.size();
+    std::uint32_t first_child = children.size();
+    std::uint32_t first_number = numbers.size();
+    std::uint32_t first_string = strings.size();
+    std::uint32_t first_param = params.size();
+
+    at.symbols.reserve(other.symbols.size());
+    for (Symbol sym = 0; sym < other.symbols.size(); ++sym)
+        at.symbols.push_back(symbols.intern(other.symbols.name(sym)));
+    auto symbol = [&at](Symbol sym) { return sym == none ? none : at.symbols[sym]; };
+
+    nodes.reserve(nodes.size() + other.nodes.size());
+    for (Node n : other.nodes)
+    {
+        n.symbol = symbol(n.symbol);
+        n.first_child += first_child;
+        switch (n.kind)
+        {
+        case NodeKind::Number: n.value += first_number; break;
+        case NodeKind::String: n.value += first_string; break;
+        case NodeKind::Ref:
+        case NodeKind::Label:
+        case NodeKind::Assign:
+        case NodeKind::Call: n.value = shift(n.value, at.labels); break;
+        case NodeKind::Block: n.value += at.scopes; break;
+        case NodeKind::Def: n.value += at.defs; break;
+        case NodeKind::Send:
+        case NodeKind::Tuple: break;
+        }
+        nodes.push_back(n);
+    }
+
+    children.reserve(children.size() + other.children.size());
+    for (NodeId child : other.children)
+        children.push_back(child + at.nodes);
+    numbers.insert(numbers.end(), other.numbers.begin(), other.numbers.end());
+    strings.insert(strings.end(), other.strings.begin(), other.strings.end());
+
+    for (Label lbl : other.labels)
+    {
+        lbl.name = symbol(lbl.name);
+        lbl.scope += at.scopes;
+        lbl.decl = shift(lbl.decl, at.nodes);
+        labels.push_back(lbl);
+    }
+    for (Scope sc : other.scopes)
+    {
+        sc.parent = shift(sc.parent, at.scopes);
+        sc.owner = shift(sc.owner, at.defs);
+        scopes.push_back(sc);
+    }
+    for (Param p : other.params)
+    {
+        p.name = symbol(p.name);
+        p.label = shift(p.label, at.labels);
+        p.type = shift(p.type, at.nodes);
+        p.default_value = shift(p.default_value, at.nodes);
+        params.push_back(p);
+    }
+    for (Def d : other.defs)
+    {
+        d.name = symbol(d.name);
+        d.scope = shift(d.scope, at.scopes);
+        d.first_param += first_param;
+        d.body = shift(d.body, at.nodes);
+        defs.push_back(d);
+    }
+    for (auto const& line : other.lines)
+        lines[line.first + at.nodes] = line.second;
+    return at;
+}
+
+void IR::write(std::string& out) const
+{
+    put(out, std::uint32_t(symbols.size()));
+    for (Symbol sym = 0; sym < symbols.size(); ++sym)
+        put_text(out, symbols.name(sym));
+
+    put_array(out, nodes);
+    put_array(out, children);
+    put_array(out, numbers);
+    put(out, std::uint32_t(strings.size()));
+    for (auto const& str : strings)
+        put_text(out, str);
+
+    put(out, std::uint32_t(labels.size()));
+    for (auto const& lbl : labels)
+    {
+        put(out, lbl.name);
+        put(out, lbl.scope);
+        put(out, lbl.index_in_scope);
+        put(out, std::uint8_t(lbl.kind));
+        put(out, lbl.decl);
+    }
+    put_array(out, scopes);
+    put_array(out, params);
+    put(out, std::uint32_t(defs.size()));
+    for (auto const& d : defs)
+    {
+        put(out, d.name);
+        put(out, d.scope);
+        put(out, d.first_param);
+        put(out, d.param_count);
+        put(out, std::uint8_t(d.has_args));
+        put(out, d.body);
+    }
+
+    put(out, std::uint32_t(lines.size()));
+    for (auto const& line : lines)
+    {
+        put(out, line.first);
+        put(out, line.second);
+    }
+}
+
+bool IR::read(char const*& at, char const* end)
+{
+    std::uint32_t count;
+    std::string text;
+    if (!get(at, end, count) || !fits(at, end, count, 4))
+        return false;
+    for (std::uint32_t i = 0; i < count; ++i)
+        if (!get_text(at, end, text) || symbols.intern(text) != i)
+            return false;
+
+    if (!get_array(at, end, nodes) || !get_array(at, end, children) || !get_array(at, end, numbers)
+        || !get(at, end, count) || !fits(at, end, count, 4))
+        return false;
+    strings.resize(count);
+    for (auto& str : strings)
+        if (!get_text(at, end, str))
+            return false;
+
+    if (!get(at, end, count) || !fits(at, end, count, 17))
+        return false;
+    labels.resize(count);
+    for (auto& lbl : labels)
+    {
+        std::uint8_t kind;
+        if (!get(at, end, lbl.name) || !get(at, end, lbl.scope) || !get(at, end, lbl.index_in_scope)
+            || !get(at, end, kind) || !get(at, end, lbl.decl) || kind > std::uint8_t(LabelKind::Def))
+            return false;
+        lbl.kind = LabelKind(kind);
+    }
+    if (!get_array(at, end, scopes) || !get_array(at, end, params) || !get(at, end, count) || !fits(at, end, count, 21))
+        return false;
+    defs.resize(count);
+    for (auto& d : defs)
+    {
+        std::uint8_t has_args;
+        if (!get(at, end, d.name) || !get(at, end, d.scope) || !get(at, end, d.first_param)
+            || !get(at, end, d.param_count) || !get(at, end, has_args) || !get(at, end, d.body))
+            return false;
+        d.has_args = has_args != 0;
+    }
+
+    if (!get(at, end, count))
+        return false;
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        NodeId id;
+        std::uint32_t line;
+        if (!get(at, end, id) || !get(at, end, line) || id >= nodes.size())
+            return false;
+        lines[id] = line;
+    }
+
+    // Everything the rest of the compiler indexes with must be in range.
+    for (NodeId child : children)
+        if (child >= nodes.size())
+            return false;
+    // Nodes are added after their children, so a child that does not come
+    // before its parent would make a cycle, which walks never leave.
+    for (NodeId id = 0; id < nodes.size(); ++id)
+    {
+        Node const& n = nodes[id];
+        if (n.kind > NodeKind::Def || !valid(n.symbol, symbols.size())
+            || n.first_child > children.size() || children.size() - n.first_child < n.child_count)
+            return false;
+        for (std::uint32_t k = 0; k < n.child_count; ++k)
+            if (children[n.first_child + k] >= id)
+                return false;
+        std::size_t limit = 0;
+        switch (n.kind)
+        {
+        case NodeKind::Number: limit = numbers.size(); break;
+        case NodeKind::String: limit = strings.size(); break;
+        case NodeKind::Ref:
+        case NodeKind::Label:
+        case NodeKind::Assign:
+        case NodeKind::Call: limit = labels.size(); break;
+        case NodeKind::Block: limit = scopes.size(); break;
+        case NodeKind::Def: limit = defs.size(); break;
+        case NodeKind::Send:
+        case NodeKind::Tuple: continue;
+        }
+        bool may_be_free = n.kind != NodeKind::Number && n.kind != NodeKind::String
+            && n.kind != NodeKind::Block && n.kind != NodeKind::Def;
+        if (may_be_free ? !valid(n.value, limit) : n.value >= limit)
+            return false;
+    }
+    for (Label const& lbl : labels)
+        if (!valid(lbl.name, symbols.size()) || lbl.scope >= scopes.size() || !valid(lbl.decl, nodes.size()))
+            return false;
+    for (ScopeId id = 0; id < scopes.size(); ++id)
+        if (!(scopes[id].parent == none || scopes[id].parent < id) || !valid(scopes[id].owner, defs.size()))
+            return false;
+    for (Param const& p : params)
+        if (!valid(p.name, symbols.size()) || !valid(p.label, labels.size())
+            || !valid(p.type, nodes.size()) || !valid(p.default_value, nodes.size()))
+            return false;
+    for (Def const& d : defs)
+        if (!valid(d.name, symbols.size()) || !valid(d.scope, scopes.size()) || !valid(d.body, nodes.size())
+            || d.first_param > params.size() || params.size() - d.first_param < d.param_count)
+            return false;
+    return true;
+}
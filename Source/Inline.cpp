@@ -0,0 +1,265 @@
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include "Knife/Inline.hpp"
+#include "Knife/Codegen.hpp"
+#include "Knife/TimeReport.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+// The summary lists its module's defs here, so the declarations its
+// bodies make of other modules' defs are not taken for exports.
+char const* const defs_metadata = "knife.defs";
+
+// Globals private to the module, such as the entries of spawned tasks and
+// string constants, cannot be referred to from another module.  Its probe
+// flags can: they are external, so a body that reads them is summarized
+// with the flags declared, as ThinLTO imports a global.
+bool refers_to_private(llvm::Value const* value)
+{
+    if (auto g = llvm::dyn_cast<llvm::GlobalValue>(value))
+        return g->hasLocalLinkage();
+    if (auto expr = llvm::dyn_cast<llvm::ConstantExpr>(value))
+        for (llvm::Value const* operand : expr->operands())
+            if (refers_to_private(operand))
+                return true;
+    return false;
+}
+
+bool uses_private(llvm::Function const& f)
+{
+    for (auto const& block : f)
+        for (auto const& inst : block)
+            for (llvm::Value const* operand : inst.operands())
+                if (refers_to_private(operand))
+                    return true;
+    return false;
+}
+
+// Calls from the module's own code to the named functions.
+std::size_t calls_to(llvm::Module const& module, std::set<std::string> const& names)
+{
+    std::size_t count = 0;
+    for (auto const& f : module)
+    {
+        if (f.isDeclaration() || f.hasAvailableExternallyLinkage())
+            continue;
+        for (auto const& block : f)
+            for (auto const& inst : block)
+                if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst))
+                    if (auto callee = call->getCalledFunction())
+                        if (names.count(callee->getName().str()))
+                            ++count;
+    }
+    return count;
+}
+
+std::unique_ptr<llvm::Module> parse(ModuleSummary const& summary, llvm::LLVMContext& context)
+{
+    auto parsed = llvm::parseBitcodeFile(llvm::MemoryBufferRef(summary.bitcode, "knife summary"), context);
+    if (!parsed)
+    {
+        llvm::logAllUnhandledErrors(parsed.takeError(), llvm::errs(), "inline: ");
+        return nullptr;
+    }
+    return std::move(*parsed);
+}
+
+}
+
+ModuleSummary Semantic::summarize(llvm::Module const& module, std::vector<std::string> const& defs)
+{
+    std::set<std::string> names(defs.begin(), defs.end());
+    std::unique_ptr<llvm::Module> copy = llvm::CloneModule(module);
+
+    for (auto& f : *copy)
+    {
+        if (f.isDeclaration())
+            continue;
+        bool small = f.getInstructionCount() <= max_inline_instructions && !uses_private(f);
+        if (!names.count(f.getName().str()) || !small || f.hasAvailableExternallyLinkage())
+            f.deleteBody();
+    }
+
+    // Without the bodies that used them, globals and most declarations go;
+    // the ones the bodies use are declared, and resolve to the module's own.
+    for (auto& g : llvm::make_early_inc_range(copy->globals()))
+    {
+        g.removeDeadConstantUsers();
+        if (!g.use_empty() && !g.hasLocalLinkage())
+        {
+            g.setInitializer(nullptr);
+            g.setLinkage(llvm::GlobalValue::ExternalLinkage);
+            continue;
+        }
+        g.replaceAllUsesWith(llvm::UndefValue::get(g.getType()));
+        g.eraseFromParent();
+    }
+    for (auto& f : llvm::make_early_inc_range(*copy))
+        if (f.isDeclaration() && f.use_empty() && !names.count(f.getName().str()))
+            f.eraseFromParent();
+    llvm::StripDebugInfo(*copy);
+
+    llvm::NamedMDNode* listed = copy->getOrInsertNamedMetadata(defs_metadata);
+    for (auto const& name : defs)
+        if (copy->getFunction(name))
+            listed->addOperand(llvm::MDNode::get(copy->getContext(), llvm::MDString::get(copy->getContext(), name)));
+
+    ModuleSummary summary;
+    llvm::raw_string_ostream out(summary.bitcode);
+    llvm::WriteBitcodeToFile(*copy, out);
+    out.flush();
+    return summary;
+}
+
+std::vector<ExportedDef> Semantic::exports_of(ModuleSummary const& summary)
+{
+    std::vector<ExportedDef> result;
+    llvm::LLVMContext context;
+    std::unique_ptr<llvm::Module> module = parse(summary, context);
+    if (!module)
+        return result;
+
+    if (llvm::NamedMDNode* listed = module->getNamedMetadata(defs_metadata))
+        for (llvm::MDNode const* entry : listed->operands())
+        {
+            std::string name = llvm::cast<llvm::MDString>(entry->getOperand(0))->getString().str();
+            llvm::Function const* f = module->getFunction(name);
+            // Callers in other modules can only pass numbers for now.
+            bool numbers_only = true;
+            for (llvm::Type const* param : f->getFunctionType()->params())
+                numbers_only = numbers_only && param->isDoubleTy();
+            if (numbers_only)
+                result.push_back(ExportedDef{ name, unsigned(f->arg_size()), !f->isDeclaration() });
+        }
+    return result;
+}
+
+InlineStats Semantic::optimize_with_imports(llvm::Module& module, std::vector<ModuleSummary> const& summaries,
+    int level, llvm::TargetMachine* target)
+{
+    InlineStats stats = { 0, 0, 0 };
+
+    std::vector<std::unique_ptr<llvm::Module>> sources;
+    for (auto const& summary : summaries)
+        if (std::unique_ptr<llvm::Module> source = parse(summary, module.getContext()))
+            sources.push_back(std::move(source));
+
+    // Only calls to other modules' defs count: runtime hooks such as
+    // knife_probe_hit are declared too, and inlined bodies bring more
+    // calls to them.
+    std::set<std::string> exported;
+    for (auto const& source : sources)
+        if (llvm::NamedMDNode* listed = source->getNamedMetadata(defs_metadata))
+            for (llvm::MDNode const* entry : listed->operands())
+                exported.insert(llvm::cast<llvm::MDString>(entry->getOperand(0))->getString().str());
+    std::set<std::string> external;
+    for (auto const& f : module)
+        if (f.isDeclaration() && exported.count(f.getName().str()))
+            external.insert(f.getName().str());
+    stats.call_sites = calls_to(module, external);
+
+    for (auto& source : sources)
+    {
+        if (stats.call_sites == 0)
+            break;
+
+        bool needed = false;
+        for (auto& f : *source)
+        {
+            if (f.isDeclaration())
+                continue;
+            llvm::Function* declared = module.getFunction(f.getName());
+            if (declared && declared->isDeclaration() && external.count(f.getName().str()))
+            {
+                f.setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+                needed = true;
+                ++stats.bodies_imported;
+            }
+            else
+                f.deleteBody();
+        }
+
+        if (!needed)
+            continue;
+        if (llvm::NamedMDNode* listed = source->getNamedMetadata(defs_metadata))
+            source->eraseNamedMetadata(listed);
+        source->setDataLayout(module.getDataLayout());
+        source->setTargetTriple(module.getTargetTriple());
+        if (llvm::Linker::linkModules(module, std::move(source), llvm::Linker::LinkOnlyNeeded))
+            cerr << "inline: could not import from a module summary" << endl;
+    }
+
+    optimize(module, level, target);
+
+    std::size_t remaining = calls_to(module, external);
+    stats.call_sites_inlined = remaining < stats.call_sites ? stats.call_sites - remaining : 0;
+
+    TimeReport::count("cross-module bodies imported", stats.bodies_imported);
+    TimeReport::count("cross-module call sites", stats.call_sites);
+    TimeReport::count("cross-module call sites inlined", stats.call_sites_inlined);
+    return stats;
+}
+
+void Semantic::embed_summary(llvm::Module& module, ModuleSummary const& summary)
+{
+    llvm::Constant* data = llvm::ConstantDataArray::getString(module.getContext(), summary.bitcode, false);
+    auto g = new llvm::GlobalVariable(module, data->getType(), true, llvm::GlobalValue::PrivateLinkage, data, "knife.summary");
+    g->setSection(summary_section);
+    g->setAlignment(llvm::Align(1));
+    llvm::appendToCompilerUsed(module, { g });
+}
+
+bool Semantic::read_summary(std::string const& object_path, ModuleSummary& summary)
+{
+    auto object = llvm::object::ObjectFile::createObjectFile(object_path);
+    if (!object)
+    {
+        llvm::logAllUnhandledErrors(object.takeError(), llvm::errs(), "inline: " + object_path + ": ");
+        return false;
+    }
+
+    for (auto const& section : object->getBinary()->sections())
+    {
+        auto name = section.getName();
+        if (!name)
+        {
+            llvm::consumeError(name.takeError());
+            continue;
+        }
+        if (*name != summary_section)
+            continue;
+
+        auto contents = section.getContents();
+        if (!contents)
+        {
+            llvm::consumeError(contents.takeError());
+            return false;
+        }
+        summary.bitcode = contents->str();
+        return true;
+    }
+    return false;
+}
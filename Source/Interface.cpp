@@ -0,0 +1,321 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#include "Knife/Interface.hpp"
+#include "Knife/TimeReport.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+char const magic[8] = { 'K', 'N', 'I', 'F', 'E', 'I', 'F', '1' };
+
+// The magic, then a checksum of the rest.
+std::size_t const header_bytes = 16;
+
+// Constants nest no deeper than the types folding makes; deeper ones in a
+// file are taken for corruption rather than recursed into.
+int const max_constant_depth = 64;
+
+// Over 8 bytes at a time, so checking a large interface costs little next
+// to reading it.
+std::uint64_t checksum(char const* data, std::size_t size)
+{
+    std::uint64_t h = 14695981039346656037ull;
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof word);
+        h = (h ^ word) * 1099511628211ull;
+        h ^= h >> 29;
+    }
+    for (; i < size; ++i)
+        h = (h ^ std::uint8_t(data[i])) * 1099511628211ull;
+    return h;
+}
+
+template <typename T>
+void put(std::string& out, T value)
+{
+    out.append(reinterpret_cast<char const*>(&value), sizeof value);
+}
+
+void put_text(std::string& out, std::string const& text)
+{
+    put(out, std::uint32_t(text.size()));
+    out.append(text);
+}
+
+template <typename T>
+bool get(char const*& at, char const* end, T& value)
+{
+    if (std::size_t(end - at) < sizeof value)
+        return false;
+    std::memcpy(&value, at, sizeof value);
+    at += sizeof value;
+    return true;
+}
+
+bool get_text(char const*& at, char const* end, std::string& text)
+{
+    std::uint32_t size;
+    if (!get(at, end, size) || std::size_t(end - at) < size)
+        return false;
+    text.assign(at, size);
+    at += size;
+    return true;
+}
+
+void put_constant(std::string& out, Constant const& c)
+{
+    put(out, std::uint8_t(c.kind));
+    put(out, c.name);
+    put(out, c.label);
+    put(out, c.number);
+    put_text(out, c.text);
+    put(out, std::uint32_t(c.elements.size()));
+    for (auto const& element : c.elements)
+        put_constant(out, element);
+}
+
+bool get_constant(char const*& at, char const* end, Constant& c, std::size_t symbol_count, int depth)
+{
+    std::uint8_t kind;
+    std::uint32_t count;
+    if (depth > max_constant_depth || !get(at, end, kind) || kind > std::uint8_t(Constant::Kind::Tuple)
+        || !get(at, end, c.name) || !get(at, end, c.label) || !get(at, end, c.number)
+        || !get_text(at, end, c.text) || !get(at, end, count))
+        return false;
+    c.kind = Constant::Kind(kind);
+    if ((c.name != none && c.name >= symbol_count) || (c.label != none && c.label >= symbol_count))
+        return false;
+
+    // Each element takes at least its fixed fields.
+    if (std::size_t(end - at) / 25 < count)
+        return false;
+    c.elements.resize(count);
+    for (auto& element : c.elements)
+        if (!get_constant(at, end, element, symbol_count, depth + 1))
+            return false;
+    return true;
+}
+
+// Whether a parameter is declared "T: type".
+bool takes_type(IR const& ir, Param const& p)
+{
+    return p.type != none && ir.node(p.type).kind == NodeKind::Ref && ir.symbols.name(ir.node(p.type).symbol) == "type";
+}
+
+char const* kind_name(ExportKind kind)
+{
+    switch (kind)
+    {
+    case ExportKind::Def: return "def";
+    case ExportKind::Template: return "template";
+    case ExportKind::Value: return "value";
+    }
+    return "";
+}
+
+}
+
+std::uint64_t Semantic::hash_source(std::string const& text)
+{
+    std::uint64_t h = 14695981039346656037ull;
+    for (char c : text)
+        h = (h ^ std::uint8_t(c)) * 1099511628211ull;
+    return h;
+}
+
+Interface::Interface()
+    : ir(std::make_shared<IR>()), hash(0)
+{
+}
+
+Interface::Interface(ModuleSpec const& spec, std::string const& source)
+    : ir(spec.share_ir()), file(spec.file_name()), hash(hash_source(source)), items(spec.item_nodes())
+{
+    // The label each top-level def's name is bound to.
+    std::unordered_map<NodeId, LabelId> def_labels;
+    for (LabelId id = 0; id < ir->label_count(); ++id)
+        if (ir->label(id).kind == LabelKind::Def && ir->label(id).scope == spec.module_scope())
+            def_labels[ir->label(id).decl] = id;
+
+    for (NodeId item : items)
+    {
+        Node const& n = ir->node(item);
+        if ((n.kind != NodeKind::Def && n.kind != NodeKind::Label) || n.symbol == none)
+            continue;
+
+        Export e;
+        e.name = ir->symbols.name(n.symbol);
+        e.arity = 0;
+        if (n.kind == NodeKind::Label)
+        {
+            e.kind = ExportKind::Value;
+            e.label = n.value;
+            IR::Range kids = ir->children_of(item);
+            if (n.flags & HasInit)
+            {
+                // Folding leaves numbers and strings as literal nodes.
+                Node const& init = ir->node(kids[kids.size() - 1]);
+                if (init.kind == NodeKind::Number)
+                    e.value = Constant::of_number(ir->number(init.value));
+                else if (init.kind == NodeKind::String)
+                    e.value = Constant::of_string(ir->string(init.value));
+                else if (Constant const* folded = spec.constant_value(kids[kids.size() - 1]))
+                    e.value = *folded;
+            }
+        }
+        else
+        {
+            Def const& d = ir->def(n.value);
+            e.arity = d.param_count;
+            e.kind = d.has_args ? ExportKind::Def : ExportKind::Template;
+            for (std::uint32_t i = 0; i < d.param_count; ++i)
+                if (takes_type(*ir, ir->param(n.value, i)))
+                    e.kind = ExportKind::Template;
+
+            auto label = def_labels.find(item);
+            if (label == def_labels.end())
+                continue;
+            e.label = label->second;
+        }
+        exported.push_back(e);
+    }
+}
+
+void Interface::write(std::string& out) const
+{
+    TimeReport::Phase phase("write interface");
+    std::size_t start = out.size();
+    out.append(magic, sizeof magic);
+    put(out, std::uint64_t(0));
+    put(out, hash);
+    put_text(out, file);
+    ir->write(out);
+
+    put(out, std::uint32_t(items.size()));
+    for (NodeId item : items)
+        put(out, item);
+
+    put(out, std::uint32_t(exported.size()));
+    for (auto const& e : exported)
+    {
+        put_text(out, e.name);
+        put(out, std::uint8_t(e.kind));
+        put(out, e.label);
+        put(out, std::uint32_t(e.arity));
+        put_constant(out, e.value);
+    }
+
+    std::size_t payload = start + header_bytes;
+    std::uint64_t sum = checksum(out.data() + payload, out.size() - payload);
+    std::memcpy(&out[start + sizeof magic], &sum, sizeof sum);
+}
+
+bool Interface::read(char const* data, std::size_t size)
+{
+    TimeReport::Phase phase("read interface");
+    char const* at = data;
+    char const* end = data + size;
+    std::uint64_t sum;
+    if (size < header_bytes || std::memcmp(data, magic, sizeof magic) != 0)
+        return false;
+    std::memcpy(&sum, data + sizeof magic, sizeof sum);
+    if (sum != checksum(data + header_bytes, size - header_bytes))
+        return false;
+    at += header_bytes;
+
+    auto loaded = std::make_shared<IR>();
+    std::uint32_t count;
+    if (!get(at, end, hash) || !get_text(at, end, file) || !loaded->read(at, end) || !get(at, end, count)
+        || std::size_t(end - at) / sizeof(NodeId) < count)
+        return false;
+    IR const& read_ir = *loaded;
+    ir = loaded;
+
+    items.resize(count);
+    for (auto& item : items)
+        if (!get(at, end, item) || item >= read_ir.node_count())
+            return false;
+
+    if (!get(at, end, count))
+        return false;
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        Export e;
+        std::uint8_t kind;
+        std::uint32_t arity;
+        if (!get_text(at, end, e.name) || !get(at, end, kind) || kind > std::uint8_t(ExportKind::Value)
+            || !get(at, end, e.label) || !get(at, end, arity)
+            || !get_constant(at, end, e.value, read_ir.symbols.size(), 0))
+            return false;
+        if (e.label >= read_ir.label_count())
+            return false;
+        e.kind = ExportKind(kind);
+        e.arity = arity;
+        exported.push_back(std::move(e));
+    }
+    TimeReport::count("interface bytes", size);
+    return at == end;
+}
+
+bool Interface::save(std::string const& path) const
+{
+    std::string bytes;
+    write(bytes);
+    std::ofstream out(path, std::ios::binary);
+    if (!(out << bytes) || !out.flush())
+    {
+        cerr << "interface: cannot write " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+void Interface::dump(std::ostream& s) const
+{
+    s << "Interface of " << file << ", " << items.size() << " items, " << ir->node_count() << " IR nodes" << endl;
+    for (auto const& e : exported)
+    {
+        s << "    " << kind_name(e.kind) << ' ' << e.name;
+        if (e.kind != ExportKind::Value)
+            s << " (" << e.arity << (e.arity == 1 ? " parameter)" : " parameters)");
+        else if (e.value.known())
+        {
+            s << " = ";
+            e.value.dump(s, ir->symbols);
+        }
+        s << endl;
+    }
+}
+
+std::shared_ptr<Interface const> Semantic::load_interface(std::string const& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        cerr << "interface: cannot read " << path << endl;
+        return nullptr;
+    }
+    in.seekg(0, std::ios::end);
+    std::string data(std::size_t(in.tellg()), '\0');
+    in.seekg(0);
+    in.read(&data[0], data.size());
+
+    auto loaded = std::make_shared<Interface>();
+    if (!loaded->read(data.data(), data.size()))
+    {
+        cerr << "interface: " << path << " is not an interface file of this compiler, or is damaged" << endl;
+        return nullptr;
+    }
+    return loaded;
+}
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <memory>
+#include <vector>
+using namespace std;
+
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "Knife/Jit.hpp"
+#include "Knife/Debugger.hpp"
+#include "Knife/Profiler.hpp"
+#include "Knife/Region.hpp"
+#include "Knife/Scheduler.hpp"
+#include "Knife/TimeReport.hpp"
+
+namespace
+{
+
+bool report(llvm::Error error)
+{
+    if (!error)
+        return true;
+    llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "jit: ");
+    return false;
+}
+
+// Hands the line tables of each loaded object to the profiler, the way
+// LLVM's perf listener does for perf.  Objects without debug info have no
+// line rows and are skipped.
+class ProfilerListener : public llvm::JITEventListener
+{
+private:
+    std::map<ObjectKey, std::vector<std::uintptr_t>> loaded;
+
+public:
+    void notifyObjectLoaded(ObjectKey key, llvm::object::ObjectFile const& object,
+        llvm::RuntimeDyld::LoadedObjectInfo const& info) override
+    {
+        llvm::object::OwningBinary<llvm::object::ObjectFile> debug = info.getObjectForDebug(object);
+        if (!debug.getBinary())
+            return;
+
+        std::unique_ptr<llvm::DWARFContext> dwarf = llvm::DWARFContext::create(*debug.getBinary());
+        llvm::DILineInfoSpecifier spec(llvm::DILineInfoSpecifier::FileLineInfoKind::RawValue,
+            llvm::DILineInfoSpecifier::FunctionNameKind::ShortName);
+
+        for (auto const& sized : llvm::object::computeSymbolSizes(*debug.getBinary()))
+        {
+            llvm::object::SymbolRef symbol = sized.first;
+            auto type = symbol.getType();
+            auto address = symbol.getAddress();
+            auto section = symbol.getSection();
+            if (!type || !address || !section || *type != llvm::object::SymbolRef::ST_Function)
+            {
+                llvm::consumeError(type.takeError());
+                llvm::consumeError(address.takeError());
+                llvm::consumeError(section.takeError());
+                continue;
+            }
+
+            std::uint64_t index = (*section)->getIndex();
+            std::vector<Profiler::LineRow> rows;
+            for (auto const& entry : dwarf->getLineInfoForAddressRange({ *address, index }, sized.second, spec))
+            {
+                llvm::DIInliningInfo inlined = dwarf->getInliningInfoForAddress({ entry.first, index }, spec);
+                Profiler::LineRow row;
+                row.address = entry.first;
+                for (std::uint32_t i = 0; i < inlined.getNumberOfFrames(); ++i)
+                {
+                    llvm::DILineInfo const& frame = inlined.getFrame(i);
+                    row.frames.push_back(Profiler::CodeLocation{ frame.FunctionName, frame.FileName,
+                        int(frame.Line), int(frame.StartLine) });
+                }
+                rows.push_back(std::move(row));
+            }
+
+            if (rows.empty())
+                continue;
+            std::stable_sort(rows.begin(), rows.end(),
+                [](Profiler::LineRow const& a, Profiler::LineRow const& b) { return a.address < b.address; });
+            Profiler::register_code(*address, *address + sized.second, std::move(rows));
+            loaded[key].push_back(*address);
+        }
+    }
+
+    void notifyFreeingObject(ObjectKey key) override
+    {
+        auto found = loaded.find(key);
+        if (found == loaded.end())
+            return;
+        for (std::uintptr_t begin : found->second)
+            Profiler::unregister_code(begin);
+        loaded.erase(found);
+    }
+};
+
+void initialize_native_target()
+{
+    static bool initialized = !llvm::InitializeNativeTarget() && !llvm::InitializeNativeTargetAsmPrinter();
+    if (!initialized)
+        cerr << "jit: no native target" << endl;
+}
+
+}
+
+Jit::Jit(int opt_level, bool cross_module_inlining)
+    : opt_level(opt_level), modules_loaded(0), cross_module_inlining(cross_module_inlining), stats{ 0, 0, 0 }
+{
+    initialize_native_target();
+
+    auto builder = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!builder)
+    {
+        report(builder.takeError());
+        return;
+    }
+
+    auto machine = builder->createTargetMachine();
+    if (!machine)
+    {
+        report(machine.takeError());
+        return;
+    }
+    target = std::move(*machine);
+
+    // RuntimeDyld rather than JITLink, for the event listener interface.
+    listener.reset(new ProfilerListener);
+    llvm::JITEventListener* events = listener.get();
+    auto created = llvm::orc::LLJITBuilder()
+        .setJITTargetMachineBuilder(*builder)
+        .setObjectLinkingLayerCreator([events](llvm::orc::ExecutionSession& session, llvm::Triple const&) {
+            std::unique_ptr<llvm::orc::RTDyldObjectLinkingLayer> layer(new llvm::orc::RTDyldObjectLinkingLayer(
+                session, [] { return std::unique_ptr<llvm::RuntimeDyld::MemoryManager>(new llvm::SectionMemoryManager); }));
+            layer->registerJITEventListener(*events);
+            return llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>>(std::move(layer));
+        })
+        .create();
+    if (!created)
+    {
+        report(created.takeError());
+        return;
+    }
+    jit = std::move(*created);
+
+    llvm::orc::JITDylib& dylib = jit->getMainJITDylib();
+    llvm::orc::MangleAndInterner mangle(jit->getExecutionSession(), jit->getDataLayout());
+
+    // The runtime hooks, then anything else from the process (e.g. libm).
+    report(dylib.define(llvm::orc::absoluteSymbols({
+        { mangle("knife_probe_hit"), llvm::JITEvaluatedSymbol(
+            llvm::pointerToJITTargetAddress(&knife_probe_hit), llvm::JITSymbolFlags::Exported) },
+        { mangle("knife_region_mark"), llvm::JITEvaluatedSymbol(
+            llvm::pointerToJITTargetAddress(&knife_region_mark), llvm::JITSymbolFlags::Exported) },
+        { mangle("knife_region_release"), llvm::JITEvaluatedSymbol(
+            llvm::pointerToJITTargetAddress(&knife_region_release), llvm::JITSymbolFlags::Exported) },
+        { mangle("knife_region_alloc"), llvm::JITEvaluatedSymbol(
+            llvm::pointerToJITTargetAddress(&knife_region_alloc), llvm::JITSymbolFlags::Exported) },
+        { mangle("knife_task_spawn"), llvm::JITEvaluatedSymbol(
+            llvm::pointerToJITTargetAddress(&knife_task_spawn), llvm::JITSymbolFlags::Exported) },
+        { mangle("knife_task_await"), llvm::JITEvaluatedSymbol(
+            llvm::pointerToJITTargetAddress(&knife_task_await), llvm::JITSymbolFlags::Exported) }
+    })));
+
+    auto process = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(jit->getDataLayout().getGlobalPrefix());
+    if (process)
+        dylib.addGenerator(std::move(*process));
+    else
+        report(process.takeError());
+}
+
+Jit::~Jit()
+{
+    // Before the jit frees the flags.
+    for (std::uint8_t* flags : probe_flags)
+        Debugger::unregister_module(flags);
+}
+
+std::size_t Jit::load(Semantic::IR const& ir, std::vector<Semantic::NodeId> const& items,
+    std::string const& file_name, Semantic::CodegenOptions options)
+{
+    if (!jit)
+        return 0;
+
+    std::unique_ptr<llvm::LLVMContext> context(new llvm::LLVMContext);
+    Semantic::Codegen codegen(ir, *context, file_name + "." + std::to_string(modules_loaded++), file_name, options);
+    for (auto const& def : exported)
+        codegen.declare_external(def.first, def.second);
+    std::size_t emitted = codegen.emit(items);
+
+    std::vector<std::string> defs;
+    for (Semantic::NodeId item : items)
+    {
+        Semantic::Node const& n = ir.node(item);
+        if (n.kind == Semantic::NodeKind::Def && n.symbol != Semantic::none && codegen.function_of(n.value))
+            defs.push_back(ir.symbols.name(n.symbol));
+    }
+
+    std::vector<Semantic::ProbeSite> sites = codegen.probe_sites();
+    std::string flags_name = codegen.probe_flags_name();
+
+    std::unique_ptr<llvm::Module> module = codegen.take_module();
+    module->setDataLayout(jit->getDataLayout());
+    module->setTargetTriple(target->getTargetTriple().str());
+    if (cross_module_inlining)
+    {
+        Semantic::InlineStats imported = Semantic::optimize_with_imports(*module, summaries, opt_level, target.get());
+        stats.bodies_imported += imported.bodies_imported;
+        stats.call_sites += imported.call_sites;
+        stats.call_sites_inlined += imported.call_sites_inlined;
+    }
+    else
+        Semantic::optimize(*module, opt_level, target.get());
+
+    // Summarized before the jit takes the module; later modules import from it.
+    Semantic::ModuleSummary summary = Semantic::summarize(*module, defs);
+    for (auto const& def : Semantic::exports_of(summary))
+        exported[def.name] = def.arity;
+    summaries.push_back(std::move(summary));
+
+    if (!report(jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(module), std::move(context)))))
+        return 0;
+
+    if (!sites.empty())
+    {
+        std::uint8_t* flags = static_cast<std::uint8_t*>(lookup(flags_name));
+        if (flags)
+        {
+            Debugger::register_module(file_name, flags, sites);
+            probe_flags.push_back(flags);
+        }
+    }
+
+    return emitted;
+}
+
+void* Jit::lookup(std::string const& name)
+{
+    if (!jit)
+        return nullptr;
+
+    // The first lookup in a module compiles it to machine code.
+    TimeReport::Phase phase("machine code");
+    auto symbol = jit->lookup(name);
+    if (!symbol)
+    {
+        report(symbol.takeError());
+        return nullptr;
+    }
+    return llvm::jitTargetAddressToPointer<void*>(symbol->getAddress());
+}
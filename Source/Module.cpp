@@ -0,0 +1,132 @@
+#include <iostream>
+#include <string>
+#include <algorithm>
+using namespace std;
+
+#include "Knife/Module.hpp"
+#include "Knife/Utf8.hpp"
+#include "Knife/Walk.hpp"
+
+Syntax::LineMap::LineMap(std::string const& source)
+{
+    starts.push_back(0);
+    for (std::size_t i = 0; i < source.size(); ++i)
+        if (source[i] == '\n')
+            starts.push_back(i + 1);
+}
+
+int Syntax::LineMap::line_of(std::size_t offset) const
+{
+    return int(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin());
+}
+
+bool Syntax::parsed_completely(Syntax::Module const& module)
+{
+    char const* const separators = " \t\r\n;";
+    std::string const& source = module.source;
+    std::size_t at = byte_order_mark(source.data(), source.size());
+    for (auto const& item : module.items)
+    {
+        if (source.find_first_not_of(separators, at) < item.span.begin)
+            return false;
+        at = item.span.end;
+    }
+    return source.find_first_not_of(separators, at) == std::string::npos;
+}
+
+std::string Syntax::top_level_name(Syntax::Stmt const& stmt)
+{
+    Syntax::NodeRef n = Syntax::node_ref(stmt);
+
+    switch (n.tag)
+    {
+    case Syntax::NodeTag::Def:
+    {
+        auto const& name = n.as<Syntax::DefExpr>().name;
+        return name ? name->value : "";
+    }
+    case Syntax::NodeTag::Label:
+    {
+        auto const& name = n.as<Syntax::LabelExpr>().name;
+        return name ? name->value : "";
+    }
+    case Syntax::NodeTag::Reassignment:
+        return n.as<Syntax::Reassignment>().name.value;
+    default:
+        return "";
+    }
+}
+
+namespace
+{
+
+bool is_reassignment(Syntax::TopLevelItem const& item)
+{
+    return boost::get<Syntax::Reassignment>(&item.stmt) != nullptr;
+}
+
+}
+
+ModuleIndex::ModuleIndex(Syntax::Module const& module)
+    : module(module)
+{
+    for (std::size_t i = 0; i < module.items.size(); ++i)
+    {
+        Syntax::TopLevelItem const& item = module.items[i];
+        if (item.name.empty())
+            continue;
+
+        if (!is_reassignment(item))
+            by_name[item.name] = i;
+        else
+        {
+            auto binding = by_name.find(item.name);
+            if (binding != by_name.end())
+                reassigned[binding->second].push_back(i);
+        }
+    }
+}
+
+Syntax::TopLevelItem const* ModuleIndex::find(std::string const& name) const
+{
+    auto pos = by_name.find(name);
+    if (pos == by_name.end())
+        return nullptr;
+    return &module.items[pos->second];
+}
+
+std::vector<Syntax::TopLevelItem const*> ModuleIndex::reassignments_of(Syntax::TopLevelItem const& binding) const
+{
+    std::vector<Syntax::TopLevelItem const*> result;
+    auto pos = reassigned.find(&binding - module.items.data());
+    if (pos != reassigned.end())
+        for (std::size_t i : pos->second)
+            result.push_back(&module.items[i]);
+    return result;
+}
+
+std::string ModuleIndex::text_of(Syntax::TopLevelItem const& item) const
+{
+    return module.source.substr(item.span.begin, item.span.end - item.span.begin);
+}
+
+std::vector<Syntax::TopLevelItem const*> ModuleIndex::named_items() const
+{
+    std::vector<Syntax::TopLevelItem const*> result;
+    for (auto const& item : module.items)
+        if (!item.name.empty() && !is_reassignment(item))
+            result.push_back(&item);
+    return result;
+}
+
+void ModuleIndex::dump(std::ostream& s) const
+{
+    s << "ModuleIndex " << module.file_name << std::endl;
+
+    for (auto const& item : module.items)
+    {
+        s << "    " << (item.name.empty() ? "_" : item.name) << (is_reassignment(item) ? " =" : "")
+          << " lines " << item.span.first_line << "-" << item.span.last_line
+          << " bytes " << item.span.begin << "-" << item.span.end << std::endl;
+    }
+}
@@ -0,0 +1,105 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+using namespace std;
+
+#include "boost/filesystem.hpp"
+
+#include "Knife/ModuleCache.hpp"
+#include "Knife/Parse.hpp"
+#include "Knife/TimeReport.hpp"
+
+static bool read_file(std::string const& path, std::string& text)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    std::stringstream source;
+    source << file.rdbuf();
+    text = source.str();
+    return true;
+}
+
+CompiledModule::CompiledModule(Syntax::Module module)
+    : syntax(std::move(module)), spec(syntax), folded(spec.fold_constants())
+{
+}
+
+CompiledModule::CompiledModule(Syntax::Module module, std::vector<std::shared_ptr<Semantic::Interface const>> const& imports)
+    : syntax(std::move(module)), spec(syntax, imports), folded(spec.fold_constants())
+{
+}
+
+ModuleCache::ModuleCache(std::size_t capacity)
+    : capacity(capacity), hit_count(0), miss_count(0)
+{
+}
+
+std::shared_ptr<CompiledModule const> ModuleCache::load(std::string const& path)
+{
+    std::string text;
+    if (!read_file(path, text))
+        return nullptr;
+
+    // The same file reached from different working directories is one entry.
+    boost::system::error_code error;
+    std::string key = boost::filesystem::canonical(path, error).string();
+    if (error)
+        key = path;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto found = modules.find(key);
+        if (found != modules.end() && found->second.module->syntax.source == text)
+        {
+            ++hit_count;
+            TimeReport::count("modules from cache");
+            recent.splice(recent.begin(), recent, found->second.recent);
+            return found->second.module;
+        }
+        ++miss_count;
+    }
+
+    // Compiled outside the lock; two threads missing on one file both
+    // compile it and the later one stays cached.
+    std::shared_ptr<CompiledModule const> compiled = std::make_shared<CompiledModule>(ParseModule(std::move(text), path));
+
+    if (!Syntax::parsed_completely(compiled->syntax))
+        return compiled;
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto found = modules.find(key);
+    if (found != modules.end())
+    {
+        found->second.module = compiled;
+        recent.splice(recent.begin(), recent, found->second.recent);
+        return compiled;
+    }
+
+    recent.push_front(key);
+    modules[key] = Entry{ compiled, recent.begin() };
+    if (modules.size() > capacity)
+    {
+        modules.erase(recent.back());
+        recent.pop_back();
+    }
+    return compiled;
+}
+
+std::shared_ptr<CompiledModule const> compile_module(std::string const& path)
+{
+    std::string text;
+    if (!read_file(path, text))
+        return nullptr;
+    return std::make_shared<CompiledModule>(ParseModule(std::move(text), path));
+}
+
+std::shared_ptr<CompiledModule const> compile_module(std::string const& path,
+    std::vector<std::shared_ptr<Semantic::Interface const>> const& imports)
+{
+    std::string text;
+    if (!read_file(path, text))
+        return nullptr;
+    return std::make_shared<CompiledModule>(ParseModule(std::move(text), path), imports);
+}
@@ -0,0 +1,132 @@
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "Knife/Operators.hpp"
+
+using namespace Syntax;
+
+namespace
+{
+
+enum Level
+{
+    LogicalOr = 1,
+    LogicalAnd,
+    BitOr,
+    BitXor,
+    BitAnd,
+    Equality,
+    Relational,
+    Shift,
+    Additive,
+    Multiplicative,
+    Other
+};
+
+// Indexed by an operator's first character, and by the character of an
+// operator that starts with it twice (&& || << >>); 0 elsewhere.  Every
+// character an operator can contain has a nonzero first entry.
+struct PrecedenceTable
+{
+    unsigned char first[128];
+    unsigned char doubled[128];
+
+    PrecedenceTable()
+        : first(), doubled()
+    {
+        first['|'] = BitOr;
+        first['^'] = BitXor;
+        first['&'] = BitAnd;
+        first['='] = first['!'] = Equality;
+        first['<'] = first['>'] = Relational;
+        first['+'] = first['-'] = Additive;
+        first['*'] = first['/'] = first['%'] = Multiplicative;
+        first['~'] = first['?'] = first['@'] = first['$'] = Other;
+
+        doubled['|'] = LogicalOr;
+        doubled['&'] = LogicalAnd;
+        doubled['<'] = doubled['>'] = Shift;
+    }
+};
+
+static_assert(Other == tightest_precedence, "tightest_precedence is out of date");
+
+PrecedenceTable const table;
+
+}
+
+int Syntax::operator_precedence(std::string const& op)
+{
+    if (op.empty())
+        return 0;
+
+    unsigned char c = op[0];
+    if (c >= 128)
+        return 0;
+    if (op.size() > 1 && op[1] == op[0] && table.doubled[c])
+        return table.doubled[c];
+    return table.first[c];
+}
+
+bool Syntax::is_operator_name(std::string const& name)
+{
+    if (name.empty() || name == "=")
+        return false;
+
+    for (char ch : name)
+    {
+        unsigned char c = ch;
+        if (c >= 128 || !table.first[c])
+            return false;
+    }
+    return true;
+}
+
+bool Syntax::is_binary_operation(Invocation const& t)
+{
+    return t.args && t.args->elements.size() == 2 && !t.postfix_lambda && !t.next_call
+        && is_operator_name(t.name.value);
+}
+
+void Syntax::fold_operators(OperatorChain& chain, Expr& result)
+{
+    if (chain.rest.empty())
+    {
+        result = std::move(chain.first);
+        return;
+    }
+
+    // Operands wait on one stack and operators on the other until one of
+    // no higher precedence arrives, so each is pushed and popped once.
+    std::vector<Expr> operands;
+    std::vector<std::pair<std::size_t, int>> pending;     // index in chain.rest, precedence
+    operands.reserve(chain.rest.size() + 1);
+    operands.push_back(std::move(chain.first));
+
+    auto reduce = [&]() {
+        Invocation call;
+        call.name.value = std::move(chain.rest[pending.back().first].op);
+        call.args = TupleExpr();
+        call.args->elements.reserve(2);
+        call.args->elements.push_back(std::move(operands[operands.size() - 2]));
+        call.args->elements.push_back(std::move(operands.back()));
+        operands.pop_back();
+        operands.back() = std::move(call);
+        pending.pop_back();
+    };
+
+    for (std::size_t i = 0; i < chain.rest.size(); ++i)
+    {
+        int precedence = operator_precedence(chain.rest[i].op);
+        while (!pending.empty() && pending.back().second >= precedence)
+            reduce();
+        pending.push_back(std::make_pair(i, precedence));
+        operands.push_back(std::move(chain.rest[i].operand));
+    }
+    while (!pending.empty())
+        reduce();
+
+    result = std::move(operands.back());
+}
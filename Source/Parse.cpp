@@ -0,0 +1,198 @@
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <algorithm>
+using namespace std;
+
+#include "Knife/Parse.hpp"
+#include "Knife/Grammar.hpp"
+#include "Knife/TimeReport.hpp"
+#include "Knife/Utf8.hpp"
+
+typedef std::string::const_iterator iterator_type;
+typedef LangParseGrammar<iterator_type> LangGrammar;
+
+// Building the grammar's rules costs more than parsing a small file, so
+// each thread keeps one.  Only source_begin changes between parses.
+static LangGrammar& grammar()
+{
+    static thread_local LangGrammar g;
+    return g;
+}
+
+static void print_expectation_failure(qi::expectation_failure<iterator_type> const& x)
+{
+    std::cout << "expected: "; print_info(x.what_);
+    std::cout << "got: \"" << std::string(x.first, x.last) << '"' << std::endl;
+}
+
+// Checks the whole text up front, so the grammar need not decode it.
+// Reports the line of the first bad byte.
+static bool check_utf8(std::string const& text, std::string const& file_name)
+{
+    TimeReport::Phase phase("check UTF-8");
+    std::size_t bad = Syntax::find_invalid_utf8(text.data(), text.size());
+    if (bad == text.size())
+        return true;
+    cerr << file_name << ":" << 1 + std::count(text.begin(), text.begin() + bad, '\n')
+         << ": invalid UTF-8 at byte " << bad << endl;
+    return false;
+}
+
+static bool is_separator(char c)
+{
+    return c == '\n' || c == '\r' || c == ';';
+}
+
+Syntax::DefExpr Parse(std::string str)
+{
+    TimeReport::Phase phase("parse");
+    TimeReport::count("source bytes", str.size());
+    LangGrammar& g = grammar();
+    g.source_begin = str.begin();
+
+    std::string::const_iterator iter = str.begin();
+    std::string::const_iterator end = str.end();
+    Skipper<iterator_type> skipper;
+    Syntax::DefExpr result;
+    if (!check_utf8(str, "<input>"))
+        return result;
+
+    try
+    {
+        bool success = phrase_parse(iter, end, g.def_expr, skipper, result);
+
+        if (!success)
+        {
+            stringstream ss;
+            ss << "LangParser failed to parse: " << str << std::endl;
+            cerr << endl << ss.str() << endl;
+            //raiseError(ParseException(ss.str()));
+        }
+        else
+        {
+            if (iter != end)
+            {
+                stringstream ss;
+                ss << "Not all of the line was parsed: " << std::string(iter, end) << std::endl;
+                cerr << endl << ss.str() << endl;
+                //raiseError(ParseException(ss.str()));
+            }
+        }
+
+        return result;
+    }
+    catch (qi::expectation_failure<iterator_type> const& x)
+    {
+        print_expectation_failure(x);
+        throw;
+    }
+}
+
+Syntax::Module ParseModule(std::string source, std::string file_name)
+{
+    TimeReport::Phase phase("parse");
+    TimeReport::count("source bytes", source.size());
+    LangGrammar& g = grammar();
+    Skipper<iterator_type> skipper;
+
+    Syntax::Module module;
+    module.file_name = file_name;
+    module.source = std::move(source);
+
+    std::string::const_iterator const begin = module.source.begin();
+    std::string::const_iterator const end = module.source.end();
+    int line = 1;
+    g.source_begin = begin;
+    if (!check_utf8(module.source, file_name))
+        return module;
+    std::string::const_iterator iter = begin + Syntax::byte_order_mark(module.source.data(), module.source.size());
+
+    while (true)
+    {
+        // Blank lines and stray separators between items.
+        while (iter != end && (is_separator(*iter) || *iter == ' ' || *iter == '\t'))
+        {
+            if (*iter == '\n')
+                ++line;
+            ++iter;
+        }
+
+        if (iter == end)
+            break;
+
+        std::string::const_iterator const item_begin = iter;
+        Syntax::TopLevelItem item;
+        item.span.begin = item_begin - begin;
+        item.span.first_line = line;
+
+        try
+        {
+            bool success = phrase_parse(iter, end, g, skipper, item.stmt);
+
+            if (!success)
+            {
+                stringstream ss;
+                ss << file_name << ":" << line << ": LangParser failed to parse: "
+                   << std::string(item_begin, std::find(item_begin, end, '\n')) << std::endl;
+                cerr << endl << ss.str() << endl;
+                //raiseError(ParseException(ss.str()));
+                break;
+            }
+        }
+        catch (qi::expectation_failure<iterator_type> const& x)
+        {
+            cerr << file_name << ":" << line << ": ";
+            print_expectation_failure(x);
+            throw;
+        }
+
+        item.span.end = iter - begin;
+        line += std::count(item_begin, iter, '\n');
+        item.span.last_line = line;
+        item.name = Syntax::top_level_name(item.stmt);
+        module.items.push_back(std::move(item));
+
+        if (iter != end && !is_separator(*iter))
+        {
+            std::string::const_iterator eol = std::find(iter, end, '\n');
+            stringstream ss;
+            ss << file_name << ":" << line << ": Not all of the line was parsed: " << std::string(iter, eol) << std::endl;
+            cerr << endl << ss.str() << endl;
+            //raiseError(ParseException(ss.str()));
+            iter = eol;
+        }
+    }
+
+    TimeReport::count("top-level items", module.items.size());
+    return module;
+}
+
+Syntax::Stmt ParseItem(std::string const& source, Syntax::SourceSpan const& span)
+{
+    LangGrammar& g = grammar();
+    Skipper<iterator_type> skipper;
+    Syntax::Stmt result;
+    g.source_begin = source.begin();
+
+    std::string::const_iterator iter = source.begin() + span.begin;
+    std::string::const_iterator end = source.begin() + span.end;
+
+    try
+    {
+        if (!phrase_parse(iter, end, g, skipper, result) || iter != end)
+        {
+            stringstream ss;
+            ss << "LangParser failed to reparse item at line " << span.first_line << std::endl;
+            cerr << endl << ss.str() << endl;
+            //raiseError(ParseException(ss.str()));
+        }
+
+        return result;
+    }
+    catch (qi::expectation_failure<iterator_type> const& x)
+    {
+        print_expectation_failure(x);
+        throw;
+    }
+}
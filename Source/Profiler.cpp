@@ -0,0 +1,503 @@
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+#include "Knife/Profiler.hpp"
+
+using Profiler::CodeLocation;
+using Profiler::LineRow;
+
+namespace
+{
+
+struct LoadedCode
+{
+    std::uintptr_t begin;
+    std::uintptr_t end;
+    std::vector<LineRow> rows;
+};
+
+// Samples are stored as runs of addresses in one pool, innermost first;
+// sample i is pool[begins[i], ends[i]).  The first address of a sample is
+// the interrupted pc, the others are return addresses.  SIGPROF can be
+// delivered to any thread, so handlers running at once each reserve their
+// run of the pool and their sample with fetch_add, and mark the sample
+// written once it is; readers skip samples that are not.
+struct State
+{
+    static std::size_t const max_samples = 1 << 16;
+    static std::size_t const max_frames = 1 << 20;
+    static std::size_t const max_depth = 128;
+    static std::size_t const max_ranges = 1024;
+    static std::uintptr_t const max_stack = 64 << 20;
+
+    std::mutex lock;
+    std::vector<LoadedCode> code;
+
+    // The code ranges again, readable from the signal handler.
+    std::atomic<std::uintptr_t> range_begin[max_ranges];
+    std::atomic<std::uintptr_t> range_end[max_ranges];
+    std::atomic<std::size_t> range_count;
+
+    std::vector<std::uintptr_t> pool;
+    std::vector<std::size_t> begins;
+    std::vector<std::size_t> ends;
+    std::unique_ptr<std::atomic<bool>[]> written;
+    std::atomic<std::size_t> samples;       // reserved, which can pass max_samples
+    std::atomic<std::size_t> dropped;
+    std::atomic<std::size_t> pool_used;     // reserved, which can pass max_frames
+
+    bool running;
+    struct sigaction saved_action;
+
+    CodeLocation unknown;
+
+    State()
+        : range_count(0), samples(0), dropped(0), pool_used(0), running(false)
+    {
+        unknown.def = "<unknown>";
+        unknown.file = "?";
+        unknown.line = 0;
+        unknown.def_line = 0;
+    }
+
+    // The start of the registered code containing the address, or 0.
+    std::uintptr_t code_begin(std::uintptr_t address) const
+    {
+        std::size_t count = range_count.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            std::uintptr_t end = range_end[i].load(std::memory_order_acquire);
+            std::uintptr_t begin = range_begin[i].load(std::memory_order_relaxed);
+            if (address >= begin && address < end)
+                return begin;
+        }
+        return 0;
+    }
+
+    // Must be called with the lock held.  Appends the defs running at an
+    // address, innermost first.
+    void resolve(std::uintptr_t address, std::vector<CodeLocation const*>& frames) const
+    {
+        for (auto const& block : code)
+        {
+            if (address < block.begin || address >= block.end)
+                continue;
+
+            auto row = std::upper_bound(block.rows.begin(), block.rows.end(), address,
+                [](std::uintptr_t a, LineRow const& r) { return a < r.address; });
+            if (row != block.rows.begin() && !(row - 1)->frames.empty())
+            {
+                for (auto const& location : (row - 1)->frames)
+                    frames.push_back(&location);
+                return;
+            }
+        }
+        frames.push_back(&unknown);
+    }
+
+    // The samples reserved so far, some of which may not be written yet.
+    std::size_t reserved() const
+    {
+        std::size_t n = samples.load(std::memory_order_relaxed);
+        return n < max_samples ? n : max_samples;
+    }
+
+    std::size_t written_count() const
+    {
+        std::size_t n = reserved(), count = 0;
+        for (std::size_t i = 0; i < n; ++i)
+            count += written[i].load(std::memory_order_acquire);
+        return count;
+    }
+
+    // Must be called with the lock held.  Each written sample's defs,
+    // outermost first; empty for samples outside generated code.
+    std::vector<std::vector<CodeLocation const*>> resolve_samples() const
+    {
+        std::size_t n = reserved();
+        std::vector<std::vector<CodeLocation const*>> result;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            if (!written[i].load(std::memory_order_acquire))
+                continue;
+            // Return addresses point after the call; look up the call itself.
+            result.emplace_back();
+            for (std::size_t k = begins[i]; k < ends[i]; ++k)
+                resolve(k == begins[i] ? pool[k] : pool[k] - 1, result.back());
+            std::reverse(result.back().begin(), result.back().end());
+        }
+        return result;
+    }
+};
+
+State& state()
+{
+    static State s;
+    return s;
+}
+
+void read_registers(void* context, std::uintptr_t& pc, std::uintptr_t& fp, std::uintptr_t& sp, std::uintptr_t& lr)
+{
+    ucontext_t const* uc = static_cast<ucontext_t const*>(context);
+#if defined(__x86_64__)
+    pc = uc->uc_mcontext.gregs[REG_RIP];
+    fp = uc->uc_mcontext.gregs[REG_RBP];
+    sp = uc->uc_mcontext.gregs[REG_RSP];
+    lr = 0;
+#elif defined(__aarch64__)
+    pc = uc->uc_mcontext.pc;
+    fp = uc->uc_mcontext.regs[29];
+    sp = uc->uc_mcontext.sp;
+    lr = uc->uc_mcontext.regs[30];
+#else
+    pc = fp = sp = lr = 0;
+#endif
+}
+
+// The return address of a def interrupted before its prologue set up the
+// frame pointer or after its epilogue restored the caller's, or 0.  The
+// frame pointer then still belongs to the caller.
+std::uintptr_t frameless_return(std::uintptr_t pc, std::uintptr_t sp, std::uintptr_t lr, std::uintptr_t begin)
+{
+    std::uintptr_t const* stack = reinterpret_cast<std::uintptr_t const*>(sp);
+#if defined(__x86_64__)
+    // push rbp; mov rbp, rsp ... pop rbp; ret
+    (void)lr;
+    if (pc == begin || *reinterpret_cast<std::uint8_t const*>(pc) == 0xc3)
+        return stack[0];
+    if (pc == begin + 1)
+        return stack[1];
+#elif defined(__aarch64__)
+    // stp x29, x30, [sp, #-16]!; mov x29, sp ... ldp x29, x30, [sp], #16; ret
+    if (pc == begin || *reinterpret_cast<std::uint32_t const*>(pc) == 0xd65f03c0)
+        return lr;
+    if (pc == begin + 4)
+        return stack[1];
+#else
+    (void)pc; (void)stack; (void)lr; (void)begin;
+#endif
+    return 0;
+}
+
+// Runs in the signal handler: no allocation, no locks.  Generated code
+// keeps frame pointers, so while the return addresses stay inside it the
+// frame chain is valid; the first return into other code ends the walk.
+void on_sample(int, siginfo_t*, void* context)
+{
+    State& s = state();
+
+    std::uintptr_t pc, fp, sp, lr;
+    read_registers(context, pc, fp, sp, lr);
+
+    // Walked onto the handler's stack first, so exactly the frames found
+    // are reserved in the pool.
+    std::uintptr_t out[State::max_depth];
+    std::size_t depth = 0;
+
+    if (std::uintptr_t begin = s.code_begin(pc))
+    {
+        out[depth++] = pc;
+
+        std::uintptr_t ret = frameless_return(pc, sp, lr, begin);
+        if (ret && s.code_begin(ret))
+            out[depth++] = ret;
+
+        while (depth < State::max_depth && fp % sizeof(void*) == 0 && fp >= sp && fp - sp < State::max_stack)
+        {
+            std::uintptr_t const* frame = reinterpret_cast<std::uintptr_t const*>(fp);
+            ret = frame[1];
+            if (!s.code_begin(ret))
+                break;
+            out[depth++] = ret;
+            if (frame[0] <= fp)
+                break;
+            fp = frame[0];
+        }
+    }
+
+    std::size_t first = s.pool_used.fetch_add(depth, std::memory_order_relaxed);
+    if (first + depth > State::max_frames)
+    {
+        s.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    std::size_t n = s.samples.fetch_add(1, std::memory_order_relaxed);
+    if (n >= State::max_samples)
+    {
+        s.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    std::copy(out, out + depth, &s.pool[first]);
+    s.begins[n] = first;
+    s.ends[n] = first + depth;
+    s.written[n].store(true, std::memory_order_release);
+}
+
+double percent(std::size_t part, std::size_t whole)
+{
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+std::string def_key(CodeLocation const& location)
+{
+    return location.def + " (" + location.file + ":" + std::to_string(location.def_line) + ")";
+}
+
+}
+
+void Profiler::register_code(std::uintptr_t begin, std::uintptr_t end, std::vector<LineRow> rows)
+{
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    // Reuse the slot of freed code (an empty range) before taking a new one.
+    std::size_t count = s.range_count.load(std::memory_order_relaxed);
+    std::size_t slot = 0;
+    while (slot < count && s.range_begin[slot].load(std::memory_order_relaxed) < s.range_end[slot].load(std::memory_order_relaxed))
+        ++slot;
+
+    if (slot == State::max_ranges)
+    {
+        cerr << "profiler: too many blocks of code, not profiling more" << endl;
+        return;
+    }
+
+    s.code.push_back(LoadedCode{begin, end, std::move(rows)});
+    s.range_begin[slot].store(begin, std::memory_order_relaxed);
+    s.range_end[slot].store(end, std::memory_order_release);
+    if (slot == count)
+        s.range_count.store(count + 1, std::memory_order_release);
+}
+
+void Profiler::unregister_code(std::uintptr_t begin)
+{
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    std::size_t count = s.range_count.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < count; ++i)
+        if (s.range_begin[i].load(std::memory_order_relaxed) == begin)
+            s.range_end[i].store(0, std::memory_order_release);
+
+    s.code.erase(std::remove_if(s.code.begin(), s.code.end(),
+        [begin](LoadedCode const& block) { return block.begin == begin; }), s.code.end());
+}
+
+bool Profiler::start(int hz)
+{
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    if (s.running || hz <= 0)
+        return false;
+
+    if (s.pool.empty())
+    {
+        s.pool.resize(State::max_frames);
+        s.begins.resize(State::max_samples);
+        s.ends.resize(State::max_samples);
+        s.written.reset(new std::atomic<bool>[State::max_samples]);
+    }
+
+    for (std::size_t i = 0; i < State::max_samples; ++i)
+        s.written[i].store(false, std::memory_order_relaxed);
+    s.samples.store(0);
+    s.dropped.store(0);
+    s.pool_used.store(0);
+
+    struct sigaction action;
+    action.sa_sigaction = &on_sample;
+    action.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &s.saved_action) != 0)
+        return false;
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = hz > 1000000 ? 1 : 1000000 / hz;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0)
+    {
+        sigaction(SIGPROF, &s.saved_action, nullptr);
+        return false;
+    }
+
+    s.running = true;
+    return true;
+}
+
+void Profiler::stop()
+{
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    if (!s.running)
+        return;
+
+    struct itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sigaction(SIGPROF, &s.saved_action, nullptr);
+    s.running = false;
+}
+
+std::size_t Profiler::sample_count()
+{
+    return state().written_count();
+}
+
+std::size_t Profiler::dropped_count()
+{
+    return state().dropped.load(std::memory_order_relaxed);
+}
+
+void Profiler::write_flat(std::ostream& out)
+{
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto stacks = s.resolve_samples();
+    std::size_t n = stacks.size();
+
+    std::map<std::string, std::size_t> self, total, lines;
+    std::size_t outside = 0;
+
+    for (auto const& stack : stacks)
+    {
+        if (stack.empty())
+        {
+            ++outside;
+            continue;
+        }
+
+        CodeLocation const& leaf = *stack.back();
+        ++self[def_key(leaf)];
+        ++lines[leaf.file + ":" + std::to_string(leaf.line) + " in " + leaf.def];
+
+        // Recursive defs count once per sample toward their total.
+        std::set<std::string> seen;
+        for (auto location : stack)
+            if (seen.insert(def_key(*location)).second)
+                ++total[def_key(*location)];
+    }
+
+    std::vector<std::pair<std::size_t, std::string>> order;
+    for (auto const& entry : total)
+        order.emplace_back(self[entry.first], entry.first);
+    std::sort(order.rbegin(), order.rend());
+
+    out << n << " samples, " << outside << " outside Knife code, "
+        << s.dropped.load() << " dropped" << std::endl << std::endl;
+    out << " self%  total%    self   total  def" << std::endl;
+    out << std::fixed << std::setprecision(1);
+    for (auto const& entry : order)
+        out << std::setw(6) << percent(entry.first, n) << std::setw(8) << percent(total[entry.second], n)
+            << std::setw(8) << entry.first << std::setw(8) << total[entry.second] << "  "
+            << entry.second << std::endl;
+
+    std::vector<std::pair<std::size_t, std::string>> by_line;
+    for (auto const& entry : lines)
+        by_line.emplace_back(entry.second, entry.first);
+    std::sort(by_line.rbegin(), by_line.rend());
+
+    out << std::endl << " self%    self  line" << std::endl;
+    for (auto const& entry : by_line)
+        out << std::setw(6) << percent(entry.first, n) << std::setw(8) << entry.first << "  "
+            << entry.second << std::endl;
+    out << std::defaultfloat;
+}
+
+void Profiler::write_call_graph(std::ostream& out)
+{
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto stacks = s.resolve_samples();
+    std::size_t n = stacks.size();
+
+    struct Entry
+    {
+        std::size_t self;
+        std::size_t total;
+        std::map<std::string, std::size_t> callers;    // "" for calls from outside Knife code
+        std::map<std::string, std::size_t> callees;
+    };
+    std::map<std::string, Entry> graph;
+
+    for (auto const& stack : stacks)
+    {
+        if (stack.empty())
+            continue;
+
+        ++graph[def_key(*stack.back())].self;
+
+        std::set<std::string> seen;
+        std::set<std::pair<std::string, std::string>> edges;
+        for (std::size_t k = 0; k < stack.size(); ++k)
+        {
+            std::string callee = def_key(*stack[k]);
+            std::string caller = k == 0 ? "" : def_key(*stack[k - 1]);
+            if (seen.insert(callee).second)
+                ++graph[callee].total;
+            if (edges.insert(std::make_pair(caller, callee)).second)
+            {
+                ++graph[callee].callers[caller];
+                if (!caller.empty())
+                    ++graph[caller].callees[callee];
+            }
+        }
+    }
+
+    std::vector<std::pair<std::size_t, std::string>> order;
+    for (auto const& entry : graph)
+        order.emplace_back(entry.second.total, entry.first);
+    std::sort(order.rbegin(), order.rend());
+
+    out << std::fixed << std::setprecision(1);
+    for (auto const& entry : order)
+    {
+        Entry const& e = graph[entry.second];
+        out << entry.second << "  total " << percent(e.total, n) << "%  self " << percent(e.self, n) << "%" << std::endl;
+        for (auto const& caller : e.callers)
+            out << "    <- " << std::setw(6) << percent(caller.second, n) << "%  "
+                << (caller.first.empty() ? "<outside>" : caller.first) << std::endl;
+        for (auto const& callee : e.callees)
+            out << "    -> " << std::setw(6) << percent(callee.second, n) << "%  " << callee.first << std::endl;
+        out << std::endl;
+    }
+    out << std::defaultfloat;
+}
+
+void Profiler::write_folded(std::ostream& out)
+{
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto stacks = s.resolve_samples();
+
+    std::map<std::string, std::size_t> folded;
+    for (auto const& stack : stacks)
+    {
+        std::string key;
+        for (auto location : stack)
+        {
+            if (!key.empty())
+                key += ';';
+            key += location->def + ":" + std::to_string(location->line);
+        }
+        ++folded[key.empty() ? "<outside>" : key];
+    }
+
+    for (auto const& entry : folded)
+        out << entry.first << " " << entry.second << std::endl;
+}
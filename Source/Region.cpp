@@ -0,0 +1,145 @@
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <pthread.h>
+
+#include "Knife/Region.hpp"
+
+namespace
+{
+
+std::size_t const first_chunk_bytes = std::size_t(64) << 10;
+std::size_t const max_chunk_bytes = std::size_t(16) << 20;
+
+// Semantic::array_alignment, which this file cannot include.
+std::size_t const array_alignment = 32;
+
+void out_of_memory()
+{
+    std::fputs("knife: out of memory\n", stderr);
+    std::abort();
+}
+
+thread_local Region* thread_region = nullptr;
+thread_local Region* task_region = nullptr;
+
+pthread_key_t region_key;
+pthread_once_t region_key_once = PTHREAD_ONCE_INIT;
+
+void destroy_region(void* region)
+{
+    Region* r = static_cast<Region*>(region);
+    r->~Region();
+    std::free(r);
+}
+
+void create_region_key()
+{
+    pthread_key_create(&region_key, destroy_region);
+}
+
+}
+
+Region::Region()
+    : chunk(nullptr), top(nullptr), spare(nullptr), next_chunk_bytes(first_chunk_bytes), reserved(0)
+{
+}
+
+Region::~Region()
+{
+    release(Mark{ nullptr, nullptr });
+    std::free(spare);
+}
+
+void* Region::grow(std::size_t bytes, std::size_t alignment)
+{
+    std::size_t needed = sizeof(Chunk) + alignment + bytes;
+    if (needed < bytes)
+        out_of_memory();
+
+    Chunk* c;
+    std::size_t size;
+    if (spare && std::size_t(spare->end - reinterpret_cast<char*>(spare)) >= needed)
+    {
+        c = spare;
+        size = spare->end - reinterpret_cast<char*>(spare);
+        spare = nullptr;
+    }
+    else
+    {
+        size = needed > next_chunk_bytes ? needed : next_chunk_bytes;
+        c = static_cast<Chunk*>(std::malloc(size));
+        if (!c)
+            out_of_memory();
+        if (next_chunk_bytes < max_chunk_bytes)
+            next_chunk_bytes *= 2;
+    }
+
+    c->previous = chunk;
+    c->end = reinterpret_cast<char*>(c) + size;
+    chunk = c;
+    reserved += size;
+
+    top = reinterpret_cast<char*>(c + 1);
+    char* p = reinterpret_cast<char*>((reinterpret_cast<std::uintptr_t>(top) + alignment - 1) & ~(alignment - 1));
+    top = p + bytes;
+    return p;
+}
+
+void Region::release(Mark const& mark)
+{
+    while (chunk != mark.chunk)
+    {
+        Chunk* c = chunk;
+        chunk = c->previous;
+        reserved -= c->end - reinterpret_cast<char*>(c);
+
+        // Keep the larger of the two, so a def that allocates in a loop
+        // does not go back to malloc on every call.
+        if (spare && spare->end - reinterpret_cast<char*>(spare) >= c->end - reinterpret_cast<char*>(c))
+            std::free(c);
+        else
+        {
+            std::free(spare);
+            spare = c;
+        }
+    }
+    top = mark.top;
+}
+
+Region& Region::current()
+{
+    if (task_region)
+        return *task_region;
+    if (!thread_region)
+    {
+        pthread_once(&region_key_once, create_region_key);
+        void* memory = std::malloc(sizeof(Region));
+        if (!memory)
+            out_of_memory();
+        thread_region = new (memory) Region;
+        pthread_setspecific(region_key, thread_region);
+    }
+    return *thread_region;
+}
+
+void Region::use(Region* region)
+{
+    task_region = region;
+}
+
+void knife_region_mark(Region::Mark* mark)
+{
+    *mark = Region::current().mark();
+}
+
+void knife_region_release(Region::Mark const* mark)
+{
+    Region::current().release(*mark);
+}
+
+void* knife_region_alloc(std::int64_t bytes)
+{
+    return Region::current().allocate(bytes > 0 ? std::size_t(bytes) : 0, array_alignment);
+}
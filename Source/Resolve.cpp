@@ -0,0 +1,95 @@
+#include "Knife/Resolve.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+class SlotResolver
+{
+private:
+    IR& ir;
+
+    void set_coordinate(NodeId id, LabelId label, ScopeId scope)
+    {
+        Node& n = ir.node(id);
+        Label const& lbl = ir.label(label);
+        n.depth = ir.scope(scope).frame_depth - ir.scope(lbl.scope).frame_depth;
+        n.slot = lbl.index_in_scope;
+    }
+
+public:
+    SlotResolver(IR& ir)
+        : ir(ir)
+    {
+    }
+
+    void compute_frames()
+    {
+        // Parents are always created before their children.
+        for (ScopeId id = 0; id < ir.scope_count(); ++id)
+        {
+            Scope& sc = ir.scope(id);
+            std::uint32_t outer = sc.parent == none ? 0 : ir.scope(sc.parent).frame_depth;
+            sc.frame_depth = outer + (sc.label_count != 0 ? 1 : 0);
+        }
+
+        // Declarations: Label and named Def nodes store into slot 0 frames out.
+        for (LabelId id = 0; id < ir.label_count(); ++id)
+        {
+            Label const& lbl = ir.label(id);
+            if (lbl.decl != none)
+                set_coordinate(lbl.decl, id, lbl.scope);
+        }
+    }
+
+    void walk(NodeId id, ScopeId scope)
+    {
+        Node const& n = ir.node(id);
+
+        switch (n.kind)
+        {
+        case NodeKind::Ref:
+        case NodeKind::Assign:
+        case NodeKind::Call:
+            if (n.value != none)
+                set_coordinate(id, n.value, scope);
+            break;
+
+        case NodeKind::Block:
+            scope = n.value;
+            break;
+
+        case NodeKind::Def:
+        {
+            Def const& d = ir.def(n.value);
+            for (std::uint32_t i = 0; i < d.param_count; ++i)
+            {
+                Param const& p = ir.param(n.value, i);
+                if (p.type != none)
+                    walk(p.type, d.scope);
+                if (p.default_value != none)
+                    walk(p.default_value, d.scope);
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+
+        for (NodeId child : ir.children_of(id))
+            walk(child, scope);
+    }
+};
+
+}
+
+void Semantic::resolve_slots(IR& ir, std::vector<NodeId> const& roots, ScopeId scope)
+{
+    SlotResolver resolver(ir);
+    resolver.compute_frames();
+
+    for (NodeId root : roots)
+        resolver.walk(root, scope);
+}
@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "boost/context/fiber.hpp"
+#include "boost/context/protected_fixedsize_stack.hpp"
+
+#include "Knife/Scheduler.hpp"
+#include "Knife/Region.hpp"
+
+namespace ctx = boost::context;
+
+namespace
+{
+
+std::size_t const stack_bytes = std::size_t(256) << 10;
+std::size_t const pooled_stacks = 64;      // per thread
+int const spins_before_sleeping = 64;
+
+struct Task
+{
+    double (*run)(double const* args);
+    double args[Scheduler::max_task_args];
+    double result;
+    bool started;
+    ctx::fiber fiber;       // the task's context while it is not running
+    ctx::fiber back;        // the context of the thread running it, while it runs
+    Region region;
+
+    std::mutex lock;
+    std::atomic<bool> done;
+    Task* waiter;           // suspended until this task is done
+    bool external_waiter;   // a thread outside the pool is waiting
+
+    Task(double (*run)(double const*), double const* from, std::int64_t count)
+        : run(run), result(0), started(false), done(false), waiter(nullptr), external_waiter(false)
+    {
+        for (std::size_t i = 0; i < Scheduler::max_task_args; ++i)
+            args[i] = std::int64_t(i) < count ? from[i] : 0;
+    }
+};
+
+struct Worker
+{
+    unsigned index;
+    std::mutex lock;
+    std::deque<Task*> ready;    // run from the back, stolen from the front
+    std::vector<ctx::stack_context> stacks;
+    Task* running;
+    Task* awaited;              // set by the running task before it suspends
+    std::atomic<std::uint64_t> tasks, steals, suspensions;
+    std::thread thread;
+
+    explicit Worker(unsigned index)
+        : index(index), running(nullptr), awaited(nullptr), tasks(0), steals(0), suspensions(0)
+    {
+    }
+};
+
+struct Pool
+{
+    std::mutex lifecycle;       // held by start and stop
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> running;
+    std::atomic<bool> stopping;
+    std::atomic<long> queued;
+    std::atomic<int> sleeping;
+    std::atomic<unsigned> next_worker;
+    std::mutex idle_lock;
+    std::condition_variable idle;
+    std::mutex external_lock;
+    std::condition_variable external;
+
+    Pool()
+        : running(false), stopping(false), queued(0), sleeping(0), next_worker(0)
+    {
+    }
+
+    ~Pool()
+    {
+        Scheduler::stop();
+    }
+};
+
+Pool& pool()
+{
+    static Pool p;
+    return p;
+}
+
+thread_local Worker* current_worker = nullptr;
+
+// A task can resume on another thread than it suspended on, and the
+// compiler may keep a thread_local's address across the switch; a call
+// here reads the running thread's.
+__attribute__((noinline)) Worker* this_worker()
+{
+    asm volatile("" ::: "memory");
+    return current_worker;
+}
+
+// Stacks with a guard page, kept for reuse by the thread that frees them.
+// A finished task's stack is freed on the thread that ran it last.
+class PooledStack
+{
+public:
+    ctx::stack_context allocate()
+    {
+        Worker* w = this_worker();
+        if (w && !w->stacks.empty())
+        {
+            ctx::stack_context stack = w->stacks.back();
+            w->stacks.pop_back();
+            return stack;
+        }
+        return ctx::protected_fixedsize_stack(stack_bytes).allocate();
+    }
+
+    void deallocate(ctx::stack_context& stack)
+    {
+        Worker* w = this_worker();
+        if (w && w->stacks.size() < pooled_stacks)
+            w->stacks.push_back(stack);
+        else
+            ctx::protected_fixedsize_stack(stack_bytes).deallocate(stack);
+    }
+};
+
+void push(Worker& w, Task* t)
+{
+    Pool& p = pool();
+    {
+        std::lock_guard<std::mutex> guard(w.lock);
+        w.ready.push_back(t);
+    }
+
+    // Either this sees the sleeper or the sleeper sees the task.
+    ++p.queued;
+    if (p.sleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> guard(p.idle_lock);
+        p.idle.notify_one();
+    }
+}
+
+Task* take(Worker& w, bool newest)
+{
+    std::lock_guard<std::mutex> guard(w.lock);
+    if (w.ready.empty())
+        return nullptr;
+    Task* t;
+    if (newest)
+    {
+        t = w.ready.back();
+        w.ready.pop_back();
+    }
+    else
+    {
+        t = w.ready.front();
+        w.ready.pop_front();
+    }
+    --pool().queued;
+    return t;
+}
+
+// Null once the pool is stopping and no task is left.
+Task* next_task(Worker& w)
+{
+    Pool& p = pool();
+    std::size_t n = p.workers.size();
+
+    for (int spins = 0;; ++spins)
+    {
+        if (Task* t = take(w, true))
+            return t;
+
+        for (std::size_t k = 1; k < n; ++k)
+            if (Task* t = take(*p.workers[(w.index + k) % n], false))
+            {
+                ++w.steals;
+                return t;
+            }
+
+        if (spins < spins_before_sleeping)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(p.idle_lock);
+        ++p.sleeping;
+        p.idle.wait(lock, [&p] { return p.queued.load() > 0 || p.stopping.load(); });
+        --p.sleeping;
+        if (p.queued.load() == 0 && p.stopping.load())
+            return nullptr;
+        spins = 0;
+    }
+}
+
+void finish(Worker& w, Task* t)
+{
+    Task* waiter;
+    bool external;
+    {
+        std::lock_guard<std::mutex> guard(t->lock);
+        t->done.store(true);
+        waiter = t->waiter;
+        external = t->external_waiter;
+    }
+    // The awaiter may free t from here on.
+
+    if (waiter)
+        push(w, waiter);
+    if (external)
+    {
+        Pool& p = pool();
+        std::lock_guard<std::mutex> guard(p.external_lock);
+        p.external.notify_all();
+    }
+}
+
+// Runs the task until it finishes or suspends to await another.
+void run(Worker& w, Task* t)
+{
+    if (!t->started)
+    {
+        t->started = true;
+        t->fiber = ctx::fiber(std::allocator_arg, PooledStack(), [t](ctx::fiber&& back) {
+            t->back = std::move(back);
+            t->result = t->run(t->args);
+            return std::move(t->back);
+        });
+        ++w.tasks;
+    }
+
+    w.running = t;
+    Region::use(&t->region);
+    t->fiber = std::move(t->fiber).resume();
+    Region::use(nullptr);
+    w.running = nullptr;
+
+    if (!t->fiber)
+    {
+        finish(w, t);
+        return;
+    }
+
+    // Suspended; its context is saved, so it can be resumed from here on.
+    Task* awaited = w.awaited;
+    w.awaited = nullptr;
+    ++w.suspensions;
+
+    std::unique_lock<std::mutex> guard(awaited->lock);
+    if (awaited->done.load())
+    {
+        guard.unlock();
+        push(w, t);
+    }
+    else
+        awaited->waiter = t;
+}
+
+void work(Worker& w)
+{
+    current_worker = &w;
+    while (Task* t = next_task(w))
+        run(w, t);
+    current_worker = nullptr;
+}
+
+}
+
+bool Scheduler::start(unsigned threads)
+{
+    Pool& p = pool();
+    std::lock_guard<std::mutex> guard(p.lifecycle);
+    if (p.running.load())
+        return false;
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    p.stopping = false;
+    for (unsigned i = 0; i < threads; ++i)
+        p.workers.emplace_back(new Worker(i));
+    for (auto& w : p.workers)
+        w->thread = std::thread(work, std::ref(*w));
+    p.running = true;
+    return true;
+}
+
+void Scheduler::stop()
+{
+    Pool& p = pool();
+    std::lock_guard<std::mutex> guard(p.lifecycle);
+    if (!p.running.load())
+        return;
+
+    {
+        std::lock_guard<std::mutex> idle_guard(p.idle_lock);
+        p.stopping = true;
+        p.idle.notify_all();
+    }
+    for (auto& w : p.workers)
+        w->thread.join();
+
+    for (auto& w : p.workers)
+        for (auto& stack : w->stacks)
+            ctx::protected_fixedsize_stack(stack_bytes).deallocate(stack);
+    p.workers.clear();
+    p.running = false;
+}
+
+unsigned Scheduler::thread_count()
+{
+    return pool().workers.size();
+}
+
+Scheduler::Stats Scheduler::stats()
+{
+    Stats s = { 0, 0, 0 };
+    for (auto const& w : pool().workers)
+    {
+        s.tasks += w->tasks.load(std::memory_order_relaxed);
+        s.steals += w->steals.load(std::memory_order_relaxed);
+        s.suspensions += w->suspensions.load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+void knife_task_spawn(Scheduler::TaskSlot* slot, double (*run)(double const*), double const* args, std::int64_t count)
+{
+    // Spawning into a label again first awaits the task it had.
+    if (slot->task)
+        knife_task_await(slot);
+
+    Pool& p = pool();
+    if (!p.running.load())
+        Scheduler::start();
+
+    Task* t = new Task(run, args, count);
+    slot->task = t;
+    Worker* w = this_worker();
+    push(w ? *w : *p.workers[p.next_worker++ % p.workers.size()], t);
+}
+
+double knife_task_await(Scheduler::TaskSlot* slot)
+{
+    Task* t = static_cast<Task*>(slot->task);
+    if (!t)
+        return slot->result;
+
+    Worker* w = this_worker();
+    Task* self = w ? w->running : nullptr;
+    bool done;
+    {
+        std::lock_guard<std::mutex> guard(t->lock);
+        done = t->done.load();
+        if (!done && !self)
+            t->external_waiter = true;
+    }
+
+    if (!done && self)
+    {
+        // The worker registers this task as t's waiter once it is off
+        // this stack; whichever thread finishes t makes it ready again.
+        w->awaited = t;
+        self->back = std::move(self->back).resume();
+    }
+    else if (!done)
+    {
+        Pool& p = pool();
+        std::unique_lock<std::mutex> lock(p.external_lock);
+        p.external.wait(lock, [t] { return t->done.load(); });
+    }
+
+    // finish has let go of the lock once it can be taken.
+    {
+        std::lock_guard<std::mutex> guard(t->lock);
+    }
+    slot->result = t->result;
+    slot->task = nullptr;
+    delete t;
+    return slot->result;
+}
@@ -0,0 +1,510 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <unordered_map>
+using namespace std;
+
+#include "Knife/Semantic.hpp"
+#include "Knife/Interface.hpp"
+#include "Knife/Resolve.hpp"
+#include "Knife/TimeReport.hpp"
+
+using namespace Semantic;
+
+namespace
+{
+
+// Lowers syntax trees into an IR.  Names are resolved while lowering:
+// each use is bound to the innermost visible label of that name, or left
+// free (none) for names such as "if" or "Int" that come from outside.
+class Lowering : public boost::static_visitor<NodeId>
+{
+private:
+    IR& ir;
+    ScopeId current;
+    Syntax::LineMap const* line_map;   // null when lowering text-less syntax
+
+    // Innermost visible label for each symbol, indexed by Symbol, plus an
+    // undo log so leaving a scope restores whatever the scope shadowed.
+    std::vector<LabelId> binding;
+    std::vector<std::pair<Symbol, LabelId>> shadowed;
+
+    // Named defs are declared before the statements of their block so that
+    // defs in the same block can call each other regardless of order.
+    std::unordered_map<Syntax::DefExpr const*, LabelId> hoisted;
+
+    struct ScopeGuard
+    {
+        Lowering& self;
+        ScopeId saved_scope;
+        std::size_t saved_undo;
+
+        ScopeGuard(Lowering& self, ScopeId scope)
+            : self(self), saved_scope(self.current), saved_undo(self.shadowed.size())
+        {
+            self.current = scope;
+        }
+
+        ~ScopeGuard()
+        {
+            while (self.shadowed.size() > saved_undo)
+            {
+                self.binding[self.shadowed.back().first] = self.shadowed.back().second;
+                self.shadowed.pop_back();
+            }
+            self.current = saved_scope;
+        }
+    };
+
+    LabelId declare(Symbol name, LabelKind kind, NodeId decl)
+    {
+        LabelId id = ir.add_label(name, current, kind, decl);
+
+        if (name != none)
+        {
+            if (binding.size() <= name)
+                binding.resize(name + 1, none);
+            shadowed.emplace_back(name, binding[name]);
+            binding[name] = id;
+        }
+
+        return id;
+    }
+
+    LabelId lookup(Symbol name) const
+    {
+        return name < binding.size() ? binding[name] : none;
+    }
+
+    static Syntax::DefExpr const* as_named_def(Syntax::Stmt const& stmt)
+    {
+        Syntax::Expr const* expr = boost::get<Syntax::Expr>(&stmt);
+        if (!expr)
+            return nullptr;
+        Syntax::DefExpr const* def = boost::get<Syntax::DefExpr>(expr);
+        return def && def->name ? def : nullptr;
+    }
+
+    NodeId lower_invocation(Syntax::Invocation const& t, NodeId receiver)
+    {
+        std::vector<NodeId> kids;
+        std::uint8_t flags = 0;
+
+        if (receiver != none)
+            kids.push_back(receiver);
+
+        if (t.args)
+        {
+            flags |= HasArgs;
+            for (auto const& arg : t.args->elements)
+                kids.push_back(boost::apply_visitor(*this, arg));
+        }
+
+        if (t.postfix_lambda)
+        {
+            flags |= HasBlock;
+            kids.push_back((*this)(*t.postfix_lambda));
+        }
+
+        Symbol name = ir.symbols.intern(t.name.value);
+        NodeId result;
+
+        if (receiver != none)
+            result = ir.add_node(NodeKind::Send, flags, name, none, kids.data(), kids.size());
+        else if (flags == 0)
+            result = ir.add_node(NodeKind::Ref, 0, name, lookup(name));
+        else
+            result = ir.add_node(NodeKind::Call, flags, name, lookup(name), kids.data(), kids.size());
+
+        if (t.next_call)
+            return lower_invocation(t.next_call->get(), result);
+
+        return result;
+    }
+
+    Param lower_param(Syntax::Expr const& arg)
+    {
+        Param p;
+        p.name = none;
+        p.type = none;
+        p.default_value = none;
+
+        Syntax::LabelExpr const* label = boost::get<Syntax::LabelExpr>(&arg);
+        Syntax::Invocation const* bare = boost::get<Syntax::Invocation>(&arg);
+
+        if (label)
+        {
+            if (label->name)
+                p.name = ir.symbols.intern(label->name->value);
+            if (label->type)
+                p.type = boost::apply_visitor(*this, *label->type);
+            if (label->term)
+                p.default_value = boost::apply_visitor(*this, label->term->value);
+        }
+        else if (bare && !bare->args && !bare->postfix_lambda && !bare->next_call)
+        {
+            p.name = ir.symbols.intern(bare->name.value);
+        }
+        else
+        {
+            // A pattern such as def f(5); the expression constrains the argument.
+            p.type = boost::apply_visitor(*this, arg);
+        }
+
+        p.label = declare(p.name, LabelKind::Param, none);
+        return p;
+    }
+
+public:
+    Lowering(IR& ir, ScopeId scope, Syntax::LineMap const* line_map = nullptr)
+        : ir(ir), current(scope), line_map(line_map)
+    {
+    }
+
+    // Makes a label of an imported interface visible in the current scope.
+    void bind(Symbol name, LabelId label)
+    {
+        if (binding.size() <= name)
+            binding.resize(name + 1, none);
+        shadowed.emplace_back(name, binding[name]);
+        binding[name] = label;
+    }
+
+    // Lowers the statements of one scope, which must already be current.
+    std::vector<NodeId> lower_stmts(std::vector<Syntax::Stmt const*> const& stmts)
+    {
+        for (auto stmt : stmts)
+            if (auto def = as_named_def(*stmt))
+                hoisted[def] = declare(ir.symbols.intern(def->name->value), LabelKind::Def, none);
+
+        std::vector<NodeId> result;
+        result.reserve(stmts.size());
+        for (auto stmt : stmts)
+            result.push_back(boost::apply_visitor(*this, *stmt));
+        return result;
+    }
+
+    NodeId lower_block(Syntax::BracesBlock const& t, ScopeId scope)
+    {
+        ScopeGuard guard(*this, scope);
+
+        std::vector<Syntax::Stmt const*> stmts;
+        stmts.reserve(t.stmts.size());
+        for (auto const& stmt : t.stmts)
+            stmts.push_back(&stmt);
+
+        std::vector<NodeId> kids = lower_stmts(stmts);
+
+        if (line_map)
+            for (std::size_t i = 0; i < t.offsets.size() && i < kids.size(); ++i)
+                ir.set_line(kids[i], line_map->line_of(t.offsets[i]));
+
+        return ir.add_node(NodeKind::Block, 0, none, scope, kids.data(), kids.size());
+    }
+
+    NodeId operator()(Syntax::Expr const& t)
+    {
+        return boost::apply_visitor(*this, t);
+    }
+
+    NodeId operator()(Syntax::Reassignment const& t)
+    {
+        NodeId value = boost::apply_visitor(*this, t.value);
+        Symbol name = ir.symbols.intern(t.name.value);
+        LabelId label = lookup(name);
+
+        if (label == none)
+            cerr << "Reassignment of undeclared label: " << t.name.value << endl;
+
+        return ir.add_node(NodeKind::Assign, 0, name, label, &value, 1);
+    }
+
+    NodeId operator()(Syntax::Number const& t)
+    {
+        return ir.add_node(NodeKind::Number, 0, none, ir.add_number(std::strtod(t.raw.c_str(), nullptr)));
+    }
+
+    NodeId operator()(Syntax::QuotedString const& t)
+    {
+        return ir.add_node(NodeKind::String, 0, none, ir.add_string(t.raw));
+    }
+
+    NodeId operator()(Syntax::TupleExpr const& t)
+    {
+        std::vector<NodeId> kids;
+        kids.reserve(t.elements.size());
+        for (auto const& elem : t.elements)
+            kids.push_back(boost::apply_visitor(*this, elem));
+        return ir.add_node(NodeKind::Tuple, 0, none, none, kids.data(), kids.size());
+    }
+
+    NodeId operator()(Syntax::LabelExpr const& t)
+    {
+        NodeId kids[2];
+        std::size_t count = 0;
+        std::uint8_t flags = 0;
+
+        if (t.type)
+        {
+            flags |= HasType;
+            kids[count++] = boost::apply_visitor(*this, *t.type);
+        }
+
+        if (t.term)
+        {
+            flags |= HasInit;
+            kids[count++] = boost::apply_visitor(*this, t.term->value);
+        }
+
+        // Declared after its initializer, so "a := a" refers to an outer a.
+        Symbol name = t.name ? ir.symbols.intern(t.name->value) : none;
+        LabelId label = declare(name, LabelKind::Local, none);
+        NodeId node = ir.add_node(NodeKind::Label, flags, name, label, kids, count);
+        ir.label(label).decl = node;
+        return node;
+    }
+
+    NodeId operator()(Syntax::BracesBlock const& t)
+    {
+        return lower_block(t, ir.add_scope(current, none));
+    }
+
+    NodeId operator()(Syntax::DefExpr const& t)
+    {
+        Symbol name = t.name ? ir.symbols.intern(t.name->value) : none;
+        DefId def = ir.add_def(name, bool(t.args));
+        ScopeId scope = ir.add_scope(current, def);
+        ir.def(def).scope = scope;
+        NodeId body;
+
+        {
+            ScopeGuard guard(*this, scope);
+
+            std::vector<Param> params;
+            if (t.args)
+                for (auto const& arg : t.args->elements)
+                    params.push_back(lower_param(arg));
+            ir.set_params(def, params);
+
+            // Lowering the body may add defs, so look this one up afterwards.
+            body = lower_block(t.code, scope);
+            ir.def(def).body = body;
+        }
+
+        NodeId node = ir.add_node(NodeKind::Def, 0, name, def, &body, 1);
+
+        if (name != none)
+        {
+            auto pos = hoisted.find(&t);
+            LabelId label = pos != hoisted.end() ? pos->second : declare(name, LabelKind::Def, none);
+            ir.label(label).decl = node;
+        }
+
+        return node;
+    }
+
+    NodeId operator()(Syntax::Invocation const& t)
+    {
+        return lower_invocation(t, none);
+    }
+};
+
+}
+
+void Ident::dump(std::ostream& s) const
+{
+    s << value;
+}
+
+Signature::Signature(IR const& ir, DefId def)
+    : ir(&ir), def(def)
+{
+}
+
+std::size_t Signature::size() const
+{
+    return ir->def(def).param_count;
+}
+
+Param const& Signature::operator[](std::size_t index) const
+{
+    return ir->param(def, index);
+}
+
+void Signature::dump(std::ostream& s) const
+{
+    s << "Signature (";
+
+    for (std::size_t i = 0; i < size(); ++i)
+    {
+        Param const& p = (*this)[i];
+
+        if (i != 0)
+            s << ", ";
+
+        s << ir->symbols.name(p.name);
+
+        if (p.type != none)
+        {
+            Node const& type = ir->node(p.type);
+            s << ":" << (type.kind == NodeKind::Ref ? ir->symbols.name(type.symbol) : "<expr>");
+        }
+
+        if (p.default_value != none)
+            s << "=<expr>";
+    }
+
+    s << ") ";
+}
+
+CodeBlock::CodeBlock(IR const& ir, NodeId block)
+    : ir(&ir), block(block)
+{
+}
+
+IR::Range CodeBlock::stmts() const
+{
+    return ir->children_of(block);
+}
+
+ScopeId CodeBlock::scope() const
+{
+    return ir->node(block).value;
+}
+
+void CodeBlock::dump(std::ostream& s) const
+{
+    ir->dump(s, block);
+}
+
+DefSpec::DefSpec(std::shared_ptr<IR const> ir, DefId id)
+    : ir(ir), id(id), code(*ir, ir->def(id).body)
+{
+    Def const& d = ir->def(id);
+
+    if (d.name != none)
+        name = Ident(ir->symbols.name(d.name));
+
+    if (d.has_args)
+        signature = Signature(*ir, id);
+}
+
+static void count_lowered(IR const& ir)
+{
+    TimeReport::count("IR nodes", ir.node_count());
+    TimeReport::count("IR defs", ir.def_count());
+    TimeReport::count("IR bytes", ir.bytes_used());
+}
+
+static std::pair<std::shared_ptr<IR>, DefId> lower_single_def(Syntax::DefExpr const& syntax)
+{
+    TimeReport::Phase phase("lower");
+    auto ir = std::make_shared<IR>();
+    ScopeId scope = ir->add_scope(none, none);
+    Lowering lowering(*ir, scope);
+    NodeId node = lowering(syntax);
+    {
+        TimeReport::Phase resolve("resolve slots");
+        resolve_slots(*ir, std::vector<NodeId>(1, node), scope);
+    }
+    count_lowered(*ir);
+    return std::make_pair(ir, ir->node(node).value);
+}
+
+DefSpec::DefSpec(Syntax::DefExpr const& syntax)
+    : DefSpec(lower_single_def(syntax).first, 0)
+{
+    // The outermost def is always the first one lowered into a fresh IR.
+}
+
+void DefSpec::dump(std::ostream& s) const
+{
+    s << "DefSpec ";
+
+    if (name)
+        name->dump(s);
+    else
+        s << "_";
+
+    s << " ";
+
+    if (signature)
+        signature->dump(s);
+    else
+        s << "_";
+
+    s << std::endl;
+
+    code.dump(s);
+}
+
+ModuleSpec::ModuleSpec(Syntax::Module const& module)
+    : ModuleSpec(module, std::vector<std::shared_ptr<Interface const>>())
+{
+}
+
+ModuleSpec::ModuleSpec(Syntax::Module const& module, std::vector<std::shared_ptr<Interface const>> const& imports)
+    : ir(std::make_shared<IR>()), file(module.file_name)
+{
+    std::vector<std::pair<Symbol, LabelId>> imported;
+    for (auto const& import : imports)
+    {
+        TimeReport::Phase phase("import");
+        IR::Offsets at = ir->append(import->get_ir());
+        for (auto const& e : import->exports())
+            imported.emplace_back(ir->symbols.intern(e.name), e.label + at.labels);
+    }
+
+    TimeReport::Phase phase("lower");
+    scope = ir->add_scope(none, none);
+
+    std::vector<Syntax::Stmt const*> stmts;
+    stmts.reserve(module.items.size());
+    for (auto const& item : module.items)
+        stmts.push_back(&item.stmt);
+
+    Syntax::LineMap line_map(module.source);
+    Lowering lowering(*ir, scope, &line_map);
+    for (auto const& label : imported)
+        lowering.bind(label.first, label.second);
+    items = lowering.lower_stmts(stmts);
+    for (std::size_t i = 0; i < items.size(); ++i)
+        ir->set_line(items[i], module.items[i].span.first_line);
+    {
+        TimeReport::Phase resolve("resolve slots");
+        resolve_slots(*ir, items, scope);
+    }
+    count_lowered(*ir);
+}
+
+FoldStats ModuleSpec::fold_constants()
+{
+    TimeReport::Phase phase("fold constants");
+    if (!constants)
+        constants.reset(new ConstEval(*ir));
+    FoldStats stats = constants->fold(items);
+    TimeReport::count("nodes folded", stats.nodes_folded);
+    TimeReport::count("template calls evaluated", stats.calls_evaluated);
+    TimeReport::count("template calls memoized", stats.memo_hits);
+    return stats;
+}
+
+Constant const* ModuleSpec::constant_value(NodeId id) const
+{
+    return constants ? constants->folded_value(id) : nullptr;
+}
+
+std::vector<DefSpec> ModuleSpec::defs() const
+{
+    std::vector<DefSpec> result;
+    for (NodeId item : items)
+        if (ir->node(item).kind == NodeKind::Def)
+            result.emplace_back(ir, ir->node(item).value);
+    return result;
+}
+
+void ModuleSpec::dump(std::ostream& s) const
+{
+    for (NodeId item : items)
+        ir->dump(s, item);
+}
@@ -0,0 +1,164 @@
+#include <iomanip>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "Knife/TimeReport.hpp"
+
+using namespace TimeReport;
+
+namespace
+{
+
+thread_local Report* collecting = nullptr;
+
+// Bytes in use on the heap, so phases report how much it grew across
+// them: what they allocated less what they freed, not their allocations.
+long long heap_in_use()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return static_cast<long long>(mallinfo2().uordblks);
+#else
+    return 0;
+#endif
+}
+
+void write_json_string(std::ostream& s, std::string const& text)
+{
+    s << '"';
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            s << '\\';
+        s << c;
+    }
+    s << '"';
+}
+
+}
+
+Report::Report()
+    : depth(0)
+{
+}
+
+double Report::total_ms() const
+{
+    double total = 0;
+    for (auto const& phase : phases)
+        if (phase.depth == 0)
+            total += phase.ms;
+    return total;
+}
+
+void Report::write_table(std::ostream& s) const
+{
+    double total = total_ms();
+
+    s << "===== Compile time report =====" << std::endl;
+    s << "   time ms      %    runs  heap growth KiB  phase" << std::endl;
+    s << std::fixed;
+    for (auto const& phase : phases)
+    {
+        s << std::setprecision(3) << std::setw(10) << phase.ms
+          << std::setprecision(1) << std::setw(7) << (total > 0 ? 100 * phase.ms / total : 0.0)
+          << std::setw(8) << phase.runs;
+        if (phase.depth == 0)
+            s << std::setw(17) << phase.heap_growth / 1024.0;
+        else
+            s << std::setw(17) << "-";
+        s << "  " << std::string(2 * phase.depth, ' ') << phase.name << std::endl;
+    }
+    s << std::setprecision(3) << std::setw(10) << total << std::setprecision(1) << std::setw(7) << 100.0
+      << "                           total" << std::endl;
+    s << std::defaultfloat;
+
+    if (!counters.empty())
+    {
+        s << std::endl;
+        for (auto const& counter : counters)
+            s << std::setw(12) << counter.value << "  " << counter.name << std::endl;
+    }
+}
+
+void Report::write_json(std::ostream& s) const
+{
+    s << "{\"phases\":[";
+    for (std::size_t i = 0; i < phases.size(); ++i)
+    {
+        PhaseTotal const& phase = phases[i];
+        s << (i ? "," : "") << "{\"name\":";
+        write_json_string(s, phase.name);
+        s << ",\"depth\":" << phase.depth << ",\"runs\":" << phase.runs << ",\"ms\":" << phase.ms;
+        if (phase.depth == 0)
+            s << ",\"heap_growth_bytes\":" << phase.heap_growth;
+        s << "}";
+    }
+    s << "],\"total_ms\":" << total_ms() << ",\"counters\":{";
+    for (std::size_t i = 0; i < counters.size(); ++i)
+    {
+        s << (i ? "," : "");
+        write_json_string(s, counters[i].name);
+        s << ":" << counters[i].value;
+    }
+    s << "}}" << std::endl;
+}
+
+Collect::Collect(Report& report)
+    : saved(collecting)
+{
+    collecting = &report;
+}
+
+Collect::~Collect()
+{
+    collecting = saved;
+}
+
+Phase::Phase(char const* name)
+    : report(collecting), index(0), heap_start(0)
+{
+    if (!report)
+        return;
+
+    while (index < report->phases.size() && report->phases[index].name != name)
+        ++index;
+    if (index == report->phases.size())
+        report->phases.push_back(Report::PhaseTotal{ name, report->depth, 0, 0.0, 0 });
+
+    if (report->depth++ == 0)
+        heap_start = heap_in_use();
+    start = std::chrono::steady_clock::now();
+}
+
+Phase::~Phase()
+{
+    if (!report)
+        return;
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    Report::PhaseTotal& phase = report->phases[index];
+    phase.ms += std::chrono::duration<double, std::milli>(elapsed).count();
+    ++phase.runs;
+    if (--report->depth == 0)
+        phase.heap_growth += heap_in_use() - heap_start;
+}
+
+void TimeReport::count(char const* name, std::uint64_t n)
+{
+    Report* report = collecting;
+    if (!report)
+        return;
+
+    for (auto& counter : report->counters)
+        if (counter.name == name)
+        {
+            counter.value += n;
+            return;
+        }
+    report->counters.push_back(Report::Counter{ name, n });
+}
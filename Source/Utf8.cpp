@@ -0,0 +1,102 @@
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Knife/Utf8.hpp"
+
+namespace
+{
+
+typedef unsigned char byte;
+
+// The length of the valid sequence starting with a byte outside ASCII, or
+// 0 if it is not one.  The second byte's range rules out overlong forms
+// (E0, F0), surrogates (ED) and code points past U+10FFFF (F4).
+std::size_t sequence_length(byte const* p, byte const* end)
+{
+    std::size_t left = end - p;
+    byte lead = p[0];
+    auto continues = [](byte b) { return (b & 0xC0) == 0x80; };
+
+    if (lead >= 0xC2 && lead <= 0xDF)
+        return left >= 2 && continues(p[1]) ? 2 : 0;
+
+    if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        byte low = lead == 0xE0 ? 0xA0 : 0x80;
+        byte high = lead == 0xED ? 0x9F : 0xBF;
+        return left >= 3 && p[1] >= low && p[1] <= high && continues(p[2]) ? 3 : 0;
+    }
+
+    if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        byte low = lead == 0xF0 ? 0x90 : 0x80;
+        byte high = lead == 0xF4 ? 0x8F : 0xBF;
+        return left >= 4 && p[1] >= low && p[1] <= high && continues(p[2]) && continues(p[3]) ? 4 : 0;
+    }
+
+    return 0;
+}
+
+// The first byte at or after p that is outside ASCII, or end.
+byte const* skip_ascii(byte const* p, byte const* end)
+{
+#ifdef __SSE2__
+    while (end - p >= 32)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 16));
+        if (_mm_movemask_epi8(_mm_or_si128(a, b)) != 0)
+        {
+            int high = _mm_movemask_epi8(a);
+            return high != 0 ? p + __builtin_ctz(high) : p + 16 + __builtin_ctz(_mm_movemask_epi8(b));
+        }
+        p += 32;
+    }
+#else
+    while (end - p >= 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, p, sizeof word);
+        if (word & 0x8080808080808080ull)
+            break;
+        p += 8;
+    }
+#endif
+    while (p != end && *p < 0x80)
+        ++p;
+    return p;
+}
+
+}
+
+std::size_t Syntax::find_invalid_utf8(char const* data, std::size_t size)
+{
+    byte const* begin = reinterpret_cast<byte const*>(data);
+    byte const* end = begin + size;
+    byte const* p = begin;
+
+    while ((p = skip_ascii(p, end)) != end)
+    {
+        // Text outside ASCII comes in short runs (a name, a word in a
+        // string), so it is decoded a sequence at a time until the next
+        // ASCII byte, and the blocks take over again.
+        do
+        {
+            std::size_t length = sequence_length(p, end);
+            if (length == 0)
+                return p - begin;
+            p += length;
+        } while (p != end && *p >= 0x80);
+    }
+    return size;
+}
+
+std::size_t Syntax::byte_order_mark(char const* data, std::size_t size)
+{
+    return size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0 ? 3 : 0;
+}
@@ -0,0 +1,344 @@
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Knife/Wire.hpp"
+
+using namespace Wire;
+using Semantic::Constant;
+
+namespace
+{
+
+char const magic[8] = { 'K', 'N', 'I', 'F', 'E', 'W', 'R', '1' };
+
+std::uint32_t size_of(FieldKind kind)
+{
+    switch (kind)
+    {
+    case FieldKind::Float: return 4;
+    case FieldKind::Bool: return 1;
+    default: return 8;     // Int, Double, and a string's offset and length
+    }
+}
+
+char const* kind_name(FieldKind kind)
+{
+    switch (kind)
+    {
+    case FieldKind::Int: return "Int";
+    case FieldKind::Float: return "Float";
+    case FieldKind::Double: return "Double";
+    case FieldKind::Bool: return "Bool";
+    case FieldKind::String: return "String";
+    }
+    return "";
+}
+
+bool is_tuple_type(Constant const& c)
+{
+    if (c.kind == Constant::Kind::Type)
+        return c.name == Semantic::none;
+
+    // (x: T, y: T) written as a tuple of types.
+    if (c.kind != Constant::Kind::Tuple)
+        return false;
+    for (auto const& element : c.elements)
+        if (element.kind != Constant::Kind::Type)
+            return false;
+    return true;
+}
+
+template <typename T>
+void append(std::string& out, T value)
+{
+    out.append(reinterpret_cast<char const*>(&value), sizeof value);
+}
+
+template <typename T>
+T load(char const* at)
+{
+    T value;
+    std::memcpy(&value, at, sizeof value);
+    return value;
+}
+
+// Puts the value's fields in the record, walking the type alongside it.
+bool put(Writer& w, Constant const& type, Constant const& value, std::vector<Field> const& fields, std::size_t& field)
+{
+    if (is_tuple_type(type))
+    {
+        if (value.kind != Constant::Kind::Tuple || value.elements.size() != type.elements.size())
+            return false;
+        for (std::size_t i = 0; i < type.elements.size(); ++i)
+            if (!put(w, type.elements[i], value.elements[i], fields, field))
+                return false;
+        return true;
+    }
+
+    std::size_t f = field++;
+    switch (fields[f].kind)
+    {
+    case FieldKind::String:
+        if (value.kind != Constant::Kind::String)
+            return false;
+        w.set_string(f, value.text);
+        return true;
+    case FieldKind::Int:
+        w.set_int(f, std::int64_t(value.number));
+        break;
+    case FieldKind::Float:
+        w.set_float(f, float(value.number));
+        break;
+    case FieldKind::Double:
+        w.set_double(f, value.number);
+        break;
+    case FieldKind::Bool:
+        w.set_bool(f, value.number != 0);
+        break;
+    }
+    return value.kind == Constant::Kind::Number;
+}
+
+Constant get(Record const& r, Constant const& type, std::vector<Field> const& fields, std::size_t& field)
+{
+    Constant value;
+    if (is_tuple_type(type))
+    {
+        value.kind = Constant::Kind::Tuple;
+        for (auto const& element : type.elements)
+            value.elements.push_back(get(r, element, fields, field));
+    }
+    else
+    {
+        Field const& f = fields[field++];
+        switch (f.kind)
+        {
+        case FieldKind::Int: value = Constant::of_number(double(r.get_int(f))); break;
+        case FieldKind::Float: value = Constant::of_number(r.get_float(f)); break;
+        case FieldKind::Double: value = Constant::of_number(r.get_double(f)); break;
+        case FieldKind::Bool: value = Constant::of_number(r.get_bool(f)); break;
+        case FieldKind::String: value = Constant::of_string(r.get_string(f).to_string()); break;
+        }
+    }
+    value.label = type.label;
+    return value;
+}
+
+}
+
+Schema::Schema()
+    : fixed_bytes(record_header_bytes), print(0)
+{
+}
+
+bool Schema::add(Constant const& element, std::string const& name, Semantic::SymbolTable const& symbols)
+{
+    if (is_tuple_type(element))
+    {
+        for (std::size_t i = 0; i < element.elements.size(); ++i)
+        {
+            Constant const& inner = element.elements[i];
+            std::string part = inner.label != Semantic::none ? symbols.name(inner.label) : "#" + std::to_string(i);
+            if (!add(inner, name.empty() ? part : name + "." + part, symbols))
+                return false;
+        }
+        return true;
+    }
+
+    static char const* const names[] = { "Int", "Float", "Double", "Bool", "String" };
+    if (element.kind == Constant::Kind::Type)
+        for (int k = 0; k < 5; ++k)
+            if (symbols.name(element.name) == names[k])
+            {
+                fields.push_back(Field{ name, FieldKind(k), 0 });
+                return true;
+            }
+
+    cerr << "wire: " << name << ": only Int, Float, Double, Bool, String and tuple types have a layout" << endl;
+    return false;
+}
+
+bool Schema::derive(Constant const& tuple_type, Semantic::SymbolTable const& symbols)
+{
+    *this = Schema();
+    if (!is_tuple_type(tuple_type))
+    {
+        cerr << "wire: not a tuple type" << endl;
+        return false;
+    }
+    if (!add(tuple_type, "", symbols))
+        return false;
+    type = tuple_type;
+
+    // Largest first: every field lands on a multiple of its size.
+    std::uint32_t at = record_header_bytes;
+    for (std::uint32_t size : { 8u, 4u, 1u })
+        for (auto& f : fields)
+            if (size_of(f.kind) == size)
+            {
+                f.offset = at;
+                at += size;
+                if (f.kind == FieldKind::String)
+                    strings.push_back(f.offset);
+            }
+    fixed_bytes = at;
+
+    // FNV-1a over the names and kinds in declaration order.
+    print = 14695981039346656037ull;
+    for (auto const& f : fields)
+    {
+        for (char c : f.name)
+            print = (print ^ std::uint8_t(c)) * 1099511628211ull;
+        print = (print ^ (0x100u + std::uint8_t(f.kind))) * 1099511628211ull;
+    }
+    return true;
+}
+
+int Schema::find(std::string const& name) const
+{
+    for (std::size_t i = 0; i < fields.size(); ++i)
+        if (fields[i].name == name)
+            return int(i);
+    return -1;
+}
+
+void Schema::dump(std::ostream& s) const
+{
+    s << fixed_bytes << " bytes fixed, fingerprint " << std::hex << std::setw(16) << std::setfill('0') << print
+      << std::dec << std::setfill(' ') << endl;
+    for (auto const& f : fields)
+        s << "    " << std::setw(4) << f.offset << "  " << std::left << std::setw(8) << kind_name(f.kind)
+          << std::right << f.name << endl;
+}
+
+Writer::Writer(Schema const& schema, std::string& out)
+    : schema(schema), out(out), record(0)
+{
+    if (out.empty())
+    {
+        out.append(magic, sizeof magic);
+        append(out, schema.fingerprint());
+    }
+}
+
+void Writer::begin()
+{
+    record = out.size();
+    out.append(schema.fixed_size(), '\0');
+}
+
+void Writer::set_string(std::size_t field, boost::string_ref value)
+{
+    std::uint32_t span[2] = { std::uint32_t(out.size() - record), std::uint32_t(value.size()) };
+    std::memcpy(&out[record + schema.field_list()[field].offset], span, sizeof span);
+    out.append(value.data(), value.size());
+}
+
+void Writer::end()
+{
+    out.append((8 - (out.size() - record) % 8) % 8, '\0');
+    std::uint32_t size = std::uint32_t(out.size() - record);
+    std::memcpy(&out[record], &size, sizeof size);
+}
+
+bool Writer::write(Constant const& tuple)
+{
+    begin();
+    std::size_t field = 0;
+    if (!put(*this, schema.tuple_type(), tuple, schema.field_list(), field))
+    {
+        out.resize(record);
+        return false;
+    }
+    end();
+    return true;
+}
+
+Constant Record::to_constant(Schema const& schema) const
+{
+    std::size_t field = 0;
+    return get(*this, schema.tuple_type(), schema.field_list(), field);
+}
+
+Reader::Reader(Schema const& schema, char const* data, std::size_t size)
+    : schema(schema), at(data + buffer_header_bytes), end(data + size), usable(false)
+{
+    usable = size >= buffer_header_bytes && std::memcmp(data, magic, sizeof magic) == 0
+        && load<std::uint64_t>(data + sizeof magic) == schema.fingerprint();
+    if (!usable)
+        at = end;
+}
+
+bool Reader::next(Record& record)
+{
+    if (at == end)
+        return false;
+
+    std::size_t left = end - at;
+    std::uint32_t size = left >= record_header_bytes ? load<std::uint32_t>(at) : 0;
+    if (size < schema.fixed_size() || size % 8 != 0 || size > left)
+    {
+        usable = false;
+        at = end;
+        return false;
+    }
+
+    for (std::uint32_t offset : schema.string_offsets())
+    {
+        std::uint64_t from = load<std::uint32_t>(at + offset);
+        std::uint64_t length = load<std::uint32_t>(at + offset + 4);
+        if (from + length > size)
+        {
+            usable = false;
+            at = end;
+            return false;
+        }
+    }
+
+    record = Record(at);
+    at += size;
+    return true;
+}
+
+MappedFile::MappedFile(std::string const& path)
+    : base(nullptr), bytes(0)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0)
+    {
+        cerr << "wire: " << path << ": " << std::strerror(errno) << endl;
+        if (fd >= 0)
+            ::close(fd);
+        return;
+    }
+
+    if (st.st_size > 0)
+    {
+        void* p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+            cerr << "wire: " << path << ": cannot map: " << std::strerror(errno) << endl;
+        else
+        {
+            base = p;
+            bytes = std::size_t(st.st_size);
+        }
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (base)
+        ::munmap(base, bytes);
+}
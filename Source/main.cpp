@@ -2,585 +2,381 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <fstream>
+#include <cstdlib>
 using namespace std;
 
 
-#include "LikeMagic/Utility/TypeDescr.hpp"
-using namespace LikeMagic;
-using namespace LikeMagic::Utility;
-
-#include "boost/spirit/include/qi.hpp"
-#include "boost/fusion/include/io.hpp"
-#include "boost/spirit/include/karma.hpp"
-
-#include "boost/spirit/include/phoenix_core.hpp"
-#include "boost/spirit/include/phoenix_operator.hpp"
-#include "boost/spirit/include/phoenix_object.hpp"
-#include "boost/fusion/include/adapt_struct.hpp"
-
-namespace qi = boost::spirit::qi;
-namespace ascii = boost::spirit::ascii;
-
-namespace Syntax {
-
-struct TupleExpr;
-struct Invocation;
-struct LabelExpr;
-struct DefExpr;
-struct BracesBlock;
-struct Number;
-struct QuotedString;
-struct Reassignment;
-
-typedef  boost::variant
-<
-    boost::recursive_wrapper<TupleExpr>,
-    boost::recursive_wrapper<LabelExpr>,
-    boost::recursive_wrapper<BracesBlock>,
-    boost::recursive_wrapper<DefExpr>,
-    boost::recursive_wrapper<Invocation>,
-    boost::recursive_wrapper<Number>,
-    boost::recursive_wrapper<QuotedString>
-> Expr;
-
-typedef  boost::variant
-<
-    boost::recursive_wrapper<Expr>,
-    boost::recursive_wrapper<Reassignment>
-> Stmt;
-
-template <typename T>
-struct DebugTrack
-{
-    char const* type;
-
-    DebugTrack()
-        : type(typeid(T).name())
-    {
-        //cout << type << " " << this << " constructed" << endl;
-    }
-
-    ~DebugTrack()
-    {
-        //cout << type << " " << this << " destructed" << endl;
-    }
-};
-
-struct Ident : private DebugTrack<Ident>
-{
-    std::string value;
-};
-
-struct BracesBlock : private DebugTrack<BracesBlock>
-{
-    std::vector<Syntax::Stmt> stmts;
-};
-
-struct TupleExpr : private DebugTrack<TupleExpr>
-{
-    std::vector<Expr> elements;
-};
-
-struct LabelAssignment : private DebugTrack<LabelAssignment>
-{
-    Expr value;
-};
-
-struct LabelExpr : private DebugTrack<LabelExpr>
-{
-    boost::optional<Ident> name;
-    boost::optional<Expr> type;
-    boost::optional<LabelAssignment> term;
-};
+#include "Knife/Parse.hpp"
+#include "Knife/Semantic.hpp"
+#include "Knife/Format.hpp"
+#include "Knife/Jit.hpp"
+#include "Knife/Profiler.hpp"
+#include "Knife/TimeReport.hpp"
+#include "Knife/ModuleCache.hpp"
+#include "Knife/Daemon.hpp"
+#include "Knife/Aot.hpp"
+#include "Knife/Interface.hpp"
+#include "Knife/Wire.hpp"
 
-struct DefExpr : private DebugTrack<DefExpr>
-{
-    boost::optional<Ident> name;
-    boost::optional<TupleExpr> args;
-    BracesBlock code;
-};
+// Set while serving as a daemon, so modules stay compiled between commands.
+static ModuleCache* module_cache = nullptr;
 
-struct Invocation : private DebugTrack<Invocation>
-{
-    Ident name;
-    boost::optional<TupleExpr> args;
-    boost::optional<BracesBlock> postfix_lambda;
-    boost::optional<
-        boost::recursive_wrapper<
-            Invocation
-        >
-    > next_call;
-};
-
-struct Number : private DebugTrack<Number>
-{
-    std::string raw;
-};
-
-struct QuotedString : private DebugTrack<QuotedString>
-{
-    std::string raw;
-};
-
-struct Reassignment : private DebugTrack<QuotedString>
-{
-    Ident name;
-    Expr value;
-};
-
-}
+typedef std::vector<std::shared_ptr<Semantic::Interface const>> Interfaces;
 
-BOOST_FUSION_ADAPT_STRUCT(
-    Syntax::Ident,
-    (std::string, value)
-)
-
-BOOST_FUSION_ADAPT_STRUCT(
-    Syntax::TupleExpr,
-    (std::vector<Syntax::Expr>, elements)
-)
-
-BOOST_FUSION_ADAPT_STRUCT(
-    Syntax::BracesBlock,
-    (std::vector<Syntax::Stmt>, stmts)
-)
-
-BOOST_FUSION_ADAPT_STRUCT(
-    Syntax::LabelAssignment,
-    (Syntax::Expr, value)
-)
-
-BOOST_FUSION_ADAPT_STRUCT(
-    Syntax::LabelExpr,
-    (boost::optional<Syntax::Ident>, name)
-    (boost::optional<Syntax::Expr>, type)
-    (boost::optional<Syntax::LabelAssignment>, term)
-)
-
-BOOST_FUSION_ADAPT_STRUCT(
-    Syntax::DefExpr,
-    (boost::optional<Syntax::Ident>, name)
-    (boost::optional<Syntax::TupleExpr>, args)
-    (Syntax::BracesBlock, code)
-)
-
-BOOST_FUSION_ADAPT_STRUCT(
-    Syntax::Invocation,
-    (Syntax::Ident, name)
-    (boost::optional<Syntax::TupleExpr>, args)
-    (boost::optional<Syntax::BracesBlock>, postfix_lambda)
-    (boost::optional<
-        boost::recursive_wrapper<
-            Syntax::Invocation
-        >
-    >, next_call)
-)
-
-BOOST_FUSION_ADAPT_STRUCT(
-    Syntax::Number,
-    (std::string, raw)
-)
-
-BOOST_FUSION_ADAPT_STRUCT(
-    Syntax::QuotedString,
-    (std::string, raw)
-)
-
-BOOST_FUSION_ADAPT_STRUCT(
-    Syntax::Reassignment,
-    (Syntax::Ident, name)
-    (Syntax::Expr, value)
-)
-
-struct printer
+static std::shared_ptr<CompiledModule const> load_module(char const* file_name, Interfaces const& imports = Interfaces())
 {
-    typedef boost::spirit::utf8_string string;
-
-    void element(string const& tag, string const& value, int depth) const
+    auto module = !imports.empty() ? compile_module(file_name, imports)
+        : module_cache ? module_cache->load(file_name) : compile_module(file_name);
+    if (!module)
+        std::cerr << file_name << ": cannot read" << std::endl;
+    else if (!Syntax::parsed_completely(module->syntax))
     {
-        for (int i = 0; i < (depth*4); ++i) // indent to depth
-            std::cout << ' ';
-
-        std::cout << "tag: " << tag;
-        if (value != "")
-            std::cout << ", value: " << value;
-        std::cout << std::endl;
+        std::cerr << file_name << ": does not parse" << std::endl;
+        return nullptr;
     }
-};
-
-void print_info(boost::spirit::info const& what)
-{
-    using boost::spirit::basic_info_walker;
-
-    printer pr;
-    basic_info_walker<printer> walker(pr, what.tag, 0);
-    boost::apply_visitor(walker, what.value);
+    return module;
 }
 
-template <typename Iterator>
-struct Skipper : qi::grammar<Iterator>
+// Loads the interface files named by "--interface path" options starting
+// at argv[i], leaving i after them.  False if one cannot be loaded.
+static bool load_interfaces(int argc, char* argv[], int& i, Interfaces& imports)
 {
-    Skipper() : Skipper::base_type(start)
+    for (; i + 1 < argc && std::string(argv[i]) == "--interface"; i += 2)
     {
-        start = +qi::char_(" \t");
+        auto import = Semantic::load_interface(argv[i + 1]);
+        if (!import)
+            return false;
+        imports.push_back(import);
     }
+    return true;
+}
 
-    qi::rule<Iterator> start;
-};
-
-template <typename Iterator>
-struct LangParseGrammar : qi::grammar<Iterator, Syntax::DefExpr(), Skipper<Iterator>>
+static int format_main(int argc, char* argv[])
 {
-    LangParseGrammar() : LangParseGrammar::base_type(def_expr)
-    {
-        ident = qi::lexeme[qi::alpha >> *(qi::alnum | qi::char_('_') )];
-        label = -ident >> qi::lit(":");
-        label_assignment = qi::lit("=") > expr;
-        label_expr = label >> -expr >> -label_assignment;
-        expr_list = expr % qi::lit(",");
-        tuple_expr = expr_list;
-        paren_arg_list %= qi::lit("(") > -tuple_expr > qi::lit(")");
-        braces_block = qi::lit("{") > stmt_list > qi::lit("}");
-        def_expr = qi::lit("def") > -ident > -paren_arg_list > braces_block;
-        invocation = ident >> -paren_arg_list >> -braces_block >> -invocation;
-        number_str %= qi::lexeme[+qi::digit];
-        number = number_str;
-        quoted_string = qi::lexeme[qi::lit('"') > *(qi::char_-'"') > '"'];
-        paren_expr %= qi::lit('(') > expr > ')';
-        reassignment = ident >> qi::lit("=") > expr;
-        stmt = expr | reassignment;
-        expr = def_expr | label_expr | paren_expr | braces_block | invocation | number | quoted_string | paren_expr;
-        stmt_list = expr % +qi::char_("\n;");
+    FormatOptions options;
+    options.check_only = false;
+    options.threads = 0;
+    std::vector<std::string> paths;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--check")
+            options.check_only = true;
+        else if (arg == "-j" && i + 1 < argc)
+            options.threads = std::atoi(argv[++i]);
+        else
+            paths.push_back(arg);
     }
 
-    qi::rule<Iterator, std::string(), Skipper<Iterator>> dummy_str;
-    qi::rule<Iterator, std::string(), Skipper<Iterator>> ident;
-    qi::rule<Iterator, std::string(), Skipper<Iterator>> number_str;
-    qi::rule<Iterator, Syntax::Ident(), Skipper<Iterator>> label;
-    qi::rule<Iterator, Syntax::LabelAssignment(), Skipper<Iterator>> label_assignment;
-    qi::rule<Iterator, Syntax::LabelExpr(), Skipper<Iterator>> label_expr;
-    qi::rule<Iterator, Syntax::Expr(), Skipper<Iterator>> expr;
-    qi::rule<Iterator, Syntax::TupleExpr(), Skipper<Iterator>> tuple_expr;
-    qi::rule<Iterator, Syntax::DefExpr(), Skipper<Iterator>> def_expr;
-    qi::rule<Iterator, Syntax::TupleExpr(), Skipper<Iterator>> paren_arg_list;
-    qi::rule<Iterator, Syntax::BracesBlock(), Skipper<Iterator>> braces_block;
-    qi::rule<Iterator, Syntax::Number(), Skipper<Iterator>> number;
-    qi::rule<Iterator, Syntax::QuotedString(), Skipper<Iterator>> quoted_string;
-    qi::rule<Iterator, Syntax::Reassignment(), Skipper<Iterator>> reassignment;
-    qi::rule<Iterator, Syntax::Stmt(), Skipper<Iterator>> stmt;
-    qi::rule<Iterator, std::vector<Syntax::Stmt>(), Skipper<Iterator>> stmt_list;
-    qi::rule<Iterator, Syntax::Invocation(), Skipper<Iterator>> invocation;
-    qi::rule<Iterator, Syntax::Expr(), Skipper<Iterator>> paren_expr;
-    qi::rule<Iterator, std::vector<Syntax::Expr>(), Skipper<Iterator>> expr_list;
-};
-
-
-Syntax::DefExpr Parse(std::string str)
-{
-    typedef std::string::const_iterator iterator_type;
-    typedef LangParseGrammar<iterator_type> LangGrammar;
+    FormatReport report = format_paths(paths, options);
 
-    LangGrammar g; // Our grammar
+    for (auto const& file : report.failed)
+        std::cerr << file << ": does not parse, left unchanged" << std::endl;
 
-    std::string::const_iterator iter = str.begin();
-    std::string::const_iterator end = str.end();
-    Skipper<iterator_type> skipper;
-    Syntax::DefExpr result;
+    std::cerr << report.files << " files, " << report.changed
+              << (options.check_only ? " need formatting" : " reformatted") << std::endl;
 
-    try
-    {
-        bool success = phrase_parse(iter, end, g, skipper, result);
-
-        if (!success)
-        {
-            stringstream ss;
-            ss << "LangParser failed to parse: " << str << std::endl;
-            cerr << endl << ss.str() << endl;
-            //raiseError(ParseException(ss.str()));
-        }
-        else
-        {
-            if (iter != end)
-            {
-                stringstream ss;
-                ss << "Not all of the line was parsed: " << std::string(iter, end) << std::endl;
-                cerr << endl << ss.str() << endl;
-                //raiseError(ParseException(ss.str()));
-            }
-        }
-
-        return result;
-    }
-    catch (qi::expectation_failure<iterator_type> const& x)
-    {
-        std::cout << "expected: "; print_info(x.what_);
-        std::cout << "got: \"" << std::string(x.first, x.last) << '"' << std::endl;
-        throw;
-    }
+    return report.failed.empty() && !(options.check_only && report.changed) ? 0 : 1;
 }
 
-/*
-struct SyntaxPrinter : boost::static_visitor<std::string>
+// argv[first] is the file, after any --interface options, then the def,
+// then its arguments.  With a profile prefix the call is sampled and the
+// profile written to prefix.flat, prefix.graph and prefix.folded.
+static int run_main(int argc, char* argv[], int first, char const* profile)
 {
-    std::string operator()(const Syntax::Invocation& t) const
-    {
-        auto self = *this;
-        std::stringstream result;
-        result << print_ident(t.name);
-        result << "(" << self(t.args) << ")";
-        result << self(t.postfix_lambda);
-        result << self(t.next_call);
-        return result.str();
-    }
-
-    std::string operator()(const Syntax::DefExpr& t) const
+    Interfaces imports;
+    if (!load_interfaces(argc, argv, first, imports))
+        return 1;
+    if (first + 1 >= argc)
     {
-        auto self = *this;
-        std::stringstream result;
-        result << "def ";
-        result << self(t.name);
-        result << "(" << self(t.args) << ")";
-        result << endl;
-        result << print_braces_block(t.code) << endl;
-        return result.str();
+        std::cerr << "no file and def to run" << std::endl;
+        return 1;
     }
 
-    std::string operator()(const Syntax::BracesBlock& t) const
-    {
-        return print_braces_block(t);
-    }
+    char const* file_name = argv[first];
+    auto module = load_module(file_name, imports);
+    if (!module)
+        return 1;
+    Semantic::ModuleSpec const& spec = module->spec;
 
-    std::string print_braces_block(const Syntax::BracesBlock& t) const
-    {
-        auto self = *this;
-        std::stringstream result;
+    Semantic::CodegenOptions options;
+    options.probes = true;
+    options.debug_info = profile != nullptr;
+    Jit jit;
 
-        result << "{";
+    // The libraries' defs are compiled from their interfaces' IR.
+    for (auto const& import : imports)
+        jit.load(import->get_ir(), import->item_nodes(), import->file_name(), options);
+    jit.load(spec.get_ir(), spec.item_nodes(), file_name, options);
 
-        for (auto expr : t.stmts)
-        {
-            result << endl << self(expr);
-        }
+    void* entry = jit.lookup(argv[first + 1]);
+    if (!entry)
+        return 1;
 
-        result << endl << "}";
+    std::vector<double> a;
+    for (int i = first + 2; i < argc; ++i)
+        a.push_back(std::strtod(argv[i], nullptr));
 
-        return result.str();
-    }
+    if (profile)
+        Profiler::start();
 
-    std::string operator()(const Syntax::TupleExpr& t) const
+    double result;
+    switch (a.size())
     {
-        auto self = *this;
-        std::stringstream result;
-
-        bool is_first = true;
-        for (auto expr : t.elements)
-        {
-            if (!is_first)
-                result << ", ";
-
-            result << self(expr);
-
-            is_first = false;
-        }
-
-        return result.str();
+    case 0: result = reinterpret_cast<double (*)()>(entry)(); break;
+    case 1: result = reinterpret_cast<double (*)(double)>(entry)(a[0]); break;
+    case 2: result = reinterpret_cast<double (*)(double, double)>(entry)(a[0], a[1]); break;
+    case 3: result = reinterpret_cast<double (*)(double, double, double)>(entry)(a[0], a[1], a[2]); break;
+    default:
+        std::cerr << "at most 3 arguments can be passed" << std::endl;
+        return 1;
     }
 
-    std::string operator()(const Syntax::Ident& t) const
+    if (profile)
     {
-        return print_ident(t);
+        Profiler::stop();
+        std::string prefix = profile;
+        std::ofstream flat(prefix + ".flat"), graph(prefix + ".graph"), folded(prefix + ".folded");
+        Profiler::write_flat(flat);
+        Profiler::write_call_graph(graph);
+        Profiler::write_folded(folded);
+        std::cerr << Profiler::sample_count() << " samples written to " << prefix << ".*" << std::endl;
     }
 
-    std::string print_ident(const Syntax::Ident& t) const
-    {
-        return t.value;
-    }
+    std::cout << result << std::endl;
+    return 0;
+}
 
-    template <typename T>
-    std::string print_optional(boost::optional<T> const& t)
-    {
-        if (t)
-            return this->operator()(*t);
+static int emit_obj_usage()
+{
+    std::cerr << "usage: Compiler --emit-obj file.kn -o out.o [--entry def] [-O level] [--native] [-g] "
+                 "[--import lib.o]... [--interface lib.kni]..." << std::endl;
+    return 1;
+}
+
+// --emit-obj file.kn -o out.o [--entry def] [-O level] [--native] [-g]
+static int emit_obj_main(int argc, char* argv[])
+{
+    char const* file_name = nullptr;
+    std::string object_path;
+    Interfaces imports;
+    Aot::Options options;
+    options.opt_level = 2;
+    options.native = false;
+    options.debug_info = false;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+            object_path = argv[++i];
+        else if (arg == "--entry" && i + 1 < argc)
+            options.entry = argv[++i];
+        else if (arg == "-O" && i + 1 < argc)
+            options.opt_level = std::atoi(argv[++i]);
+        else if (arg == "--native")
+            options.native = true;
+        else if (arg == "-g")
+            options.debug_info = true;
+        else if (arg == "--import" && i + 1 < argc)
+            options.imports.push_back(argv[++i]);
+        else if (arg == "--interface" && i + 1 < argc)
+        {
+            auto import = Semantic::load_interface(argv[++i]);
+            if (!import)
+                return 1;
+            imports.push_back(import);
+        }
+        else if (arg[0] != '-' && !file_name)
+            file_name = argv[i];
         else
-            return "_";
+            return emit_obj_usage();
     }
 
-    template <typename T>
-    std::string operator()(boost::optional<T> const& t)
-    {
-        return print_optional(t);
-    }
+    if (!file_name || object_path.empty())
+        return emit_obj_usage();
 
-    template <typename T>
-    std::string operator()(boost::recursive_wrapper<T> const& t)
-    {
-        return this->operator()(t.get());
-    }
+    auto module = load_module(file_name, imports);
+    if (!module)
+        return 1;
+    return Aot::emit_object(module->spec.get_ir(), module->spec.item_nodes(), file_name, object_path, options) ? 0 : 1;
+}
 
-    std::string operator()(Syntax::Expr const& t)
+// --emit-interface lib.kn -o lib.kni
+static int emit_interface_main(int argc, char* argv[])
+{
+    if (argc != 5 || std::string(argv[3]) != "-o")
     {
-        return boost::apply_visitor(*this, t);
+        std::cerr << "usage: Compiler --emit-interface lib.kn -o lib.kni" << std::endl;
+        return 1;
     }
+    auto module = load_module(argv[2]);
+    if (!module)
+        return 1;
+    return Semantic::Interface(module->spec, module->syntax.source).save(argv[4]) ? 0 : 1;
+}
 
-    std::string print_stmt(Syntax::Stmt const& t)
-    {
-        return boost::apply_visitor(*this, t);
-    }
+// The wire layout of every top-level label whose value is a tuple type.
+static int schema_main(int argc, char* argv[])
+{
+    Interfaces imports;
+    int first = 2;
+    if (!load_interfaces(argc, argv, first, imports) || first >= argc)
+        return 1;
+    char const* file_name = argv[first];
+    auto module = load_module(file_name, imports);
+    if (!module)
+        return 1;
+    Semantic::ModuleSpec const& spec = module->spec;
+    Semantic::IR const& ir = spec.get_ir();
+
+    int shown = 0;
+    for (Semantic::NodeId item : spec.item_nodes())
+    {
+        Semantic::Node const& label = ir.node(item);
+        if (label.kind != Semantic::NodeKind::Label || !(label.flags & Semantic::HasInit))
+            continue;
+        Semantic::IR::Range kids = ir.children_of(item);
+        Semantic::Constant const* type = spec.constant_value(kids[kids.size() - 1]);
+        if (!type || type->kind != Semantic::Constant::Kind::Type || type->name != Semantic::none)
+            continue;
+
+        Wire::Schema schema;
+        std::cout << ir.symbols.name(label.symbol) << ": ";
+        if (!schema.derive(*type, ir.symbols))
+            return 1;
+        schema.dump(std::cout);
+        ++shown;
+    }
+
+    if (shown == 0)
+        std::cerr << file_name << ": no label has a tuple type" << std::endl;
+    return 0;
+}
 
-    std::string operator()(Syntax::LabelExpr const& t)
-    {
-        auto self = *this;
-        stringstream result;
-        result << print_optional<Syntax::Ident>(t.name);
-        result << ":" << self(t.type);
-        result << self(t.term);
-        return result.str();
-    }
+// Usage:
+//   Compiler file.kn                          dump the module's index and IR
+//   Compiler --print file.kn                  print file.kn formatted
+//   Compiler --format [--check] [-j N] paths  format .kn files in place
+//   Compiler --run [--interface lib.kni]... file.kn def [numbers...]
+//                                             compile file.kn and call def
+//   Compiler --profile prefix [--interface lib.kni]... file.kn def [numbers...]
+//                                             the same, writing a sampled profile
+//   Compiler --emit-obj file.kn -o out.o [--entry def] [-O level] [--native] [-g]
+//            [--import lib.o]... [--interface lib.kni]...
+//                                             compile file.kn to an object file;
+//                                             see Knife/Aot.hpp for linking programs
+//   Compiler --emit-interface lib.kn -o lib.kni
+//                                             write lib.kn's interface for importers;
+//                                             see Knife/Interface.hpp
+//   Compiler --exports lib.kni                list an interface's exports
+//   Compiler --schema [--interface lib.kni]... file.kn
+//                                             print the wire layout of each tuple type;
+//                                             see Knife/Wire.hpp
+//   Compiler --daemon [socket]                serve these commands to knifec,
+//                                             keeping compiled modules warm
+//
+// Any of these can be preceded by --time-report or --time-report=json to
+// print the time spent in each compiler phase to stderr at the end.
+static int compiler_main(int argc, char* argv[])
+{
+    if (argc > 3 && std::string(argv[1]) == "--run")
+        return run_main(argc, argv, 2, nullptr);
 
-    std::string operator()(Syntax::Reassignment const& t)
-    {
-        auto self = *this;
-        stringstream result;
-        result << print_ident(t.name);
-        result << "=" << self(t.value);
-        return result.str();
-    }
+    if (argc > 4 && std::string(argv[1]) == "--profile")
+        return run_main(argc, argv, 3, argv[2]);
 
-    std::string operator()(Syntax::LabelAssignment const& t)
-    {
-        return "=" + operator()(t.value);
-    }
+    if (argc > 1 && std::string(argv[1]) == "--emit-obj")
+        return emit_obj_main(argc, argv);
 
-    std::string operator()(Syntax::Number const& t)
-    {
-        return t.raw;
-    }
+    if (argc > 1 && std::string(argv[1]) == "--emit-interface")
+        return emit_interface_main(argc, argv);
 
-    template <typename T>
-    std::string operator()(const T& t) const
+    if (argc > 2 && std::string(argv[1]) == "--exports")
     {
-        return TypeDescr<T>::text();
+        auto loaded = Semantic::load_interface(argv[2]);
+        if (!loaded)
+            return 1;
+        loaded->dump(std::cout);
+        return 0;
     }
-};*/
 
-namespace Semantic
-{
-// Base class for all statements and Exprs.
-// (The rationale for making Expr derive from Stmt
-// is that a brace block may contain one or more stmts,
-// and not all stmts are exprs (e.g. operations returning void)
-// but a brace block may need to contain one expr for lambda syntax).
-class Stmt
-{
-};
+    if (argc > 2 && std::string(argv[1]) == "--schema")
+        return schema_main(argc, argv);
 
-class Ident
-{
-private:
-    std::string value;
-
-public:
-    Ident(Syntax::Ident const& name)
-        : value(name.value)
-    {
-    }
+    if (argc > 1 && std::string(argv[1]) == "--format")
+        return format_main(argc, argv);
 
-    void dump(std::ostream& s)
+    if (argc > 2 && std::string(argv[1]) == "--print")
     {
-        s << value;
+        std::ifstream file(argv[2]);
+        std::stringstream source;
+        source << file.rdbuf();
+        std::string formatted;
+        if (!format_source(source.str(), argv[2], formatted))
+            return 1;
+        std::cout << formatted;
+        return 0;
     }
-};
 
-class Signature
-{
-private:
-    std::vector<std::string> argList;
-
-public:
-    Signature(Syntax::TupleExpr const& args)
+    if (argc > 1)
     {
-        for (auto elem : args.elements)
-            argList.push_back("an arg");
+        auto module = load_module(argv[1]);
+        if (!module)
+            return 1;
+        ModuleIndex(module->syntax).dump(std::cout);
+        module->spec.dump(std::cout);
+        Semantic::FoldStats const& folded = module->folded;
+        std::cout << "Folded " << folded.nodes_folded << " nodes, evaluated "
+                  << folded.calls_evaluated << " template calls ("
+                  << folded.memo_hits << " memoized)" << std::endl;
+        return 0;
     }
 
-    void dump(std::ostream& s)
-    {
-        s << "Signature (";
-
-        bool is_first = true;
-        for (auto arg : argList)
-        {
-            if (!is_first)
-                s << ", ";
-            s << arg;
-            is_first = false;
-        }
-        s << ") ";
-    }
-};
+    auto result = Parse("def Main(x:Int=0, y:) { if(x) { say(1) } else { say(2) } }");
+    Semantic::DefSpec testProgram(result);
+    testProgram.dump(std::cout);
+    std::string text;
+    SyntaxPrinter(text).print(Syntax::Stmt(Syntax::Expr(result)));
+    std::cout << text << std::endl;
+    std::cout << "Press enter..." << std::endl;
+    std::cin.ignore( 99, '\n' );
+    return 0;
+}
 
-class CodeBlock
+static int command_main(int argc, char* argv[])
 {
-private:
-    std::vector<Stmt>
+    std::string first = argc > 1 ? argv[1] : "";
+    if (first != "--time-report" && first != "--time-report=json")
+        return compiler_main(argc, argv);
 
-public:
-    CodeBlock(Syntax::BracesBlock const& code)
+    // Drop the option and run the rest under a report.
+    argv[1] = argv[0];
+    TimeReport::Report report;
+    int status;
     {
+        TimeReport::Collect collect(report);
+        status = compiler_main(argc - 1, argv + 1);
     }
 
-    void dump(std::ostream& s)
-    {
-        s << "{" << " CodeBlock " << "}" << std::endl;
-    }
-};
+    if (first == "--time-report=json")
+        report.write_json(std::cerr);
+    else
+        report.write_table(std::cerr);
+    return status;
+}
 
-class DefSpec
+int main(int argc, char* argv[])
 {
-private:
-    boost::optional<Ident> name;
-    boost::optional<Signature> signature;
-    CodeBlock code;
-public:
-    DefSpec(Syntax::DefExpr const& syntax)
-        : name(syntax.name), signature(syntax.args), code(syntax.code)
+    if (argc > 1 && std::string(argv[1]) == "--daemon")
     {
+        ModuleCache cache;
+        module_cache = &cache;
+        std::string socket_path = argc > 2 ? argv[2] : Daemon::default_socket_path();
+        return Daemon::serve(socket_path, &command_main) ? 0 : 1;
     }
 
-    void dump(std::ostream& s)
-    {
-        s << "DefSpec ";
-
-        if (name)
-            name->dump(s);
-        else
-            s << "_";
-
-        s << " ";
-
-        if (signature)
-            signature->dump(s);
-        else
-            s << "_";
-
-        s << " ";
-
-        code.dump(s);
-
-        s << std::endl;
-    }
-};
-
-}
-
-
-int main(int argc, char* argv[])
-{
-    auto result = Parse("def Main(x:Int=0, y:) { if(x) { say(1) } else { say(2) } }");
-    Semantic::DefSpec testProgram(result);
-    testProgram.dump(std::cout);
-    //std::cout << boost::apply_visitor(SyntaxPrinter(), result) << std::endl;
-    std::cout << "Press enter..." << std::endl;
-    std::cin.ignore( 99, '\n' );
-    return 0;
+    return command_main(argc, argv);
 }
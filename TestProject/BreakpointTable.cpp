@@ -0,0 +1,122 @@
+#include <cstdlib>
+#include <new>
+
+#include "BreakpointTable.hpp"
+
+BreakpointTable::BreakpointTable()
+    : active_count(0), next_number(1)
+{
+    for (auto& f : files)
+        f.store(nullptr, std::memory_order_relaxed);
+}
+
+BreakpointTable::~BreakpointTable()
+{
+    for (auto& f : files)
+        std::free(f.load(std::memory_order_relaxed));
+    for (auto bits : retired)
+        std::free(bits);
+}
+
+BreakpointTable::LineBits* BreakpointTable::allocate(std::size_t word_count)
+{
+    std::size_t size = sizeof(LineBits) + (word_count - 1) * sizeof(std::atomic<std::uint64_t>);
+    LineBits* bits = static_cast<LineBits*>(std::malloc(size));
+    if (!bits)
+        throw std::bad_alloc();
+
+    bits->word_count = word_count;
+    for (std::size_t i = 0; i < word_count; ++i)
+        new (&bits->words[i]) std::atomic<std::uint64_t>(0);
+    return bits;
+}
+
+int BreakpointTable::intern_file(char const* file_name)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto pos = file_ids.find(file_name);
+    if (pos != file_ids.end())
+        return pos->second;
+
+    if (file_names.size() >= std::size_t(max_files))
+        return -1;
+
+    int id = file_names.size();
+    file_names.push_back(file_name);
+    file_ids.emplace(file_name, id);
+    return id;
+}
+
+std::string BreakpointTable::file_name(int file_id)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return unsigned(file_id) < file_names.size() ? file_names[file_id] : std::string();
+}
+
+// Must be called with the lock held.
+BreakpointTable::LineBits* BreakpointTable::bits_for_line(int file_id, int line)
+{
+    LineBits* bits = files[file_id].load(std::memory_order_relaxed);
+    std::size_t needed = (unsigned(line) >> 6) + 1;
+
+    if (bits && needed <= bits->word_count)
+        return bits;
+
+    // Grow to the next power of two so a file that gets breakpoints further
+    // and further down is only copied a logarithmic number of times.
+    std::size_t count = 1;
+    while (count < needed)
+        count *= 2;
+
+    LineBits* grown = allocate(count);
+    if (bits)
+    {
+        for (std::size_t i = 0; i < bits->word_count; ++i)
+            grown->words[i].store(bits->words[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        retired.push_back(bits);
+    }
+
+    files[file_id].store(grown, std::memory_order_release);
+    return grown;
+}
+
+int BreakpointTable::add(int file_id, int line)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (unsigned(file_id) >= file_names.size() || line < 0)
+        return -1;
+
+    LineBits* bits = bits_for_line(file_id, line);
+    bits->words[line >> 6].fetch_or(std::uint64_t(1) << (line & 63), std::memory_order_release);
+
+    int number = next_number++;
+    by_number[number] = std::make_pair(file_id, line);
+    ++per_line[std::make_pair(file_id, line)];
+    active_count.fetch_add(1, std::memory_order_release);
+    return number;
+}
+
+bool BreakpointTable::remove(int breakpoint_number)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto pos = by_number.find(breakpoint_number);
+    if (pos == by_number.end())
+        return false;
+
+    std::pair<int, int> where = pos->second;
+    by_number.erase(pos);
+
+    // Another breakpoint may still be set on the same line.
+    if (--per_line[where] == 0)
+    {
+        per_line.erase(where);
+        LineBits* bits = files[where.first].load(std::memory_order_relaxed);
+        bits->words[where.second >> 6].fetch_and(~(std::uint64_t(1) << (where.second & 63)), std::memory_order_release);
+    }
+
+    active_count.fetch_sub(1, std::memory_order_release);
+    return true;
+}
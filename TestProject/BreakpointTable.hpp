@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Breakpoints indexed by interned file id and line number.
+//
+// The question asked on every executed line, "is there a breakpoint here?",
+// is answered by has_breakpoint without taking a lock: one load of the
+// global count (zero in the common case), one load of the file's line
+// bitset and one bit test.  Adding and removing breakpoints takes a mutex
+// and may happen on any thread while the program runs.  A bitset that has
+// to grow is replaced and the old one kept until the table is destroyed,
+// so a reader that loaded the old pointer never sees freed memory.
+class BreakpointTable
+{
+public:
+    static int const max_files = 4096;
+
+private:
+    struct LineBits
+    {
+        std::size_t word_count;
+        std::atomic<std::uint64_t> words[1];    // word_count words follow
+    };
+
+    std::atomic<int> active_count;
+    std::atomic<LineBits*> files[max_files];
+
+    std::mutex lock;
+    std::unordered_map<std::string, int> file_ids;
+    std::vector<std::string> file_names;
+    std::map<int, std::pair<int, int>> by_number;       // number -> (file, line)
+    std::map<std::pair<int, int>, int> per_line;        // (file, line) -> count
+    std::vector<LineBits*> retired;
+    int next_number;
+
+    static LineBits* allocate(std::size_t word_count);
+    LineBits* bits_for_line(int file_id, int line);
+
+public:
+    BreakpointTable();
+    ~BreakpointTable();
+
+    BreakpointTable(BreakpointTable const&) = delete;
+    BreakpointTable& operator=(BreakpointTable const&) = delete;
+
+    // Returns the same id for the same name every time, or -1 when the
+    // table is full.  Call once per file (e.g. when it is loaded) and keep
+    // the id for the per-line checks.
+    int intern_file(char const* file_name);
+    std::string file_name(int file_id);
+
+    // Returns the breakpoint's number, or -1 for a bad file id or line.
+    int add(int file_id, int line);
+
+    // Returns false if no breakpoint has that number.
+    bool remove(int breakpoint_number);
+
+    bool has_breakpoint(int file_id, int line) const
+    {
+        if (active_count.load(std::memory_order_relaxed) == 0)
+            return false;
+
+        if (unsigned(file_id) >= unsigned(max_files))
+            return false;
+
+        LineBits const* bits = files[file_id].load(std::memory_order_acquire);
+        std::size_t word = unsigned(line) >> 6;
+        return bits && word < bits->word_count
+            && (bits->words[word].load(std::memory_order_relaxed) >> (line & 63)) & 1;
+    }
+};
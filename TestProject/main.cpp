@@ -2,13 +2,14 @@
 #include <vector>
 using namespace std;
 
-struct Breakpoint
-{
-    std::string file_name;
-    int line_number;
-};
+#include "BreakpointTable.hpp"
+
+// Io's own definitions (IoObject.h, IoMessage.h); this test program does
+// not link against the Io VM, so only the pointer types are needed.
+typedef struct CollectorMarker IoObject;
+typedef IoObject IoMessage;
 
-std::vector<Breakpoint> breakpoints;
+BreakpointTable breakpoints;
 
 extern "C"
 {
@@ -21,13 +22,29 @@ void io_debugger_break_here(IoObject *self, IoObject *locals, IoMessage *m, int
     asm ("nop;");
 }
 
+#pragma GCC pop_options
+
+// Call once per source file and pass the id to io_debugger_has_breakpoint.
+int io_debugger_file_id(char const* file_name)
+{
+    return breakpoints.intern_file(file_name);
+}
+
 int io_debugger_set_breakpoint(char const* file_name, int line_number)
 {
-    breakpoints.push_back({file_name, line_number});
-    return breakpoints.size();
+    return breakpoints.add(breakpoints.intern_file(file_name), line_number);
 }
 
-#pragma GCC pop_options
+int io_debugger_clear_breakpoint(int breakpoint_number)
+{
+    return breakpoints.remove(breakpoint_number);
+}
+
+// The per-line check: lock-free, and a single load when no breakpoints are set.
+int io_debugger_has_breakpoint(int file_id, int line_number)
+{
+    return breakpoints.has_breakpoint(file_id, line_number);
+}
 }
 
 
@@ -35,11 +52,16 @@ int main()
 {
     cout << "Hello world!" << endl;
 
-    // Simulate hitting a breakpoint.
-    //if (!breakpoints.empty())
-    //    io_debugger_break_here(1, breakpoints.at(0).file_name.c_str(), breakpoints.at(0).line_number);
-
-    io_debugger_break_here(1, "/Users/dennisferron/code/LikeMagic-All/Iocaste/Debugger/TestProject/test.io", 5);
+    char const* file_name = "/Users/dennisferron/code/LikeMagic-All/Iocaste/Debugger/TestProject/test.io";
+    int file_id = io_debugger_file_id(file_name);
+    int number = io_debugger_set_breakpoint(file_name, 5);
+
+    // Simulate running test.io and hitting the breakpoint.
+    for (int line = 1; line <= 6; ++line)
+        if (io_debugger_has_breakpoint(file_id, line))
+            io_debugger_break_here(0, 0, 0, number, file_name, line);
+
+    io_debugger_clear_breakpoint(number);
 
     cout << "Goodbye, cruel world!" << endl;
     return 0;
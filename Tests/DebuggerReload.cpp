@@ -0,0 +1,36 @@
+#include <cstdint>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include "Knife/Debugger.hpp"
+
+// A module with no probe sites still takes its flags' address: when it is
+// freed without being unregistered and another module's flags are put
+// there, the new module replaces it, and breakpoints in the old module's
+// file do not reach the new one's flags.
+int main()
+{
+    std::uint8_t flags[1] = { 0 };
+
+    Debugger::register_module("empty.kn", flags, std::vector<Semantic::ProbeSite>());
+    Debugger::register_module("reloaded.kn", flags, std::vector<Semantic::ProbeSite>{ Semantic::ProbeSite{ 0, 1 } });
+
+    int stale = Debugger::set_breakpoint("empty.kn", 1);
+    if (flags[0] != 0)
+    {
+        std::cerr << "a breakpoint in a freed module's file armed the module loaded in its place" << std::endl;
+        return 1;
+    }
+    Debugger::clear_breakpoint(stale);
+
+    int current = Debugger::set_breakpoint("reloaded.kn", 1);
+    if (flags[0] != 1)
+    {
+        std::cerr << "a breakpoint did not arm the module loaded in a freed module's place" << std::endl;
+        return 1;
+    }
+    Debugger::clear_breakpoint(current);
+    Debugger::unregister_module(flags);
+    return 0;
+}